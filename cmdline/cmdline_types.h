@@ -436,6 +436,10 @@ struct XGcOption {
   // Do no measurements for kUseTableLookupReadBarrier to avoid test timeouts. b/31679493
   bool measure_ = kIsDebugBuild && !kUseTableLookupReadBarrier;
   bool gcstress_ = false;
+  // Collect the young generation separately with the concurrent copying collector.
+  bool generational_cc_ = false;
+  // Process the concurrent copying mark stack with the GC worker threads.
+  bool parallel_cc_marking_ = false;
 };
 
 template <>
@@ -479,6 +483,14 @@ struct CmdlineType<XGcOption> : CmdlineTypeParser<XGcOption> {
         xgc.gcstress_ = false;
       } else if (gc_option == "measure") {
         xgc.measure_ = true;
+      } else if (gc_option == "generational_cc") {
+        xgc.generational_cc_ = true;
+      } else if (gc_option == "nogenerational_cc") {
+        xgc.generational_cc_ = false;
+      } else if (gc_option == "parallel_cc_marking") {
+        xgc.parallel_cc_marking_ = true;
+      } else if (gc_option == "noparallel_cc_marking") {
+        xgc.parallel_cc_marking_ = false;
       } else if ((gc_option == "precise") ||
                  (gc_option == "noprecise") ||
                  (gc_option == "verifycardtable") ||
@@ -16,12 +16,15 @@
 
 #include <algorithm>
 #include <ostream>
+#include <vector>
 
 #include "compiled_method_storage.h"
 
 #include <android-base/logging.h>
 
+#include "base/bit_utils.h"
 #include "base/data_hash.h"
+#include "base/globals.h"
 #include "base/utils.h"
 #include "compiled_method.h"
 #include "linker/linker_patch.h"
@@ -85,23 +88,83 @@ class CompiledMethodStorage::DedupeHashFunc {
   }
 };
 
+// Allocator for the arrays stored in a dedupe set. Deduplicated arrays live as long as the
+// set, so instead of going to the swap space for every array, each shard of the set (which gets
+// its own copy of the allocator and serializes Copy() with its lock) carves them out of larger
+// blocks and returns the blocks in bulk when the set is destroyed.
 template <typename T>
 class CompiledMethodStorage::LengthPrefixedArrayAlloc {
  public:
   explicit LengthPrefixedArrayAlloc(SwapSpace* swap_space)
-      : swap_space_(swap_space) {
+      : swap_space_(swap_space),
+        blocks_(SwapAllocator<Block>(swap_space)),
+        current_(nullptr),
+        current_end_(nullptr) {
+  }
+
+  // Only the unused prototype passed to the dedupe set may be copied.
+  LengthPrefixedArrayAlloc(const LengthPrefixedArrayAlloc& other)
+      : LengthPrefixedArrayAlloc(other.swap_space_) {
+    DCHECK(other.blocks_.empty());
+  }
+
+  ~LengthPrefixedArrayAlloc() {
+    SwapAllocator<uint8_t> allocator(swap_space_);
+    for (const Block& block : blocks_) {
+      allocator.deallocate(block.first, block.second);
+    }
   }
 
   const LengthPrefixedArray<T>* Copy(const ArrayRef<const T>& array) {
-    return CopyArray(swap_space_, array);
+    DCHECK(!array.empty());
+    void* storage = Allocate(LengthPrefixedArray<T>::ComputeSize(array.size()));
+    LengthPrefixedArray<T>* array_copy = new(storage) LengthPrefixedArray<T>(array.size());
+    std::copy(array.begin(), array.end(), array_copy->begin());
+    return array_copy;
   }
 
   void Destroy(const LengthPrefixedArray<T>* array) {
-    ReleaseArray(swap_space_, array);
+    // The memory is released with the blocks.
+    array->~LengthPrefixedArray<T>();
   }
 
  private:
+  static constexpr size_t kBlockSize = 8 * KB;
+  // Arrays bigger than this get a block of their own, so that they do not waste the remainder
+  // of the current block.
+  static constexpr size_t kMaxArraySizeInBlock = kBlockSize / 4u;
+  static constexpr size_t kAlignment = alignof(LengthPrefixedArray<T>);
+  static_assert(IsPowerOfTwo(kAlignment), "Alignment must be a power of two");
+  static_assert(kAlignment <= 8u, "SwapSpace only guarantees 8-byte alignment");
+
+  using Block = std::pair<uint8_t*, size_t>;
+
+  void* Allocate(size_t size) {
+    size = RoundUp(size, kAlignment);
+    if (size > kMaxArraySizeInBlock) {
+      return AllocateBlock(size);
+    }
+    if (static_cast<size_t>(current_end_ - current_) < size) {
+      current_ = AllocateBlock(kBlockSize);
+      current_end_ = current_ + kBlockSize;
+    }
+    uint8_t* result = current_;
+    current_ += size;
+    return result;
+  }
+
+  uint8_t* AllocateBlock(size_t size) {
+    uint8_t* block = SwapAllocator<uint8_t>(swap_space_).allocate(size);
+    blocks_.push_back(Block(block, size));
+    return block;
+  }
+
   SwapSpace* const swap_space_;
+  std::vector<Block, SwapAllocator<Block>> blocks_;
+  uint8_t* current_;
+  uint8_t* current_end_;
+
+  LengthPrefixedArrayAlloc& operator=(const LengthPrefixedArrayAlloc&) = delete;
 };
 
 class CompiledMethodStorage::ThunkMapKey {
@@ -153,7 +216,7 @@ CompiledMethodStorage::CompiledMethodStorage(int swap_fd)
       dedupe_vmap_table_("dedupe vmap table",
                          LengthPrefixedArrayAlloc<uint8_t>(swap_space_.get())),
       dedupe_cfi_info_("dedupe cfi info", LengthPrefixedArrayAlloc<uint8_t>(swap_space_.get())),
-      dedupe_linker_patches_("dedupe cfi info",
+      dedupe_linker_patches_("dedupe linker patches",
                              LengthPrefixedArrayAlloc<linker::LinkerPatch>(swap_space_.get())),
       thunk_map_lock_("thunk_map_lock"),
       thunk_map_(std::less<ThunkMapKey>(), SwapAllocator<ThunkMapValueType>(swap_space_.get())) {
@@ -169,13 +232,19 @@ void CompiledMethodStorage::DumpMemoryUsage(std::ostream& os, bool extended) con
     os << " swap=" << PrettySize(swap_size) << " (" << swap_size << "B)";
   }
   if (extended) {
-    Thread* self = Thread::Current();
-    os << "\nCode dedupe: " << dedupe_code_.DumpStats(self);
-    os << "\nVmap table dedupe: " << dedupe_vmap_table_.DumpStats(self);
-    os << "\nCFI info dedupe: " << dedupe_cfi_info_.DumpStats(self);
+    DumpDedupeStats(os);
   }
 }
 
+void CompiledMethodStorage::DumpDedupeStats(std::ostream& os) const {
+  Thread* self = Thread::Current();
+  os << "\nCode dedupe: " << dedupe_code_.DumpStats(self);
+  os << "\nMethod info dedupe: " << dedupe_method_info_.DumpStats(self);
+  os << "\nVmap table dedupe: " << dedupe_vmap_table_.DumpStats(self);
+  os << "\nCFI info dedupe: " << dedupe_cfi_info_.DumpStats(self);
+  os << "\nLinker patches dedupe: " << dedupe_linker_patches_.DumpStats(self);
+}
+
 const LengthPrefixedArray<uint8_t>* CompiledMethodStorage::DeduplicateCode(
     const ArrayRef<const uint8_t>& code) {
   return AllocateOrDeduplicateArray(code, &dedupe_code_);
@@ -40,6 +40,9 @@ class CompiledMethodStorage {
 
   void DumpMemoryUsage(std::ostream& os, bool extended) const;
 
+  // Dumps the collision and hit statistics of the dedupe sets.
+  void DumpDedupeStats(std::ostream& os) const;
+
   void SetDedupeEnabled(bool dedupe_enabled) {
     dedupe_enabled_ = dedupe_enabled;
   }
@@ -105,13 +108,17 @@ class CompiledMethodStorage {
   template <typename T>
   class LengthPrefixedArrayAlloc;
 
+  // All compiler threads store their results here, so use enough shards to keep lock contention
+  // low even with many threads.
+  static constexpr size_t kDedupeShards = 64u;
+
   template <typename T>
   using ArrayDedupeSet = DedupeSet<ArrayRef<const T>,
                                    LengthPrefixedArray<T>,
                                    LengthPrefixedArrayAlloc<T>,
                                    size_t,
                                    DedupeHashFunc<const T>,
-                                   4>;
+                                   kDedupeShards>;
 
   // Swap pool and allocator used for native allocations. May be file-backed. Needs to be first
   // as other fields rely on this.
@@ -92,6 +92,11 @@ static constexpr bool kTimeCompileMethod = !kIsDebugBuild;
 // Print additional info during profile guided compilation.
 static constexpr bool kDebugProfileGuidedCompilation = false;
 
+// Whether to run the per-class work of a phase for all dex files as a single batch, rather than
+// waiting for all the workers at the end of each dex file. Small secondary dex files of multidex
+// apps would otherwise leave most threads idle.
+static constexpr bool kBatchDexFiles = true;
+
 // Max encoded fields allowed for initializing app image. Hardcode the number for now
 // because 5000 should be large enough.
 static constexpr uint32_t kMaxEncodedFields = 5000;
@@ -361,6 +366,11 @@ void CompilerDriver::CompileAll(jobject class_loader,
   }
   if (GetCompilerOptions().GetDumpStats()) {
     stats_->Dump();
+    if (compiled_method_storage_.DedupeEnabled()) {
+      std::ostringstream oss;
+      compiled_method_storage_.DumpDedupeStats(oss);
+      LOG(INFO) << "Dedupe stats:" << oss.str();
+    }
   }
 
   FreeThreadPools();
@@ -723,6 +733,14 @@ void CompilerDriver::Resolve(jobject class_loader,
                                      : parallel_thread_pool_.get();
   size_t resolve_thread_count = force_determinism ? 1U : parallel_thread_count_;
 
+  if (kBatchDexFiles) {
+    ResolveDexFiles(class_loader,
+                    dex_files,
+                    resolve_thread_pool,
+                    resolve_thread_count,
+                    timings);
+    return;
+  }
   for (size_t i = 0; i != dex_files.size(); ++i) {
     const DexFile* dex_file = dex_files[i];
     CHECK(dex_file != nullptr);
@@ -1616,6 +1634,32 @@ class ParallelCompilationManager {
     thread_pool_->StopWorkers(self);
   }
 
+  // Run `fn(dex_file, class_def_index)` for the class defs of all `dex_files` as one batch of
+  // work units.
+  template <typename Fn>
+  void ForAllClassDefsLambda(const std::vector<const DexFile*>& dex_files,
+                             Fn fn,
+                             size_t work_units)
+      REQUIRES(!*Locks::mutator_lock_) {
+    // Index in the batch of the first class def of each dex file.
+    std::vector<size_t> starts;
+    starts.reserve(dex_files.size());
+    size_t total = 0u;
+    for (const DexFile* dex_file : dex_files) {
+      CHECK(dex_file != nullptr);
+      starts.push_back(total);
+      total += dex_file->NumClassDefs();
+    }
+    auto visit = [&dex_files, &starts, &fn](size_t index) {
+      // Empty dex files share their start with the next one, take the last dex file starting at
+      // or before `index`.
+      size_t dex_file_index =
+          std::upper_bound(starts.begin(), starts.end(), index) - starts.begin() - 1u;
+      fn(*dex_files[dex_file_index], index - starts[dex_file_index]);
+    };
+    ForAllLambda(0, total, visit, work_units);
+  }
+
   size_t NextIndex() {
     return index_.fetch_add(1, std::memory_order_seq_cst);
   }
@@ -1661,6 +1705,35 @@ class ParallelCompilationManager {
   DISALLOW_COPY_AND_ASSIGN(ParallelCompilationManager);
 };
 
+// Visitor of class defs that can be used both for the dex file of a ParallelCompilationManager
+// and for a batch of dex files, see ForAllClassDefs.
+class ClassDefVisitor : public CompilationVisitor {
+ public:
+  void Visit(size_t class_def_index) OVERRIDE {
+    VisitClassDef(*manager_->GetDexFile(), class_def_index);
+  }
+
+  virtual void VisitClassDef(const DexFile& dex_file, size_t class_def_index) = 0;
+
+ protected:
+  explicit ClassDefVisitor(const ParallelCompilationManager* manager) : manager_(manager) {}
+
+  const ParallelCompilationManager* const manager_;
+};
+
+static void ForAllClassDefs(ParallelCompilationManager* manager,
+                            const std::vector<const DexFile*>& dex_files,
+                            ClassDefVisitor* visitor,
+                            size_t work_units)
+    REQUIRES(!Locks::mutator_lock_) {
+  manager->ForAllClassDefsLambda(
+      dex_files,
+      [visitor](const DexFile& dex_file, size_t class_def_index) {
+        visitor->VisitClassDef(dex_file, class_def_index);
+      },
+      work_units);
+}
+
 // A fast version of SkipClass above if the class pointer is available
 // that avoids the expensive FindInClassPath search.
 static bool SkipClass(jobject class_loader, const DexFile& dex_file, ObjPtr<mirror::Class> klass)
@@ -1725,16 +1798,16 @@ bool CompilerDriver::RequiresConstructorBarrier(const DexFile& dex_file,
   return false;
 }
 
-class ResolveClassFieldsAndMethodsVisitor : public CompilationVisitor {
+class ResolveClassFieldsAndMethodsVisitor : public ClassDefVisitor {
  public:
   explicit ResolveClassFieldsAndMethodsVisitor(const ParallelCompilationManager* manager)
-      : manager_(manager) {}
+      : ClassDefVisitor(manager) {}
 
-  void Visit(size_t class_def_index) OVERRIDE REQUIRES(!Locks::mutator_lock_) {
+  void VisitClassDef(const DexFile& dex_file, size_t class_def_index)
+      OVERRIDE REQUIRES(!Locks::mutator_lock_) {
     ScopedTrace trace(__FUNCTION__);
     Thread* const self = Thread::Current();
     jobject jclass_loader = manager_->GetClassLoader();
-    const DexFile& dex_file = *manager_->GetDexFile();
     ClassLinker* class_linker = manager_->GetClassLinker();
 
     // If an instance field is final then we need to have a barrier on the return, static final
@@ -1828,9 +1901,6 @@ class ResolveClassFieldsAndMethodsVisitor : public CompilationVisitor {
                                                            class_def_index,
                                                            requires_constructor_barrier);
   }
-
- private:
-  const ParallelCompilationManager* const manager_;
 };
 
 class ResolveTypeVisitor : public CompilationVisitor {
@@ -1894,10 +1964,42 @@ void CompilerDriver::ResolveDexFile(jobject class_loader,
   context.ForAll(0, dex_file.NumClassDefs(), &visitor, thread_count);
 }
 
+void CompilerDriver::ResolveDexFiles(jobject class_loader,
+                                     const std::vector<const DexFile*>& dex_files,
+                                     ThreadPool* thread_pool,
+                                     size_t thread_count,
+                                     TimingLogger* timings) {
+  ClassLinker* class_linker = Runtime::Current()->GetClassLinker();
+  if (GetCompilerOptions().IsBootImage()) {
+    // The type visitor works on the type ids of one dex file, but only boot images need it.
+    TimingLogger::ScopedTiming t("Resolve Types", timings);
+    for (const DexFile* dex_file : dex_files) {
+      ParallelCompilationManager context(class_linker, class_loader, this, dex_file, dex_files,
+                                         thread_pool);
+      ResolveTypeVisitor visitor(&context);
+      context.ForAll(0, dex_file->NumTypeIds(), &visitor, thread_count);
+    }
+  }
+
+  TimingLogger::ScopedTiming t("Resolve MethodsAndFields", timings);
+  ParallelCompilationManager context(class_linker, class_loader, this, /* dex_file */ nullptr,
+                                     dex_files, thread_pool);
+  ResolveClassFieldsAndMethodsVisitor visitor(&context);
+  ForAllClassDefs(&context, dex_files, &visitor, thread_count);
+}
+
 void CompilerDriver::SetVerified(jobject class_loader,
                                  const std::vector<const DexFile*>& dex_files,
                                  TimingLogger* timings) {
   // This can be run in parallel.
+  if (kBatchDexFiles) {
+    SetVerifiedDexFiles(class_loader,
+                        dex_files,
+                        parallel_thread_pool_.get(),
+                        parallel_thread_count_,
+                        timings);
+    return;
+  }
   for (const DexFile* dex_file : dex_files) {
     CHECK(dex_file != nullptr);
     SetVerifiedDexFile(class_loader,
@@ -1966,7 +2068,9 @@ bool CompilerDriver::FastVerify(jobject jclass_loader,
   StackHandleScope<2> hs(soa.Self());
   Handle<mirror::ClassLoader> class_loader(
       hs.NewHandle(soa.Decode<mirror::ClassLoader>(jclass_loader)));
-  if (!verifier_deps->ValidateDependencies(class_loader, soa.Self())) {
+  if (!verifier_deps->ValidateDependencies(class_loader,
+                                           soa.Self(),
+                                           parallel_thread_pool_.get())) {
     return false;
   }
 
@@ -1979,7 +2083,7 @@ bool CompilerDriver::FastVerify(jobject jclass_loader,
   // runtime.
   for (const DexFile* dex_file : dex_files) {
     // Fetch the list of unverified classes.
-    const std::set<dex::TypeIndex>& unverified_classes =
+    const verifier::SortedVector<dex::TypeIndex>& unverified_classes =
         verifier_deps->GetUnverifiedClasses(*dex_file);
     for (uint32_t i = 0; i < dex_file->NumClassDefs(); ++i) {
       const DexFile::ClassDef& class_def = dex_file->GetClassDef(i);
@@ -2051,14 +2155,23 @@ void CompilerDriver::Verify(jobject jclass_loader,
   ThreadPool* verify_thread_pool =
       force_determinism ? single_thread_pool_.get() : parallel_thread_pool_.get();
   size_t verify_thread_count = force_determinism ? 1U : parallel_thread_count_;
-  for (const DexFile* dex_file : dex_files) {
-    CHECK(dex_file != nullptr);
-    VerifyDexFile(jclass_loader,
-                  *dex_file,
-                  dex_files,
-                  verify_thread_pool,
-                  verify_thread_count,
-                  timings);
+  if (kBatchDexFiles) {
+    // With a single thread, the class defs are still visited in dex file order.
+    VerifyDexFiles(jclass_loader,
+                   dex_files,
+                   verify_thread_pool,
+                   verify_thread_count,
+                   timings);
+  } else {
+    for (const DexFile* dex_file : dex_files) {
+      CHECK(dex_file != nullptr);
+      VerifyDexFile(jclass_loader,
+                    *dex_file,
+                    dex_files,
+                    verify_thread_pool,
+                    verify_thread_count,
+                    timings);
+    }
   }
 
   if (!GetCompilerOptions().IsBootImage()) {
@@ -2070,19 +2183,20 @@ void CompilerDriver::Verify(jobject jclass_loader,
       verifier_deps->MergeWith(*thread_deps, GetCompilerOptions().GetDexFilesForOatFile());
       delete thread_deps;
     }
+    verifier_deps->SortDependencies();
     Thread::Current()->SetVerifierDeps(nullptr);
   }
 }
 
-class VerifyClassVisitor : public CompilationVisitor {
+class VerifyClassVisitor : public ClassDefVisitor {
  public:
   VerifyClassVisitor(const ParallelCompilationManager* manager, verifier::HardFailLogMode log_level)
-     : manager_(manager), log_level_(log_level) {}
+     : ClassDefVisitor(manager), log_level_(log_level) {}
 
-  virtual void Visit(size_t class_def_index) REQUIRES(!Locks::mutator_lock_) OVERRIDE {
+  void VisitClassDef(const DexFile& dex_file, size_t class_def_index)
+      REQUIRES(!Locks::mutator_lock_) OVERRIDE {
     ScopedTrace trace(__FUNCTION__);
     ScopedObjectAccess soa(Thread::Current());
-    const DexFile& dex_file = *manager_->GetDexFile();
     const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
     const char* descriptor = dex_file.GetClassDescriptor(class_def);
     ClassLinker* class_linker = manager_->GetClassLinker();
@@ -2148,7 +2262,7 @@ class VerifyClassVisitor : public CompilationVisitor {
           << klass->PrettyDescriptor() << ": state=" << klass->GetStatus();
 
       // Class has a meaningful status for the compiler now, record it.
-      ClassReference ref(manager_->GetDexFile(), class_def_index);
+      ClassReference ref(&dex_file, class_def_index);
       manager_->GetCompiler()->RecordClassStatus(ref, klass->GetStatus());
 
       // It is *very* problematic if there are resolution errors in the boot classpath.
@@ -2184,7 +2298,6 @@ class VerifyClassVisitor : public CompilationVisitor {
   }
 
  private:
-  const ParallelCompilationManager* const manager_;
   const verifier::HardFailLogMode log_level_;
 };
 
@@ -2207,14 +2320,33 @@ void CompilerDriver::VerifyDexFile(jobject class_loader,
   context.ForAll(0, dex_file.NumClassDefs(), &visitor, thread_count);
 }
 
-class SetVerifiedClassVisitor : public CompilationVisitor {
+void CompilerDriver::VerifyDexFiles(jobject class_loader,
+                                    const std::vector<const DexFile*>& dex_files,
+                                    ThreadPool* thread_pool,
+                                    size_t thread_count,
+                                    TimingLogger* timings) {
+  TimingLogger::ScopedTiming t("Verify Dex Files", timings);
+  ClassLinker* class_linker = Runtime::Current()->GetClassLinker();
+  ParallelCompilationManager context(class_linker, class_loader, this, /* dex_file */ nullptr,
+                                     dex_files, thread_pool);
+  bool abort_on_verifier_failures = GetCompilerOptions().AbortOnHardVerifierFailure()
+                                    || GetCompilerOptions().AbortOnSoftVerifierFailure();
+  verifier::HardFailLogMode log_level = abort_on_verifier_failures
+                              ? verifier::HardFailLogMode::kLogInternalFatal
+                              : verifier::HardFailLogMode::kLogWarning;
+  VerifyClassVisitor visitor(&context, log_level);
+  ForAllClassDefs(&context, dex_files, &visitor, thread_count);
+}
+
+class SetVerifiedClassVisitor : public ClassDefVisitor {
  public:
-  explicit SetVerifiedClassVisitor(const ParallelCompilationManager* manager) : manager_(manager) {}
+  explicit SetVerifiedClassVisitor(const ParallelCompilationManager* manager)
+      : ClassDefVisitor(manager) {}
 
-  virtual void Visit(size_t class_def_index) REQUIRES(!Locks::mutator_lock_) OVERRIDE {
+  void VisitClassDef(const DexFile& dex_file, size_t class_def_index)
+      REQUIRES(!Locks::mutator_lock_) OVERRIDE {
     ScopedTrace trace(__FUNCTION__);
     ScopedObjectAccess soa(Thread::Current());
-    const DexFile& dex_file = *manager_->GetDexFile();
     const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
     const char* descriptor = dex_file.GetClassDescriptor(class_def);
     ClassLinker* class_linker = manager_->GetClassLinker();
@@ -2241,7 +2373,7 @@ class SetVerifiedClassVisitor : public CompilationVisitor {
           klass->SetVerificationAttempted();
         }
         // Record the final class status if necessary.
-        ClassReference ref(manager_->GetDexFile(), class_def_index);
+        ClassReference ref(&dex_file, class_def_index);
         manager_->GetCompiler()->RecordClassStatus(ref, klass->GetStatus());
       }
     } else {
@@ -2250,9 +2382,6 @@ class SetVerifiedClassVisitor : public CompilationVisitor {
       self->ClearException();
     }
   }
-
- private:
-  const ParallelCompilationManager* const manager_;
 };
 
 void CompilerDriver::SetVerifiedDexFile(jobject class_loader,
@@ -2272,6 +2401,24 @@ void CompilerDriver::SetVerifiedDexFile(jobject class_loader,
   context.ForAll(0, dex_file.NumClassDefs(), &visitor, thread_count);
 }
 
+void CompilerDriver::SetVerifiedDexFiles(jobject class_loader,
+                                         const std::vector<const DexFile*>& dex_files,
+                                         ThreadPool* thread_pool,
+                                         size_t thread_count,
+                                         TimingLogger* timings) {
+  TimingLogger::ScopedTiming t("Verify Dex Files", timings);
+  for (const DexFile* dex_file : dex_files) {
+    if (!compiled_classes_.HaveDexFile(dex_file)) {
+      compiled_classes_.AddDexFile(dex_file);
+    }
+  }
+  ClassLinker* class_linker = Runtime::Current()->GetClassLinker();
+  ParallelCompilationManager context(class_linker, class_loader, this, /* dex_file */ nullptr,
+                                     dex_files, thread_pool);
+  SetVerifiedClassVisitor visitor(&context);
+  ForAllClassDefs(&context, dex_files, &visitor, thread_count);
+}
+
 class InitializeClassVisitor : public CompilationVisitor {
  public:
   explicit InitializeClassVisitor(const ParallelCompilationManager* manager) : manager_(manager) {}
@@ -2732,6 +2879,92 @@ void CompilerDriver::InitializeClasses(jobject class_loader,
   }
 }
 
+// Compile the methods of the class def `class_def_index` of `dex_file`.
+template <typename CompileFn>
+static void CompileClass(ParallelCompilationManager* manager,
+                         const DexFile& dex_file,
+                         size_t class_def_index,
+                         CompileFn compile_fn) {
+  ScopedTrace trace(__FUNCTION__);
+  const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
+  ClassLinker* class_linker = manager->GetClassLinker();
+  jobject jclass_loader = manager->GetClassLoader();
+  ClassReference ref(&dex_file, class_def_index);
+  // Skip compiling classes with generic verifier failures since they will still fail at runtime
+  if (manager->GetCompiler()->GetVerificationResults()->IsClassRejected(ref)) {
+    return;
+  }
+  // Use a scoped object access to perform to the quick SkipClass check.
+  const char* descriptor = dex_file.GetClassDescriptor(class_def);
+  ScopedObjectAccess soa(Thread::Current());
+  StackHandleScope<3> hs(soa.Self());
+  Handle<mirror::ClassLoader> class_loader(
+      hs.NewHandle(soa.Decode<mirror::ClassLoader>(jclass_loader)));
+  Handle<mirror::Class> klass(
+      hs.NewHandle(class_linker->FindClass(soa.Self(), descriptor, class_loader)));
+  Handle<mirror::DexCache> dex_cache;
+  if (klass == nullptr) {
+    soa.Self()->AssertPendingException();
+    soa.Self()->ClearException();
+    dex_cache = hs.NewHandle(class_linker->FindDexCache(soa.Self(), dex_file));
+  } else if (SkipClass(jclass_loader, dex_file, klass.Get())) {
+    return;
+  } else if (&klass->GetDexFile() != &dex_file) {
+    // Skip a duplicate class (as the resolved class is from another, earlier dex file).
+    return;  // Do not update state.
+  } else {
+    dex_cache = hs.NewHandle(klass->GetDexCache());
+  }
+
+  const uint8_t* class_data = dex_file.GetClassData(class_def);
+  if (class_data == nullptr) {
+    // empty class, probably a marker interface
+    return;
+  }
+
+  // Go to native so that we don't block GC during compilation.
+  ScopedThreadSuspension sts(soa.Self(), kNative);
+
+  CompilerDriver* const driver = manager->GetCompiler();
+
+  // Can we run DEX-to-DEX compiler on this class ?
+  optimizer::DexToDexCompiler::CompilationLevel dex_to_dex_compilation_level =
+      GetDexToDexCompilationLevel(soa.Self(), *driver, jclass_loader, dex_file, class_def);
+
+  ClassDataItemIterator it(dex_file, class_data);
+  it.SkipAllFields();
+
+  bool compilation_enabled = driver->IsClassToCompile(
+      dex_file.StringByTypeIdx(class_def.class_idx_));
+
+  // Compile direct and virtual methods.
+  int64_t previous_method_idx = -1;
+  while (it.HasNextMethod()) {
+    uint32_t method_idx = it.GetMemberIndex();
+    if (method_idx == previous_method_idx) {
+      // smali can create dex files with two encoded_methods sharing the same method_idx
+      // http://code.google.com/p/smali/issues/detail?id=119
+      it.Next();
+      continue;
+    }
+    previous_method_idx = method_idx;
+    compile_fn(soa.Self(),
+               driver,
+               it.GetMethodCodeItem(),
+               it.GetMethodAccessFlags(),
+               it.GetMethodInvokeType(class_def),
+               class_def_index,
+               method_idx,
+               class_loader,
+               dex_file,
+               dex_to_dex_compilation_level,
+               compilation_enabled,
+               dex_cache);
+    it.Next();
+  }
+  DCHECK(!it.HasNext());
+}
+
 template <typename CompileFn>
 static void CompileDexFile(CompilerDriver* driver,
                            jobject class_loader,
@@ -2749,89 +2982,41 @@ static void CompileDexFile(CompilerDriver* driver,
                                      &dex_file,
                                      dex_files,
                                      thread_pool);
-
-  auto compile = [&context, &compile_fn](size_t class_def_index) {
-    ScopedTrace trace(__FUNCTION__);
-    const DexFile& dex_file = *context.GetDexFile();
-    const DexFile::ClassDef& class_def = dex_file.GetClassDef(class_def_index);
-    ClassLinker* class_linker = context.GetClassLinker();
-    jobject jclass_loader = context.GetClassLoader();
-    ClassReference ref(&dex_file, class_def_index);
-    // Skip compiling classes with generic verifier failures since they will still fail at runtime
-    if (context.GetCompiler()->GetVerificationResults()->IsClassRejected(ref)) {
-      return;
-    }
-    // Use a scoped object access to perform to the quick SkipClass check.
-    const char* descriptor = dex_file.GetClassDescriptor(class_def);
-    ScopedObjectAccess soa(Thread::Current());
-    StackHandleScope<3> hs(soa.Self());
-    Handle<mirror::ClassLoader> class_loader(
-        hs.NewHandle(soa.Decode<mirror::ClassLoader>(jclass_loader)));
-    Handle<mirror::Class> klass(
-        hs.NewHandle(class_linker->FindClass(soa.Self(), descriptor, class_loader)));
-    Handle<mirror::DexCache> dex_cache;
-    if (klass == nullptr) {
-      soa.Self()->AssertPendingException();
-      soa.Self()->ClearException();
-      dex_cache = hs.NewHandle(class_linker->FindDexCache(soa.Self(), dex_file));
-    } else if (SkipClass(jclass_loader, dex_file, klass.Get())) {
-      return;
-    } else if (&klass->GetDexFile() != &dex_file) {
-      // Skip a duplicate class (as the resolved class is from another, earlier dex file).
-      return;  // Do not update state.
-    } else {
-      dex_cache = hs.NewHandle(klass->GetDexCache());
-    }
-
-    const uint8_t* class_data = dex_file.GetClassData(class_def);
-    if (class_data == nullptr) {
-      // empty class, probably a marker interface
-      return;
-    }
-
-    // Go to native so that we don't block GC during compilation.
-    ScopedThreadSuspension sts(soa.Self(), kNative);
-
-    CompilerDriver* const driver = context.GetCompiler();
-
-    // Can we run DEX-to-DEX compiler on this class ?
-    optimizer::DexToDexCompiler::CompilationLevel dex_to_dex_compilation_level =
-        GetDexToDexCompilationLevel(soa.Self(), *driver, jclass_loader, dex_file, class_def);
-
-    ClassDataItemIterator it(dex_file, class_data);
-    it.SkipAllFields();
-
-    bool compilation_enabled = driver->IsClassToCompile(
-        dex_file.StringByTypeIdx(class_def.class_idx_));
-
-    // Compile direct and virtual methods.
-    int64_t previous_method_idx = -1;
-    while (it.HasNextMethod()) {
-      uint32_t method_idx = it.GetMemberIndex();
-      if (method_idx == previous_method_idx) {
-        // smali can create dex files with two encoded_methods sharing the same method_idx
-        // http://code.google.com/p/smali/issues/detail?id=119
-        it.Next();
-        continue;
-      }
-      previous_method_idx = method_idx;
-      compile_fn(soa.Self(),
-                 driver,
-                 it.GetMethodCodeItem(),
-                 it.GetMethodAccessFlags(),
-                 it.GetMethodInvokeType(class_def),
-                 class_def_index,
-                 method_idx,
-                 class_loader,
-                 dex_file,
-                 dex_to_dex_compilation_level,
-                 compilation_enabled,
-                 dex_cache);
-      it.Next();
+  context.ForAllLambda(0,
+                       dex_file.NumClassDefs(),
+                       [&context, &dex_file, &compile_fn](size_t class_def_index) {
+                         CompileClass(&context, dex_file, class_def_index, compile_fn);
+                       },
+                       thread_count);
+}
+
+// Compile the class defs of all the `dex_files` as one batch. `next_dex_file_fn` is called by the
+// thread which starts on the first class def of each dex file but the first one, where the
+// per-dex-file path would run it between two calls to CompileDexFile.
+template <typename CompileFn, typename NextDexFileFn>
+static void CompileDexFiles(CompilerDriver* driver,
+                            jobject class_loader,
+                            const std::vector<const DexFile*>& dex_files,
+                            ThreadPool* thread_pool,
+                            size_t thread_count,
+                            TimingLogger* timings,
+                            const char* timing_name,
+                            CompileFn compile_fn,
+                            NextDexFileFn next_dex_file_fn) {
+  TimingLogger::ScopedTiming t(timing_name, timings);
+  ParallelCompilationManager context(Runtime::Current()->GetClassLinker(),
+                                     class_loader,
+                                     driver,
+                                     /* dex_file */ nullptr,
+                                     dex_files,
+                                     thread_pool);
+  auto compile = [&](const DexFile& dex_file, size_t class_def_index) {
+    if (class_def_index == 0u && &dex_file != dex_files.front()) {
+      next_dex_file_fn();
     }
-    DCHECK(!it.HasNext());
+    CompileClass(&context, dex_file, class_def_index, compile_fn);
   };
-  context.ForAllLambda(0, dex_file.NumClassDefs(), compile, thread_count);
+  context.ForAllClassDefsLambda(dex_files, compile, thread_count);
 }
 
 void CompilerDriver::Compile(jobject class_loader,
@@ -2845,27 +3030,33 @@ void CompilerDriver::Compile(jobject class_loader,
   }
 
   dex_to_dex_compiler_.ClearState();
-  for (const DexFile* dex_file : dex_files) {
-    CHECK(dex_file != nullptr);
-    CompileDexFile(this,
-                   class_loader,
-                   *dex_file,
-                   dex_files,
-                   parallel_thread_pool_.get(),
-                   parallel_thread_count_,
-                   timings,
-                   "Compile Dex File Quick",
-                   CompileMethodQuick);
+  // Free the arenas left over by the compilation of a dex file before the next one. In batch mode,
+  // this runs on a worker thread while the other workers still compile.
+  auto reclaim_arena_pool_memory = [this]() {
     const ArenaPool* const arena_pool = Runtime::Current()->GetArenaPool();
     const size_t arena_alloc = arena_pool->GetBytesAllocated();
-    max_arena_alloc_ = std::max(arena_alloc, max_arena_alloc_);
+    size_t max_arena_alloc = max_arena_alloc_.load(std::memory_order_relaxed);
+    while (arena_alloc > max_arena_alloc &&
+           !max_arena_alloc_.compare_exchange_weak(max_arena_alloc,
+                                                   arena_alloc,
+                                                   std::memory_order_relaxed)) {
+    }
     Runtime::Current()->ReclaimArenaPoolMemory();
-  }
-
-  if (dex_to_dex_compiler_.NumCodeItemsToQuicken(Thread::Current()) > 0u) {
-    // TODO: Not visit all of the dex files, its probably rare that only one would have quickened
-    // methods though.
+  };
+  if (kBatchDexFiles) {
+    CompileDexFiles(this,
+                    class_loader,
+                    dex_files,
+                    parallel_thread_pool_.get(),
+                    parallel_thread_count_,
+                    timings,
+                    "Compile Dex Files Quick",
+                    CompileMethodQuick,
+                    reclaim_arena_pool_memory);
+    reclaim_arena_pool_memory();
+  } else {
     for (const DexFile* dex_file : dex_files) {
+      CHECK(dex_file != nullptr);
       CompileDexFile(this,
                      class_loader,
                      *dex_file,
@@ -2873,8 +3064,37 @@ void CompilerDriver::Compile(jobject class_loader,
                      parallel_thread_pool_.get(),
                      parallel_thread_count_,
                      timings,
-                     "Compile Dex File Dex2Dex",
-                     CompileMethodDex2Dex);
+                     "Compile Dex File Quick",
+                     CompileMethodQuick);
+      reclaim_arena_pool_memory();
+    }
+  }
+
+  if (dex_to_dex_compiler_.NumCodeItemsToQuicken(Thread::Current()) > 0u) {
+    // TODO: Not visit all of the dex files, its probably rare that only one would have quickened
+    // methods though.
+    if (kBatchDexFiles) {
+      CompileDexFiles(this,
+                      class_loader,
+                      dex_files,
+                      parallel_thread_pool_.get(),
+                      parallel_thread_count_,
+                      timings,
+                      "Compile Dex Files Dex2Dex",
+                      CompileMethodDex2Dex,
+                      []() {});
+    } else {
+      for (const DexFile* dex_file : dex_files) {
+        CompileDexFile(this,
+                       class_loader,
+                       *dex_file,
+                       dex_files,
+                       parallel_thread_pool_.get(),
+                       parallel_thread_count_,
+                       timings,
+                       "Compile Dex File Dex2Dex",
+                       CompileMethodDex2Dex);
+      }
     }
     dex_to_dex_compiler_.ClearState();
   }
@@ -3034,7 +3254,8 @@ std::string CompilerDriver::GetMemoryUsageString(bool extended) const {
   std::ostringstream oss;
   const gc::Heap* const heap = Runtime::Current()->GetHeap();
   const size_t java_alloc = heap->GetBytesAllocated();
-  oss << "arena alloc=" << PrettySize(max_arena_alloc_) << " (" << max_arena_alloc_ << "B)";
+  const size_t max_arena_alloc = max_arena_alloc_.load(std::memory_order_relaxed);
+  oss << "arena alloc=" << PrettySize(max_arena_alloc) << " (" << max_arena_alloc << "B)";
   oss << " java alloc=" << PrettySize(java_alloc) << " (" << java_alloc << "B)";
 #if defined(__BIONIC__) || defined(__GLIBC__)
   const struct mallinfo info = mallinfo();
@@ -3049,6 +3270,7 @@ std::string CompilerDriver::GetMemoryUsageString(bool extended) const {
 
 void CompilerDriver::InitializeThreadPools() {
   size_t parallel_count = parallel_thread_count_ > 0 ? parallel_thread_count_ - 1 : 0;
+  // The tasks are all added by the main thread to the shared queue, work stealing would not help.
   parallel_thread_pool_.reset(
       new ThreadPool("Compiler driver thread pool", parallel_count));
   single_thread_pool_.reset(new ThreadPool("Single-threaded Compiler driver thread pool", 0));
@@ -383,6 +383,13 @@ class CompilerDriver {
                       size_t thread_count,
                       TimingLogger* timings)
       REQUIRES(!Locks::mutator_lock_);
+  // Same as ResolveDexFile for all the dex files at once.
+  void ResolveDexFiles(jobject class_loader,
+                       const std::vector<const DexFile*>& dex_files,
+                       ThreadPool* thread_pool,
+                       size_t thread_count,
+                       TimingLogger* timings)
+      REQUIRES(!Locks::mutator_lock_);
 
   // Do fast verification through VerifierDeps if possible. Return whether
   // verification was successful.
@@ -401,6 +408,13 @@ class CompilerDriver {
                      size_t thread_count,
                      TimingLogger* timings)
       REQUIRES(!Locks::mutator_lock_);
+  // Same as VerifyDexFile for all the dex files at once.
+  void VerifyDexFiles(jobject class_loader,
+                      const std::vector<const DexFile*>& dex_files,
+                      ThreadPool* thread_pool,
+                      size_t thread_count,
+                      TimingLogger* timings)
+      REQUIRES(!Locks::mutator_lock_);
 
   void SetVerified(jobject class_loader,
                    const std::vector<const DexFile*>& dex_files,
@@ -412,6 +426,13 @@ class CompilerDriver {
                           size_t thread_count,
                           TimingLogger* timings)
       REQUIRES(!Locks::mutator_lock_);
+  // Same as SetVerifiedDexFile for all the dex files at once.
+  void SetVerifiedDexFiles(jobject class_loader,
+                           const std::vector<const DexFile*>& dex_files,
+                           ThreadPool* thread_pool,
+                           size_t thread_count,
+                           TimingLogger* timings)
+      REQUIRES(!Locks::mutator_lock_);
 
   void InitializeClasses(jobject class_loader,
                          const std::vector<const DexFile*>& dex_files,
@@ -500,7 +521,8 @@ class CompilerDriver {
   // Info for profile guided compilation.
   const ProfileCompilationInfo* const profile_compilation_info_;
 
-  size_t max_arena_alloc_;
+  // Largest size of the free arenas reclaimed between dex files.
+  std::atomic<size_t> max_arena_alloc_;
 
   // Compiler for dex to dex (quickening).
   optimizer::DexToDexCompiler dex_to_dex_compiler_;
@@ -44,6 +44,8 @@ struct DedupeSet<InKey, StoreKey, Alloc, HashType, HashFunc, kShard>::Stats {
   size_t collision_max = 0u;
   size_t total_probe_distance = 0u;
   size_t total_size = 0u;
+  size_t hit_count = 0u;
+  size_t miss_count = 0u;
 };
 
 template <typename InKey,
@@ -58,7 +60,9 @@ class DedupeSet<InKey, StoreKey, Alloc, HashType, HashFunc, kShard>::Shard {
       : alloc_(alloc),
         lock_name_(lock_name),
         lock_(lock_name_.c_str()),
-        keys_() {
+        keys_(),
+        hit_count_(0u),
+        miss_count_(0u) {
   }
 
   ~Shard() {
@@ -74,8 +78,10 @@ class DedupeSet<InKey, StoreKey, Alloc, HashType, HashFunc, kShard>::Shard {
     auto it = keys_.find(hashed_in_key);
     if (it != keys_.end()) {
       DCHECK(it->Key() != nullptr);
+      ++hit_count_;
       return it->Key();
     }
+    ++miss_count_;
     const StoreKey* store_key = alloc_.Copy(in_key);
     keys_.insert(HashedKey<StoreKey> { hash, store_key });
     return store_key;
@@ -91,6 +97,8 @@ class DedupeSet<InKey, StoreKey, Alloc, HashType, HashFunc, kShard>::Shard {
       // It may have been higher before a re-hash.
       global_stats->total_probe_distance += keys_.TotalProbeDistance();
       global_stats->total_size += keys_.size();
+      global_stats->hit_count += hit_count_;
+      global_stats->miss_count += miss_count_;
       for (const HashedKey<StoreKey>& key : keys_) {
         auto it = stats.find(key.Hash());
         if (it == stats.end()) {
@@ -178,6 +186,9 @@ class DedupeSet<InKey, StoreKey, Alloc, HashType, HashFunc, kShard>::Shard {
   const std::string lock_name_;
   Mutex lock_;
   HashSet<HashedKey<StoreKey>, ShardEmptyFn, ShardHashFn, ShardPred> keys_ GUARDED_BY(lock_);
+  // Number of Add() calls that found an existing key and that had to store a new one.
+  size_t hit_count_ GUARDED_BY(lock_);
+  size_t miss_count_ GUARDED_BY(lock_);
 };
 
 template <typename InKey,
@@ -240,13 +251,19 @@ std::string DedupeSet<InKey, StoreKey, Alloc, HashType, HashFunc, kShard>::DumpS
   for (HashType shard = 0; shard < kShard; ++shard) {
     shards_[shard]->UpdateStats(self, &stats);
   }
+  size_t add_count = stats.hit_count + stats.miss_count;
+  double hit_rate = (add_count != 0u) ? 100.0 * stats.hit_count / add_count : 0.0;
   return android::base::StringPrintf("%zu collisions, %zu max hash collisions, "
-                                     "%zu/%zu probe distance, %" PRIu64 " ns hash time",
+                                     "%zu/%zu probe distance, %" PRIu64 " ns hash time, "
+                                     "%zu/%zu hits (%.1f%%)",
                                      stats.collision_sum,
                                      stats.collision_max,
                                      stats.total_probe_distance,
                                      stats.total_size,
-                                     hash_time_);
+                                     hash_time_,
+                                     stats.hit_count,
+                                     add_count,
+                                     hit_rate);
 }
 
 
@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <string>
 #include <vector>
 
 #include "base/array_ref.h"
@@ -86,6 +87,10 @@ TEST(DedupeSetTest, Test) {
     ASSERT_NE(array3, array1);
     ASSERT_TRUE(std::equal(test3.begin(), test3.end(), array3->begin()));
   }
+
+  // Only the second array was found in the set.
+  std::string stats = deduplicator.DumpStats(self);
+  EXPECT_NE(stats.find("1/3 hits"), std::string::npos) << stats;
 }
 
 }  // namespace art
@@ -17,13 +17,17 @@
 #include "swap_space.h"
 
 #include <sys/mman.h>
+#include <sys/statvfs.h>
 
 #include <algorithm>
 #include <numeric>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "base/bit_utils.h"
 #include "base/macros.h"
 #include "base/mutex.h"
+#include "base/utils.h"
 #include "thread-current-inl.h"
 
 namespace art {
@@ -31,8 +35,33 @@ namespace art {
 // The chunk size by which the swap file is increased and mapped.
 static constexpr size_t kMininumMapSize = 16 * MB;
 
+// Maximum address space reserved up front for mapping the swap file. The reservation is also
+// limited to the space available for the file on its file system.
+#ifdef __LP64__
+static constexpr size_t kMaxReservationSize = 32 * GB;
+#else
+static constexpr size_t kMaxReservationSize = 128 * MB;
+#endif
+
+// Serve small allocations from the slot caches.
+static constexpr bool kUseSlotCaches = true;
+
+// Amount of memory carved from the chunk space when a size class runs out of slots.
+static constexpr size_t kSlotRunSize = 16 * KB;
+
+// When a slot cache holds more free memory than this for a size class, it releases the slots
+// of that class to the global pool, so that slots freed by one thread can be used by others.
+static constexpr size_t kMaxCachedSlotBytes = 64 * KB;
+
+// The released slots of a size class are coalesced when they reach this amount, or twice the
+// amount left by the previous coalescing.
+static constexpr size_t kMinCoalesceBytes = 256 * KB;
+
 static constexpr bool kCheckFreeMaps = false;
 
+static constexpr LockLevel kSwapSpaceLockLevel =
+    static_cast<LockLevel>(LockLevel::kDefaultMutexLevel - 1);
+
 template <typename FreeBySizeSet>
 static void DumpFreeMap(const FreeBySizeSet& free_by_size) {
   size_t last_size = static_cast<size_t>(-1);
@@ -59,19 +88,34 @@ inline void SwapSpace::InsertChunk(const SpaceChunk& chunk) {
   free_by_size_.emplace(chunk.size, insert_result.first);
 }
 
+SwapSpace::SlotCache::SlotCache() : lock("SwapSpace slot cache lock", kSwapSpaceLockLevel) {}
+
 SwapSpace::SwapSpace(int fd, size_t initial_size)
     : fd_(fd),
       size_(0),
-      lock_("SwapSpace lock", static_cast<LockLevel>(LockLevel::kDefaultMutexLevel - 1)) {
+      reservation_begin_(nullptr),
+      reservation_size_(0u),
+      reservation_used_(0u),
+      lock_("SwapSpace lock", kSwapSpaceLockLevel) {
   // Assume that the file is unlinked.
 
+  std::fill_n(released_bytes_, kNumSizeClasses, 0u);
+  std::fill_n(coalesce_threshold_, kNumSizeClasses, kMinCoalesceBytes);
+  for (std::unique_ptr<SlotCache>& cache : slot_caches_) {
+    cache.reset(new SlotCache());
+  }
+  ReserveAddressSpace(initial_size);
   InsertChunk(NewFileChunk(initial_size));
 }
 
 SwapSpace::~SwapSpace() {
-  // Unmap all mmapped chunks. Nothing should be allocated anymore at
-  // this point, so there should be only full size chunks in free_by_start_.
-  for (const SpaceChunk& chunk : free_by_start_) {
+  // Nothing should be allocated anymore at this point, and slots are not tracked individually,
+  // so simply unmap everything that was mapped.
+  if (reservation_begin_ != nullptr && munmap(reservation_begin_, reservation_size_) != 0) {
+    PLOG(ERROR) << "Failed to unmap swap space reservation at "
+        << static_cast<const void*>(reservation_begin_) << " size=" << reservation_size_;
+  }
+  for (const SpaceChunk& chunk : extra_maps_) {
     if (munmap(chunk.ptr, chunk.size) != 0) {
       PLOG(ERROR) << "Failed to unmap swap space chunk at "
           << static_cast<const void*>(chunk.ptr) << " size=" << chunk.size;
@@ -105,58 +149,284 @@ static size_t CollectFree(const FreeByStartSet& free_by_start, const FreeBySizeS
   return sum1;
 }
 
+inline size_t SwapSpace::SizeClassIndex(size_t size) {
+  DCHECK_NE(size, 0u);
+  DCHECK_LE(size, kMaxSlotSize);
+  if (size <= kMaxSteppedSizeClass) {
+    return (size - 1u) / kSizeClassStep;
+  }
+  return (size <= kMaxSlotSize / 2u) ? kNumSizeClasses - 2u : kNumSizeClasses - 1u;
+}
+
+inline size_t SwapSpace::SizeClassSize(size_t index) {
+  DCHECK_LT(index, kNumSizeClasses);
+  if (index < kNumSizeClasses - 2u) {
+    return (index + 1u) * kSizeClassStep;
+  }
+  return (index == kNumSizeClasses - 2u) ? kMaxSlotSize / 2u : kMaxSlotSize;
+}
+
+inline SwapSpace::SlotCache* SwapSpace::GetSlotCache(Thread* self) {
+  pid_t tid = (self != nullptr) ? self->GetTid() : GetTid();
+  return slot_caches_[static_cast<size_t>(tid) % kNumSlotCaches].get();
+}
+
 void* SwapSpace::Alloc(size_t size) {
+  size = RoundUp(std::max<size_t>(size, 1u), 8U);
+  if (kUseSlotCaches && size <= kMaxSlotSize) {
+    return AllocSlot(size);
+  }
   MutexLock lock(Thread::Current(), lock_);
-  size = RoundUp(size, 8U);
+  return AllocChunk(size);
+}
 
+void SwapSpace::Free(void* ptr, size_t size) {
+  size = RoundUp(std::max<size_t>(size, 1u), 8U);
+  if (kUseSlotCaches && size <= kMaxSlotSize) {
+    FreeSlot(ptr, size);
+    return;
+  }
+  MutexLock lock(Thread::Current(), lock_);
+  FreeChunk(ptr, size);
+}
+
+void* SwapSpace::AllocSlot(size_t size) {
+  Thread* self = Thread::Current();
+  size_t index = SizeClassIndex(size);
+  SlotCache* cache = GetSlotCache(self);
+  {
+    MutexLock lock(self, cache->lock);
+    SlotList& list = cache->free_lists[index];
+    if (list.head != nullptr) {
+      Slot* slot = list.head;
+      list.head = slot->next;
+      if (list.head == nullptr) {
+        list.tail = nullptr;
+      }
+      --list.length;
+      return slot;
+    }
+  }
+  // The cache has no slot of this size class, refill it. We do not hold the cache lock while
+  // taking the global lock, so another thread may have refilled the cache in the meantime.
+  SlotList refill;
+  {
+    MutexLock lock(self, lock_);
+    refill = TakeSlots(index);
+  }
+  DCHECK(refill.head != nullptr);
+  Slot* slot = refill.head;
+  refill.head = slot->next;
+  --refill.length;
+  if (refill.head != nullptr) {
+    MutexLock lock(self, cache->lock);
+    SlotList& list = cache->free_lists[index];
+    refill.tail->next = list.head;
+    list.head = refill.head;
+    if (list.tail == nullptr) {
+      list.tail = refill.tail;
+    }
+    list.length += refill.length;
+  }
+  return slot;
+}
+
+void SwapSpace::FreeSlot(void* ptr, size_t size) {
+  Thread* self = Thread::Current();
+  size_t index = SizeClassIndex(size);
+  SlotCache* cache = GetSlotCache(self);
+  Slot* slot = reinterpret_cast<Slot*>(ptr);
+  SlotList released;
+  {
+    MutexLock lock(self, cache->lock);
+    SlotList& list = cache->free_lists[index];
+    slot->next = list.head;
+    list.head = slot;
+    if (list.tail == nullptr) {
+      list.tail = slot;
+    }
+    ++list.length;
+    if (list.length * SizeClassSize(index) > kMaxCachedSlotBytes) {
+      released = list;
+      list = SlotList();
+    }
+  }
+  if (released.head != nullptr) {
+    MutexLock lock(self, lock_);
+    ReleaseSlots(index, released);
+  }
+}
+
+SwapSpace::SlotList SwapSpace::TakeSlots(size_t index) {
+  size_t slot_size = SizeClassSize(index);
+  if (!released_slots_[index].empty()) {
+    SlotList slots = released_slots_[index].back();
+    released_slots_[index].pop_back();
+    DCHECK_GE(released_bytes_[index], slots.length * slot_size);
+    released_bytes_[index] -= slots.length * slot_size;
+    return slots;
+  }
+  size_t count = kSlotRunSize / slot_size;
+  uint8_t* run = reinterpret_cast<uint8_t*>(AllocChunk(count * slot_size));
+  slot_runs_.emplace(run, index);
+  SlotList slots;
+  for (size_t i = count; i != 0u; ) {
+    --i;
+    Slot* slot = reinterpret_cast<Slot*>(run + i * slot_size);
+    slot->next = slots.head;
+    slots.head = slot;
+    if (slots.tail == nullptr) {
+      slots.tail = slot;
+    }
+  }
+  slots.length = count;
+  return slots;
+}
+
+void SwapSpace::ReleaseSlots(size_t index, const SlotList& slots) {
+  released_slots_[index].push_back(slots);
+  released_bytes_[index] += slots.length * SizeClassSize(index);
+  if (released_bytes_[index] >= coalesce_threshold_[index]) {
+    CoalesceReleasedSlots(index);
+    coalesce_threshold_[index] = std::max(2u * released_bytes_[index], kMinCoalesceBytes);
+  }
+}
+
+void SwapSpace::CoalesceReleasedSlots(size_t index) {
+  const size_t slot_size = SizeClassSize(index);
+  const size_t slots_per_run = kSlotRunSize / slot_size;
+  auto find_run = [this](Slot* slot) {
+    auto run_it = slot_runs_.upper_bound(reinterpret_cast<uint8_t*>(slot));
+    DCHECK(run_it != slot_runs_.begin());
+    --run_it;
+    return run_it->first;
+  };
+  // Count the released slots of each run. The slots still cached by the threads or in use keep
+  // their run out of the chunk space.
+  std::unordered_map<uint8_t*, size_t> released_per_run;
+  for (const SlotList& list : released_slots_[index]) {
+    Slot* slot = list.head;
+    for (size_t i = 0; i != list.length; ++i, slot = slot->next) {
+      ++released_per_run[find_run(slot)];
+    }
+  }
+  std::unordered_set<uint8_t*> free_runs;
+  for (const auto& entry : released_per_run) {
+    DCHECK_LE(entry.second, slots_per_run);
+    if (entry.second == slots_per_run) {
+      free_runs.insert(entry.first);
+    }
+  }
+  if (free_runs.empty()) {
+    return;
+  }
+  // Rebuild the released batches without the slots of the free runs.
+  std::vector<SlotList> old_batches;
+  old_batches.swap(released_slots_[index]);
+  const size_t batch_length = std::max<size_t>(kMaxCachedSlotBytes / slot_size, 1u);
+  SlotList batch;
+  for (const SlotList& list : old_batches) {
+    Slot* slot = list.head;
+    for (size_t i = 0; i != list.length; ++i) {
+      Slot* next = slot->next;
+      if (free_runs.find(find_run(slot)) == free_runs.end()) {
+        slot->next = batch.head;
+        batch.head = slot;
+        if (batch.tail == nullptr) {
+          batch.tail = slot;
+        }
+        if (++batch.length == batch_length) {
+          released_slots_[index].push_back(batch);
+          batch = SlotList();
+        }
+      }
+      slot = next;
+    }
+  }
+  if (batch.head != nullptr) {
+    released_slots_[index].push_back(batch);
+  }
+  for (uint8_t* run : free_runs) {
+    slot_runs_.erase(run);
+    FreeChunk(run, slots_per_run * slot_size);
+  }
+  released_bytes_[index] -= free_runs.size() * slots_per_run * slot_size;
+}
+
+void* SwapSpace::AllocChunk(size_t size) {
   // Check the free list for something that fits.
   // TODO: Smarter implementation. Global biggest chunk, ...
   auto it = free_by_start_.empty()
       ? free_by_size_.end()
       : free_by_size_.lower_bound(FreeBySizeEntry { size, free_by_start_.begin() });
-  if (it != free_by_size_.end()) {
-    auto entry = it->free_by_start_entry;
-    SpaceChunk old_chunk = *entry;
-    if (old_chunk.size == size) {
-      RemoveChunk(it);
+  if (it == free_by_size_.end()) {
+    // Not a big enough free chunk, need to increase file size. The new chunk may extend the
+    // free chunk at the end of the previous one.
+    InsertAndCoalesceChunk(NewFileChunk(size));
+    it = free_by_size_.lower_bound(FreeBySizeEntry { size, free_by_start_.begin() });
+    DCHECK(it != free_by_size_.end());
+  }
+  auto entry = it->free_by_start_entry;
+  SpaceChunk old_chunk = *entry;
+  if (old_chunk.size == size) {
+    RemoveChunk(it);
+  } else {
+    // Try to avoid deallocating and allocating the std::set<> nodes.
+    // This would be much simpler if we could use replace() from Boost.Bimap.
+
+    // The free_by_start_ map contains disjoint intervals ordered by the `ptr`.
+    // Shrinking the interval does not affect the ordering.
+    it->free_by_start_entry->ptr += size;
+    it->free_by_start_entry->size -= size;
+
+    // The free_by_size_ map is ordered by the `size` and then `free_by_start_entry->ptr`.
+    // Adjusting the `ptr` above does not change that ordering but decreasing `size` can
+    // push the node before the previous node(s).
+    if (it == free_by_size_.begin()) {
+      it->size -= size;
     } else {
-      // Try to avoid deallocating and allocating the std::set<> nodes.
-      // This would be much simpler if we could use replace() from Boost.Bimap.
-
-      // The free_by_start_ map contains disjoint intervals ordered by the `ptr`.
-      // Shrinking the interval does not affect the ordering.
-      it->free_by_start_entry->ptr += size;
-      it->free_by_start_entry->size -= size;
-
-      // The free_by_size_ map is ordered by the `size` and then `free_by_start_entry->ptr`.
-      // Adjusting the `ptr` above does not change that ordering but decreasing `size` can
-      // push the node before the previous node(s).
-      if (it == free_by_size_.begin()) {
+      auto prev = it;
+      --prev;
+      FreeBySizeEntry new_value(old_chunk.size - size, entry);
+      if (free_by_size_.key_comp()(*prev, new_value)) {
         it->size -= size;
       } else {
-        auto prev = it;
-        --prev;
-        FreeBySizeEntry new_value(old_chunk.size - size, entry);
-        if (free_by_size_.key_comp()(*prev, new_value)) {
-          it->size -= size;
-        } else {
-          // Changing in place would break the std::set<> ordering, we need to remove and insert.
-          free_by_size_.erase(it);
-          free_by_size_.insert(new_value);
-        }
+        // Changing in place would break the std::set<> ordering, we need to remove and insert.
+        free_by_size_.erase(it);
+        free_by_size_.insert(new_value);
       }
     }
-    return old_chunk.ptr;
-  } else {
-    // Not a big enough free chunk, need to increase file size.
-    SpaceChunk new_chunk = NewFileChunk(size);
-    if (new_chunk.size != size) {
-      // Insert the remainder.
-      SpaceChunk remainder = { new_chunk.ptr + size, new_chunk.size - size };
-      InsertChunk(remainder);
-    }
-    return new_chunk.ptr;
   }
+  return old_chunk.ptr;
+}
+
+void SwapSpace::ReserveAddressSpace(size_t initial_size) {
+#if !defined(__APPLE__)
+  size_t reservation_size = kMaxReservationSize;
+  struct statvfs fs;
+  if (fstatvfs(fd_, &fs) == 0) {
+    // The swap file cannot grow beyond the space available on its file system.
+    uint64_t available = static_cast<uint64_t>(fs.f_bavail) * fs.f_frsize;
+    available = std::max<uint64_t>(available, initial_size);
+    reservation_size = static_cast<size_t>(std::min<uint64_t>(
+        reservation_size, RoundUp(available + kMininumMapSize, kMininumMapSize)));
+  }
+  void* reservation = mmap(nullptr,
+                           reservation_size,
+                           PROT_NONE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           /* fd */ -1,
+                           /* offset */ 0);
+  if (reservation == MAP_FAILED) {
+    // Not fatal, file chunks are then mapped wherever the kernel puts them.
+    PLOG(WARNING) << "Unable to reserve " << reservation_size << " bytes for the swap space.";
+    return;
+  }
+  reservation_begin_ = reinterpret_cast<uint8_t*>(reservation);
+  reservation_size_ = reservation_size;
+#else
+  UNUSED(initial_size, kMaxReservationSize);
+#endif
 }
 
 SwapSpace::SpaceChunk SwapSpace::NewFileChunk(size_t min_size) {
@@ -166,8 +436,25 @@ SwapSpace::SpaceChunk SwapSpace::NewFileChunk(size_t min_size) {
   if (result != 0) {
     PLOG(FATAL) << "Unable to increase swap file.";
   }
-  uint8_t* ptr = reinterpret_cast<uint8_t*>(
-      mmap(nullptr, next_part, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, size_));
+  uint8_t* ptr;
+  if (reservation_size_ - reservation_used_ >= next_part) {
+    // Map the chunk right after the previous one.
+    ptr = reinterpret_cast<uint8_t*>(mmap(reservation_begin_ + reservation_used_,
+                                          next_part,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_FIXED,
+                                          fd_,
+                                          size_));
+    if (ptr != MAP_FAILED) {
+      reservation_used_ += next_part;
+    }
+  } else {
+    ptr = reinterpret_cast<uint8_t*>(
+        mmap(nullptr, next_part, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, size_));
+    if (ptr != MAP_FAILED) {
+      extra_maps_.push_back(SpaceChunk {ptr, next_part});
+    }
+  }
   if (ptr == MAP_FAILED) {
     LOG(ERROR) << "Unable to mmap new swap file chunk.";
     LOG(ERROR) << "Current size: " << size_ << " requested: " << next_part << "/" << min_size;
@@ -186,17 +473,26 @@ SwapSpace::SpaceChunk SwapSpace::NewFileChunk(size_t min_size) {
 #endif
 }
 
-// TODO: Full coalescing.
-void SwapSpace::Free(void* ptr, size_t size) {
-  MutexLock lock(Thread::Current(), lock_);
-  size = RoundUp(size, 8U);
-
+void SwapSpace::FreeChunk(void* ptr, size_t size) {
   size_t free_before = 0;
   if (kCheckFreeMaps) {
     free_before = CollectFree(free_by_start_, free_by_size_);
   }
 
-  SpaceChunk chunk = { reinterpret_cast<uint8_t*>(ptr), size };
+  InsertAndCoalesceChunk(SpaceChunk { reinterpret_cast<uint8_t*>(ptr), size });
+
+  if (kCheckFreeMaps) {
+    size_t free_after = CollectFree(free_by_start_, free_by_size_);
+
+    if (free_after != free_before + size) {
+      DumpFreeMap(free_by_size_);
+      CHECK_EQ(free_after, free_before + size) << "Should be " << size << " difference from " << free_before;
+    }
+  }
+}
+
+// TODO: Full coalescing.
+void SwapSpace::InsertAndCoalesceChunk(SpaceChunk chunk) {
   auto it = free_by_start_.lower_bound(chunk);
   if (it != free_by_start_.begin()) {
     auto prev = it;
@@ -224,15 +520,6 @@ void SwapSpace::Free(void* ptr, size_t size) {
     }
   }
   InsertChunk(chunk);
-
-  if (kCheckFreeMaps) {
-    size_t free_after = CollectFree(free_by_start_, free_by_size_);
-
-    if (free_after != free_before + size) {
-      DumpFreeMap(free_by_size_);
-      CHECK_EQ(free_after, free_before + size) << "Should be " << size << " difference from " << free_before;
-    }
-  }
 }
 
 }  // namespace art
@@ -21,6 +21,8 @@
 #include <stdint.h>
 #include <cstdlib>
 #include <list>
+#include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -32,6 +34,13 @@
 namespace art {
 
 // An arena pool that creates arenas backed by an mmaped file.
+//
+// Small allocations are rounded up to a size class and served from striped slot caches, so that
+// compiler threads mostly take an uncontended cache lock instead of the global lock. Slots come
+// in runs carved from the free chunks of the file, and a run goes back to the free chunks once all
+// its slots are released by the caches. Larger allocations are served best-fit from the free
+// chunks. The file is mapped into an address space reservation sized for the file system of the
+// file, so that consecutive growth chunks are contiguous.
 class SwapSpace {
  public:
   SwapSpace(int fd, size_t initial_size);
@@ -44,6 +53,32 @@ class SwapSpace {
   }
 
  private:
+  // Size classes are 16 bytes apart up to 512 bytes, followed by 1KiB and 2KiB.
+  static constexpr size_t kSizeClassStep = 16u;
+  static constexpr size_t kMaxSteppedSizeClass = 512u;
+  static constexpr size_t kMaxSlotSize = 2048u;
+  static constexpr size_t kNumSizeClasses = kMaxSteppedSizeClass / kSizeClassStep + 2u;
+  // Threads pick a slot cache by their tid.
+  static constexpr size_t kNumSlotCaches = 16u;
+
+  // Free slot of a size class, linked through its first word.
+  struct Slot {
+    Slot* next;
+  };
+
+  struct SlotList {
+    Slot* head = nullptr;
+    Slot* tail = nullptr;
+    size_t length = 0u;
+  };
+
+  struct SlotCache {
+    SlotCache();
+
+    Mutex lock;
+    SlotList free_lists[kNumSizeClasses] GUARDED_BY(lock);
+  };
+
   // Chunk of space.
   struct SpaceChunk {
     // We need mutable members as we keep these objects in a std::set<> (providing only const
@@ -89,14 +124,41 @@ class SwapSpace {
   };
   typedef std::set<FreeBySizeEntry, FreeBySizeComparator> FreeBySizeSet;
 
+  static size_t SizeClassIndex(size_t size);
+  static size_t SizeClassSize(size_t index);
+
+  SlotCache* GetSlotCache(Thread* self);
+  void* AllocSlot(size_t size) REQUIRES(!lock_);
+  void FreeSlot(void* ptr, size_t size) REQUIRES(!lock_);
+  // Returns free slots of the given size class, either a batch released by a slot cache or a
+  // new run carved from the chunk space.
+  SlotList TakeSlots(size_t index) REQUIRES(lock_);
+  // Adds a batch of free slots released by a slot cache.
+  void ReleaseSlots(size_t index, const SlotList& slots) REQUIRES(lock_);
+  // Returns the runs of the given size class whose slots are all released to the chunk space.
+  void CoalesceReleasedSlots(size_t index) REQUIRES(lock_);
+
+  void* AllocChunk(size_t size) REQUIRES(lock_);
+  void FreeChunk(void* ptr, size_t size) REQUIRES(lock_);
+
+  void ReserveAddressSpace(size_t initial_size);
   SpaceChunk NewFileChunk(size_t min_size) REQUIRES(lock_);
 
   void RemoveChunk(FreeBySizeSet::const_iterator free_by_size_pos) REQUIRES(lock_);
   void InsertChunk(const SpaceChunk& chunk) REQUIRES(lock_);
+  // Inserts the chunk, merging it with adjacent free chunks.
+  void InsertAndCoalesceChunk(SpaceChunk chunk) REQUIRES(lock_);
 
   int fd_;
   size_t size_;
 
+  // Address space reserved for mapping the file, and how much of it is mapped. File chunks that
+  // do not fit in the reservation are mapped elsewhere and recorded in extra_maps_.
+  uint8_t* reservation_begin_;
+  size_t reservation_size_;
+  size_t reservation_used_ GUARDED_BY(lock_);
+  std::vector<SpaceChunk> extra_maps_ GUARDED_BY(lock_);
+
   // NOTE: Boost.Bimap would be useful for the two following members.
 
   // Map start of a free chunk to its size.
@@ -104,6 +166,16 @@ class SwapSpace {
   // Free chunks ordered by size.
   FreeBySizeSet free_by_size_ GUARDED_BY(lock_);
 
+  // Batches of free slots released by slot caches that grew too large, by size class.
+  std::vector<SlotList> released_slots_[kNumSizeClasses] GUARDED_BY(lock_);
+  // Bytes in released_slots_, and the amount at which they are next coalesced, by size class.
+  size_t released_bytes_[kNumSizeClasses] GUARDED_BY(lock_);
+  size_t coalesce_threshold_[kNumSizeClasses] GUARDED_BY(lock_);
+  // Runs of slots carved from the chunk space, by start address, with their size class.
+  std::map<uint8_t*, size_t> slot_runs_ GUARDED_BY(lock_);
+
+  std::unique_ptr<SlotCache> slot_caches_[kNumSlotCaches];
+
   mutable Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
   DISALLOW_COPY_AND_ASSIGN(SwapSpace);
 };
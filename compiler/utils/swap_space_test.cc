@@ -21,12 +21,18 @@
 #include <sys/types.h>
 
 #include <cstdio>
+#include <iostream>
+#include <vector>
 
 #include "gtest/gtest.h"
 
+#include "base/histogram-inl.h"
 #include "base/os.h"
+#include "base/time_utils.h"
 #include "base/unix_file/fd_file.h"
 #include "common_runtime_test.h"
+#include "thread-current-inl.h"
+#include "thread_pool.h"
 
 namespace art {
 
@@ -80,4 +86,119 @@ TEST_F(SwapSpaceTest, Swap) {
   SwapTest(true);
 }
 
+// Sizes of the allocations made by the multi-threaded tests, mostly small ones like those of
+// dex2oat, with a few above the slot size limit.
+static size_t AllocationSize(size_t i) {
+  return (i % 16u == 15u) ? 4 * KB + i % 1000u : 1u + (i * 37u) % 600u;
+}
+
+static void AllocateFromThreads(SwapSpace* pool,
+                                size_t num_threads,
+                                size_t num_allocations,
+                                bool check_contents,
+                                Histogram<uint64_t>* histogram) {
+  Thread* self = Thread::Current();
+  ThreadPool thread_pool("Swap space test thread pool", num_threads);
+  Mutex histogram_lock("Swap space test histogram lock");
+  for (size_t t = 0; t != num_threads; ++t) {
+    thread_pool.AddTask(self, new FunctionTask([=, &histogram_lock](Thread* worker) {
+      std::vector<uint8_t*> allocations(num_allocations);
+      uint64_t start_time = NanoTime();
+      for (size_t round = 0; round != 2u; ++round) {
+        for (size_t i = 0; i != num_allocations; ++i) {
+          allocations[i] = reinterpret_cast<uint8_t*>(pool->Alloc(AllocationSize(i)));
+          if (check_contents) {
+            std::fill_n(allocations[i], AllocationSize(i), static_cast<uint8_t>(t + i));
+          }
+        }
+        for (size_t i = 0; i != num_allocations; ++i) {
+          if (check_contents) {
+            for (size_t j = 0; j != AllocationSize(i); ++j) {
+              ASSERT_EQ(static_cast<uint8_t>(t + i), allocations[i][j]);
+            }
+          }
+          // Free in a different order than allocated.
+          size_t index = (i * 7919u) % num_allocations;
+          if (allocations[index] != nullptr) {
+            pool->Free(allocations[index], AllocationSize(index));
+            allocations[index] = nullptr;
+          }
+        }
+        for (size_t i = 0; i != num_allocations; ++i) {
+          if (allocations[i] != nullptr) {
+            pool->Free(allocations[i], AllocationSize(i));
+          }
+        }
+      }
+      if (histogram != nullptr) {
+        MutexLock mu(worker, histogram_lock);
+        histogram->AddValue(NanoTime() - start_time);
+      }
+    }));
+  }
+  thread_pool.StartWorkers(self);
+  thread_pool.Wait(self, /* do_work */ true, /* may_hold_locks */ false);
+  thread_pool.StopWorkers(self);
+}
+
+TEST_F(SwapSpaceTest, SwapThreads) {
+  ScratchFile scratch;
+  int fd = scratch.GetFd();
+  unlink(scratch.GetFilename().c_str());
+
+  SwapSpace pool(fd, 1 * MB);
+  AllocateFromThreads(&pool,
+                      /* num_threads */ 4u,
+                      /* num_allocations */ 10000u,
+                      /* check_contents */ true,
+                      /* histogram */ nullptr);
+  scratch.Close();
+}
+
+TEST_F(SwapSpaceTest, ReleasedSlotsAreCoalesced) {
+  ScratchFile scratch;
+  int fd = scratch.GetFd();
+  unlink(scratch.GetFilename().c_str());
+
+  SwapSpace pool(fd, 1 * MB);
+  // 20MB of the largest slots, past the first 16MB chunk of the file.
+  static constexpr size_t kSlotSize = 2 * KB;
+  std::vector<void*> slots(20 * MB / kSlotSize);
+  for (void*& slot : slots) {
+    slot = pool.Alloc(kSlotSize);
+  }
+  const size_t size = pool.GetSize();
+  EXPECT_LT(20 * MB, size);
+  for (void* slot : slots) {
+    pool.Free(slot, kSlotSize);
+  }
+  // Only the last slots freed are still cached or waiting to be coalesced, the others went back
+  // to the free chunks and make room for a large allocation without growing the file.
+  void* chunk = pool.Alloc(16 * MB);
+  EXPECT_EQ(size, pool.GetSize());
+  pool.Free(chunk, 16 * MB);
+  scratch.Close();
+}
+
+// A benchmark, which prints the times to stdout. Run with --gtest_also_run_disabled_tests.
+TEST_F(SwapSpaceTest, DISABLED_Speed) {
+  ScratchFile scratch;
+  int fd = scratch.GetFd();
+  unlink(scratch.GetFilename().c_str());
+
+  SwapSpace pool(fd, 1 * MB);
+  std::unique_ptr<Histogram<uint64_t>> hist(new Histogram<uint64_t>("SwapSpaceSpeedTest", 5));
+  for (size_t i = 0; i != 8u; ++i) {
+    AllocateFromThreads(&pool,
+                        /* num_threads */ 8u,
+                        /* num_allocations */ 100000u,
+                        /* check_contents */ false,
+                        hist.get());
+  }
+  Histogram<uint64_t>::CumulativeData data;
+  hist->CreateHistogram(&data);
+  hist->PrintConfidenceIntervals(std::cout, 0.99, data);
+  scratch.Close();
+}
+
 }  // namespace art
@@ -33,6 +33,7 @@
 #include "runtime.h"
 #include "scoped_thread_state_change-inl.h"
 #include "thread.h"
+#include "thread_pool.h"
 #include "utils/atomic_dex_ref_map-inl.h"
 #include "verifier/method_verifier-inl.h"
 
@@ -189,6 +190,8 @@ class VerifierDepsTest : public CommonCompilerTest {
                             true /* allow_thread_suspension */);
     verifier.Verify();
     Thread::Current()->SetVerifierDeps(nullptr);
+    // As CompilerDriver::Verify does once the recording is done.
+    callbacks_->GetVerifierDeps()->SortDependencies();
     return !verifier.HasFailures();
   }
 
@@ -228,7 +231,8 @@ class VerifierDepsTest : public CommonCompilerTest {
         hs.NewHandle(soa.Decode<mirror::ClassLoader>(class_loader_)));
     MutableHandle<mirror::Class> cls(hs.NewHandle<mirror::Class>(nullptr));
     for (const DexFile* dex_file : dex_files_) {
-      const std::set<dex::TypeIndex>& unverified_classes = deps.GetUnverifiedClasses(*dex_file);
+      const SortedVector<dex::TypeIndex>& unverified_classes =
+          deps.GetUnverifiedClasses(*dex_file);
       for (uint32_t i = 0; i < dex_file->NumClassDefs(); ++i) {
         const DexFile::ClassDef& class_def = dex_file->GetClassDef(i);
         const char* descriptor = dex_file->GetClassDescriptor(class_def);
@@ -1171,6 +1175,8 @@ TEST_F(VerifierDepsTest, UnverifiedOrder) {
                                       dex::TypeIndex(0),
                                       verifier::FailureKind::kHardFailure);
   self->SetVerifierDeps(nullptr);
+  deps1.SortDependencies();
+  deps2.SortDependencies();
   std::vector<uint8_t> buffer1;
   deps1.Encode(dex_files, &buffer1);
   std::vector<uint8_t> buffer2;
@@ -1358,7 +1364,7 @@ TEST_F(VerifierDepsTest, VerifyDeps) {
     VerifierDeps decoded_deps(dex_files_, ArrayRef<const uint8_t>(buffer));
     VerifierDeps::DexFileDeps* deps = decoded_deps.GetDexFileDeps(*primary_dex_file_);
     bool found = false;
-    std::set<VerifierDeps::MethodResolution>* methods = &deps->methods_;
+    SortedVector<VerifierDeps::MethodResolution>* methods = &deps->methods_;
     for (const auto& entry : *methods) {
       if (entry.IsResolved()) {
         methods->insert(VerifierDeps::MethodResolution(entry.GetDexMethodIndex(),
@@ -1377,7 +1383,7 @@ TEST_F(VerifierDepsTest, VerifyDeps) {
     VerifierDeps decoded_deps(dex_files_, ArrayRef<const uint8_t>(buffer));
     VerifierDeps::DexFileDeps* deps = decoded_deps.GetDexFileDeps(*primary_dex_file_);
     bool found = false;
-    std::set<VerifierDeps::MethodResolution>* methods = &deps->methods_;
+    SortedVector<VerifierDeps::MethodResolution>* methods = &deps->methods_;
     for (const auto& entry : *methods) {
       if (!entry.IsResolved()) {
         constexpr dex::StringIndex kStringIndexZero(0);  // We know there is a class there.
@@ -1397,7 +1403,7 @@ TEST_F(VerifierDepsTest, VerifyDeps) {
     VerifierDeps decoded_deps(dex_files_, ArrayRef<const uint8_t>(buffer));
     VerifierDeps::DexFileDeps* deps = decoded_deps.GetDexFileDeps(*primary_dex_file_);
     bool found = false;
-    std::set<VerifierDeps::MethodResolution>* methods = &deps->methods_;
+    SortedVector<VerifierDeps::MethodResolution>* methods = &deps->methods_;
     for (const auto& entry : *methods) {
       if (entry.IsResolved()) {
         methods->insert(VerifierDeps::MethodResolution(entry.GetDexMethodIndex(),
@@ -1416,7 +1422,7 @@ TEST_F(VerifierDepsTest, VerifyDeps) {
     VerifierDeps decoded_deps(dex_files_, ArrayRef<const uint8_t>(buffer));
     VerifierDeps::DexFileDeps* deps = decoded_deps.GetDexFileDeps(*primary_dex_file_);
     bool found = false;
-    std::set<VerifierDeps::MethodResolution>* methods = &deps->methods_;
+    SortedVector<VerifierDeps::MethodResolution>* methods = &deps->methods_;
     for (const auto& entry : *methods) {
       constexpr dex::StringIndex kNewTypeIndex(0);
       if (entry.IsResolved() && entry.GetDeclaringClassIndex() != kNewTypeIndex) {
@@ -1468,6 +1474,7 @@ TEST_F(VerifierDepsTest, CompilerDriver) {
           }
         }
         ASSERT_TRUE(found);
+        decoded_deps.SortDependencies();
       }
       VerifyWithCompilerDriver(&decoded_deps);
 
@@ -1481,6 +1488,46 @@ TEST_F(VerifierDepsTest, CompilerDriver) {
   }
 }
 
+TEST_F(VerifierDepsTest, ParallelValidation) {
+  VerifyDexFile("MultiDex");
+  ASSERT_GT(NumberOfCompiledDexFiles(), 1u);
+
+  std::vector<uint8_t> buffer;
+  verifier_deps_->Encode(dex_files_, &buffer);
+  ASSERT_FALSE(buffer.empty());
+
+  ThreadPool thread_pool("Verifier deps test thread pool", 2u);
+  ScopedObjectAccess soa(Thread::Current());
+  StackHandleScope<1> hs(soa.Self());
+  MutableHandle<mirror::ClassLoader> new_class_loader(hs.NewHandle<mirror::ClassLoader>(nullptr));
+  {
+    VerifierDeps decoded_deps(dex_files_, ArrayRef<const uint8_t>(buffer));
+    new_class_loader.Assign(
+        soa.Decode<mirror::ClassLoader>(LoadMultiDex("VerifierDeps", "MultiDex")));
+    ASSERT_TRUE(decoded_deps.ValidateDependencies(new_class_loader, soa.Self(), &thread_pool));
+  }
+
+  {
+    // Taint the dependencies of one of the dex files, which must fail the whole validation.
+    VerifierDeps decoded_deps(dex_files_, ArrayRef<const uint8_t>(buffer));
+    VerifierDeps::DexFileDeps* deps = decoded_deps.GetDexFileDeps(*primary_dex_file_);
+    bool found = false;
+    for (const auto& entry : deps->classes_) {
+      if (entry.IsResolved()) {
+        deps->classes_.insert(VerifierDeps::ClassResolution(
+            entry.GetDexTypeIndex(), VerifierDeps::kUnresolvedMarker));
+        found = true;
+        break;
+      }
+    }
+    ASSERT_TRUE(found);
+    new_class_loader.Assign(
+        soa.Decode<mirror::ClassLoader>(LoadMultiDex("VerifierDeps", "MultiDex")));
+    ASSERT_FALSE(decoded_deps.ValidateDependencies(new_class_loader, soa.Self(), &thread_pool));
+    ASSERT_FALSE(decoded_deps.ValidateDependencies(new_class_loader, soa.Self()));
+  }
+}
+
 TEST_F(VerifierDepsTest, MultiDexVerification) {
   VerifyDexFile("VerifierDepsMulti");
   ASSERT_EQ(NumberOfCompiledDexFiles(), 2u);
@@ -26,6 +26,7 @@
 #include "android-base/stringprintf.h"
 
 #include "art_method-inl.h"
+#include "base/casts.h"
 #include "base/file_utils.h"
 #include "base/hash_set.h"
 #include "base/unix_file/fd_file.h"
@@ -78,6 +79,9 @@ class ImageTest : public CommonCompilerTest {
 
   void TestWriteRead(ImageHeader::StorageMode storage_mode);
 
+  // Check the block table of a compressed image and its decompression.
+  void CheckCompressedBlocks(const std::string& image_filename);
+
   void Compile(ImageHeader::StorageMode storage_mode,
                /*out*/ CompilationHelper& out_helper,
                const std::string& extra_dex = "",
@@ -495,6 +499,54 @@ inline void ImageTest::TestWriteRead(ImageHeader::StorageMode storage_mode) {
       EXPECT_TRUE(Monitor::IsValidLockWord(klass->GetLockWord(false)));
     }
   }
+
+  if (storage_mode != ImageHeader::kStorageModeUncompressed) {
+    for (ScratchFile& image_file : helper.image_files) {
+      CheckCompressedBlocks(image_file.GetFilename());
+    }
+  }
+}
+
+inline void ImageTest::CheckCompressedBlocks(const std::string& image_filename) {
+  std::unique_ptr<File> file(OS::OpenFileForReading(image_filename.c_str()));
+  ASSERT_TRUE(file != nullptr);
+  ImageHeader image_header;
+  ASSERT_TRUE(file->ReadFully(&image_header, sizeof(image_header)));
+  const size_t image_data_size = image_header.GetImageSize() - sizeof(ImageHeader);
+  const size_t block_size = image_header.GetBlockSize();
+  const size_t block_count = image_header.GetBlockCount();
+  ASSERT_EQ(ImageHeader::kCompressionBlockSize, block_size);
+  ASSERT_EQ(RoundUp(image_data_size, block_size) / block_size, block_count);
+  std::vector<uint8_t> data(image_header.GetDataSize());
+  ASSERT_TRUE(file->ReadFully(data.data(), data.size()));
+
+  // The blocks follow the block table, in order and without gaps.
+  const ImageHeader::Block* blocks = image_header.GetBlocks(data.data());
+  size_t expected_offset = block_count * sizeof(ImageHeader::Block);
+  for (size_t i = 0; i != block_count; ++i) {
+    EXPECT_EQ(expected_offset, blocks[i].data_offset_) << i;
+    expected_offset = blocks[i].data_offset_ + blocks[i].data_size_;
+  }
+  EXPECT_EQ(data.size(), expected_offset);
+
+  // Decompressing on a thread pool gives the same data as decompressing serially.
+  ScopedObjectAccess soa(Thread::Current());
+  std::vector<uint8_t> serial(image_data_size);
+  std::vector<uint8_t> parallel(image_data_size);
+  std::string error_msg;
+  ASSERT_TRUE(gc::space::ImageSpace::DecompressImageData(
+      image_header, data.data(), serial.data(), /* parallel */ false, &error_msg)) << error_msg;
+  ASSERT_TRUE(gc::space::ImageSpace::DecompressImageData(
+      image_header, data.data(), parallel.data(), /* parallel */ true, &error_msg)) << error_msg;
+  EXPECT_TRUE(serial == parallel);
+
+  // A block pointing outside of the stored data is rejected.
+  if (block_count != 0u) {
+    ImageHeader::Block* mutable_blocks = reinterpret_cast<ImageHeader::Block*>(data.data());
+    mutable_blocks[block_count - 1u].data_offset_ = dchecked_integral_cast<uint32_t>(data.size());
+    EXPECT_FALSE(gc::space::ImageSpace::DecompressImageData(
+        image_header, data.data(), parallel.data(), /* parallel */ true, &error_msg));
+  }
 }
 
 }  // namespace linker
@@ -29,6 +29,7 @@
 #include "art_field-inl.h"
 #include "art_method-inl.h"
 #include "base/callee_save_type.h"
+#include "base/casts.h"
 #include "base/enums.h"
 #include "base/globals.h"
 #include "base/logging.h"  // For VLOG.
@@ -242,14 +243,29 @@ bool ImageWriter::Write(int image_fd,
     switch (image_storage_mode_) {
       case ImageHeader::kStorageModeLZ4HC:  // Fall-through.
       case ImageHeader::kStorageModeLZ4: {
-        const size_t compressed_max_size = LZ4_compressBound(image_data_size);
+        // Compress fixed size blocks independently so that the runtime can decompress them in
+        // parallel. The block table goes first, followed by the compressed blocks.
+        const size_t block_size = ImageHeader::kCompressionBlockSize;
+        const size_t block_count = RoundUp(image_data_size, block_size) / block_size;
+        const size_t table_size = block_count * sizeof(ImageHeader::Block);
+        const size_t compressed_max_size = table_size + block_count * LZ4_compressBound(block_size);
         compressed_data.reset(new char[compressed_max_size]);
-        data_size = LZ4_compress_default(
-            reinterpret_cast<char*>(image_info.image_->Begin()) + sizeof(ImageHeader),
-            &compressed_data[0],
-            image_data_size,
-            compressed_max_size);
-
+        ImageHeader::Block* blocks = reinterpret_cast<ImageHeader::Block*>(&compressed_data[0]);
+        data_size = table_size;
+        for (size_t i = 0; i != block_count; ++i) {
+          const size_t block_begin = i * block_size;
+          const size_t input_size = std::min(block_size, image_data_size - block_begin);
+          const int compressed_size = LZ4_compress_default(image_data + block_begin,
+                                                           &compressed_data[data_size],
+                                                           input_size,
+                                                           compressed_max_size - data_size);
+          CHECK_GT(compressed_size, 0) << "Failed to compress image block " << i;
+          blocks[i].data_offset_ = dchecked_integral_cast<uint32_t>(data_size);
+          blocks[i].data_size_ = static_cast<uint32_t>(compressed_size);
+          data_size += compressed_size;
+        }
+        image_header->block_size_ = block_size;
+        image_header->block_count_ = block_count;
         break;
       }
       /*
@@ -282,12 +298,19 @@ bool ImageWriter::Write(int image_fd,
                      << PrettyDuration(NanoTime() - compress_start_time);
       if (kIsDebugBuild) {
         std::unique_ptr<uint8_t[]> temp(new uint8_t[image_data_size]);
-        const size_t decompressed_size = LZ4_decompress_safe(
-            reinterpret_cast<char*>(&compressed_data[0]),
-            reinterpret_cast<char*>(&temp[0]),
-            data_size,
-            image_data_size);
-        CHECK_EQ(decompressed_size, image_data_size);
+        const ImageHeader::Block* blocks =
+            image_header->GetBlocks(reinterpret_cast<uint8_t*>(&compressed_data[0]));
+        const size_t block_size = image_header->GetBlockSize();
+        for (size_t i = 0; i != image_header->GetBlockCount(); ++i) {
+          const size_t block_begin = i * block_size;
+          const size_t expected_size = std::min(block_size, image_data_size - block_begin);
+          const int decompressed_size = LZ4_decompress_safe(
+              &compressed_data[blocks[i].data_offset_],
+              reinterpret_cast<char*>(&temp[block_begin]),
+              blocks[i].data_size_,
+              expected_size);
+          CHECK_EQ(static_cast<size_t>(decompressed_size), expected_size);
+        }
         CHECK_EQ(memcmp(image_data, &temp[0], image_data_size), 0) << image_storage_mode_;
       }
     }
@@ -65,6 +65,7 @@
 #include "profile/profile_compilation_info.h"
 #include "quicken_info.h"
 #include "scoped_thread_state_change-inl.h"
+#include "thread_pool.h"
 #include "utils/dex_cache_arrays_layout-inl.h"
 #include "vdex_file.h"
 #include "verifier/verifier_deps.h"
@@ -89,6 +90,13 @@ static constexpr bool kOatWriterForceOatCodeLayout = false;
 
 static constexpr bool kOatWriterDebugOatCodeLayout = false;
 
+// Look up the targets of the linker patches of the compiled code on multiple threads before
+// writing the code, for oat files with at least kMinMethodsForParallelPatchResolution methods.
+// Each task of the thread pool resolves the patches of kPatchResolutionChunkSize methods.
+static constexpr bool kParallelPatchResolution = true;
+static constexpr size_t kMinMethodsForParallelPatchResolution = 1024u;
+static constexpr size_t kPatchResolutionChunkSize = 64u;
+
 typedef DexFile::Header __attribute__((aligned(1))) UnalignedDexFileHeader;
 
 const UnalignedDexFileHeader* AsUnalignedDexFileHeader(const uint8_t* raw_data) {
@@ -439,7 +447,9 @@ OatWriter::OatWriter(const CompilerOptions& compiler_options,
     relative_patcher_(nullptr),
     absolute_patch_locations_(),
     profile_compilation_info_(info),
-    compact_dex_level_(compact_dex_level) {
+    compact_dex_level_(compact_dex_level),
+    min_methods_for_parallel_patch_resolution_(kMinMethodsForParallelPatchResolution),
+    patch_resolution_chunk_size_(kPatchResolutionChunkSize) {
   // If we have a profile, always use at least the default compact dex level. The reason behind
   // this is that CompactDex conversion is not more expensive than normal dexlayout.
   if (info != nullptr && compact_dex_level_ == CompactDexLevel::kCompactDexLevelNone) {
@@ -1119,6 +1129,11 @@ class OatWriter::OrderedMethodVisitor {
     return std::move(ordered_methods_);
   }
 
+ protected:
+  const OrderedMethodList& GetOrderedMethods() const {
+    return ordered_methods_;
+  }
+
  private:
   // List of compiled methods, sorted by the order defined in OrderedMethodData.
   // Methods can be inserted more than once in case of duplicated methods.
@@ -1784,102 +1799,14 @@ class OatWriter::WriteCodeMethodVisitor : public OrderedMethodVisitor {
       if (!compiled_method->GetPatches().empty()) {
         patched_code_.assign(quick_code.begin(), quick_code.end());
         quick_code = ArrayRef<const uint8_t>(patched_code_);
-        for (const LinkerPatch& patch : compiled_method->GetPatches()) {
-          uint32_t literal_offset = patch.LiteralOffset();
-          switch (patch.GetType()) {
-            case LinkerPatch::Type::kMethodBssEntry: {
-              uint32_t target_offset =
-                  writer_->bss_start_ + writer_->bss_method_entries_.Get(patch.TargetMethod());
-              writer_->relative_patcher_->PatchPcRelativeReference(&patched_code_,
-                                                                   patch,
-                                                                   offset_ + literal_offset,
-                                                                   target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kCallRelative: {
-              // NOTE: Relative calls across oat files are not supported.
-              uint32_t target_offset = GetTargetOffset(patch);
-              writer_->relative_patcher_->PatchCall(&patched_code_,
-                                                    literal_offset,
-                                                    offset_ + literal_offset,
-                                                    target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kStringRelative: {
-              uint32_t target_offset = GetTargetObjectOffset(GetTargetString(patch));
-              writer_->relative_patcher_->PatchPcRelativeReference(&patched_code_,
-                                                                   patch,
-                                                                   offset_ + literal_offset,
-                                                                   target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kStringInternTable: {
-              uint32_t target_offset = GetInternTableEntryOffset(patch);
-              writer_->relative_patcher_->PatchPcRelativeReference(&patched_code_,
-                                                                   patch,
-                                                                   offset_ + literal_offset,
-                                                                   target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kStringBssEntry: {
-              StringReference ref(patch.TargetStringDexFile(), patch.TargetStringIndex());
-              uint32_t target_offset =
-                  writer_->bss_start_ + writer_->bss_string_entries_.Get(ref);
-              writer_->relative_patcher_->PatchPcRelativeReference(&patched_code_,
-                                                                   patch,
-                                                                   offset_ + literal_offset,
-                                                                   target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kTypeRelative: {
-              uint32_t target_offset = GetTargetObjectOffset(GetTargetType(patch));
-              writer_->relative_patcher_->PatchPcRelativeReference(&patched_code_,
-                                                                   patch,
-                                                                   offset_ + literal_offset,
-                                                                   target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kTypeClassTable: {
-              uint32_t target_offset = GetClassTableEntryOffset(patch);
-              writer_->relative_patcher_->PatchPcRelativeReference(&patched_code_,
-                                                                   patch,
-                                                                   offset_ + literal_offset,
-                                                                   target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kTypeBssEntry: {
-              TypeReference ref(patch.TargetTypeDexFile(), patch.TargetTypeIndex());
-              uint32_t target_offset = writer_->bss_start_ + writer_->bss_type_entries_.Get(ref);
-              writer_->relative_patcher_->PatchPcRelativeReference(&patched_code_,
-                                                                   patch,
-                                                                   offset_ + literal_offset,
-                                                                   target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kCall: {
-              uint32_t target_offset = GetTargetOffset(patch);
-              PatchCodeAddress(&patched_code_, literal_offset, target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kMethodRelative: {
-              uint32_t target_offset = GetTargetMethodOffset(GetTargetMethod(patch));
-              writer_->relative_patcher_->PatchPcRelativeReference(&patched_code_,
-                                                                   patch,
-                                                                   offset_ + literal_offset,
-                                                                   target_offset);
-              break;
-            }
-            case LinkerPatch::Type::kBakerReadBarrierBranch: {
-              writer_->relative_patcher_->PatchBakerReadBarrierBranch(&patched_code_,
-                                                                      patch,
-                                                                      offset_ + literal_offset);
-              break;
-            }
-            default: {
-              DCHECK(false) << "Unexpected linker patch type: " << patch.GetType();
-              break;
-            }
-          }
+        ArrayRef<const LinkerPatch> patches = compiled_method->GetPatches();
+        const uint32_t* resolved_targets = GetResolvedPatchTargets(method_data);
+        for (size_t i = 0; i != patches.size(); ++i) {
+          const LinkerPatch& patch = patches[i];
+          uint32_t target_offset = (resolved_targets != nullptr)
+              ? resolved_targets[i]
+              : GetPatchTargetOffset(patch);
+          ApplyPatch(patch, target_offset);
         }
       }
 
@@ -1899,7 +1826,147 @@ class OatWriter::WriteCodeMethodVisitor : public OrderedMethodVisitor {
     return offset_;
   }
 
+  // Look up the targets of the patches of all ordered methods with `thread_pool` ahead of
+  // writing, `chunk_size` methods at a time. These lookups are most of the cost of patching; the
+  // patches themselves are still applied in order by VisitMethod because the thunk bookkeeping of
+  // the relative patchers depends on what has been written so far.
+  void ResolvePatchTargets(ThreadPool* thread_pool, size_t thread_count, size_t chunk_size)
+      REQUIRES_SHARED(Locks::mutator_lock_) {
+    const OrderedMethodList& ordered_methods = GetOrderedMethods();
+    patch_target_starts_.clear();
+    patch_target_starts_.reserve(ordered_methods.size() + 1u);
+    size_t num_patches = 0u;
+    for (const OrderedMethodData& method_data : ordered_methods) {
+      patch_target_starts_.push_back(num_patches);
+      num_patches += method_data.compiled_method->GetPatches().size();
+    }
+    patch_target_starts_.push_back(num_patches);
+    patch_targets_.resize(num_patches);
+
+    Thread* self = Thread::Current();
+    AtomicInteger next_chunk(0);
+    const size_t num_chunks = RoundUp(ordered_methods.size(), chunk_size) / chunk_size;
+    for (size_t i = 0; i != thread_count; ++i) {
+      thread_pool->AddTask(self, new FunctionTask([=, &next_chunk](Thread* worker) {
+        ScopedObjectAccess soa(worker);
+        // The visitor caches the dex file and dex cache of the current method, so each thread
+        // needs its own.
+        WriteCodeMethodVisitor resolver(writer_,
+                                        /* out */ nullptr,
+                                        /* file_offset */ 0u,
+                                        /* relative_offset */ 0u,
+                                        OrderedMethodList());
+        const OrderedMethodList& methods = GetOrderedMethods();
+        for (size_t chunk = static_cast<size_t>(next_chunk.fetch_add(1));
+             chunk < num_chunks;
+             chunk = static_cast<size_t>(next_chunk.fetch_add(1))) {
+          size_t begin = chunk * chunk_size;
+          size_t end = std::min(begin + chunk_size, methods.size());
+          for (size_t index = begin; index != end; ++index) {
+            const CompiledMethod* compiled_method = methods[index].compiled_method;
+            ArrayRef<const LinkerPatch> patches = compiled_method->GetPatches();
+            if (patches.empty()) {
+              continue;
+            }
+            resolver.UpdateDexFileAndDexCache(methods[index].method_reference.dex_file);
+            uint32_t* targets = &patch_targets_[patch_target_starts_[index]];
+            for (size_t i = 0; i != patches.size(); ++i) {
+              targets[i] = resolver.GetPatchTargetOffset(patches[i]);
+            }
+          }
+        }
+      }));
+    }
+    thread_pool->StartWorkers(self);
+    thread_pool->Wait(self, /* do_work */ true, /* may_hold_locks */ true);
+    thread_pool->StopWorkers(self);
+  }
+
  private:
+  // Returns the patch targets found by ResolvePatchTargets for `method_data`, or null if they
+  // need to be looked up now.
+  const uint32_t* GetResolvedPatchTargets(const OrderedMethodData& method_data) const {
+    if (patch_targets_.empty()) {
+      return nullptr;
+    }
+    size_t index = &method_data - GetOrderedMethods().data();
+    DCHECK_LT(index + 1u, patch_target_starts_.size());
+    return patch_targets_.data() + patch_target_starts_[index];
+  }
+
+  uint32_t GetPatchTargetOffset(const LinkerPatch& patch) REQUIRES_SHARED(Locks::mutator_lock_) {
+    switch (patch.GetType()) {
+      case LinkerPatch::Type::kMethodBssEntry:
+        return writer_->bss_start_ + writer_->bss_method_entries_.Get(patch.TargetMethod());
+      case LinkerPatch::Type::kCallRelative:
+        // NOTE: Relative calls across oat files are not supported.
+      case LinkerPatch::Type::kCall:
+        return GetTargetOffset(patch);
+      case LinkerPatch::Type::kStringRelative:
+        return GetTargetObjectOffset(GetTargetString(patch));
+      case LinkerPatch::Type::kStringInternTable:
+        return GetInternTableEntryOffset(patch);
+      case LinkerPatch::Type::kStringBssEntry: {
+        StringReference ref(patch.TargetStringDexFile(), patch.TargetStringIndex());
+        return writer_->bss_start_ + writer_->bss_string_entries_.Get(ref);
+      }
+      case LinkerPatch::Type::kTypeRelative:
+        return GetTargetObjectOffset(GetTargetType(patch));
+      case LinkerPatch::Type::kTypeClassTable:
+        return GetClassTableEntryOffset(patch);
+      case LinkerPatch::Type::kTypeBssEntry: {
+        TypeReference ref(patch.TargetTypeDexFile(), patch.TargetTypeIndex());
+        return writer_->bss_start_ + writer_->bss_type_entries_.Get(ref);
+      }
+      case LinkerPatch::Type::kMethodRelative:
+        return GetTargetMethodOffset(GetTargetMethod(patch));
+      case LinkerPatch::Type::kBakerReadBarrierBranch:
+        // No target, the thunk is found by the relative patcher.
+        return 0u;
+      default:
+        DCHECK(false) << "Unexpected linker patch type: " << patch.GetType();
+        return 0u;
+    }
+  }
+
+  // Apply `patch` to patched_code_, for the code of the method being written at offset_.
+  void ApplyPatch(const LinkerPatch& patch, uint32_t target_offset)
+      REQUIRES_SHARED(Locks::mutator_lock_) {
+    uint32_t literal_offset = patch.LiteralOffset();
+    switch (patch.GetType()) {
+      case LinkerPatch::Type::kCallRelative:
+        writer_->relative_patcher_->PatchCall(&patched_code_,
+                                              literal_offset,
+                                              offset_ + literal_offset,
+                                              target_offset);
+        break;
+      case LinkerPatch::Type::kCall:
+        PatchCodeAddress(&patched_code_, literal_offset, target_offset);
+        break;
+      case LinkerPatch::Type::kBakerReadBarrierBranch:
+        writer_->relative_patcher_->PatchBakerReadBarrierBranch(&patched_code_,
+                                                                patch,
+                                                                offset_ + literal_offset);
+        break;
+      case LinkerPatch::Type::kMethodBssEntry:
+      case LinkerPatch::Type::kStringRelative:
+      case LinkerPatch::Type::kStringInternTable:
+      case LinkerPatch::Type::kStringBssEntry:
+      case LinkerPatch::Type::kTypeRelative:
+      case LinkerPatch::Type::kTypeClassTable:
+      case LinkerPatch::Type::kTypeBssEntry:
+      case LinkerPatch::Type::kMethodRelative:
+        writer_->relative_patcher_->PatchPcRelativeReference(&patched_code_,
+                                                             patch,
+                                                             offset_ + literal_offset,
+                                                             target_offset);
+        break;
+      default:
+        DCHECK(false) << "Unexpected linker patch type: " << patch.GetType();
+        break;
+    }
+  }
+
   OatWriter* const writer_;
 
   // Updated in VisitMethod as methods are written out.
@@ -1919,6 +1986,10 @@ class OatWriter::WriteCodeMethodVisitor : public OrderedMethodVisitor {
   ClassLinker* const class_linker_;
   ObjPtr<mirror::DexCache> dex_cache_;
   std::vector<uint8_t> patched_code_;
+  // Patch targets filled by ResolvePatchTargets, indexed through patch_target_starts_ by the
+  // position of the method in the ordered method list. Empty if targets are looked up on demand.
+  std::vector<uint32_t> patch_targets_;
+  std::vector<size_t> patch_target_starts_;
   const ScopedAssertNoThreadSuspension no_thread_suspension_;
 
   void ReportWriteFailure(const char* what, const MethodReference& method_ref) {
@@ -3304,19 +3375,34 @@ size_t OatWriter::WriteCodeDexFiles(OutputStream* out,
 
     return relative_offset;
   }
-  ScopedObjectAccess soa(Thread::Current());
   DCHECK(ordered_methods_ != nullptr);
-  std::unique_ptr<OrderedMethodList> ordered_methods_ptr =
-      std::move(ordered_methods_);
-  WriteCodeMethodVisitor visitor(this,
-                                 out,
-                                 file_offset,
-                                 relative_offset,
-                                 std::move(*ordered_methods_ptr));
-  if (UNLIKELY(!visitor.Visit())) {
-    return 0;
+  // Create the workers before taking the mutator lock.
+  std::unique_ptr<ThreadPool> thread_pool;
+  size_t thread_count = (compiler_driver_ != nullptr) ? compiler_driver_->GetThreadCount() : 1u;
+  if (kParallelPatchResolution &&
+      thread_count > 1u &&
+      ordered_methods_->size() >= min_methods_for_parallel_patch_resolution_) {
+    // The current thread also does work in ThreadPool::Wait.
+    thread_pool.reset(new ThreadPool("Oat code patch resolution thread pool", thread_count - 1u));
+  }
+  {
+    ScopedObjectAccess soa(Thread::Current());
+    std::unique_ptr<OrderedMethodList> ordered_methods_ptr =
+        std::move(ordered_methods_);
+    WriteCodeMethodVisitor visitor(this,
+                                   out,
+                                   file_offset,
+                                   relative_offset,
+                                   std::move(*ordered_methods_ptr));
+    if (thread_pool != nullptr) {
+      TimingLogger::ScopedTiming split("ResolvePatchTargets", timings_);
+      visitor.ResolvePatchTargets(thread_pool.get(), thread_count, patch_resolution_chunk_size_);
+    }
+    if (UNLIKELY(!visitor.Visit())) {
+      return 0;
+    }
+    relative_offset = visitor.GetOffset();
   }
-  relative_offset = visitor.GetOffset();
 
   size_code_alignment_ += relative_patcher_->CodeAlignmentSize();
   size_relative_call_thunks_ += relative_patcher_->RelativeCallThunksSize();
@@ -4380,7 +4466,9 @@ bool OatWriter::OatClass::Write(OatWriter* oat_writer, OutputStream* out) const
 
 const uint8_t* OatWriter::LookupBootImageInternTableSlot(const DexFile& dex_file,
                                                          dex::StringIndex string_idx)
-    NO_THREAD_SAFETY_ANALYSIS {  // Single-threaded OatWriter can avoid locking.
+    NO_THREAD_SAFETY_ANALYSIS {
+  // OatWriter can avoid locking, the boot image intern table does not change while writing and
+  // concurrent lookups from ResolvePatchTargets only read it.
   uint32_t utf16_length;
   const char* utf8_data = dex_file.StringDataAndUtf16LengthByIdx(string_idx, &utf16_length);
   DCHECK_EQ(utf16_length, CountModifiedUtf8Chars(utf8_data));
@@ -4388,9 +4476,9 @@ const uint8_t* OatWriter::LookupBootImageInternTableSlot(const DexFile& dex_file
                                  utf8_data,
                                  ComputeUtf16HashFromModifiedUtf8(utf8_data, utf16_length));
   const InternTable* intern_table = Runtime::Current()->GetClassLinker()->intern_table_;
-  for (const InternTable::Table::UnorderedSet& table : intern_table->strong_interns_.tables_) {
-    auto it = table.find(string);
-    if (it != table.end()) {
+  for (const InternTable::Table::UnorderedSet* table : intern_table->strong_interns_.GetSets()) {
+    auto it = table->find(string);
+    if (it != table->end()) {
       return reinterpret_cast<const uint8_t*>(std::addressof(*it));
     }
   }
@@ -4400,13 +4488,14 @@ const uint8_t* OatWriter::LookupBootImageInternTableSlot(const DexFile& dex_file
 
 const uint8_t* OatWriter::LookupBootImageClassTableSlot(const DexFile& dex_file,
                                                         dex::TypeIndex type_idx)
-    NO_THREAD_SAFETY_ANALYSIS {  // Single-threaded OatWriter can avoid locking.
+    NO_THREAD_SAFETY_ANALYSIS {
+  // OatWriter can avoid locking, see LookupBootImageInternTableSlot.
   const char* descriptor = dex_file.StringByTypeIdx(type_idx);
   ClassTable::DescriptorHashPair pair(descriptor, ComputeModifiedUtf8Hash(descriptor));
   ClassTable* table = Runtime::Current()->GetClassLinker()->boot_class_table_.get();
-  for (const ClassTable::ClassSet& class_set : table->classes_) {
-    auto it = class_set.find(pair);
-    if (it != class_set.end()) {
+  for (const ClassTable::ClassSet* class_set : table->GetSets()) {
+    auto it = class_set->find(pair);
+    if (it != class_set->end()) {
       return reinterpret_cast<const uint8_t*>(std::addressof(*it));
     }
   }
@@ -245,6 +245,15 @@ class OatWriter {
     return compiler_options_;
   }
 
+  // Resolve the patch targets on multiple threads for oat files with at least `min_methods`
+  // methods, in chunks of `chunk_size` methods. For testing the parallel and serial paths on
+  // small inputs.
+  void SetParallelPatchResolutionForTesting(size_t min_methods, size_t chunk_size) {
+    DCHECK_NE(chunk_size, 0u);
+    min_methods_for_parallel_patch_resolution_ = min_methods;
+    patch_resolution_chunk_size_ = chunk_size;
+  }
+
  private:
   class DexFileSource;
   class OatClassHeader;
@@ -516,6 +525,10 @@ class OatWriter {
   // Compact dex level that is generated.
   CompactDexLevel compact_dex_level_;
 
+  // When and how WriteCode resolves the patch targets on multiple threads.
+  size_t min_methods_for_parallel_patch_resolution_;
+  size_t patch_resolution_chunk_size_;
+
   using OrderedMethodList = std::vector<OrderedMethodData>;
 
   // List of compiled methods, sorted by the order defined in OrderedMethodData.
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <limits>
+
 #include "android-base/stringprintf.h"
 
 #include "arch/instruction_set_features.h"
@@ -161,11 +163,43 @@ class OatTest : public CommonCompilerTest {
     return DoWriteElf(vdex_file, oat_file, oat_writer, key_value_store, verify);
   }
 
+  // Writes the oat file with the patch targets resolved on multiple threads for at least
+  // `min_methods` methods, in chunks of `chunk_size` methods. The oat writer is initialized with
+  // the compiled `dex_files` rather than the copies opened from the vdex file, so that the oat
+  // file contains their code.
+  bool WriteElfWithPatchResolution(File* vdex_file,
+                                   File* oat_file,
+                                   const std::vector<const DexFile*>& dex_files,
+                                   SafeMap<std::string, std::string>& key_value_store,
+                                   size_t min_methods,
+                                   size_t chunk_size) {
+    TimingLogger timings("WriteElf", false, false);
+    ClearBootImageOption();
+    OatWriter oat_writer(*compiler_options_,
+                         &timings,
+                         /*profile_compilation_info*/nullptr,
+                         CompactDexLevel::kCompactDexLevelNone);
+    oat_writer.SetParallelPatchResolutionForTesting(min_methods, chunk_size);
+    for (const DexFile* dex_file : dex_files) {
+      ArrayRef<const uint8_t> raw_dex_file(
+          reinterpret_cast<const uint8_t*>(&dex_file->GetHeader()),
+          dex_file->GetHeader().file_size_);
+      if (!oat_writer.AddRawDexFileSource(raw_dex_file,
+                                          dex_file->GetLocation().c_str(),
+                                          dex_file->GetLocationChecksum())) {
+        return false;
+      }
+    }
+    return DoWriteElf(
+        vdex_file, oat_file, oat_writer, key_value_store, /* verify */ false, &dex_files);
+  }
+
   bool DoWriteElf(File* vdex_file,
                   File* oat_file,
                   OatWriter& oat_writer,
                   SafeMap<std::string, std::string>& key_value_store,
-                  bool verify) {
+                  bool verify,
+                  const std::vector<const DexFile*>* compiled_dex_files = nullptr) {
     std::unique_ptr<ElfWriter> elf_writer = CreateElfWriterQuick(
         compiler_driver_->GetCompilerOptions(),
         oat_file);
@@ -196,7 +230,9 @@ class OatTest : public CommonCompilerTest {
     MultiOatRelativePatcher patcher(compiler_options_->GetInstructionSet(),
                                     compiler_options_->GetInstructionSetFeatures(),
                                     compiler_driver_->GetCompiledMethodStorage());
-    oat_writer.Initialize(compiler_driver_.get(), nullptr, dex_files);
+    oat_writer.Initialize(compiler_driver_.get(),
+                          nullptr,
+                          (compiled_dex_files != nullptr) ? *compiled_dex_files : dex_files);
     oat_writer.PrepareLayout(&patcher);
     size_t rodata_size = oat_writer.GetOatHeader().GetExecutableOffset();
     size_t text_size = oat_writer.GetOatSize() - rodata_size;
@@ -543,6 +579,82 @@ TEST_F(OatTest, EmptyTextSection) {
             static_cast<size_t>(tmp_oat.GetFile()->GetLength()));
 }
 
+TEST_F(OatTest, ParallelPatchResolution) {
+  TimingLogger timings("OatTest::ParallelPatchResolution", false, false);
+  SetupCompiler(std::vector<std::string>());
+  ASSERT_GT(compiler_driver_->GetThreadCount(), 1u);
+
+  jobject class_loader;
+  {
+    ScopedObjectAccess soa(Thread::Current());
+    class_loader = LoadDex("ManyMethods");
+  }
+  ASSERT_TRUE(class_loader != nullptr);
+  std::vector<const DexFile*> dex_files = GetDexFiles(class_loader);
+  ASSERT_TRUE(!dex_files.empty());
+
+  ClassLinker* const class_linker = Runtime::Current()->GetClassLinker();
+  for (const DexFile* dex_file : dex_files) {
+    ScopedObjectAccess soa(Thread::Current());
+    class_linker->RegisterDexFile(*dex_file,
+                                  soa.Decode<mirror::ClassLoader>(class_loader).Ptr());
+  }
+  SetDexFilesForOatFile(dex_files);
+  compiler_driver_->CompileAll(class_loader, dex_files, &timings);
+
+  // Write the same compiled code with the patch targets resolved while writing, and resolved
+  // ahead of writing on multiple threads, one method at a time.
+  ScratchFile serial_base, serial_oat(serial_base, ".oat"), serial_vdex(serial_base, ".vdex");
+  SafeMap<std::string, std::string> key_value_store;
+  key_value_store.Put(OatHeader::kImageLocationKey, "test.art");
+  bool success = WriteElfWithPatchResolution(serial_vdex.GetFile(),
+                                             serial_oat.GetFile(),
+                                             dex_files,
+                                             key_value_store,
+                                             /* min_methods */ std::numeric_limits<size_t>::max(),
+                                             /* chunk_size */ 1u);
+  ASSERT_TRUE(success);
+  ScratchFile parallel_base, parallel_oat(parallel_base, ".oat");
+  ScratchFile parallel_vdex(parallel_base, ".vdex");
+  success = WriteElfWithPatchResolution(parallel_vdex.GetFile(),
+                                        parallel_oat.GetFile(),
+                                        dex_files,
+                                        key_value_store,
+                                        /* min_methods */ 0u,
+                                        /* chunk_size */ 1u);
+  ASSERT_TRUE(success);
+
+  std::string error_msg;
+  std::unique_ptr<OatFile> serial_oat_file(OatFile::Open(/* zip_fd */ -1,
+                                                         serial_oat.GetFilename(),
+                                                         serial_oat.GetFilename(),
+                                                         nullptr,
+                                                         nullptr,
+                                                         false,
+                                                         /*low_4gb*/false,
+                                                         nullptr,
+                                                         &error_msg));
+  ASSERT_TRUE(serial_oat_file != nullptr) << error_msg;
+  std::unique_ptr<OatFile> parallel_oat_file(OatFile::Open(/* zip_fd */ -1,
+                                                           parallel_oat.GetFilename(),
+                                                           parallel_oat.GetFilename(),
+                                                           nullptr,
+                                                           nullptr,
+                                                           false,
+                                                           /*low_4gb*/false,
+                                                           nullptr,
+                                                           &error_msg));
+  ASSERT_TRUE(parallel_oat_file != nullptr) << error_msg;
+
+  // The oat files contain code, and the patched code is the same.
+  const size_t executable_offset = serial_oat_file->GetOatHeader().GetExecutableOffset();
+  ASSERT_LT(executable_offset, serial_oat_file->Size());
+  ASSERT_EQ(serial_oat_file->Size(), parallel_oat_file->Size());
+  EXPECT_EQ(0, memcmp(serial_oat_file->Begin() + executable_offset,
+                      parallel_oat_file->Begin() + executable_offset,
+                      serial_oat_file->Size() - executable_offset));
+}
+
 static void MaybeModifyDexFileToFail(bool verify, std::unique_ptr<const DexFile>& data) {
   // If in verify mode (= fail the verifier mode), make sure we fail early. We'll fail already
   // because of the missing map, but that may lead to out of bounds reads.
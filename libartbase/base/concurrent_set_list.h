@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_LIBARTBASE_BASE_CONCURRENT_SET_LIST_H_
+#define ART_LIBARTBASE_BASE_CONCURRENT_SET_LIST_H_
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <android-base/logging.h>
+
+#include "base/atomic.h"
+#include "base/macros.h"
+
+namespace art {
+
+// A list of hash sets which can be searched without the lock serializing its writers.
+//
+// The elements are kept in a list of frozen sets (e.g. the sets read from an image, or the sets
+// frozen when the zygote forks to avoid dirtying their pages), which are no longer inserted into,
+// and in a live set receiving the inserts. The frozen sets are published as a linked list and the
+// live set is never resized in place: when it is full it is copied into a set twice as large,
+// which is published with a release store. The replaced set is retired, since concurrent readers
+// may still be searching it, and is only freed by FreeRetiredSets(). As the live set doubles when
+// it grows, the retired sets take less memory than the live set.
+//
+// Inserting, including growing the live set, cannot make a concurrent search miss an element
+// inserted before the search. Freezing the live set and erasing (which shifts slots back) can.
+//
+// All the methods but GetSets(), Find() and FindWithHash() must be serialized by the owner.
+template <class Set>
+class ConcurrentSetList {
+ public:
+  using ValueType = typename Set::value_type;
+
+  // Minimum number of elements the live set is grown to.
+  static constexpr size_t kMinLiveSetSize = 64u;
+
+  explicit ConcurrentSetList(Set* live_set)
+      : frozen_sets_(nullptr),
+        last_frozen_set_(nullptr),
+        live_set_(live_set),
+        num_retired_sets_at_previous_free_(0u) {}
+
+  ~ConcurrentSetList() {
+    FrozenSet* frozen = frozen_sets_.load(std::memory_order_relaxed);
+    while (frozen != nullptr) {
+      FrozenSet* next = frozen->next.load(std::memory_order_relaxed);
+      delete frozen;
+      frozen = next;
+    }
+    delete live_set_.load(std::memory_order_relaxed);
+  }
+
+  Set* GetLiveSet() const {
+    return live_set_.load(std::memory_order_acquire);
+  }
+
+  // Return the frozen sets followed by the live set.
+  std::vector<Set*> GetSets() const {
+    std::vector<Set*> sets;
+    for (FrozenSet* frozen = frozen_sets_.load(std::memory_order_acquire);
+         frozen != nullptr;
+         frozen = frozen->next.load(std::memory_order_acquire)) {
+      sets.push_back(frozen->set.get());
+    }
+    sets.push_back(GetLiveSet());
+    return sets;
+  }
+
+  // Return the first element equal to `key` in the sets, or null.
+  template <typename K>
+  ValueType* Find(const K& key) const {
+    return FindInSets([&key](Set* set) { return set->find(key); });
+  }
+
+  template <typename K>
+  ValueType* FindWithHash(const K& key, size_t hash) const {
+    return FindInSets([&key, hash](Set* set) { return set->FindWithHash(key, hash); });
+  }
+
+  // Add a frozen set before the other ones. Takes ownership of `set`.
+  void PrependFrozenSet(Set* set) {
+    FrozenSet* frozen = new FrozenSet(set);
+    frozen->next.store(frozen_sets_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // Publish the set after it has been fully constructed.
+    frozen_sets_.store(frozen, std::memory_order_release);
+    if (last_frozen_set_ == nullptr) {
+      last_frozen_set_ = frozen;
+    }
+  }
+
+  // Freeze the live set, after the other frozen sets, and replace it with `new_live_set`. A
+  // concurrent search may miss the elements of the live set in both places.
+  void FreezeLiveSet(Set* new_live_set) {
+    FrozenSet* frozen = new FrozenSet(live_set_.load(std::memory_order_relaxed));
+    if (last_frozen_set_ == nullptr) {
+      frozen_sets_.store(frozen, std::memory_order_release);
+    } else {
+      last_frozen_set_->next.store(frozen, std::memory_order_release);
+    }
+    last_frozen_set_ = frozen;
+    live_set_.store(new_live_set, std::memory_order_release);
+  }
+
+  // Return the live set to insert one element into, after replacing it with a larger copy if it
+  // is full.
+  Set* GetLiveSetForInsert() {
+    Set* live_set = live_set_.load(std::memory_order_relaxed);
+    if (live_set->size() < live_set->ElementsUntilExpand()) {
+      return live_set;
+    }
+    // Growing the set in place would free the buckets under concurrent searches.
+    std::unique_ptr<Set> grown(new Set(live_set->GetMinLoadFactor(), live_set->GetMaxLoadFactor()));
+    grown->reserve(std::max<size_t>(2u * live_set->size(), kMinLiveSetSize));
+    for (const ValueType& element : *live_set) {
+      grown->insert(element);
+    }
+    retired_sets_.emplace_back(live_set);
+    live_set_.store(grown.get(), std::memory_order_release);
+    return grown.release();
+  }
+
+  size_t GetNumRetiredSets() const {
+    return retired_sets_.size();
+  }
+
+  // Free the retired sets. No concurrent search may be in progress.
+  void FreeRetiredSets() {
+    retired_sets_.clear();
+    num_retired_sets_at_previous_free_ = 0u;
+  }
+
+  // Free the sets which were retired before the previous call. For owners which cannot stop the
+  // concurrent searches but know that the searches in progress at the previous call are done.
+  void FreeSetsRetiredBeforePreviousCall() {
+    DCHECK_LE(num_retired_sets_at_previous_free_, retired_sets_.size());
+    retired_sets_.erase(retired_sets_.begin(),
+                        retired_sets_.begin() + num_retired_sets_at_previous_free_);
+    num_retired_sets_at_previous_free_ = retired_sets_.size();
+  }
+
+ private:
+  struct FrozenSet {
+    explicit FrozenSet(Set* s) : set(s), next(nullptr) {}
+
+    std::unique_ptr<Set> set;
+    Atomic<FrozenSet*> next;
+  };
+
+  template <typename FindFn>
+  ValueType* FindInSets(const FindFn& find) const {
+    for (FrozenSet* frozen = frozen_sets_.load(std::memory_order_acquire);
+         frozen != nullptr;
+         frozen = frozen->next.load(std::memory_order_acquire)) {
+      auto it = find(frozen->set.get());
+      if (it != frozen->set->end()) {
+        return &*it;
+      }
+    }
+    Set* live_set = GetLiveSet();
+    auto it = find(live_set);
+    return (it != live_set->end()) ? &*it : nullptr;
+  }
+
+  // Head of the list of frozen sets.
+  Atomic<FrozenSet*> frozen_sets_;
+  FrozenSet* last_frozen_set_;
+  // The set receiving the inserts.
+  Atomic<Set*> live_set_;
+  // Live sets replaced by a larger copy, which concurrent searches may still be reading.
+  std::vector<std::unique_ptr<Set>> retired_sets_;
+  size_t num_retired_sets_at_previous_free_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConcurrentSetList);
+};
+
+}  // namespace art
+
+#endif  // ART_LIBARTBASE_BASE_CONCURRENT_SET_LIST_H_
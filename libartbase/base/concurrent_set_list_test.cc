@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "concurrent_set_list.h"
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "hash_set.h"
+
+namespace art {
+
+using StringSet = HashSet<std::string>;
+
+TEST(ConcurrentSetListTest, FrozenAndLiveSets) {
+  ConcurrentSetList<StringSet> sets(new StringSet());
+  sets.GetLiveSetForInsert()->insert("live");
+  StringSet* image_set = new StringSet();
+  image_set->insert("image");
+  sets.PrependFrozenSet(image_set);
+  StringSet* live_set = sets.GetLiveSet();
+  sets.FreezeLiveSet(new StringSet());
+  sets.GetLiveSetForInsert()->insert("new");
+
+  std::vector<StringSet*> all_sets = sets.GetSets();
+  ASSERT_EQ(3u, all_sets.size());
+  EXPECT_EQ(image_set, all_sets[0]);
+  EXPECT_EQ(live_set, all_sets[1]);
+  EXPECT_EQ(sets.GetLiveSet(), all_sets[2]);
+  for (const char* str : { "image", "live", "new" }) {
+    std::string* found = sets.Find(std::string(str));
+    ASSERT_TRUE(found != nullptr) << str;
+    EXPECT_EQ(str, *found);
+  }
+  EXPECT_TRUE(sets.Find(std::string("missing")) == nullptr);
+}
+
+TEST(ConcurrentSetListTest, GrowByCopy) {
+  ConcurrentSetList<StringSet> sets(new StringSet());
+  StringSet* initial_set = sets.GetLiveSet();
+  static constexpr size_t kNumStrings = 1000u;
+  for (size_t i = 0; i != kNumStrings; ++i) {
+    sets.GetLiveSetForInsert()->insert(std::to_string(i));
+  }
+  EXPECT_NE(initial_set, sets.GetLiveSet());
+  EXPECT_EQ(kNumStrings, sets.GetLiveSet()->size());
+  ASSERT_EQ(1u, sets.GetSets().size());
+  const size_t num_retired_sets = sets.GetNumRetiredSets();
+  ASSERT_NE(0u, num_retired_sets);
+  for (size_t i = 0; i != kNumStrings; ++i) {
+    EXPECT_TRUE(sets.Find(std::to_string(i)) != nullptr) << i;
+  }
+
+  // Only the sets retired before the previous call are freed.
+  sets.FreeSetsRetiredBeforePreviousCall();
+  EXPECT_EQ(num_retired_sets, sets.GetNumRetiredSets());
+  for (size_t i = kNumStrings; i != 4u * kNumStrings; ++i) {
+    sets.GetLiveSetForInsert()->insert(std::to_string(i));
+  }
+  const size_t num_new_retired_sets = sets.GetNumRetiredSets() - num_retired_sets;
+  ASSERT_NE(0u, num_new_retired_sets);
+  sets.FreeSetsRetiredBeforePreviousCall();
+  EXPECT_EQ(num_new_retired_sets, sets.GetNumRetiredSets());
+  sets.FreeRetiredSets();
+  EXPECT_EQ(0u, sets.GetNumRetiredSets());
+  EXPECT_EQ(4u * kNumStrings, sets.GetLiveSet()->size());
+}
+
+}  // namespace art
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "indexed_profile.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "android-base/file.h"
+#include "android-base/stringprintf.h"
+
+#include "base/bit_utils.h"
+#include "base/logging.h"
+#include "base/systrace.h"
+#include "dex/dex_file_types.h"
+
+namespace art {
+
+using android::base::StringPrintf;
+
+const uint8_t IndexedProfile::kIndexedProfileMagic[] = { 'p', 'r', 'i', '\0' };
+const uint8_t IndexedProfile::kIndexedProfileVersion[] = { '0', '0', '1', '\0' };
+
+struct IndexedProfile::Header {
+  uint8_t magic[4];
+  uint8_t version[4];
+  uint32_t number_of_dex_files;
+  uint32_t file_size;
+};
+
+// All offsets are from the start of the file.
+struct IndexedProfile::DexFileEntry {
+  uint32_t checksum;
+  uint32_t num_method_ids;
+  uint32_t profile_key_offset;
+  uint32_t profile_key_size;
+  uint32_t hot_methods_offset;
+  uint32_t num_hot_methods;
+  uint32_t classes_offset;
+  uint32_t num_classes;
+  uint32_t bitmap_offset;
+  uint32_t bitmap_size;
+};
+
+static_assert(sizeof(IndexedProfile::kIndexedProfileMagic) == 4u, "Unexpected magic size");
+static_assert(sizeof(IndexedProfile::kIndexedProfileVersion) == 4u, "Unexpected version size");
+
+bool IndexedProfile::IsIndexedProfile(int fd) {
+  uint8_t magic[sizeof(kIndexedProfileMagic)];
+  if (TEMP_FAILURE_RETRY(pread(fd, magic, sizeof(magic), 0)) != sizeof(magic)) {
+    return false;
+  }
+  return memcmp(magic, kIndexedProfileMagic, sizeof(magic)) == 0;
+}
+
+bool IndexedProfile::Write(const ProfileCompilationInfo& info, int fd) {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  const uint32_t number_of_dex_files = static_cast<uint32_t>(info.info_.size());
+  std::vector<DexFileEntry> entries(number_of_dex_files);
+
+  // Lay out the sections: the uint16_t arrays first so that they stay aligned, then the bitmaps
+  // and the profile keys.
+  size_t offset = sizeof(Header) + number_of_dex_files * sizeof(DexFileEntry);
+  for (uint32_t i = 0; i != number_of_dex_files; ++i) {
+    const ProfileCompilationInfo::DexFileData* dex_data = info.info_[i];
+    DexFileEntry& entry = entries[i];
+    entry.checksum = dex_data->checksum;
+    entry.num_method_ids = dex_data->num_method_ids;
+    entry.hot_methods_offset = offset;
+    entry.num_hot_methods = dex_data->method_map.size();
+    offset += entry.num_hot_methods * sizeof(uint16_t);
+    entry.classes_offset = offset;
+    entry.num_classes = dex_data->class_set.size();
+    offset += entry.num_classes * sizeof(uint16_t);
+  }
+  for (uint32_t i = 0; i != number_of_dex_files; ++i) {
+    entries[i].bitmap_offset = offset;
+    entries[i].bitmap_size = info.info_[i]->bitmap_storage.size();
+    offset += entries[i].bitmap_size;
+  }
+  for (uint32_t i = 0; i != number_of_dex_files; ++i) {
+    entries[i].profile_key_offset = offset;
+    entries[i].profile_key_size = info.info_[i]->profile_key.size();
+    offset += entries[i].profile_key_size;
+  }
+  if (offset > std::numeric_limits<uint32_t>::max()) {
+    LOG(ERROR) << "Profile too large for the indexed format: " << offset;
+    return false;
+  }
+
+  std::vector<uint8_t> buffer(offset);
+  Header header;
+  memcpy(header.magic, kIndexedProfileMagic, sizeof(header.magic));
+  memcpy(header.version, kIndexedProfileVersion, sizeof(header.version));
+  header.number_of_dex_files = number_of_dex_files;
+  header.file_size = static_cast<uint32_t>(offset);
+  memcpy(buffer.data(), &header, sizeof(header));
+  if (number_of_dex_files != 0u) {
+    memcpy(buffer.data() + sizeof(header),
+           entries.data(),
+           number_of_dex_files * sizeof(DexFileEntry));
+  }
+  for (uint32_t i = 0; i != number_of_dex_files; ++i) {
+    const ProfileCompilationInfo::DexFileData* dex_data = info.info_[i];
+    const DexFileEntry& entry = entries[i];
+    // The method map and the class set are ordered, so the arrays come out sorted.
+    uint16_t* hot_methods = reinterpret_cast<uint16_t*>(buffer.data() + entry.hot_methods_offset);
+    for (const auto& method_it : dex_data->method_map) {
+      *hot_methods++ = method_it.first;
+    }
+    uint16_t* classes = reinterpret_cast<uint16_t*>(buffer.data() + entry.classes_offset);
+    for (dex::TypeIndex type_index : dex_data->class_set) {
+      *classes++ = type_index.index_;
+    }
+    std::copy(dex_data->bitmap_storage.begin(),
+              dex_data->bitmap_storage.end(),
+              buffer.begin() + entry.bitmap_offset);
+    std::copy(dex_data->profile_key.begin(),
+              dex_data->profile_key.end(),
+              buffer.begin() + entry.profile_key_offset);
+  }
+  return android::base::WriteFully(fd, buffer.data(), buffer.size());
+}
+
+std::unique_ptr<IndexedProfile> IndexedProfile::Open(int fd,
+                                                     const std::string& location,
+                                                     /*out*/ std::string* error) {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  struct stat stat_buffer;
+  if (fstat(fd, &stat_buffer) != 0) {
+    *error = StringPrintf("Failed to stat %s: %s", location.c_str(), strerror(errno));
+    return nullptr;
+  }
+  const size_t file_size = static_cast<size_t>(stat_buffer.st_size);
+  if (file_size < sizeof(Header)) {
+    *error = StringPrintf("Profile %s too small for an indexed profile: %zu",
+                          location.c_str(),
+                          file_size);
+    return nullptr;
+  }
+  std::unique_ptr<MemMap> map(MemMap::MapFile(file_size,
+                                              PROT_READ,
+                                              MAP_PRIVATE,
+                                              fd,
+                                              /* start */ 0,
+                                              /* low_4gb */ false,
+                                              location.c_str(),
+                                              error));
+  if (map == nullptr) {
+    return nullptr;
+  }
+
+  const Header* header = reinterpret_cast<const Header*>(map->Begin());
+  if (memcmp(header->magic, kIndexedProfileMagic, sizeof(header->magic)) != 0) {
+    *error = "Profile missing indexed profile magic: " + location;
+    return nullptr;
+  }
+  if (memcmp(header->version, kIndexedProfileVersion, sizeof(header->version)) != 0) {
+    *error = "Indexed profile version mismatch: " + location;
+    return nullptr;
+  }
+  if (header->file_size != file_size) {
+    *error = StringPrintf("Indexed profile %s has unexpected size: %zu, expected %u",
+                          location.c_str(),
+                          file_size,
+                          header->file_size);
+    return nullptr;
+  }
+  const uint32_t number_of_dex_files = header->number_of_dex_files;
+  const size_t entries_end =
+      sizeof(Header) + static_cast<size_t>(number_of_dex_files) * sizeof(DexFileEntry);
+  if (number_of_dex_files > file_size / sizeof(DexFileEntry) || entries_end > file_size) {
+    *error = StringPrintf("Indexed profile %s has too many dex files: %u",
+                          location.c_str(),
+                          number_of_dex_files);
+    return nullptr;
+  }
+
+  // Check that all sections are within the file, so that AddTo() does not need to.
+  const DexFileEntry* entries =
+      reinterpret_cast<const DexFileEntry*>(map->Begin() + sizeof(Header));
+  auto in_file = [entries_end, file_size](uint32_t offset, uint64_t size) {
+    return offset >= entries_end && offset <= file_size && size <= file_size - offset;
+  };
+  for (uint32_t i = 0; i != number_of_dex_files; ++i) {
+    const DexFileEntry& entry = entries[i];
+    const uint64_t bitmap_size =
+        ProfileCompilationInfo::DexFileData::ComputeBitmapStorage(entry.num_method_ids);
+    if (!IsAligned<alignof(uint16_t)>(entry.hot_methods_offset) ||
+        !IsAligned<alignof(uint16_t)>(entry.classes_offset) ||
+        !in_file(entry.hot_methods_offset, uint64_t{entry.num_hot_methods} * sizeof(uint16_t)) ||
+        !in_file(entry.classes_offset, uint64_t{entry.num_classes} * sizeof(uint16_t)) ||
+        !in_file(entry.bitmap_offset, entry.bitmap_size) ||
+        !in_file(entry.profile_key_offset, entry.profile_key_size) ||
+        entry.bitmap_size != bitmap_size ||
+        entry.profile_key_size == 0u) {
+      *error = StringPrintf("Indexed profile %s has an invalid entry for dex file %u",
+                            location.c_str(),
+                            i);
+      return nullptr;
+    }
+  }
+
+  // The arrays are added to ordered containers and the method indexes are used as bitmap
+  // indexes, check that the arrays are sorted without duplicates and that the method indexes
+  // are valid.
+  std::unique_ptr<IndexedProfile> indexed_profile(
+      new IndexedProfile(std::move(map), entries, number_of_dex_files));
+  auto is_strictly_sorted = [](ArrayRef<const uint16_t> array) {
+    return std::adjacent_find(array.begin(), array.end(), std::greater_equal<uint16_t>()) ==
+        array.end();
+  };
+  for (uint32_t i = 0; i != number_of_dex_files; ++i) {
+    const DexFileEntry& entry = entries[i];
+    ArrayRef<const uint16_t> hot_methods = indexed_profile->GetHotMethods(entry);
+    if (!is_strictly_sorted(hot_methods) ||
+        (!hot_methods.empty() && hot_methods.back() >= entry.num_method_ids)) {
+      *error = StringPrintf("Indexed profile %s has invalid hot methods for dex file %u",
+                            location.c_str(),
+                            i);
+      return nullptr;
+    }
+    if (!is_strictly_sorted(indexed_profile->GetClasses(entry))) {
+      *error = StringPrintf("Indexed profile %s has invalid classes for dex file %u",
+                            location.c_str(),
+                            i);
+      return nullptr;
+    }
+  }
+  return indexed_profile;
+}
+
+IndexedProfile::IndexedProfile(std::unique_ptr<MemMap>&& map,
+                               const DexFileEntry* entries,
+                               uint32_t number_of_dex_files)
+    : map_(std::move(map)),
+      entries_(entries),
+      number_of_dex_files_(number_of_dex_files) {}
+
+ArrayRef<const uint16_t> IndexedProfile::GetHotMethods(const DexFileEntry& entry) const {
+  return ArrayRef<const uint16_t>(
+      reinterpret_cast<const uint16_t*>(map_->Begin() + entry.hot_methods_offset),
+      entry.num_hot_methods);
+}
+
+ArrayRef<const uint16_t> IndexedProfile::GetClasses(const DexFileEntry& entry) const {
+  return ArrayRef<const uint16_t>(
+      reinterpret_cast<const uint16_t*>(map_->Begin() + entry.classes_offset),
+      entry.num_classes);
+}
+
+ArrayRef<const uint8_t> IndexedProfile::GetBitmap(const DexFileEntry& entry) const {
+  return ArrayRef<const uint8_t>(map_->Begin() + entry.bitmap_offset, entry.bitmap_size);
+}
+
+ArrayRef<const char> IndexedProfile::GetProfileKey(const DexFileEntry& entry) const {
+  return ArrayRef<const char>(
+      reinterpret_cast<const char*>(map_->Begin() + entry.profile_key_offset),
+      entry.profile_key_size);
+}
+
+bool IndexedProfile::AddTo(ProfileCompilationInfo* info,
+                           bool merge_classes,
+                           const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn) const {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  for (uint32_t i = 0; i != number_of_dex_files_; ++i) {
+    const DexFileEntry& entry = entries_[i];
+    ArrayRef<const char> key_data = GetProfileKey(entry);
+    const std::string profile_key(key_data.begin(), key_data.end());
+    if (!filter_fn(profile_key, entry.checksum)) {
+      continue;
+    }
+    ProfileCompilationInfo::DexFileData* dex_data =
+        info->GetOrAddDexFileData(profile_key, entry.checksum, entry.num_method_ids);
+    if (dex_data == nullptr) {
+      return false;
+    }
+    for (uint16_t method_index : GetHotMethods(entry)) {
+      if (dex_data->FindOrAddMethod(method_index) == nullptr) {
+        return false;
+      }
+    }
+    if (merge_classes) {
+      // The classes are sorted, so inserting at the end is the common case.
+      for (uint16_t type_index : GetClasses(entry)) {
+        dex_data->class_set.insert(dex_data->class_set.end(), dex::TypeIndex(type_index));
+      }
+    }
+    ArrayRef<const uint8_t> bitmap = GetBitmap(entry);
+    DCHECK_EQ(bitmap.size(), dex_data->bitmap_storage.size());
+    for (size_t j = 0; j != bitmap.size(); ++j) {
+      dex_data->bitmap_storage[j] |= bitmap[j];
+    }
+  }
+  return true;
+}
+
+}  // namespace art
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_LIBPROFILE_PROFILE_INDEXED_PROFILE_H_
+#define ART_LIBPROFILE_PROFILE_INDEXED_PROFILE_H_
+
+#include <memory>
+#include <string>
+
+#include "base/array_ref.h"
+#include "base/macros.h"
+#include "base/mem_map.h"
+#include "profile/profile_compilation_info.h"
+
+namespace art {
+
+/**
+ * A profile stored in the indexed format.
+ *
+ * Unlike the format written by ProfileCompilationInfo::Save(), the indexed format is not
+ * compressed: the hot methods and the classes of each dex file are stored as sorted arrays of
+ * indexes next to the method bitmap. ProfileCompilationInfo::Load() maps the file and adds the
+ * arrays to its containers (see AddTo()) without inflating anything, which makes large profiles
+ * (e.g. boot image profiles) faster to load. Inline caches are not stored.
+ *
+ * Layout (see Write()):
+ *   header: magic, version, number_of_dex_files, file_size
+ *   dex file table: number_of_dex_files fixed size entries with the checksum, the number of
+ *       method ids and the offsets and sizes of the arrays below
+ *   the sorted hot method indexes (uint16_t) and class indexes (uint16_t) of each dex file
+ *   the method bitmap of each dex file (startup bits, then post-startup bits)
+ *   the profile key of each dex file
+ */
+class IndexedProfile {
+ public:
+  static const uint8_t kIndexedProfileMagic[];
+  static const uint8_t kIndexedProfileVersion[];
+
+  // Return true if the file starts with the indexed profile magic. Does not change the offset
+  // of the file descriptor.
+  static bool IsIndexedProfile(int fd);
+
+  // Write the profile in the indexed format. Inline caches are dropped.
+  static bool Write(const ProfileCompilationInfo& info, int fd);
+
+  // Map the indexed profile stored in the given file. Returns null and sets `error` if the file
+  // is not a valid indexed profile.
+  static std::unique_ptr<IndexedProfile> Open(int fd,
+                                              const std::string& location,
+                                              /*out*/ std::string* error);
+
+  uint32_t GetNumberOfDexFiles() const {
+    return number_of_dex_files_;
+  }
+
+  // Add the data of this profile to `info`, keeping only the dex files accepted by `filter_fn`
+  // and the classes if `merge_classes` is set. Returns false if the data does not match what
+  // `info` already contains.
+  bool AddTo(ProfileCompilationInfo* info,
+             bool merge_classes,
+             const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn) const;
+
+ private:
+  struct Header;
+  struct DexFileEntry;
+
+  IndexedProfile(std::unique_ptr<MemMap>&& map,
+                 const DexFileEntry* entries,
+                 uint32_t number_of_dex_files);
+
+  ArrayRef<const uint16_t> GetHotMethods(const DexFileEntry& entry) const;
+  ArrayRef<const uint16_t> GetClasses(const DexFileEntry& entry) const;
+  ArrayRef<const uint8_t> GetBitmap(const DexFileEntry& entry) const;
+  ArrayRef<const char> GetProfileKey(const DexFileEntry& entry) const;
+
+  std::unique_ptr<MemMap> map_;
+  const DexFileEntry* const entries_;
+  const uint32_t number_of_dex_files_;
+
+  DISALLOW_COPY_AND_ASSIGN(IndexedProfile);
+};
+
+}  // namespace art
+
+#endif  // ART_LIBPROFILE_PROFILE_INDEXED_PROFILE_H_
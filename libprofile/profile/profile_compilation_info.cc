@@ -46,14 +46,15 @@
 #include "base/utils.h"
 #include "base/zip_archive.h"
 #include "dex/dex_file_loader.h"
+#include "indexed_profile.h"
 
 namespace art {
 
 const uint8_t ProfileCompilationInfo::kProfileMagic[] = { 'p', 'r', 'o', '\0' };
-// Last profile version: merge profiles directly from the file without creating
-// profile_compilation_info object. All the profile line headers are now placed together
-// before corresponding method_encodings and class_ids.
-const uint8_t ProfileCompilationInfo::kProfileVersion[] = { '0', '1', '0', '\0' };
+// Last profile version: a file may hold several profile sections one after the other, see
+// Append(). Older readers would fail on the second section, the version makes them treat such
+// files as obsolete.
+const uint8_t ProfileCompilationInfo::kProfileVersion[] = { '0', '1', '1', '\0' };
 
 // The name of the profile entry in the dex metadata file.
 // DO NOT CHANGE THIS! (it's similar to classes.dex in the apk files).
@@ -289,6 +290,53 @@ bool ProfileCompilationInfo::Save(const std::string& filename, uint64_t* bytes_w
   return result;
 }
 
+bool ProfileCompilationInfo::Append(const std::string& filename,
+                                    uint64_t expected_file_size,
+                                    /*out*/ uint64_t* file_size) {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  std::string error;
+  int flags = O_WRONLY | O_NOFOLLOW | O_CLOEXEC;
+  // As for Save(), there's no need to fsync the appended data.
+  ScopedFlock profile_file = LockedFile::Open(filename.c_str(), flags,
+                                              /*block*/false, &error);
+  if (profile_file.get() == nullptr) {
+    LOG(WARNING) << "Couldn't lock the profile file " << filename << ": " << error;
+    return false;
+  }
+
+  // The file may have been rewritten or cleared by somebody else (e.g. profman) since the caller
+  // last saw it. The caller then needs to merge with the new content instead.
+  int64_t size = profile_file->GetLength();
+  if (size < 0 || static_cast<uint64_t>(size) != expected_file_size) {
+    VLOG(profiler) << "Not appending to profile " << filename << " of unexpected size " << size
+                   << ", expected " << expected_file_size;
+    return false;
+  }
+
+  int fd = profile_file->Fd();
+  if (lseek(fd, 0, SEEK_END) != size) {
+    PLOG(WARNING) << "Could not seek to the end of profile file: " << filename;
+    return false;
+  }
+  if (!Save(fd)) {
+    // Do not leave a partial section behind, that would make the whole file unreadable.
+    if (profile_file->SetLength(size) != 0) {
+      PLOG(WARNING) << "Could not truncate profile file: " << filename;
+    }
+    VLOG(profiler) << "Failed to append profile info to " << filename;
+    return false;
+  }
+  size = profile_file->GetLength();
+  if (size < 0) {
+    PLOG(WARNING) << "Could not get the size of profile file: " << filename;
+    return false;
+  }
+  VLOG(profiler) << "Successfully appended profile info to " << filename
+                 << " Size: " << size << " (" << (size - expected_file_size) << " new)";
+  *file_size = static_cast<uint64_t>(size);
+  return true;
+}
+
 // Returns true if all the bytes were successfully written to the file descriptor.
 static bool WriteBuffer(int fd, const uint8_t* buffer, size_t byte_count) {
   while (byte_count > 0) {
@@ -340,6 +388,8 @@ static constexpr size_t kLineHeaderSize =
  *    M stands for megamorphic or missing types and it's encoded as either
  *    the byte kIsMegamorphicEncoding or kIsMissingTypesEncoding.
  *    When present, there will be no class ids following.
+ * A profile file may hold several such profiles one after the other (see Append()); the data
+ * of all of them is merged when loading the file.
  **/
 bool ProfileCompilationInfo::Save(int fd) {
   uint64_t start = NanoTime();
@@ -1236,9 +1286,18 @@ ProfileCompilationInfo::ProfileLoadStatus ProfileCompilationInfo::ProfileSource:
 }
 
 bool ProfileCompilationInfo::ProfileSource::HasConsumedAllData() const {
-  return IsMemMap()
-      ? (mem_map_ == nullptr || mem_map_cur_ == mem_map_->Size())
-      : (testEOF(fd_) == 0);
+  if (IsMemMap()) {
+    return mem_map_ == nullptr || mem_map_cur_ == mem_map_->Size();
+  }
+  // Check the position against the file size, so that no data is consumed if there are more
+  // sections to read. Fall back to reading for descriptors which cannot seek.
+  off_t position = lseek(fd_, 0, SEEK_CUR);
+  struct stat stat_buffer;
+  if (position != static_cast<off_t>(-1) && fstat(fd_, &stat_buffer) == 0 &&
+      S_ISREG(stat_buffer.st_mode)) {
+    return position >= stat_buffer.st_size;
+  }
+  return testEOF(fd_) == 0;
 }
 
 bool ProfileCompilationInfo::ProfileSource::HasEmptyContent() const {
@@ -1253,6 +1312,15 @@ bool ProfileCompilationInfo::ProfileSource::HasEmptyContent() const {
   }
 }
 
+// Return the path of the file opened as `fd`, for error messages.
+static std::string GetProfileLocation(int32_t fd) {
+  std::string location;
+  if (!android::base::Readlink("/proc/self/fd/" + std::to_string(fd), &location)) {
+    location = "<profile fd " + std::to_string(fd) + ">";
+  }
+  return location;
+}
+
 // TODO(calin): fail fast if the dex checksums don't match.
 ProfileCompilationInfo::ProfileLoadStatus ProfileCompilationInfo::LoadInternal(
       int32_t fd,
@@ -1262,6 +1330,20 @@ ProfileCompilationInfo::ProfileLoadStatus ProfileCompilationInfo::LoadInternal(
   ScopedTrace trace(__PRETTY_FUNCTION__);
   DCHECK_GE(fd, 0);
 
+  // Profiles in the indexed format are mapped and copied directly into the containers.
+  if (IndexedProfile::IsIndexedProfile(fd)) {
+    std::unique_ptr<IndexedProfile> indexed_profile =
+        IndexedProfile::Open(fd, GetProfileLocation(fd), error);
+    if (indexed_profile == nullptr) {
+      return kProfileLoadBadData;
+    }
+    if (!indexed_profile->AddTo(this, merge_classes, filter_fn)) {
+      *error = "Indexed profile does not match the loaded data";
+      return kProfileLoadBadData;
+    }
+    return kProfileLoadSuccess;
+  }
+
   std::unique_ptr<ProfileSource> source;
   ProfileLoadStatus status = OpenSource(fd, &source, error);
   if (status != kProfileLoadSuccess) {
@@ -1275,15 +1357,36 @@ ProfileCompilationInfo::ProfileLoadStatus ProfileCompilationInfo::LoadInternal(
     return kProfileLoadSuccess;
   }
 
+  // The file holds a profile followed by the sections added by Append(). Each section has the
+  // format of a complete profile and is merged into the data loaded so far.
+  bool first_section = true;
+  do {
+    status = LoadSection(*source, merge_classes, filter_fn, error);
+    if (status != kProfileLoadSuccess) {
+      // A later section which is not a profile is corrupted data, not an obsolete profile.
+      return (!first_section && status == kProfileLoadVersionMismatch)
+          ? kProfileLoadBadData
+          : status;
+    }
+    first_section = false;
+  } while (!source->HasConsumedAllData());
+  return kProfileLoadSuccess;
+}
+
+ProfileCompilationInfo::ProfileLoadStatus ProfileCompilationInfo::LoadSection(
+    ProfileSource& source,
+    bool merge_classes,
+    const ProfileLoadFilterFn& filter_fn,
+    /*out*/ std::string* error) {
   // Read profile header: magic + version + number_of_dex_files.
   uint8_t number_of_dex_files;
   uint32_t uncompressed_data_size;
   uint32_t compressed_data_size;
-  status = ReadProfileHeader(*source,
-                             &number_of_dex_files,
-                             &uncompressed_data_size,
-                             &compressed_data_size,
-                             error);
+  ProfileLoadStatus status = ReadProfileHeader(source,
+                                               &number_of_dex_files,
+                                               &uncompressed_data_size,
+                                               &compressed_data_size,
+                                               error);
 
   if (status != kProfileLoadSuccess) {
     return status;
@@ -1303,17 +1406,12 @@ ProfileCompilationInfo::ProfileLoadStatus ProfileCompilationInfo::LoadInternal(
   }
 
   std::unique_ptr<uint8_t[]> compressed_data(new uint8_t[compressed_data_size]);
-  status = source->Read(compressed_data.get(), compressed_data_size, "ReadContent", error);
+  status = source.Read(compressed_data.get(), compressed_data_size, "ReadContent", error);
   if (status != kProfileLoadSuccess) {
     *error += "Unable to read compressed profile data";
     return status;
   }
 
-  if (!source->HasConsumedAllData()) {
-    *error += "Unexpected data in the profile file.";
-    return kProfileLoadBadData;
-  }
-
   SafeBuffer uncompressed_data(uncompressed_data_size);
 
   int ret = InflateBuffer(compressed_data.get(),
@@ -1551,6 +1649,91 @@ bool ProfileCompilationInfo::MergeWith(const ProfileCompilationInfo& other,
   return true;
 }
 
+size_t ProfileCompilationInfo::HashInlineCache(const InlineCacheMap& inline_cache) const {
+  std::hash<std::string> hash_string;
+  size_t hash = inline_cache.size();
+  for (const auto& ic_it : inline_cache) {
+    const DexPcData& dex_pc_data = ic_it.second;
+    hash = hash * 31u + ic_it.first;
+    hash = hash * 31u + (dex_pc_data.is_missing_types ? 1u : 0u);
+    hash = hash * 31u + (dex_pc_data.is_megamorphic ? 1u : 0u);
+    // The classes are ordered by profile index, combine their hashes independently of the order.
+    size_t classes_hash = 0u;
+    for (const ClassReference& class_ref : dex_pc_data.classes) {
+      const DexFileData* dex_data = info_[class_ref.dex_profile_index];
+      size_t class_hash = hash_string(dex_data->profile_key);
+      class_hash = class_hash * 31u + dex_data->checksum;
+      class_hash = class_hash * 31u + class_ref.type_index.index_;
+      classes_hash += class_hash;
+    }
+    hash = hash * 31u + classes_hash;
+  }
+  return hash;
+}
+
+bool ProfileCompilationInfo::RecordDataIn(SavedDataDigest* digest) const {
+  for (const DexFileData* dex_data : info_) {
+    auto it = digest->dex_files_.find(std::make_pair(dex_data->profile_key, dex_data->checksum));
+    if (it != digest->dex_files_.end() && it->second.num_method_ids != dex_data->num_method_ids) {
+      return false;
+    }
+  }
+
+  for (const DexFileData* dex_data : info_) {
+    SavedDataDigest::DexFileDigest& dex_digest =
+        digest->dex_files_[std::make_pair(dex_data->profile_key, dex_data->checksum)];
+    if (dex_digest.bitmap_storage.empty()) {
+      dex_digest.num_method_ids = dex_data->num_method_ids;
+      dex_digest.bitmap_storage.resize(dex_data->bitmap_storage.size(), 0u);
+    }
+    DCHECK_EQ(dex_digest.bitmap_storage.size(), dex_data->bitmap_storage.size());
+    for (size_t i = 0; i < dex_data->bitmap_storage.size(); ++i) {
+      dex_digest.bitmap_storage[i] |= dex_data->bitmap_storage[i];
+    }
+    for (dex::TypeIndex type_index : dex_data->class_set) {
+      dex_digest.classes.insert(type_index.index_);
+    }
+    for (const auto& method_it : dex_data->method_map) {
+      dex_digest.method_hashes[method_it.first] = HashInlineCache(method_it.second);
+    }
+  }
+  return true;
+}
+
+void ProfileCompilationInfo::RemoveDataPresentIn(const SavedDataDigest& digest) {
+  for (DexFileData* dex_data : info_) {
+    auto dex_it = digest.dex_files_.find(std::make_pair(dex_data->profile_key, dex_data->checksum));
+    if (dex_it == digest.dex_files_.end() ||
+        dex_it->second.num_method_ids != dex_data->num_method_ids) {
+      continue;
+    }
+    const SavedDataDigest::DexFileDigest& dex_digest = dex_it->second;
+
+    for (auto it = dex_data->class_set.begin(); it != dex_data->class_set.end(); ) {
+      if (dex_digest.classes.find(it->index_) != dex_digest.classes.end()) {
+        it = dex_data->class_set.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    for (auto it = dex_data->method_map.begin(); it != dex_data->method_map.end(); ) {
+      auto hash_it = dex_digest.method_hashes.find(it->first);
+      if (hash_it != dex_digest.method_hashes.end() &&
+          hash_it->second == HashInlineCache(it->second)) {
+        it = dex_data->method_map.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    DCHECK_EQ(dex_data->bitmap_storage.size(), dex_digest.bitmap_storage.size());
+    for (size_t i = 0; i < dex_data->bitmap_storage.size(); ++i) {
+      dex_data->bitmap_storage[i] &= ~dex_digest.bitmap_storage[i];
+    }
+  }
+}
+
 const ProfileCompilationInfo::DexFileData* ProfileCompilationInfo::FindDexData(
     const DexFile* dex_file) const {
   return FindDexData(GetProfileDexFileKey(dex_file->GetLocation()),
@@ -17,7 +17,11 @@
 #ifndef ART_LIBPROFILE_PROFILE_PROFILE_COMPILATION_INFO_H_
 #define ART_LIBPROFILE_PROFILE_PROFILE_COMPILATION_INFO_H_
 
+#include <map>
 #include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "base/arena_containers.h"
@@ -353,6 +357,52 @@ class ProfileCompilationInfo {
   // Save the current profile into the given file. The file will be cleared before saving.
   bool Save(const std::string& filename, uint64_t* bytes_written);
 
+  // Append the current profile as a new section at the end of the given file, provided that the
+  // file still has `expected_file_size` bytes. Loading the file merges all its sections, so this
+  // saves new data without rewriting what the file already contains. On success, stores the
+  // size of the file in `file_size`.
+  bool Append(const std::string& filename,
+              uint64_t expected_file_size,
+              /*out*/ uint64_t* file_size);
+
+  // A compact record of the data saved in a profile file: for each dex file, its method bitmap,
+  // its classes and a hash of the inline caches of each method. This is enough to tell which data
+  // of a new profile still needs to be saved, without keeping the whole saved profile around.
+  class SavedDataDigest {
+   public:
+    SavedDataDigest() {}
+
+    size_t GetNumberOfDexFiles() const {
+      return dex_files_.size();
+    }
+
+   private:
+    struct DexFileDigest {
+      uint32_t num_method_ids;
+      std::vector<uint8_t> bitmap_storage;
+      std::unordered_set<uint16_t> classes;
+      // Hash of the inline caches of each method, see HashInlineCache().
+      std::unordered_map<uint16_t, size_t> method_hashes;
+    };
+
+    // Keyed by profile key and dex checksum.
+    std::map<std::pair<std::string, uint32_t>, DexFileDigest> dex_files_;
+
+    friend class ProfileCompilationInfo;
+
+    DISALLOW_COPY_AND_ASSIGN(SavedDataDigest);
+  };
+
+  // Record the data of this profile in `digest`, as saved along with the data it already
+  // records. Returns false, without changing `digest`, if a dex file has a different number of
+  // method ids in `digest`.
+  bool RecordDataIn(SavedDataDigest* digest) const;
+
+  // Remove the data that is already recorded in `digest`, so that only the new data remains. A
+  // method is new if its inline caches differ from the last ones recorded for it. Dex files are
+  // kept, even if they end up without data, since inline caches may refer to them.
+  void RemoveDataPresentIn(const SavedDataDigest& digest);
+
   // Return the number of methods that were profiled.
   uint32_t GetNumberOfMethods() const;
 
@@ -582,6 +632,10 @@ class ProfileCompilationInfo {
   // Add all classes from the given dex cache to the the profile.
   bool AddResolvedClasses(const DexCacheResolvedClasses& classes);
 
+  // Hash an inline cache of this profile. The hash does not depend on the profile indexes of the
+  // dex files, so hashes from different profiles can be compared.
+  size_t HashInlineCache(const InlineCacheMap& inline_cache) const;
+
   // Encode the known dex_files into a vector. The index of a dex_reference will
   // be the same as the profile index of the dex file (used to encode the ClassReferences).
   void DexFileToProfileIndex(/*out*/std::vector<DexReference>* dex_references) const;
@@ -724,6 +778,13 @@ class ProfileCompilationInfo {
       bool merge_classes = true,
       const ProfileLoadFilterFn& filter_fn = ProfileFilterFnAcceptAll);
 
+  // Load one profile section (header and compressed data) from the current position of the
+  // source and merge it into the current profile.
+  ProfileLoadStatus LoadSection(ProfileSource& source,
+                                bool merge_classes,
+                                const ProfileLoadFilterFn& filter_fn,
+                                /*out*/ std::string* error);
+
   // Read the profile header from the given fd and store the number of profile
   // lines into number_of_dex_files.
   ProfileLoadStatus ReadProfileHeader(ProfileSource& source,
@@ -798,6 +859,7 @@ class ProfileCompilationInfo {
   friend class CompilerDriverProfileTest;
   friend class ProfileAssistantTest;
   friend class Dex2oatLayoutTest;
+  friend class IndexedProfile;
 
   MallocArenaPool default_arena_pool_;
   ArenaAllocator allocator_;
@@ -29,6 +29,7 @@
 #include "linear_alloc.h"
 #include "mirror/class-inl.h"
 #include "mirror/class_loader.h"
+#include "profile/indexed_profile.h"
 #include "profile/profile_compilation_info.h"
 #include "scoped_thread_state_change-inl.h"
 #include "ziparchive/zip_writer.h"
@@ -425,6 +426,142 @@ TEST_F(ProfileCompilationInfoTest, SaveFd) {
   ASSERT_TRUE(loaded_info2.Equals(saved_info));
 }
 
+TEST_F(ProfileCompilationInfoTest, Append) {
+  ScratchFile profile;
+
+  ProfileCompilationInfo saved_info;
+  for (uint16_t i = 0; i < 10; i++) {
+    ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, /* method_idx */ i, &saved_info));
+  }
+  ProfileCompilationInfo::OfflineProfileMethodInfo pmi = GetOfflineProfileMethodInfo();
+  ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, /* method_idx */ 8, pmi, &saved_info));
+  ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, /* method_idx */ 9, pmi, &saved_info));
+  uint64_t bytes_written = 0;
+  ASSERT_TRUE(saved_info.Save(profile.GetFilename(), &bytes_written));
+  ASSERT_GT(bytes_written, 0u);
+  ProfileCompilationInfo::SavedDataDigest digest;
+  ASSERT_TRUE(saved_info.RecordDataIn(&digest));
+  ASSERT_EQ(3u, digest.GetNumberOfDexFiles());
+
+  // A dex file with a different number of methods cannot be recorded.
+  ProfileCompilationInfo mismatched_info;
+  ASSERT_TRUE(mismatched_info.AddMethodIndex(
+      Hotness::kFlagHot, "dex_location1", /* checksum */ 1, /* method_idx */ 0, kMaxMethodIds - 1));
+  ASSERT_TRUE(AddMethod("dex_location4", /* checksum */ 4, /* method_idx */ 0, &mismatched_info));
+  ASSERT_FALSE(mismatched_info.RecordDataIn(&digest));
+  ASSERT_EQ(3u, digest.GetNumberOfDexFiles());
+
+  // Keep only what is not in the file yet. Method 8 has the same inline caches as in the file,
+  // method 9 new ones.
+  ProfileCompilationInfo new_info;
+  for (uint16_t i = 5; i < 20; i++) {
+    ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, /* method_idx */ i, &new_info));
+    ASSERT_TRUE(AddMethod("dex_location2", /* checksum */ 2, /* method_idx */ i, &new_info));
+  }
+  ProfileCompilationInfo::OfflineProfileMethodInfo pmi_megamorphic =
+      GetOfflineProfileMethodInfo();
+  MakeMegamorphic(&pmi_megamorphic);
+  ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, /* method_idx */ 8, pmi, &new_info));
+  ASSERT_TRUE(
+      AddMethod("dex_location1", /* checksum */ 1, /* method_idx */ 9, pmi_megamorphic, &new_info));
+  new_info.RemoveDataPresentIn(digest);
+  ASSERT_EQ(26u, new_info.GetNumberOfMethods());
+  ASSERT_TRUE(new_info.GetMethod("dex_location1", /* checksum */ 1, /* method_idx */ 9) != nullptr);
+  ASSERT_TRUE(new_info.GetMethod("dex_location1", /* checksum */ 1, /* method_idx */ 8) == nullptr);
+  ASSERT_TRUE(new_info.RecordDataIn(&digest));
+
+  // Appending fails if the file does not have the expected size.
+  uint64_t file_size = 0;
+  ASSERT_FALSE(new_info.Append(profile.GetFilename(), bytes_written + 1u, &file_size));
+  ASSERT_TRUE(new_info.Append(profile.GetFilename(), bytes_written, &file_size));
+  ASSERT_GT(file_size, bytes_written);
+
+  // Check that loading the file merges both sections.
+  ASSERT_TRUE(saved_info.MergeWith(new_info));
+  ProfileCompilationInfo loaded_info;
+  ASSERT_TRUE(profile.GetFile()->ResetOffset());
+  ASSERT_TRUE(loaded_info.Load(GetFd(profile)));
+  ASSERT_TRUE(loaded_info.Equals(saved_info));
+}
+
+TEST_F(ProfileCompilationInfoTest, IndexedProfile) {
+  ScratchFile profile;
+
+  ProfileCompilationInfo saved_info;
+  for (uint16_t i = 0; i < 10; i++) {
+    ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, /* method_idx */ 2 * i, &saved_info));
+    ASSERT_TRUE(AddClass("dex_location2", /* checksum */ 2, dex::TypeIndex(3 * i), &saved_info));
+  }
+  ASSERT_TRUE(saved_info.AddMethodIndex(
+      Hotness::kFlagStartup, "dex_location2", /* checksum */ 2, /* method_idx */ 7, kMaxMethodIds));
+  ASSERT_TRUE(IndexedProfile::Write(saved_info, GetFd(profile)));
+  ASSERT_TRUE(IndexedProfile::IsIndexedProfile(GetFd(profile)));
+
+  std::string error;
+  std::unique_ptr<IndexedProfile> indexed_profile =
+      IndexedProfile::Open(GetFd(profile), profile.GetFilename(), &error);
+  ASSERT_TRUE(indexed_profile != nullptr) << error;
+  ASSERT_EQ(2u, indexed_profile->GetNumberOfDexFiles());
+
+  // Loading an indexed profile gives back the same data, minus the inline caches.
+  ProfileCompilationInfo loaded_info;
+  ASSERT_TRUE(profile.GetFile()->ResetOffset());
+  ASSERT_TRUE(loaded_info.Load(GetFd(profile)));
+  ASSERT_TRUE(loaded_info.Equals(saved_info));
+  for (uint16_t i = 0; i < 20; i++) {
+    Hotness hotness = loaded_info.GetMethodHotness("dex_location1", /* checksum */ 1, i);
+    ASSERT_EQ(i % 2 == 0, hotness.IsHot());
+    ASSERT_FALSE(hotness.IsStartup());
+  }
+  Hotness startup = loaded_info.GetMethodHotness("dex_location2", /* checksum */ 2, 7);
+  ASSERT_TRUE(startup.IsStartup());
+  ASSERT_FALSE(startup.IsHot());
+  ASSERT_FALSE(loaded_info.GetMethodHotness("dex_location1", /* checksum */ 3, 0).IsHot());
+  ASSERT_EQ(10u, loaded_info.GetNumberOfResolvedClasses());
+}
+
+TEST_F(ProfileCompilationInfoTest, IndexedProfileRejectsInvalidIndexes) {
+  ScratchFile profile;
+
+  // Distinctive indexes, so that the test can find them in the file.
+  static constexpr uint16_t kMethods[] = { 0x1234u, 0x4321u };
+  static constexpr uint16_t kClasses[] = { 0x2345u, 0x5432u };
+  ProfileCompilationInfo info;
+  for (size_t i = 0; i != 2u; ++i) {
+    ASSERT_TRUE(AddMethod("dex_location1", /* checksum */ 1, kMethods[i], &info));
+    ASSERT_TRUE(AddClass("dex_location1", /* checksum */ 1, dex::TypeIndex(kClasses[i]), &info));
+  }
+  ASSERT_TRUE(IndexedProfile::Write(info, GetFd(profile)));
+  std::vector<uint8_t> data(profile.GetFile()->GetLength());
+  ASSERT_TRUE(profile.GetFile()->PreadFully(data.data(), data.size(), /* offset */ 0));
+  auto find_array = [&data](const uint16_t (&array)[2]) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(array);
+    return std::search(data.begin(), data.end(), bytes, bytes + sizeof(array)) - data.begin();
+  };
+  const size_t methods_offset = find_array(kMethods);
+  const size_t classes_offset = find_array(kClasses);
+  ASSERT_LT(methods_offset, data.size());
+  ASSERT_LT(classes_offset, data.size());
+
+  auto open_with = [&](size_t offset, const uint16_t (&array)[2]) {
+    EXPECT_TRUE(profile.GetFile()->PwriteFully(array, sizeof(array), offset));
+    std::string error;
+    std::unique_ptr<IndexedProfile> indexed_profile =
+        IndexedProfile::Open(GetFd(profile), profile.GetFilename(), &error);
+    // Restore the valid file.
+    EXPECT_TRUE(profile.GetFile()->PwriteFully(data.data(), data.size(), /* offset */ 0));
+    return indexed_profile != nullptr;
+  };
+  ASSERT_TRUE(open_with(methods_offset, kMethods));
+  // Unsorted or duplicate hot methods.
+  ASSERT_FALSE(open_with(methods_offset, { kMethods[1], kMethods[0] }));
+  ASSERT_FALSE(open_with(methods_offset, { kMethods[0], kMethods[0] }));
+  // A hot method index out of range.
+  ASSERT_FALSE(open_with(methods_offset, { kMethods[0], kMaxMethodIds }));
+  // Unsorted classes.
+  ASSERT_FALSE(open_with(classes_offset, { kClasses[1], kClasses[0] }));
+}
+
 TEST_F(ProfileCompilationInfoTest, AddMethodsAndClassesFail) {
   ScratchFile profile;
 
@@ -16,7 +16,11 @@
 
 #include "profile_assistant.h"
 
+#include <memory>
+#include <thread>
+
 #include "base/os.h"
+#include "base/systrace.h"
 #include "base/unix_file/fd_file.h"
 
 namespace art {
@@ -28,11 +32,93 @@ static constexpr const uint32_t kMinNewMethodsPercentChangeForCompilation = 2;
 static constexpr const uint32_t kMinNewClassesForCompilation = 50;
 static constexpr const uint32_t kMinNewClassesPercentChangeForCompilation = 2;
 
+// Load the profiles in [begin, end) and merge them into `info`.
+static bool LoadAndMergeRange(const std::vector<int>& profile_files_fd,
+                              size_t begin,
+                              size_t end,
+                              const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+                              /*out*/ ProfileCompilationInfo* info) {
+  for (size_t i = begin; i < end; i++) {
+    ProfileCompilationInfo cur_info;
+    if (!cur_info.Load(profile_files_fd[i], /*merge_classes*/ true, filter_fn)) {
+      LOG(WARNING) << "Could not load profile file at index " << i;
+      return false;
+    }
+    if (!info->MergeWith(cur_info)) {
+      LOG(WARNING) << "Could not merge profile file at index " << i;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ProfileAssistant::MergeProfiles(const std::vector<int>& profile_files_fd,
+                                     const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+                                     size_t number_of_threads,
+                                     /*out*/ ProfileCompilationInfo* info) {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  const size_t number_of_profiles = profile_files_fd.size();
+  number_of_threads = std::min(number_of_threads, number_of_profiles);
+  if (number_of_threads <= 1u) {
+    return LoadAndMergeRange(profile_files_fd, 0u, number_of_profiles, filter_fn, info);
+  }
+
+  // Fold a contiguous range of the profiles per thread. Keeping the ranges contiguous and the
+  // merges below ordered gives the same dex file order as a sequential merge.
+  std::vector<std::unique_ptr<ProfileCompilationInfo>> partial_infos(number_of_threads);
+  std::unique_ptr<bool[]> success(new bool[number_of_threads]);
+  std::vector<std::thread> threads;
+  threads.reserve(number_of_threads);
+  for (size_t t = 0; t != number_of_threads; ++t) {
+    partial_infos[t].reset(new ProfileCompilationInfo());
+    const size_t begin = t * number_of_profiles / number_of_threads;
+    const size_t end = (t + 1u) * number_of_profiles / number_of_threads;
+    threads.emplace_back([&, t, begin, end]() {
+      success[t] =
+          LoadAndMergeRange(profile_files_fd, begin, end, filter_fn, partial_infos[t].get());
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (size_t t = 0; t != number_of_threads; ++t) {
+    if (!success[t]) {
+      return false;
+    }
+  }
+
+  // Combine the partial profiles pairwise, each round halving their number. The right hand side
+  // of each merge is released as soon as it has been merged.
+  for (size_t stride = 1u; stride < number_of_threads; stride *= 2u) {
+    threads.clear();
+    for (size_t t = 0; t + stride < number_of_threads; t += 2u * stride) {
+      threads.emplace_back([&, t, stride]() {
+        success[t] = partial_infos[t]->MergeWith(*partial_infos[t + stride]);
+        partial_infos[t + stride].reset();
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    for (size_t t = 0; t + stride < number_of_threads; t += 2u * stride) {
+      if (!success[t]) {
+        LOG(WARNING) << "Could not merge profile files";
+        return false;
+      }
+    }
+  }
+  if (!info->MergeWith(*partial_infos[0])) {
+    LOG(WARNING) << "Could not merge profile files";
+    return false;
+  }
+  return true;
+}
 
 ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfilesInternal(
         const std::vector<ScopedFlock>& profile_files,
         const ScopedFlock& reference_profile_file,
-        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn) {
+        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+        size_t number_of_threads) {
   DCHECK(!profile_files.empty());
 
   ProfileCompilationInfo info;
@@ -47,16 +133,13 @@ ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfilesInternal(
   uint32_t number_of_classes = info.GetNumberOfResolvedClasses();
 
   // Merge all current profiles.
-  for (size_t i = 0; i < profile_files.size(); i++) {
-    ProfileCompilationInfo cur_info;
-    if (!cur_info.Load(profile_files[i]->Fd(), /*merge_classes*/ true, filter_fn)) {
-      LOG(WARNING) << "Could not load profile file at index " << i;
-      return kErrorBadProfiles;
-    }
-    if (!info.MergeWith(cur_info)) {
-      LOG(WARNING) << "Could not merge profile file at index " << i;
-      return kErrorBadProfiles;
-    }
+  std::vector<int> profile_files_fd;
+  profile_files_fd.reserve(profile_files.size());
+  for (const ScopedFlock& profile_file : profile_files) {
+    profile_files_fd.push_back(profile_file->Fd());
+  }
+  if (!MergeProfiles(profile_files_fd, filter_fn, number_of_threads, &info)) {
+    return kErrorBadProfiles;
   }
 
   uint32_t min_change_in_methods_for_compilation = std::max(
@@ -124,7 +207,8 @@ class ScopedFlockList {
 ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfiles(
         const std::vector<int>& profile_files_fd,
         int reference_profile_file_fd,
-        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn) {
+        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+        size_t number_of_threads) {
   DCHECK_GE(reference_profile_file_fd, 0);
 
   std::string error;
@@ -147,13 +231,15 @@ ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfiles(
 
   return ProcessProfilesInternal(profile_files.Get(),
                                  reference_profile_file,
-                                 filter_fn);
+                                 filter_fn,
+                                 number_of_threads);
 }
 
 ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfiles(
         const std::vector<std::string>& profile_files,
         const std::string& reference_profile_file,
-        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn) {
+        const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+        size_t number_of_threads) {
   std::string error;
 
   ScopedFlockList profile_files_list(profile_files.size());
@@ -171,7 +257,8 @@ ProfileAssistant::ProcessingResult ProfileAssistant::ProcessProfiles(
 
   return ProcessProfilesInternal(profile_files_list.Get(),
                                  locked_reference_profile_file,
-                                 filter_fn);
+                                 filter_fn,
+                                 number_of_threads);
 }
 
 }  // namespace art
@@ -51,23 +51,41 @@ class ProfileAssistant {
   // merge of the current profiles and the reference one is insignificant. In
   // this case no file will be updated.
   //
+  // The profiles are loaded and merged with `number_of_threads` threads (see MergeProfiles).
+  //
   static ProcessingResult ProcessProfiles(
       const std::vector<std::string>& profile_files,
       const std::string& reference_profile_file,
       const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn
-          = ProfileCompilationInfo::ProfileFilterFnAcceptAll);
+          = ProfileCompilationInfo::ProfileFilterFnAcceptAll,
+      size_t number_of_threads = 1u);
 
   static ProcessingResult ProcessProfiles(
       const std::vector<int>& profile_files_fd_,
       int reference_profile_file_fd,
       const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn
-          = ProfileCompilationInfo::ProfileFilterFnAcceptAll);
+          = ProfileCompilationInfo::ProfileFilterFnAcceptAll,
+      size_t number_of_threads = 1u);
+
+  // Load the profiles in the given files and merge them into `info`. Returns false if a profile
+  // cannot be loaded or merged.
+  //
+  // With more than one thread, each thread loads and folds a contiguous range of the files into
+  // its own profile, and the partial profiles are then merged pairwise in a tree. At most two
+  // profiles per thread are alive at any time, and since merging keeps the order in which dex
+  // files are first seen, the result is the same as merging the files one by one. `filter_fn`
+  // is called concurrently in that case.
+  static bool MergeProfiles(const std::vector<int>& profile_files_fd,
+                            const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+                            size_t number_of_threads,
+                            /*out*/ ProfileCompilationInfo* info);
 
  private:
   static ProcessingResult ProcessProfilesInternal(
       const std::vector<ScopedFlock>& profile_files,
       const ScopedFlock& reference_profile_file,
-      const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn);
+      const ProfileCompilationInfo::ProfileLoadFilterFn& filter_fn,
+      size_t number_of_threads);
 
   DISALLOW_COPY_AND_ASSIGN(ProfileAssistant);
 };
@@ -16,8 +16,12 @@
 
 #include <gtest/gtest.h>
 
+#include <iostream>
+
 #include "android-base/strings.h"
 #include "art_method-inl.h"
+#include "base/histogram-inl.h"
+#include "base/time_utils.h"
 #include "base/unix_file/fd_file.h"
 #include "base/utils.h"
 #include "common_runtime_test.h"
@@ -26,6 +30,7 @@
 #include "linear_alloc.h"
 #include "mirror/class-inl.h"
 #include "obj_ptr-inl.h"
+#include "profile/indexed_profile.h"
 #include "profile/profile_compilation_info.h"
 #include "profile_assistant.h"
 #include "scoped_thread_state_change-inl.h"
@@ -188,6 +193,40 @@ class ProfileAssistantTest : public CommonRuntimeTest {
     return static_cast<int>(file.GetFd());
   }
 
+  // Create `number_of_profiles` profiles over the same few dex files, each with a different
+  // window of methods and classes.
+  void SetupSyntheticProfiles(size_t number_of_profiles,
+                              uint16_t number_of_methods,
+                              std::vector<std::unique_ptr<ScratchFile>>* profiles,
+                              std::vector<int>* profile_fds) {
+    static constexpr uint32_t kNumberOfDexFiles = 4u;
+    for (size_t i = 0; i != number_of_profiles; ++i) {
+      profiles->emplace_back(new ScratchFile());
+      profile_fds->push_back(GetFd(*profiles->back()));
+      ProfileCompilationInfo info;
+      for (uint32_t dex = 0; dex != kNumberOfDexFiles; ++dex) {
+        // Vary the order in which the dex files are first seen.
+        const uint32_t d = (dex + i) % kNumberOfDexFiles;
+        const std::string dex_location = "location" + std::to_string(d);
+        const uint16_t start =
+            static_cast<uint16_t>((i * 97u) % (kMaxMethodIds - number_of_methods));
+        for (uint16_t m = start; m != start + number_of_methods; ++m) {
+          Hotness::Flag flags = (m % 3u == 0u) ? Hotness::kFlagHot : Hotness::kFlagStartup;
+          ASSERT_TRUE(info.AddMethodIndex(flags, dex_location, d + 1u, m, kMaxMethodIds));
+          ASSERT_TRUE(info.AddClassIndex(dex_location, d + 1u, dex::TypeIndex(m), kMaxMethodIds));
+        }
+      }
+      ASSERT_TRUE(info.Save(profile_fds->back()));
+      ASSERT_EQ(0, profiles->back()->GetFile()->Flush());
+    }
+  }
+
+  void ResetOffsets(const std::vector<std::unique_ptr<ScratchFile>>& profiles) {
+    for (const std::unique_ptr<ScratchFile>& profile : profiles) {
+      ASSERT_TRUE(profile->GetFile()->ResetOffset());
+    }
+  }
+
   void CheckProfileInfo(ScratchFile& file, const ProfileCompilationInfo& info) {
     ProfileCompilationInfo file_info;
     ASSERT_TRUE(file.GetFile()->ResetOffset());
@@ -1294,4 +1333,106 @@ TEST_F(ProfileAssistantTest, CopyAndUpdateProfileKey) {
   }
 }
 
+TEST_F(ProfileAssistantTest, MergeProfilesInParallel) {
+  std::vector<std::unique_ptr<ScratchFile>> profiles;
+  std::vector<int> profile_fds;
+  SetupSyntheticProfiles(/* number_of_profiles */ 13u,
+                         /* number_of_methods */ 200u,
+                         &profiles,
+                         &profile_fds);
+
+  ProfileCompilationInfo expected;
+  ResetOffsets(profiles);
+  ASSERT_TRUE(ProfileAssistant::MergeProfiles(profile_fds,
+                                              ProfileCompilationInfo::ProfileFilterFnAcceptAll,
+                                              /* number_of_threads */ 1u,
+                                              &expected));
+  for (size_t number_of_threads : {2u, 3u, 4u, 16u}) {
+    ProfileCompilationInfo result;
+    ResetOffsets(profiles);
+    ASSERT_TRUE(ProfileAssistant::MergeProfiles(profile_fds,
+                                                ProfileCompilationInfo::ProfileFilterFnAcceptAll,
+                                                number_of_threads,
+                                                &result));
+    ASSERT_TRUE(result.Equals(expected)) << number_of_threads;
+  }
+
+  // A profile with a mismatching checksum makes the merge fail.
+  ScratchFile bad_profile;
+  ProfileCompilationInfo bad_info;
+  ASSERT_TRUE(bad_info.AddMethodIndex(
+      Hotness::kFlagHot, "location0", /* checksum */ 42u, /* method_idx */ 0u, kMaxMethodIds));
+  ASSERT_TRUE(bad_info.Save(GetFd(bad_profile)));
+  ASSERT_TRUE(bad_profile.GetFile()->ResetOffset());
+  profile_fds.push_back(GetFd(bad_profile));
+  ProfileCompilationInfo result;
+  ResetOffsets(profiles);
+  ASSERT_FALSE(ProfileAssistant::MergeProfiles(profile_fds,
+                                               ProfileCompilationInfo::ProfileFilterFnAcceptAll,
+                                               /* number_of_threads */ 4u,
+                                               &result));
+}
+
+TEST_F(ProfileAssistantTest, GenerateIndexedProfileIntoReferenceFd) {
+  ScratchFile profile1;
+  ScratchFile reference_profile;
+  ProfileCompilationInfo info1;
+  SetupProfile("p1", /* checksum */ 1, /* number_of_methods */ 20, /* number_of_classes */ 10,
+      profile1, &info1);
+
+  // The descriptor holds older, longer content which must not remain after the indexed profile.
+  std::vector<uint8_t> old_content(64 * KB, 0xffu);
+  ASSERT_TRUE(reference_profile.GetFile()->WriteFully(old_content.data(), old_content.size()));
+  ASSERT_TRUE(reference_profile.GetFile()->ResetOffset());
+
+  std::vector<std::string> argv_str;
+  argv_str.push_back(GetProfmanCmd());
+  argv_str.push_back("--generate-indexed-profile");
+  argv_str.push_back("--profile-file-fd=" + std::to_string(GetFd(profile1)));
+  argv_str.push_back("--reference-profile-file-fd=" + std::to_string(GetFd(reference_profile)));
+  std::string error;
+  ASSERT_EQ(ExecAndReturnCode(argv_str, &error), 0) << error;
+
+  std::unique_ptr<IndexedProfile> indexed_profile =
+      IndexedProfile::Open(GetFd(reference_profile), reference_profile.GetFilename(), &error);
+  ASSERT_TRUE(indexed_profile != nullptr) << error;
+  ASSERT_EQ(2u, indexed_profile->GetNumberOfDexFiles());
+  ProfileCompilationInfo loaded_info;
+  ASSERT_TRUE(reference_profile.GetFile()->ResetOffset());
+  ASSERT_TRUE(loaded_info.Load(GetFd(reference_profile)));
+  for (uint16_t i = 0; i < 30; i++) {
+    EXPECT_EQ(i < 20,
+              loaded_info.GetMethodHotness("location1p1", /* checksum */ 1, i).IsInProfile());
+  }
+  EXPECT_EQ(info1.GetNumberOfResolvedClasses(), loaded_info.GetNumberOfResolvedClasses());
+}
+
+// A benchmark, which prints the times to stdout. Run with --gtest_also_run_disabled_tests.
+TEST_F(ProfileAssistantTest, DISABLED_MergeProfilesSpeed) {
+  std::vector<std::unique_ptr<ScratchFile>> profiles;
+  std::vector<int> profile_fds;
+  SetupSyntheticProfiles(/* number_of_profiles */ 128u,
+                         /* number_of_methods */ 2000u,
+                         &profiles,
+                         &profile_fds);
+
+  for (size_t number_of_threads : {1u, 8u}) {
+    std::unique_ptr<Histogram<uint64_t>> hist(new Histogram<uint64_t>(
+        ("MergeProfilesSpeedTest" + std::to_string(number_of_threads)).c_str(), 5));
+    for (size_t i = 0; i != 4u; ++i) {
+      ResetOffsets(profiles);
+      ProfileCompilationInfo result;
+      uint64_t start_time = NanoTime();
+      ASSERT_TRUE(ProfileAssistant::MergeProfiles(profile_fds,
+                                                  ProfileCompilationInfo::ProfileFilterFnAcceptAll,
+                                                  number_of_threads,
+                                                  &result));
+      hist->AddValue(NanoTime() - start_time);
+    }
+    Histogram<uint64_t>::CumulativeData data;
+    hist->CreateHistogram(&data);
+    hist->PrintConfidenceIntervals(std::cout, 0.99, data);
+  }
+}
+
 }  // namespace art
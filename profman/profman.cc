@@ -48,6 +48,7 @@
 #include "dex/dex_file_loader.h"
 #include "dex/dex_file_types.h"
 #include "dex/type_reference.h"
+#include "profile/indexed_profile.h"
 #include "profile/profile_compilation_info.h"
 #include "profile_assistant.h"
 #include "runtime.h"
@@ -119,6 +120,9 @@ NO_RETURN static void Usage(const char *fmt, ...) {
   UsageError("      accepts a file descriptor. Cannot be used together with");
   UsageError("      --reference-profile-file.");
   UsageError("");
+  UsageError("  --merge-threads=<number>: number of threads used to load and merge the");
+  UsageError("      --profile-file inputs. Defaults to 1.");
+  UsageError("");
   UsageError("  --generate-test-profile=<filename>: generates a random profile file for testing.");
   UsageError("  --generate-test-profile-num-dex=<number>: number of dex files that should be");
   UsageError("      included in the generated profile. Defaults to 20.");
@@ -132,6 +136,10 @@ NO_RETURN static void Usage(const char *fmt, ...) {
   UsageError("  --create-profile-from=<filename>: creates a profile from a list of classes and");
   UsageError("      methods.");
   UsageError("");
+  UsageError("  --generate-indexed-profile: merges the input profiles and writes the result to");
+  UsageError("      the reference profile in the indexed format, which loads without being");
+  UsageError("      decompressed. Inline caches are dropped.");
+  UsageError("");
   UsageError("  --dex-location=<string>: location string to use with corresponding");
   UsageError("      apk-fd to find dex files");
   UsageError("");
@@ -187,6 +195,8 @@ class ProfMan FINAL {
       dump_only_(false),
       dump_classes_and_methods_(false),
       generate_boot_image_profile_(false),
+      generate_indexed_profile_(false),
+      merge_threads_(1u),
       dump_output_to_fd_(kInvalidFd),
       test_profile_num_dex_(kDefaultTestProfileNumDex),
       test_profile_method_percerntage_(kDefaultTestProfileMethodPercentage),
@@ -230,6 +240,10 @@ class ProfMan FINAL {
         ParseUintOption(option, "--dump-output-to-fd", &dump_output_to_fd_, Usage);
       } else if (option == "--generate-boot-image-profile") {
         generate_boot_image_profile_ = true;
+      } else if (option == "--generate-indexed-profile") {
+        generate_indexed_profile_ = true;
+      } else if (option.starts_with("--merge-threads=")) {
+        ParseUintOption(option, "--merge-threads", &merge_threads_, Usage);
       } else if (option.starts_with("--boot-image-class-threshold=")) {
         ParseUintOption(option,
                         "--boot-image-class-threshold",
@@ -356,12 +370,14 @@ class ProfMan FINAL {
       File file(reference_profile_file_fd_, false);
       result = ProfileAssistant::ProcessProfiles(profile_files_fd_,
                                                  reference_profile_file_fd_,
-                                                 filter_fn);
+                                                 filter_fn,
+                                                 merge_threads_);
       CloseAllFds(profile_files_fd_, "profile_files_fd_");
     } else {
       result = ProfileAssistant::ProcessProfiles(profile_files_,
                                                  reference_profile_file_,
-                                                 filter_fn);
+                                                 filter_fn,
+                                                 merge_threads_);
     }
     return result;
   }
@@ -1125,6 +1141,54 @@ class ProfMan FINAL {
     return !create_profile_from_file_.empty();
   }
 
+  bool ShouldCreateIndexedProfile() const {
+    return generate_indexed_profile_;
+  }
+
+  // Merges the input profiles and writes them to the reference profile in the indexed format.
+  int CreateIndexedProfile() {
+    if (profile_files_.empty() && profile_files_fd_.empty()) {
+      Usage("Profile must be specified with --profile-file or --profile-file-fd");
+    }
+    if (reference_profile_file_.empty() && !FdIsValid(reference_profile_file_fd_)) {
+      Usage("Reference profile must be specified with --reference-profile-file or "
+            "--reference-profile-file-fd");
+    }
+    ProfileCompilationInfo merged_profile;
+    for (int profile_file_fd : profile_files_fd_) {
+      std::unique_ptr<const ProfileCompilationInfo> profile(LoadProfile("", profile_file_fd));
+      if (profile == nullptr || !merged_profile.MergeWith(*profile)) {
+        return -1;
+      }
+    }
+    for (const std::string& profile_file : profile_files_) {
+      std::unique_ptr<const ProfileCompilationInfo> profile(LoadProfile(profile_file, kInvalidFd));
+      if (profile == nullptr || !merged_profile.MergeWith(*profile)) {
+        return -1;
+      }
+    }
+    const int reference_fd = OpenReferenceProfile();
+    if (!FdIsValid(reference_fd)) {
+      return -2;
+    }
+    // A descriptor passed with --reference-profile-file-fd belongs to the caller. It may hold an
+    // older, longer profile, which would leave trailing bytes after the indexed profile.
+    const bool owns_reference_fd = !FdIsValid(reference_profile_file_fd_);
+    if (!owns_reference_fd &&
+        (ftruncate(reference_fd, 0) != 0 || lseek(reference_fd, 0, SEEK_SET) != 0)) {
+      PLOG(ERROR) << "Failed to clear the reference profile";
+      return -3;
+    }
+    bool success = IndexedProfile::Write(merged_profile, reference_fd);
+    if (!success) {
+      PLOG(ERROR) << "Failed to write indexed profile";
+    }
+    if (owns_reference_fd && close(reference_fd) < 0) {
+      PLOG(WARNING) << "Failed to close descriptor";
+    }
+    return success ? 0 : -3;
+  }
+
   int GenerateTestProfile() {
     // Validate parameters for this command.
     if (test_profile_method_percerntage_ > 100) {
@@ -1254,6 +1318,8 @@ class ProfMan FINAL {
   bool dump_only_;
   bool dump_classes_and_methods_;
   bool generate_boot_image_profile_;
+  bool generate_indexed_profile_;
+  uint32_t merge_threads_;
   int dump_output_to_fd_;
   BootImageOptions boot_image_options_;
   std::string test_profile_;
@@ -1293,6 +1359,10 @@ static int profman(int argc, char** argv) {
     return profman.CreateBootProfile();
   }
 
+  if (profman.ShouldCreateIndexedProfile()) {
+    return profman.CreateIndexedProfile();
+  }
+
   if (profman.ShouldCopyAndUpdateProfileKey()) {
     return profman.CopyAndUpdateProfileKey();
   }
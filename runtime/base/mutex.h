@@ -92,11 +92,14 @@ enum LockLevel {
   kHostDlOpenHandlesLock,
   kVerifierDepsLock,
   kOatFileManagerLock,
+  kTracingWriterLock,
   kTracingUniqueMethodsLock,
   kTracingStreamingLock,
+  kSamplingProfilerLock,
   kDeoptimizedMethodsLock,
   kClassLoaderClassesLock,
   kDefaultMutexLevel,
+  kBackgroundVerifierLock,
   kDexLock,
   kMarkSweepLargeObjectLock,
   kJdwpObjectRegistryLock,
@@ -122,8 +122,10 @@
 #include "scoped_thread_state_change-inl.h"
 #include "thread-inl.h"
 #include "thread_list.h"
+#include "thread_pool.h"
 #include "trace.h"
 #include "utils/dex_cache_arrays_layout-inl.h"
+#include "verifier/background_verifier.h"
 #include "verifier/method_verifier.h"
 #include "well_known_classes.h"
 
@@ -368,6 +370,61 @@ static void ShuffleForward(size_t* current_field_idx,
   }
 }
 
+// Loads the classes of a list of descriptors on the threads which run it. Classes are claimed one
+// at a time as the cost of loading one varies a lot, depending on how many of its superclasses
+// and interfaces are already loaded.
+class ClassLinker::ClassPreloader {
+ public:
+  ClassPreloader(ClassLinker* class_linker,
+                 jobject class_loader,
+                 std::vector<std::string>&& descriptors)
+      : class_linker_(class_linker),
+        class_loader_(class_loader),
+        descriptors_(std::move(descriptors)),
+        next_index_(0u),
+        loaded_count_(0u) {}
+
+  // Loads classes until none is left to claim or the preloading is cancelled.
+  void Run(Thread* self) REQUIRES(!Locks::mutator_lock_) {
+    ScopedObjectAccess soa(self);
+    StackHandleScope<1> hs(self);
+    Handle<mirror::ClassLoader> loader(
+        hs.NewHandle(soa.Decode<mirror::ClassLoader>(class_loader_)));
+    for (size_t i = next_index_.fetch_add(1u, std::memory_order_relaxed);
+         i < descriptors_.size();
+         i = next_index_.fetch_add(1u, std::memory_order_relaxed)) {
+      if (class_linker_->FindClass(self, descriptors_[i].c_str(), loader) != nullptr) {
+        loaded_count_.fetch_add(1u, std::memory_order_relaxed);
+      } else {
+        // The application reports the error if it ever uses the class.
+        self->ClearException();
+      }
+    }
+  }
+
+  // Makes the threads stop after the class they are loading.
+  void Cancel() {
+    next_index_.store(descriptors_.size(), std::memory_order_relaxed);
+  }
+
+  size_t NumDescriptors() const {
+    return descriptors_.size();
+  }
+
+  size_t GetLoadedCount() const {
+    return loaded_count_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  ClassLinker* const class_linker_;
+  const jobject class_loader_;
+  const std::vector<std::string> descriptors_;
+  Atomic<size_t> next_index_;
+  Atomic<size_t> loaded_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(ClassPreloader);
+};
+
 ClassLinker::ClassLinker(InternTable* intern_table)
     : boot_class_table_(new ClassTable()),
       failed_dex_cache_class_lookups_(0),
@@ -382,7 +439,9 @@ ClassLinker::ClassLinker(InternTable* intern_table)
       quick_generic_jni_trampoline_(nullptr),
       quick_to_interpreter_bridge_trampoline_(nullptr),
       image_pointer_size_(kRuntimePointerSize),
-      cha_(Runtime::Current()->IsAotCompiler() ? nullptr : new ClassHierarchyAnalysis()) {
+      cha_(Runtime::Current()->IsAotCompiler() ? nullptr : new ClassHierarchyAnalysis()),
+      background_verified_classes_(0u),
+      on_demand_verified_classes_(0u) {
   // For CHA disabled during Aot, see b/34193647.
 
   CHECK(intern_table_ != nullptr);
@@ -3536,6 +3595,9 @@ ObjPtr<mirror::DexCache> ClassLinker::RegisterDexFile(const DexFile& dex_file,
     // Since we added a strong root to the class table, do the write barrier as required for
     // remembered sets and generational GCs.
     WriteBarrier::ForEveryFieldWrite(h_class_loader.Get());
+    if (background_verifier_ != nullptr) {
+      background_verifier_->AddDexFile(self, dex_file, h_class_loader.Get());
+    }
   }
   return h_dex_cache.Get();
 }
@@ -3875,11 +3937,13 @@ mirror::Class* ClassLinker::LookupClass(Thread* self,
   return LookupClass(self, descriptor, ComputeModifiedUtf8Hash(descriptor), class_loader);
 }
 
-mirror::Class* ClassLinker::LookupClass(Thread* self,
+mirror::Class* ClassLinker::LookupClass(Thread* self ATTRIBUTE_UNUSED,
                                         const char* descriptor,
                                         size_t hash,
                                         ObjPtr<mirror::ClassLoader> class_loader) {
-  ReaderMutexLock mu(self, *Locks::classlinker_classes_lock_);
+  // The class table of a reachable class loader is never deleted and ClassTable::Lookup does not
+  // need the classes lock, so do not take it on this hot path either. See RegisterClassLoader for
+  // the publication of the table.
   ClassTable* const class_table = ClassTableForClassLoader(class_loader);
   if (class_table != nullptr) {
     ObjPtr<mirror::Class> result = class_table->Lookup(descriptor, hash);
@@ -3890,6 +3954,81 @@ mirror::Class* ClassLinker::LookupClass(Thread* self,
   return nullptr;
 }
 
+size_t ClassLinker::PreloadClasses(Thread* self,
+                                   jobject class_loader,
+                                   const std::vector<std::string>& descriptors,
+                                   size_t thread_count) {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  ClassPreloader preloader(this, class_loader, std::vector<std::string>(descriptors));
+  thread_count = std::min(thread_count, descriptors.size());
+  if (thread_count <= 1u) {
+    preloader.Run(self);
+  } else {
+    // Pool workers cannot call into Java, so FindClass fails for class loaders that are not
+    // understood natively and these classes are skipped.
+    ThreadPool pool("Class preloading thread pool", thread_count - 1u);
+    for (size_t i = 0; i != thread_count; ++i) {
+      pool.AddTask(self, new FunctionTask([&preloader](Thread* thread) {
+        preloader.Run(thread);
+      }));
+    }
+    pool.StartWorkers(self);
+    pool.Wait(self, /* do_work */ true, /* may_hold_locks */ false);
+  }
+  VLOG(class_linker) << "Preloaded " << preloader.GetLoadedCount() << " of "
+                     << descriptors.size() << " classes with " << thread_count << " threads";
+  return preloader.GetLoadedCount();
+}
+
+void ClassLinker::StartPreloadingClasses(Thread* self,
+                                         jobject class_loader,
+                                         std::vector<std::string>&& descriptors,
+                                         size_t thread_count) {
+  CHECK(class_preloader_ == nullptr);
+  thread_count = std::min(thread_count, descriptors.size());
+  if (thread_count == 0u) {
+    return;
+  }
+  VLOG(class_linker) << "Preloading " << descriptors.size() << " classes with " << thread_count
+                     << " background threads";
+  class_preloader_.reset(new ClassPreloader(this, class_loader, std::move(descriptors)));
+  class_preloading_thread_pool_.reset(
+      new ThreadPool("Class preloading thread pool", thread_count));
+  ClassPreloader* const preloader = class_preloader_.get();
+  for (size_t i = 0; i != thread_count; ++i) {
+    class_preloading_thread_pool_->AddTask(self, new FunctionTask([preloader](Thread* thread) {
+      ScopedTrace trace("Preload classes");
+      preloader->Run(thread);
+    }));
+  }
+  class_preloading_thread_pool_->StartWorkers(self);
+}
+
+void ClassLinker::ShutdownClassPreloading(Thread* self) {
+  if (class_preloader_ == nullptr) {
+    return;
+  }
+  class_preloader_->Cancel();
+  // The tasks return after the class they are loading, let them release the preloader.
+  class_preloading_thread_pool_->Wait(self, /* do_work */ false, /* may_hold_locks */ false);
+  VLOG(class_linker) << "Preloaded " << class_preloader_->GetLoadedCount() << " of "
+                     << class_preloader_->NumDescriptors() << " classes";
+  class_preloading_thread_pool_.reset();
+  class_preloader_.reset();
+}
+
+void ClassLinker::StartBackgroundVerification(size_t thread_count) {
+  DCHECK(!Runtime::Current()->IsAotCompiler());
+  CHECK(background_verifier_ == nullptr);
+  background_verifier_.reset(new verifier::BackgroundVerifier(thread_count));
+}
+
+void ClassLinker::ShutdownBackgroundVerification(Thread* self) {
+  if (background_verifier_ != nullptr) {
+    background_verifier_->Shutdown(self);
+  }
+}
+
 class MoveClassTableToPreZygoteVisitor : public ClassLoaderVisitor {
  public:
   MoveClassTableToPreZygoteVisitor() {}
@@ -4137,6 +4276,13 @@ verifier::FailureKind ClassLinker::VerifyClass(
   verifier::FailureKind verifier_failure = verifier::FailureKind::kNoFailure;
   if (!preverified) {
     verifier_failure = PerformClassVerification(self, klass, log_level, &error_msg);
+    if (!Runtime::Current()->IsAotCompiler()) {
+      if (verifier::BackgroundVerifier::IsWorkerThread(self)) {
+        background_verified_classes_.fetch_add(1u, std::memory_order_relaxed);
+      } else {
+        on_demand_verified_classes_.fetch_add(1u, std::memory_order_relaxed);
+      }
+    }
   }
 
   // Verification is done, grab the lock again.
@@ -5276,6 +5422,8 @@ void ClassLinker::RegisterClassLoader(ObjPtr<mirror::ClassLoader> class_loader)
   data.weak_root = self->GetJniEnv()->GetVm()->AddWeakGlobalRef(self, class_loader);
   // Create and set the class table.
   data.class_table = new ClassTable;
+  // Make sure that a LookupClass without the classes lock which sees the table sees it initialized.
+  std::atomic_thread_fence(std::memory_order_release);
   class_loader->SetClassTable(data.class_table);
   // Create and set the linear allocator.
   data.allocator = Runtime::Current()->CreateLinearAlloc();
@@ -8605,6 +8753,8 @@ void ClassLinker::DumpForSigQuit(std::ostream& os) {
   ReaderMutexLock mu(soa.Self(), *Locks::classlinker_classes_lock_);
   os << "Zygote loaded classes=" << NumZygoteClasses() << " post zygote classes="
      << NumNonZygoteClasses() << "\n";
+  os << "Runtime verified classes background=" << GetBackgroundVerifiedClassCount()
+     << " on demand=" << GetOnDemandVerifiedClassCount() << "\n";
 }
 
 class CountClassesVisitor : public ClassLoaderVisitor {
@@ -8855,6 +9005,13 @@ void ClassLinker::CleanupClassLoaders() {
         it = class_loaders_.erase(it);
       }
     }
+    // The GC suspends all threads at least once before cleaning up the class loaders, and a
+    // lookup has no suspend point, so the lookups which may have been reading a set retired
+    // before the previous cleanup are done.
+    boot_class_table_->FreeSetsRetiredBeforePreviousCall();
+    for (const ClassLoaderData& data : class_loaders_) {
+      data.class_table->FreeSetsRetiredBeforePreviousCall();
+    }
   }
   for (ClassLoaderData& data : to_delete) {
     // CHA unloading analysis and SingleImplementaion cleanups are required.
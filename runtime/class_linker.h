@@ -24,6 +24,7 @@
 #include <utility>
 #include <vector>
 
+#include "base/atomic.h"
 #include "base/enums.h"
 #include "base/macros.h"
 #include "base/mutex.h"
@@ -50,6 +51,10 @@ class ImageWriter;
 class OatWriter;
 }  // namespace linker
 
+namespace verifier {
+class BackgroundVerifier;
+}  // namespace verifier
+
 namespace mirror {
 class ClassLoader;
 class DexCache;
@@ -83,6 +88,7 @@ template<class T> class ObjectLock;
 class Runtime;
 class ScopedObjectAccessAlreadyRunnable;
 template<size_t kNumReferences> class PACKED(4) StackHandleScope;
+class ThreadPool;
 
 enum VisitRootFlags : uint8_t;
 
@@ -182,6 +188,56 @@ class ClassLinker {
       REQUIRES(!Locks::classlinker_classes_lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
+  // Loads and links the classes with the given descriptors in `class_loader` (null for the boot
+  // class loader) on a temporary pool of `thread_count` threads including the calling one, so
+  // that they are ready when the application first uses them. The descriptors would typically be
+  // the hot classes of the profile, see ProfileCompilationInfo::GetClassDescriptors. Independent
+  // classes are loaded concurrently; a class needed by several of them is loaded once, the other
+  // threads waiting for it as with any concurrent FindClass. Classes which cannot be loaded without
+  // calling into Java, or fail to load, are skipped and left for the application to load. The
+  // classes are not initialized. Returns the number of classes that were loaded.
+  size_t PreloadClasses(Thread* self,
+                        jobject class_loader,
+                        const std::vector<std::string>& descriptors,
+                        size_t thread_count)
+      REQUIRES(!Locks::mutator_lock_, !Locks::dex_lock_);
+
+  // Like PreloadClasses, but loads the classes on a pool of `thread_count` background threads and
+  // returns without waiting for them. Pool workers cannot call into Java, so only the classes of
+  // the boot class loader and of class loaders understood natively, such as PathClassLoader, are
+  // preloaded. `class_loader` must stay valid until ShutdownClassPreloading. Used when the
+  // application starts with the classes of the -Xpreloadclassesprofile profile.
+  void StartPreloadingClasses(Thread* self,
+                              jobject class_loader,
+                              std::vector<std::string>&& descriptors,
+                              size_t thread_count)
+      REQUIRES(!Locks::mutator_lock_);
+
+  // Stops the background class preloading, abandoning the classes not loaded yet, and waits for
+  // its threads to exit.
+  void ShutdownClassPreloading(Thread* self) REQUIRES(!Locks::mutator_lock_);
+
+  // Verifies on `thread_count` low priority threads, ahead of their first use, the classes that
+  // would otherwise be verified on demand in the dex files registered from now on with a class
+  // loader other than the boot class loader. See verifier::BackgroundVerifier.
+  void StartBackgroundVerification(size_t thread_count) REQUIRES(!Locks::mutator_lock_);
+
+  // Stops the background verification, abandoning the classes not verified yet.
+  void ShutdownBackgroundVerification(Thread* self) REQUIRES(!Locks::mutator_lock_);
+
+  verifier::BackgroundVerifier* GetBackgroundVerifier() const {
+    return background_verifier_.get();
+  }
+
+  // Number of classes that were verified at runtime by the background verification threads, and
+  // on demand by the threads using them.
+  size_t GetBackgroundVerifiedClassCount() const {
+    return background_verified_classes_.load(std::memory_order_relaxed);
+  }
+  size_t GetOnDemandVerifiedClassCount() const {
+    return on_demand_verified_classes_.load(std::memory_order_relaxed);
+  }
+
   // Finds all the classes with the given descriptor, regardless of ClassLoader.
   void LookupClasses(const char* descriptor, std::vector<ObjPtr<mirror::Class>>& classes)
       REQUIRES(!Locks::classlinker_classes_lock_)
@@ -1293,6 +1349,17 @@ class ClassLinker {
 
   std::unique_ptr<ClassHierarchyAnalysis> cha_;
 
+  // Null unless StartBackgroundVerification was called. Kept after shutdown as other threads may
+  // still register dex files.
+  std::unique_ptr<verifier::BackgroundVerifier> background_verifier_;
+  Atomic<size_t> background_verified_classes_;
+  Atomic<size_t> on_demand_verified_classes_;
+
+  // Null unless StartPreloadingClasses was called and until ShutdownClassPreloading.
+  class ClassPreloader;
+  std::unique_ptr<ClassPreloader> class_preloader_;
+  std::unique_ptr<ThreadPool> class_preloading_thread_pool_;
+
   class FindVirtualMethodHolderVisitor;
 
   friend class AppImageClassLoadersAndDexCachesHelper;
@@ -16,6 +16,7 @@
 
 #include "class_linker.h"
 
+#include <iostream>
 #include <memory>
 #include <string>
 
@@ -24,9 +25,12 @@
 #include "art_field-inl.h"
 #include "art_method-inl.h"
 #include "base/enums.h"
+#include "base/histogram-inl.h"
+#include "base/time_utils.h"
 #include "class_linker-inl.h"
 #include "class_root.h"
 #include "common_runtime_test.h"
+#include "compiler_callbacks.h"
 #include "dex/dex_file_types.h"
 #include "dex/standard_dex_file.h"
 #include "entrypoints/entrypoint_utils-inl.h"
@@ -53,6 +57,7 @@
 #include "mirror/var_handle.h"
 #include "scoped_thread_state_change-inl.h"
 #include "thread-current-inl.h"
+#include "verifier/background_verifier.h"
 
 namespace art {
 
@@ -440,6 +445,17 @@ class ClassLinkerTest : public CommonRuntimeTest {
     class_linker_->VisitRoots(&visitor, kVisitRootFlagAllRoots);
   }
 
+  // Returns the descriptors of the classes defined in the test dex files `dex_name`.
+  std::vector<std::string> GetClassDescriptors(const char* dex_name) {
+    std::vector<std::string> descriptors;
+    for (const std::unique_ptr<const DexFile>& dex_file : OpenTestDexFiles(dex_name)) {
+      for (size_t i = 0; i < dex_file->NumClassDefs(); i++) {
+        descriptors.push_back(dex_file->GetClassDescriptor(dex_file->GetClassDef(i)));
+      }
+    }
+    return descriptors;
+  }
+
   class TestRootVisitor : public SingleRootVisitor {
    public:
     void VisitRoot(mirror::Object* root, const RootInfo& info ATTRIBUTE_UNUSED) OVERRIDE {
@@ -1661,6 +1677,135 @@ TEST_F(ClassLinkerTest, JniShortName_JniLongName) {
   EXPECT_EQ("Java_java_lang_String_copyValueOf___3CII", m->JniLongName());
 }
 
+TEST_F(ClassLinkerTest, PreloadClasses) {
+  Thread* self = Thread::Current();
+  jobject jclass_loader;
+  {
+    ScopedObjectAccess soa(self);
+    jclass_loader = LoadDex("Interfaces");
+  }
+  std::vector<std::string> descriptors = GetClassDescriptors("Interfaces");
+  ASSERT_FALSE(descriptors.empty());
+  const size_t num_classes = descriptors.size();
+  // Missing classes are skipped.
+  descriptors.push_back("LNotThere;");
+  EXPECT_EQ(num_classes,
+            class_linker_->PreloadClasses(self, jclass_loader, descriptors, /* thread_count */ 4u));
+
+  ScopedObjectAccess soa(self);
+  EXPECT_FALSE(self->IsExceptionPending());
+  ObjPtr<mirror::ClassLoader> class_loader = soa.Decode<mirror::ClassLoader>(jclass_loader);
+  for (size_t i = 0; i != num_classes; ++i) {
+    ObjPtr<mirror::Class> klass =
+        class_linker_->LookupClass(self, descriptors[i].c_str(), class_loader);
+    ASSERT_TRUE(klass != nullptr) << descriptors[i];
+    EXPECT_TRUE(klass->IsResolved()) << descriptors[i];
+    EXPECT_OBJ_PTR_EQ(class_loader, klass->GetClassLoader());
+  }
+  EXPECT_TRUE(class_linker_->LookupClass(self, "LNotThere;", class_loader) == nullptr);
+}
+
+TEST_F(ClassLinkerTest, PreloadClassesInBackground) {
+  Thread* self = Thread::Current();
+  jobject jclass_loader;
+  {
+    ScopedObjectAccess soa(self);
+    jclass_loader = LoadDex("Interfaces");
+  }
+  std::vector<std::string> descriptors = GetClassDescriptors("Interfaces");
+  ASSERT_FALSE(descriptors.empty());
+  class_linker_->StartPreloadingClasses(
+      self, jclass_loader, std::vector<std::string>(descriptors), /* thread_count */ 4u);
+
+  // The classes get loaded while this thread goes on.
+  static constexpr uint64_t kTimeoutMs = 60 * 1000;
+  const uint64_t start_time = MilliTime();
+  for (size_t i = 0; i != descriptors.size(); ) {
+    {
+      ScopedObjectAccess soa(self);
+      ObjPtr<mirror::ClassLoader> class_loader = soa.Decode<mirror::ClassLoader>(jclass_loader);
+      ObjPtr<mirror::Class> klass =
+          class_linker_->LookupClass(self, descriptors[i].c_str(), class_loader);
+      if (klass != nullptr && klass->IsResolved()) {
+        EXPECT_OBJ_PTR_EQ(class_loader, klass->GetClassLoader());
+        ++i;
+        continue;
+      }
+    }
+    ASSERT_LT(MilliTime() - start_time, kTimeoutMs) << descriptors[i];
+    usleep(1000);
+  }
+  class_linker_->ShutdownClassPreloading(self);
+}
+
+// A benchmark, which prints the times to stdout. Run with --gtest_also_run_disabled_tests.
+TEST_F(ClassLinkerTest, DISABLED_PreloadClassesSpeed) {
+  Thread* self = Thread::Current();
+  const std::vector<std::string> descriptors = GetClassDescriptors("VerifierDeps");
+  for (size_t thread_count : {1u, 4u}) {
+    std::unique_ptr<Histogram<uint64_t>> hist(new Histogram<uint64_t>(
+        ("PreloadClassesSpeedTest" + std::to_string(thread_count)).c_str(), 5));
+    for (size_t i = 0; i != 4u; ++i) {
+      // Use a new class loader each time, so that all the classes need to be loaded.
+      jobject jclass_loader;
+      {
+        ScopedObjectAccess soa(self);
+        jclass_loader = LoadDex("VerifierDeps");
+      }
+      uint64_t start_time = NanoTime();
+      class_linker_->PreloadClasses(self, jclass_loader, descriptors, thread_count);
+      hist->AddValue(NanoTime() - start_time);
+    }
+    Histogram<uint64_t>::CumulativeData data;
+    hist->CreateHistogram(&data);
+    hist->PrintConfidenceIntervals(std::cout, 0.99, data);
+  }
+}
+
+class ClassLinkerBackgroundVerificationTest : public ClassLinkerTest {
+ protected:
+  void SetUpRuntimeOptions(RuntimeOptions* options) OVERRIDE {
+    ClassLinkerTest::SetUpRuntimeOptions(options);
+    // Do not appear to be a compiler, so that classes are verified as at runtime.
+    callbacks_.reset();
+  }
+};
+
+TEST_F(ClassLinkerBackgroundVerificationTest, VerifyRegisteredDexFile) {
+  Thread* self = Thread::Current();
+  class_linker_->StartBackgroundVerification(/* thread_count */ 2u);
+  jobject jclass_loader;
+  {
+    ScopedObjectAccess soa(self);
+    jclass_loader = LoadDex("Interfaces");
+  }
+  const std::vector<std::string> descriptors = GetClassDescriptors("Interfaces");
+  ASSERT_FALSE(descriptors.empty());
+  const size_t on_demand_count = class_linker_->GetOnDemandVerifiedClassCount();
+  {
+    // Loading a first class registers the dex file, which queues its classes for verification.
+    ScopedObjectAccess soa(self);
+    StackHandleScope<1> hs(self);
+    Handle<mirror::ClassLoader> class_loader(
+        hs.NewHandle(soa.Decode<mirror::ClassLoader>(jclass_loader)));
+    ASSERT_TRUE(class_linker_->FindClass(self, descriptors[0].c_str(), class_loader) != nullptr);
+  }
+  class_linker_->GetBackgroundVerifier()->Wait(self);
+  {
+    ScopedObjectAccess soa(self);
+    ObjPtr<mirror::ClassLoader> class_loader = soa.Decode<mirror::ClassLoader>(jclass_loader);
+    for (const std::string& descriptor : descriptors) {
+      ObjPtr<mirror::Class> klass =
+          class_linker_->LookupClass(self, descriptor.c_str(), class_loader);
+      ASSERT_TRUE(klass != nullptr) << descriptor;
+      EXPECT_TRUE(klass->IsVerified()) << descriptor;
+    }
+  }
+  EXPECT_GE(class_linker_->GetBackgroundVerifiedClassCount(), descriptors.size());
+  EXPECT_EQ(on_demand_count, class_linker_->GetOnDemandVerifiedClassCount());
+  class_linker_->ShutdownBackgroundVerification(self);
+}
+
 class ClassLinkerClassLoaderTest : public ClassLinkerTest {
  protected:
   // Verifies that the class identified by the given descriptor is loaded with
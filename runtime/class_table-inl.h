@@ -27,8 +27,8 @@ namespace art {
 template<class Visitor>
 void ClassTable::VisitRoots(Visitor& visitor) {
   ReaderMutexLock mu(Thread::Current(), lock_);
-  for (ClassSet& class_set : classes_) {
-    for (TableSlot& table_slot : class_set) {
+  for (ClassSet* class_set : GetSets()) {
+    for (TableSlot& table_slot : *class_set) {
       table_slot.VisitRoot(visitor);
     }
   }
@@ -45,8 +45,8 @@ void ClassTable::VisitRoots(Visitor& visitor) {
 template<class Visitor>
 void ClassTable::VisitRoots(const Visitor& visitor) {
   ReaderMutexLock mu(Thread::Current(), lock_);
-  for (ClassSet& class_set : classes_) {
-    for (TableSlot& table_slot : class_set) {
+  for (ClassSet* class_set : GetSets()) {
+    for (TableSlot& table_slot : *class_set) {
       table_slot.VisitRoot(visitor);
     }
   }
@@ -63,8 +63,8 @@ void ClassTable::VisitRoots(const Visitor& visitor) {
 template <typename Visitor, ReadBarrierOption kReadBarrierOption>
 bool ClassTable::Visit(Visitor& visitor) {
   ReaderMutexLock mu(Thread::Current(), lock_);
-  for (ClassSet& class_set : classes_) {
-    for (TableSlot& table_slot : class_set) {
+  for (ClassSet* class_set : GetSets()) {
+    for (TableSlot& table_slot : *class_set) {
       if (!visitor(table_slot.Read<kReadBarrierOption>())) {
         return false;
       }
@@ -76,8 +76,8 @@ bool ClassTable::Visit(Visitor& visitor) {
 template <typename Visitor, ReadBarrierOption kReadBarrierOption>
 bool ClassTable::Visit(const Visitor& visitor) {
   ReaderMutexLock mu(Thread::Current(), lock_);
-  for (ClassSet& class_set : classes_) {
-    for (TableSlot& table_slot : class_set) {
+  for (ClassSet* class_set : GetSets()) {
+    for (TableSlot& table_slot : *class_set) {
       if (!visitor(table_slot.Read<kReadBarrierOption>())) {
         return false;
       }
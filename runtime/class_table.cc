@@ -22,23 +22,31 @@
 
 namespace art {
 
-ClassTable::ClassTable() : lock_("Class loader classes", kClassLoaderClassesLock) {
-  Runtime* const runtime = Runtime::Current();
-  classes_.push_back(ClassSet(runtime->GetHashTableMinLoadFactor(),
-                              runtime->GetHashTableMaxLoadFactor()));
-}
+ClassTable::ClassTable()
+    : lock_("Class loader classes", kClassLoaderClassesLock),
+      sets_(new ClassSet(Runtime::Current()->GetHashTableMinLoadFactor(),
+                         Runtime::Current()->GetHashTableMaxLoadFactor())),
+      modification_sequence_(0u) {}
 
 void ClassTable::FreezeSnapshot() {
   WriterMutexLock mu(Thread::Current(), lock_);
-  classes_.push_back(ClassSet());
+  // A lookup could miss the live set both in the frozen list and as the live set.
+  BeginUnsafeModification();
+  sets_.FreezeLiveSet(new ClassSet());
+  EndUnsafeModification();
+}
+
+void ClassTable::FreeSetsRetiredBeforePreviousCall() {
+  WriterMutexLock mu(Thread::Current(), lock_);
+  sets_.FreeSetsRetiredBeforePreviousCall();
 }
 
 bool ClassTable::Contains(ObjPtr<mirror::Class> klass) {
   ReaderMutexLock mu(Thread::Current(), lock_);
   TableSlot slot(klass);
-  for (ClassSet& class_set : classes_) {
-    auto it = class_set.find(slot);
-    if (it != class_set.end()) {
+  for (ClassSet* class_set : GetSets()) {
+    auto it = class_set->find(slot);
+    if (it != class_set->end()) {
       return it->Read() == klass;
     }
   }
@@ -48,9 +56,9 @@ bool ClassTable::Contains(ObjPtr<mirror::Class> klass) {
 mirror::Class* ClassTable::LookupByDescriptor(ObjPtr<mirror::Class> klass) {
   ReaderMutexLock mu(Thread::Current(), lock_);
   TableSlot slot(klass);
-  for (ClassSet& class_set : classes_) {
-    auto it = class_set.find(slot);
-    if (it != class_set.end()) {
+  for (ClassSet* class_set : GetSets()) {
+    auto it = class_set->find(slot);
+    if (it != class_set->end()) {
       return it->Read();
     }
   }
@@ -67,10 +75,11 @@ mirror::Class* ClassTable::UpdateClass(const char* descriptor, mirror::Class* kl
   WriterMutexLock mu(Thread::Current(), lock_);
   // Should only be updating latest table.
   DescriptorHashPair pair(descriptor, hash);
-  auto existing_it = classes_.back().FindWithHash(pair, hash);
-  if (kIsDebugBuild && existing_it == classes_.back().end()) {
-    for (const ClassSet& class_set : classes_) {
-      if (class_set.FindWithHash(pair, hash) != class_set.end()) {
+  ClassSet* const live_set = sets_.GetLiveSet();
+  auto existing_it = live_set->FindWithHash(pair, hash);
+  if (kIsDebugBuild && existing_it == live_set->end()) {
+    for (const ClassSet* class_set : GetSets()) {
+      if (class_set->FindWithHash(pair, hash) != class_set->end()) {
         LOG(FATAL) << "Updating class found in frozen table " << descriptor;
       }
     }
@@ -83,7 +92,7 @@ mirror::Class* ClassTable::UpdateClass(const char* descriptor, mirror::Class* kl
   CHECK(!klass->IsTemp()) << descriptor;
   VerifyObject(klass);
   // Update the element in the hash set with the new class. This is safe to do since the descriptor
-  // doesn't change.
+  // doesn't change, even for concurrent lookups.
   *existing_it = TableSlot(klass, hash);
   return existing;
 }
@@ -103,99 +112,133 @@ size_t ClassTable::CountDefiningLoaderClasses(ObjPtr<mirror::ClassLoader> defini
 
 size_t ClassTable::NumZygoteClasses(ObjPtr<mirror::ClassLoader> defining_loader) const {
   ReaderMutexLock mu(Thread::Current(), lock_);
+  std::vector<ClassSet*> sets = GetSets();
   size_t sum = 0;
-  for (size_t i = 0; i < classes_.size() - 1; ++i) {
-    sum += CountDefiningLoaderClasses(defining_loader, classes_[i]);
+  for (size_t i = 0; i < sets.size() - 1; ++i) {
+    sum += CountDefiningLoaderClasses(defining_loader, *sets[i]);
   }
   return sum;
 }
 
 size_t ClassTable::NumNonZygoteClasses(ObjPtr<mirror::ClassLoader> defining_loader) const {
   ReaderMutexLock mu(Thread::Current(), lock_);
-  return CountDefiningLoaderClasses(defining_loader, classes_.back());
+  return CountDefiningLoaderClasses(defining_loader, *sets_.GetLiveSet());
 }
 
 size_t ClassTable::NumReferencedZygoteClasses() const {
   ReaderMutexLock mu(Thread::Current(), lock_);
+  std::vector<ClassSet*> sets = GetSets();
   size_t sum = 0;
-  for (size_t i = 0; i < classes_.size() - 1; ++i) {
-    sum += classes_[i].size();
+  for (size_t i = 0; i < sets.size() - 1; ++i) {
+    sum += sets[i]->size();
   }
   return sum;
 }
 
 size_t ClassTable::NumReferencedNonZygoteClasses() const {
   ReaderMutexLock mu(Thread::Current(), lock_);
-  return classes_.back().size();
+  return sets_.GetLiveSet()->size();
+}
+
+template <typename K>
+mirror::Class* ClassTable::FindInSets(const K& key, size_t hash) const {
+  TableSlot* slot = sets_.FindWithHash(key, hash);
+  return (slot != nullptr) ? slot->Read() : nullptr;
 }
 
 mirror::Class* ClassTable::Lookup(const char* descriptor, size_t hash) {
   DescriptorHashPair pair(descriptor, hash);
-  ReaderMutexLock mu(Thread::Current(), lock_);
-  for (ClassSet& class_set : classes_) {
-    auto it = class_set.FindWithHash(pair, hash);
-    if (it != class_set.end()) {
-      return it->Read();
+  // Search without the lock first. Inserts, including the copy when the live set grows, cannot
+  // make us miss a class inserted before the lookup, so the result is valid unless a
+  // FreezeSnapshot or Remove ran concurrently.
+  const uint32_t sequence = modification_sequence_.load(std::memory_order_acquire);
+  if ((sequence & 1u) == 0u) {
+    mirror::Class* result = FindInSets(pair, hash);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (modification_sequence_.load(std::memory_order_relaxed) == sequence) {
+      return result;
     }
   }
-  return nullptr;
+  ReaderMutexLock mu(Thread::Current(), lock_);
+  return FindInSets(pair, hash);
 }
 
 ObjPtr<mirror::Class> ClassTable::TryInsert(ObjPtr<mirror::Class> klass) {
-  TableSlot slot(klass);
+  const uint32_t hash = TableSlot::HashDescriptor(klass);
+  TableSlot slot(klass, hash);
   WriterMutexLock mu(Thread::Current(), lock_);
-  for (ClassSet& class_set : classes_) {
-    auto it = class_set.find(slot);
-    if (it != class_set.end()) {
-      return it->Read();
-    }
+  mirror::Class* existing = FindInSets(slot, hash);
+  if (existing != nullptr) {
+    return existing;
   }
-  classes_.back().insert(slot);
+  InsertIntoLiveSet(slot, hash);
   return klass;
 }
 
 void ClassTable::Insert(ObjPtr<mirror::Class> klass) {
   const uint32_t hash = TableSlot::HashDescriptor(klass);
   WriterMutexLock mu(Thread::Current(), lock_);
-  classes_.back().InsertWithHash(TableSlot(klass, hash), hash);
+  InsertIntoLiveSet(TableSlot(klass, hash), hash);
 }
 
 void ClassTable::CopyWithoutLocks(const ClassTable& source_table) {
   if (kIsDebugBuild) {
-    for (ClassSet& class_set : classes_) {
-      CHECK(class_set.empty());
+    for (ClassSet* class_set : GetSets()) {
+      CHECK(class_set->empty());
     }
   }
-  for (const ClassSet& class_set : source_table.classes_) {
-    for (const TableSlot& slot : class_set) {
-      classes_.back().insert(slot);
+  for (ClassSet* class_set : source_table.GetSets()) {
+    for (const TableSlot& slot : *class_set) {
+      InsertIntoLiveSet(slot, TableSlot::HashDescriptor(slot.Read()));
     }
   }
 }
 
 void ClassTable::InsertWithoutLocks(ObjPtr<mirror::Class> klass) {
   const uint32_t hash = TableSlot::HashDescriptor(klass);
-  classes_.back().InsertWithHash(TableSlot(klass, hash), hash);
+  InsertIntoLiveSet(TableSlot(klass, hash), hash);
 }
 
 void ClassTable::InsertWithHash(ObjPtr<mirror::Class> klass, size_t hash) {
   WriterMutexLock mu(Thread::Current(), lock_);
-  classes_.back().InsertWithHash(TableSlot(klass, hash), hash);
+  InsertIntoLiveSet(TableSlot(klass, hash), hash);
+}
+
+void ClassTable::InsertIntoLiveSet(const TableSlot& slot, size_t hash) {
+  sets_.GetLiveSetForInsert()->InsertWithHash(slot, hash);
 }
 
 bool ClassTable::Remove(const char* descriptor) {
-  DescriptorHashPair pair(descriptor, ComputeModifiedUtf8Hash(descriptor));
+  const uint32_t hash = ComputeModifiedUtf8Hash(descriptor);
+  DescriptorHashPair pair(descriptor, hash);
   WriterMutexLock mu(Thread::Current(), lock_);
-  for (ClassSet& class_set : classes_) {
-    auto it = class_set.find(pair);
-    if (it != class_set.end()) {
-      class_set.erase(it);
+  for (ClassSet* class_set : GetSets()) {
+    auto it = class_set->FindWithHash(pair, hash);
+    if (it != class_set->end()) {
+      // Erasing shifts the following slots back, which a concurrent lookup could miss.
+      BeginUnsafeModification();
+      class_set->erase(it);
+      EndUnsafeModification();
       return true;
     }
   }
   return false;
 }
 
+void ClassTable::BeginUnsafeModification() {
+  DCHECK_EQ(modification_sequence_.load(std::memory_order_relaxed) & 1u, 0u);
+  modification_sequence_.store(modification_sequence_.load(std::memory_order_relaxed) + 1u,
+                               std::memory_order_relaxed);
+  // Order the odd sequence number before the modification of the sets.
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void ClassTable::EndUnsafeModification() {
+  DCHECK_EQ(modification_sequence_.load(std::memory_order_relaxed) & 1u, 1u);
+  modification_sequence_.store(modification_sequence_.load(std::memory_order_relaxed) + 1u,
+                               std::memory_order_release);
+}
+
 uint32_t ClassTable::ClassDescriptorHashEquals::operator()(const TableSlot& slot)
     const {
   std::string temp;
@@ -216,10 +259,11 @@ bool ClassTable::ClassDescriptorHashEquals::operator()(const TableSlot& a,
 bool ClassTable::ClassDescriptorHashEquals::operator()(const TableSlot& a,
                                                        const DescriptorHashPair& b) const {
   if (!a.MaskedHashEquals(b.second)) {
-    DCHECK(!a.Read()->DescriptorEquals(b.first));
     return false;
   }
-  return a.Read()->DescriptorEquals(b.first);
+  mirror::Class* klass = a.Read();
+  // `a` may have been emptied by a Remove while a concurrent lookup was reading it.
+  return klass != nullptr && klass->DescriptorEquals(b.first);
 }
 
 uint32_t ClassTable::ClassDescriptorHashEquals::operator()(const DescriptorHashPair& pair) const {
@@ -266,8 +310,8 @@ size_t ClassTable::WriteToMemory(uint8_t* ptr) const {
   ClassSet combined;
   // Combine all the class sets in case there are multiple, also adjusts load factor back to
   // default in case classes were pruned.
-  for (const ClassSet& class_set : classes_) {
-    for (const TableSlot& root : class_set) {
+  for (const ClassSet* class_set : GetSets()) {
+    for (const TableSlot& root : *class_set) {
       combined.insert(root);
     }
   }
@@ -289,7 +333,7 @@ size_t ClassTable::ReadFromMemory(uint8_t* ptr) {
 
 void ClassTable::AddClassSet(ClassSet&& set) {
   WriterMutexLock mu(Thread::Current(), lock_);
-  classes_.insert(classes_.begin(), std::move(set));
+  sets_.PrependFrozenSet(new ClassSet(std::move(set)));
 }
 
 void ClassTable::ClearStrongRoots() {
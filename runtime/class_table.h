@@ -22,6 +22,8 @@
 #include <vector>
 
 #include "base/allocator.h"
+#include "base/atomic.h"
+#include "base/concurrent_set_list.h"
 #include "base/hash_set.h"
 #include "base/macros.h"
 #include "base/mutex.h"
@@ -46,7 +48,12 @@ class ClassLoader;
 class Object;
 }  // namespace mirror
 
-// Each loader has a ClassTable
+// Each loader has a ClassTable.
+//
+// Lookup does not take the lock: the class sets can be searched concurrently with inserts, which
+// are still serialized by the lock. The writers which may make a concurrent lookup miss a class
+// (FreezeSnapshot and Remove) bump a sequence number, and a lookup which raced with one of them
+// is retried with the lock.
 class ClassTable {
  public:
   class TableSlot {
@@ -60,7 +67,8 @@ class ClassTable {
     TableSlot(ObjPtr<mirror::Class> klass, uint32_t descriptor_hash);
 
     TableSlot& operator=(const TableSlot& copy) {
-      data_.store(copy.data_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      // Release so that a lookup without the lock which reads the slot sees the class.
+      data_.store(copy.data_.load(std::memory_order_relaxed), std::memory_order_release);
       return *this;
     }
 
@@ -151,6 +159,10 @@ class ClassTable {
       REQUIRES(!lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
+  // Free the sets replaced when growing the live set before the previous call. Must only be
+  // called once the lookups in progress at the previous call are done.
+  void FreeSetsRetiredBeforePreviousCall() REQUIRES(!lock_);
+
   // Returns the number of classes in previous snapshots defined by `defining_loader`.
   size_t NumZygoteClasses(ObjPtr<mirror::ClassLoader> defining_loader) const
       REQUIRES(!lock_)
@@ -199,7 +211,8 @@ class ClassTable {
       REQUIRES(!lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
-  // Return the first class that matches the descriptor. Returns null if there are none.
+  // Return the first class that matches the descriptor. Returns null if there are none. Does not
+  // take the lock unless the lookup races with a FreezeSnapshot or Remove.
   mirror::Class* Lookup(const char* descriptor, size_t hash)
       REQUIRES(!lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
@@ -269,6 +282,26 @@ class ClassTable {
   }
 
  private:
+  // Return the first class in the sets that matches the key. Safe to call without the lock, but
+  // the result is then only meaningful if no FreezeSnapshot or Remove ran concurrently.
+  template <typename K>
+  mirror::Class* FindInSets(const K& key, size_t hash) const
+      REQUIRES_SHARED(Locks::mutator_lock_);
+
+  // Return the frozen sets followed by the live set.
+  std::vector<ClassSet*> GetSets() const {
+    return sets_.GetSets();
+  }
+
+  // Insert into the live set, replacing it with a larger copy first if it is full.
+  void InsertIntoLiveSet(const TableSlot& slot, size_t hash)
+      REQUIRES(lock_)
+      REQUIRES_SHARED(Locks::mutator_lock_);
+
+  // Make concurrent lookups retry with the lock until EndUnsafeModification.
+  void BeginUnsafeModification() REQUIRES(lock_);
+  void EndUnsafeModification() REQUIRES(lock_);
+
   // Only copies classes.
   void CopyWithoutLocks(const ClassTable& source_table) NO_THREAD_SAFETY_ANALYSIS;
   void InsertWithoutLocks(ObjPtr<mirror::Class> klass) NO_THREAD_SAFETY_ANALYSIS;
@@ -285,8 +318,12 @@ class ClassTable {
 
   // Lock to guard inserting and removing.
   mutable ReaderWriterMutex lock_;
-  // We have a vector to help prevent dirty pages after the zygote forks by calling FreezeSnapshot.
-  std::vector<ClassSet> classes_ GUARDED_BY(lock_);
+  // The image class tables, the sets frozen by FreezeSnapshot to help prevent dirty pages after
+  // the zygote forks, and the live set. Modified with the lock held. Lookups may be reading the
+  // retired sets, which are freed by FreeSetsRetiredBeforePreviousCall.
+  ConcurrentSetList<ClassSet> sets_;
+  // Odd while a FreezeSnapshot or Remove is modifying the sets, incremented again once done.
+  Atomic<uint32_t> modification_sequence_;
   // Extra strong roots that can be either dex files or dex caches. Dex files used by the class
   // loader which may not be owned by the class loader must be held strongly live. Also dex caches
   // are held live to prevent them being unloading once they have classes in them.
@@ -296,6 +333,7 @@ class ClassTable {
 
   friend class linker::ImageWriter;  // for InsertWithoutLocks.
   friend class linker::OatWriter;  // for boot class TableSlot address lookup.
+  DISALLOW_COPY_AND_ASSIGN(ClassTable);
 };
 
 }  // namespace art
@@ -27,6 +27,7 @@
 #include "mirror/class-inl.h"
 #include "obj_ptr.h"
 #include "scoped_thread_state_change-inl.h"
+#include "thread_pool.h"
 
 namespace art {
 namespace mirror {
@@ -65,6 +66,26 @@ class CollectRootVisitor {
   mutable std::set<mirror::Object*> roots_;
 };
 
+// Collects boot image classes with distinct descriptors, which do not move.
+class CollectBootImageClassesVisitor : public ClassVisitor {
+ public:
+  explicit CollectBootImageClassesVisitor(size_t max_classes) : max_classes_(max_classes) {}
+
+  bool operator()(ObjPtr<Class> klass) OVERRIDE REQUIRES_SHARED(Locks::mutator_lock_) {
+    if (Runtime::Current()->GetHeap()->ObjectIsInBootImageSpace(klass)) {
+      std::string temp;
+      if (descriptors_.insert(klass->GetDescriptor(&temp)).second) {
+        classes_.push_back(klass.Ptr());
+      }
+    }
+    return classes_.size() < max_classes_;
+  }
+
+  const size_t max_classes_;
+  std::set<std::string> descriptors_;
+  std::vector<Class*> classes_;
+};
+
 
 class ClassTableTest : public CommonRuntimeTest {};
 
@@ -159,5 +180,72 @@ TEST_F(ClassTableTest, ClassTable) {
   // TODO: Add tests for UpdateClass, InsertOatFile.
 }
 
+TEST_F(ClassTableTest, ConcurrentLookup) {
+  Thread* self = Thread::Current();
+  static constexpr size_t kNumThreads = 4u;
+  static constexpr size_t kNumRounds = 20u;
+  std::vector<Class*> classes;
+  std::vector<std::string> descriptors;
+  {
+    ScopedObjectAccess soa(self);
+    CollectBootImageClassesVisitor visitor(/* max_classes */ 1000u);
+    class_linker_->VisitClasses(&visitor);
+    classes = visitor.classes_;
+    for (Class* klass : classes) {
+      std::string temp;
+      descriptors.push_back(klass->GetDescriptor(&temp));
+    }
+  }
+  ASSERT_GE(classes.size(), 16u);
+  const size_t half = classes.size() / 2u;
+  ClassTable table;
+  {
+    ScopedObjectAccess soa(self);
+    for (size_t i = 0; i != half; ++i) {
+      table.Insert(classes[i]);
+    }
+  }
+  // Look up the first half while the second half is inserted, frozen and partly removed. The
+  // lookups which race with a FreezeSnapshot or a Remove must still find the classes.
+  ThreadPool pool("Class table test thread pool", kNumThreads);
+  for (size_t t = 0; t != kNumThreads; ++t) {
+    pool.AddTask(self, new FunctionTask([&](Thread* worker) {
+      ScopedObjectAccess soa(worker);
+      for (size_t round = 0; round != kNumRounds; ++round) {
+        for (size_t i = 0; i != half; ++i) {
+          const char* descriptor = descriptors[i].c_str();
+          ASSERT_EQ(classes[i], table.Lookup(descriptor, ComputeModifiedUtf8Hash(descriptor)));
+        }
+        ASSERT_EQ(nullptr, table.Lookup("NOT_THERE", ComputeModifiedUtf8Hash("NOT_THERE")));
+      }
+    }));
+  }
+  pool.StartWorkers(self);
+  {
+    ScopedObjectAccess soa(self);
+    for (size_t i = half; i != classes.size(); ++i) {
+      table.Insert(classes[i]);
+      if (i == half + half / 2u) {
+        table.FreezeSnapshot();
+      }
+    }
+    for (size_t i = half; i < classes.size(); i += 2u) {
+      EXPECT_TRUE(table.Remove(descriptors[i].c_str()));
+    }
+  }
+  pool.Wait(self, /* do_work */ false, /* may_hold_locks */ false);
+  pool.StopWorkers(self);
+  // No lookup is in progress, the second call frees all the sets retired while growing.
+  table.FreeSetsRetiredBeforePreviousCall();
+  table.FreeSetsRetiredBeforePreviousCall();
+
+  ScopedObjectAccess soa(self);
+  for (size_t i = 0; i != classes.size(); ++i) {
+    const char* descriptor = descriptors[i].c_str();
+    Class* expected = (i >= half && (i - half) % 2u == 0u) ? nullptr : classes[i];
+    EXPECT_EQ(expected, table.Lookup(descriptor, ComputeModifiedUtf8Hash(descriptor)));
+  }
+}
+
 }  // namespace mirror
 }  // namespace art
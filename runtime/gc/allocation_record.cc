@@ -20,6 +20,8 @@
 #include "base/enums.h"
 #include "base/logging.h"  // For VLOG
 #include "base/stl_util.h"
+#include "base/time_utils.h"
+#include "gc/heap.h"
 #include "obj_ptr-inl.h"
 #include "object_callbacks.h"
 #include "stack.h"
@@ -321,5 +323,115 @@ void AllocRecordObjectMap::Clear() {
 AllocRecordObjectMap::AllocRecordObjectMap()
     : new_record_condition_("New allocation record condition", *Locks::alloc_tracker_lock_) {}
 
+void AllocSampleTable::SetAllocSamplingEnabled(bool enabled, size_t sampling_interval) {
+  Thread* self = Thread::Current();
+  Heap* heap = Runtime::Current()->GetHeap();
+  MutexLock mu(self, *Locks::alloc_tracker_lock_);
+  if (enabled) {
+    CHECK_GT(sampling_interval, 0U);
+    AllocSampleTable* table = heap->GetAllocSampleTable();
+    if (table == nullptr) {
+      table = new AllocSampleTable;
+      heap->SetAllocSampleTable(table);
+    }
+    // Start over, possibly with a different interval.
+    table->sampling_interval_ = sampling_interval;
+    table->random_.seed(static_cast<uint32_t>(NanoTime()));
+    table->samples_.clear();
+    table->total_samples_ = 0;
+    LOG(INFO) << "Enabling allocation sampling every " << PrettySize(sampling_interval)
+              << " on average";
+    heap->SetAllocSamplingEnabled(true);
+  } else if (heap->IsAllocSamplingEnabled()) {
+    // Keep the samples so that they can still be dumped.
+    heap->SetAllocSamplingEnabled(false);
+    LOG(INFO) << "Disabling allocation sampling";
+  }
+}
+
+int64_t AllocSampleTable::NextSampleDistance() {
+  std::exponential_distribution<double> distribution(1.0 / sampling_interval_);
+  return static_cast<int64_t>(distribution(random_)) + 1;
+}
+
+void AllocSampleTable::RecordTlabAllocation(Thread* self, size_t bytes) {
+  int64_t bytes_remaining = self->GetAllocSampleBytesRemaining();
+  if (LIKELY(bytes_remaining > static_cast<int64_t>(bytes))) {
+    self->SetAllocSampleBytesRemaining(bytes_remaining - bytes);
+    return;
+  }
+  const bool first_tlab = (bytes_remaining == 0);
+  bytes_remaining -= bytes;
+  uint64_t num_samples = 0;
+  {
+    MutexLock mu(self, *Locks::alloc_tracker_lock_);
+    if (first_tlab) {
+      // Do not sample the first TLAB of every thread.
+      bytes_remaining += NextSampleDistance();
+    }
+    while (bytes_remaining <= 0) {
+      ++num_samples;
+      bytes_remaining += NextSampleDistance();
+    }
+  }
+  self->SetAllocSampleBytesRemaining(bytes_remaining);
+  if (num_samples == 0) {
+    return;
+  }
+  // Get stack trace outside of lock in case there are allocations during the stack walk.
+  AllocRecordStackTrace trace;
+  AllocRecordStackVisitor visitor(self, kMaxStackDepth, /*out*/ &trace);
+  visitor.WalkStack();
+
+  MutexLock mu(self, *Locks::alloc_tracker_lock_);
+  if (!Runtime::Current()->GetHeap()->IsAllocSamplingEnabled()) {
+    // Disabled during the stack walk.
+    return;
+  }
+  samples_[std::move(trace)] += num_samples;
+  total_samples_ += num_samples;
+}
+
+void AllocSampleTable::VisitRoots(RootVisitor* visitor) {
+  BufferedRootVisitor<kDefaultBufferedRootCount> buffered_visitor(visitor, RootInfo(kRootDebugger));
+  for (const auto& entry : samples_) {
+    const AllocRecordStackTrace& trace = entry.first;
+    for (size_t i = 0, depth = trace.GetDepth(); i < depth; ++i) {
+      const AllocRecordStackTraceElement& element = trace.GetStackElement(i);
+      DCHECK(element.GetMethod() != nullptr);
+      element.GetMethod()->VisitRoots(buffered_visitor, kRuntimePointerSize);
+    }
+  }
+}
+
+void AllocSampleTable::Dump(std::ostream& os) {
+  std::vector<std::pair<uint64_t, const AllocRecordStackTrace*>> traces;
+  traces.reserve(samples_.size());
+  for (const auto& entry : samples_) {
+    traces.emplace_back(entry.second, &entry.first);
+  }
+  std::sort(traces.begin(),
+            traces.end(),
+            [](const std::pair<uint64_t, const AllocRecordStackTrace*>& lhs,
+               const std::pair<uint64_t, const AllocRecordStackTrace*>& rhs) {
+              return lhs.first > rhs.first;
+            });
+  os << "Allocation samples: " << total_samples_ << " in " << traces.size()
+     << " stack traces, one every " << sampling_interval_ << " bytes on average\n";
+  for (const auto& entry : traces) {
+    os << "\n" << entry.first << " samples, about "
+       << PrettySize(entry.first * sampling_interval_) << " allocated\n";
+    const AllocRecordStackTrace* trace = entry.second;
+    for (size_t i = 0, depth = trace->GetDepth(); i < depth; ++i) {
+      const AllocRecordStackTraceElement& element = trace->GetStackElement(i);
+      ArtMethod* method = element.GetMethod();
+      const char* source_file = method->GetDeclaringClassSourceFile();
+      os << "  at " << method->PrettyMethod() << "("
+         << (source_file != nullptr ? source_file : "unknown") << ":"
+         << element.ComputeLineNumber() << ")\n";
+    }
+  }
+}
+
 }  // namespace gc
 }  // namespace art
@@ -19,6 +19,8 @@
 
 #include <list>
 #include <memory>
+#include <random>
+#include <unordered_map>
 
 #include "base/mutex.h"
 #include "gc_root.h"
@@ -307,6 +309,63 @@ class AllocRecordObjectMap {
   void SetProperties() REQUIRES(Locks::alloc_tracker_lock_);
 };
 
+// Sampled allocation profile, cheap enough to be left enabled in production. Unlike
+// AllocRecordObjectMap, which records every allocation, the allocated bytes are sampled as a
+// Poisson process: a thread takes a sample after allocating an exponentially distributed number
+// of bytes with a mean of the sampling interval. Threads only check for due samples when they get
+// a new TLAB, so the fast allocation paths are not instrumented. The samples are aggregated per
+// stack trace, and each of them stands for sampling interval bytes on average.
+class AllocSampleTable {
+ public:
+  static constexpr size_t kDefaultSamplingInterval = 512 * KB;
+
+  AllocSampleTable() {}
+
+  // Enable sampling with the given mean interval in bytes, dropping the previous samples, or
+  // disable it. The samples taken so far are kept and can still be dumped after disabling.
+  static void SetAllocSamplingEnabled(bool enabled, size_t sampling_interval)
+      REQUIRES(!Locks::alloc_tracker_lock_);
+
+  // Called when `self` got `bytes` more for thread-local allocation. The samples that fall into
+  // these bytes are attributed to the stack trace of the current allocation.
+  void RecordTlabAllocation(Thread* self, size_t bytes)
+      REQUIRES(!Locks::alloc_tracker_lock_)
+      REQUIRES_SHARED(Locks::mutator_lock_);
+
+  // Keep the methods in the sampled stack traces from being unloaded.
+  void VisitRoots(RootVisitor* visitor)
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(Locks::alloc_tracker_lock_);
+
+  // Dump the stack traces by decreasing number of samples, with the estimated allocated bytes.
+  void Dump(std::ostream& os)
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(Locks::alloc_tracker_lock_);
+
+  size_t GetSamplingInterval() const REQUIRES(Locks::alloc_tracker_lock_) {
+    return sampling_interval_;
+  }
+
+  uint64_t GetTotalSamples() const REQUIRES(Locks::alloc_tracker_lock_) {
+    return total_samples_;
+  }
+
+ private:
+  static constexpr size_t kMaxStackDepth = 32;
+
+  // Draw the number of bytes to allocate until the next sample.
+  int64_t NextSampleDistance() REQUIRES(Locks::alloc_tracker_lock_);
+
+  size_t sampling_interval_ GUARDED_BY(Locks::alloc_tracker_lock_) = kDefaultSamplingInterval;
+  std::minstd_rand random_ GUARDED_BY(Locks::alloc_tracker_lock_);
+  // Number of samples per stack trace. The thread ids of the traces are not recorded.
+  std::unordered_map<AllocRecordStackTrace, uint64_t, HashAllocRecordTypes> samples_
+      GUARDED_BY(Locks::alloc_tracker_lock_);
+  uint64_t total_samples_ GUARDED_BY(Locks::alloc_tracker_lock_) = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(AllocSampleTable);
+};
+
 }  // namespace gc
 }  // namespace art
 #endif  // ART_RUNTIME_GC_ALLOCATION_RECORD_H_
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gc/allocation_record.h"
+
+#include <sstream>
+#include <string>
+
+#include "common_runtime_test.h"
+#include "gc/heap.h"
+#include "mirror/array-inl.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread-current-inl.h"
+
+namespace art {
+namespace gc {
+
+static constexpr size_t kSamplingInterval = 4 * KB;
+
+class AllocSampleTableTest : public CommonRuntimeTest {
+ protected:
+  void SetUpRuntimeOptions(RuntimeOptions* options) OVERRIDE {
+    CommonRuntimeTest::SetUpRuntimeOptions(options);
+    options->push_back(std::make_pair(
+        "-Xallocsampling-interval:" + std::to_string(kSamplingInterval), nullptr));
+  }
+
+  uint64_t GetTotalSamples() {
+    MutexLock mu(Thread::Current(), *Locks::alloc_tracker_lock_);
+    AllocSampleTable* table = Runtime::Current()->GetHeap()->GetAllocSampleTable();
+    return (table != nullptr) ? table->GetTotalSamples() : 0u;
+  }
+
+  std::string Dump() {
+    std::ostringstream oss;
+    Runtime::Current()->GetHeap()->DumpAllocSamples(oss);
+    return oss.str();
+  }
+};
+
+TEST_F(AllocSampleTableTest, SamplesAreKeptUntilRestart) {
+  Heap* heap = Runtime::Current()->GetHeap();
+  // Enabled by the runtime option.
+  ASSERT_TRUE(heap->IsAllocSamplingEnabled());
+  {
+    MutexLock mu(Thread::Current(), *Locks::alloc_tracker_lock_);
+    ASSERT_TRUE(heap->GetAllocSampleTable() != nullptr);
+    EXPECT_EQ(kSamplingInterval, heap->GetAllocSampleTable()->GetSamplingInterval());
+  }
+  if (heap->GetCurrentAllocator() != kAllocatorTypeTLAB &&
+      heap->GetCurrentAllocator() != kAllocatorTypeRegionTLAB) {
+    // Only the allocations with a new TLAB take samples.
+    return;
+  }
+
+  {
+    ScopedObjectAccess soa(Thread::Current());
+    // 4MB, many TLABs and about a thousand samples.
+    for (size_t i = 0; i != 4 * KB; ++i) {
+      ASSERT_TRUE(mirror::IntArray::Alloc(soa.Self(), KB / sizeof(int32_t)) != nullptr);
+    }
+  }
+  const uint64_t total_samples = GetTotalSamples();
+  EXPECT_NE(0u, total_samples);
+
+  // Stopping keeps the samples, they can still be dumped.
+  AllocSampleTable::SetAllocSamplingEnabled(false, AllocSampleTable::kDefaultSamplingInterval);
+  EXPECT_FALSE(heap->IsAllocSamplingEnabled());
+  EXPECT_EQ(total_samples, GetTotalSamples());
+  std::string dump = Dump();
+  EXPECT_NE(std::string::npos,
+            dump.find("Allocation samples: " + std::to_string(total_samples) + " in "))
+      << dump;
+
+  // Restarting drops them.
+  AllocSampleTable::SetAllocSamplingEnabled(true, kSamplingInterval);
+  EXPECT_TRUE(heap->IsAllocSamplingEnabled());
+  EXPECT_EQ(0u, GetTotalSamples());
+  AllocSampleTable::SetAllocSamplingEnabled(false, AllocSampleTable::kDefaultSamplingInterval);
+}
+
+}  // namespace gc
+}  // namespace art
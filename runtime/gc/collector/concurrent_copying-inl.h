@@ -37,9 +37,10 @@ inline mirror::Object* ConcurrentCopying::MarkUnevacFromSpaceRegion(
   // (black) to gray even though the object has already been marked through. This happens if a
   // mutator thread gets preempted before the AtomicSetReadBarrierState below, GC marks through the
   // object (changes it from non-gray (white) to gray and back to non-gray (black)), and the thread
-  // runs and incorrectly changes it from non-gray (black) to gray. If this happens, the object
-  // will get added to the mark stack again and get changed back to non-gray (black) after it is
-  // processed.
+  // runs and incorrectly changes it from non-gray (black) to gray. If this happens, the bitmap is
+  // set by then and we change the object back to non-gray (black) ourselves rather than pushing
+  // it again: ProcessMarkStackRef leaves marked objects to the thread which scanned them, which
+  // may be another GC thread during parallel marking.
   if (kUseBakerReadBarrier) {
     // Test the bitmap first to avoid graying an object that has already been marked through most
     // of the time.
@@ -60,10 +61,19 @@ inline mirror::Object* ConcurrentCopying::MarkUnevacFromSpaceRegion(
     success = !bitmap->AtomicTestAndSet(ref);
   }
   if (success) {
-    // Newly marked.
     if (kUseBakerReadBarrier) {
       DCHECK_EQ(ref->GetReadBarrierState(), ReadBarrier::GrayState());
+      // Pairs with the release when the GC makes a scanned object non-gray, after setting its bit.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (UNLIKELY(bitmap->Test(ref))) {
+        // Already marked through, see above.
+        bool reverted = ref->AtomicSetReadBarrierState(ReadBarrier::GrayState(),
+                                                       ReadBarrier::NonGrayState());
+        DCHECK(reverted);
+        return ref;
+      }
     }
+    // Newly marked.
     PushOntoMarkStack(ref);
   }
   return ref;
@@ -77,7 +87,7 @@ inline mirror::Object* ConcurrentCopying::MarkImmuneSpace(mirror::Object* ref) {
     // true). Also, a mutator doesn't (need to) gray an immune object after GC has updated all
     // immune space objects (when updated_all_immune_objects_ is true).
     if (kIsDebugBuild) {
-      if (Thread::Current() == thread_running_gc_) {
+      if (IsGcThread(Thread::Current())) {
         DCHECK(!kGrayImmuneObject ||
                updated_all_immune_objects_.load(std::memory_order_relaxed) ||
                gc_grays_immune_objects_);
@@ -110,7 +120,7 @@ inline mirror::Object* ConcurrentCopying::Mark(mirror::Object* from_ref,
   DCHECK(heap_->collector_type_ == kCollectorTypeCC);
   if (kFromGCThread) {
     DCHECK(is_active_);
-    DCHECK_EQ(Thread::Current(), thread_running_gc_);
+    DCHECK(IsGcThread(Thread::Current()));
   } else if (UNLIKELY(kUseBakerReadBarrier && !is_active_)) {
     // In the lock word forward address state, the read barrier bits
     // in the lock word are part of the stored forwarding address and
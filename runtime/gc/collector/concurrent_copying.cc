@@ -43,6 +43,7 @@
 #include "scoped_thread_state_change-inl.h"
 #include "thread-inl.h"
 #include "thread_list.h"
+#include "thread_pool.h"
 #include "well_known_classes.h"
 
 namespace art {
@@ -62,8 +63,14 @@ static constexpr bool kDisallowReadBarrierDuringScan = kIsDebugBuild;
 static constexpr size_t kReadBarrierMarkStackSize = 512 * KB;
 // Verify that there are no missing card marks.
 static constexpr bool kVerifyNoMissingCardMarks = kIsDebugBuild;
+// With -Xgc:parallel_cc_marking, the mark stack is processed with the GC workers of the heap
+// thread pool in the thread-local mark stack mode if there are at least this many refs on it.
+static constexpr size_t kMinimumParallelMarkStackSize = 1024;
+// Number of refs of the GC mark stack taken at once by a parallel marking task.
+static constexpr size_t kParallelMarkStackChunkSize = 256;
 
 ConcurrentCopying::ConcurrentCopying(Heap* heap,
+                                     bool young_gen,
                                      const std::string& name_prefix,
                                      bool measure_read_barrier_slow_path)
     : GarbageCollector(heap,
@@ -79,6 +86,9 @@ ConcurrentCopying::ConcurrentCopying(Heap* heap,
       rb_mark_bit_stack_full_(false),
       mark_stack_lock_("concurrent copying mark stack lock", kMarkSweepMarkStackLock),
       thread_running_gc_(nullptr),
+      parallel_marking_(false),
+      parallel_mark_stack_index_(0),
+      parallel_mark_count_(0),
       is_marking_(false),
       is_using_read_barrier_entrypoints_(false),
       is_active_(false),
@@ -102,6 +112,8 @@ ConcurrentCopying::ConcurrentCopying(Heap* heap,
       rb_slow_path_count_gc_total_(0),
       rb_table_(heap_->GetReadBarrierTable()),
       force_evacuate_all_(false),
+      use_generational_cc_(heap->GetUseGenerationalCC()),
+      young_gen_(young_gen),
       gc_grays_immune_objects_(false),
       immune_gray_stack_lock_("concurrent copying immune gray stack lock",
                               kMarkSweepMarkStackLock) {
@@ -175,6 +187,10 @@ void ConcurrentCopying::RunPhases() {
     // the pause.
     ReaderMutexLock mu(self, *Locks::mutator_lock_);
     GrayAllDirtyImmuneObjects();
+    if (young_gen_) {
+      // Likewise for the old objects that may refer to young ones.
+      GrayAllDirtyOldObjects();
+    }
   }
   FlipThreadRoots();
   {
@@ -269,9 +285,29 @@ void ConcurrentCopying::BindBitmaps() {
       immune_spaces_.AddSpace(space);
     } else if (space == region_space_) {
       // It is OK to clear the bitmap with mutators running since the only place it is read is
-      // VisitObjects which has exclusion with CC.
+      // VisitObjects which has exclusion with CC. A young-generation collection keeps the bitmap
+      // since it records the live old objects.
       region_space_bitmap_ = region_space_->GetMarkBitmap();
-      region_space_bitmap_->Clear();
+      if (!young_gen_) {
+        region_space_bitmap_->Clear();
+      }
+    }
+  }
+  if (use_generational_cc_) {
+    // Age the cards of the region space and the non-moving space: cards dirtied since the last
+    // collection become aged and the others become clean. Any old object that may refer to a
+    // young object is on a dirty or aged card at the next young-generation collection.
+    accounting::CardTable* const card_table = heap_->GetCardTable();
+    card_table->ModifyCardsAtomic(region_space_->Begin(),
+                                  region_space_->Limit(),
+                                  AgeCardVisitor(),
+                                  /* card modified visitor */ VoidFunctor());
+    space::ContinuousSpace* const non_moving_space = heap_->GetNonMovingSpace();
+    if (non_moving_space != nullptr) {
+      card_table->ModifyCardsAtomic(non_moving_space->Begin(),
+                                    non_moving_space->Limit(),
+                                    AgeCardVisitor(),
+                                    /* card modified visitor */ VoidFunctor());
     }
   }
 }
@@ -422,18 +458,37 @@ class ConcurrentCopying::FlipCallback : public Closure {
     Locks::mutator_lock_->AssertExclusiveHeld(self);
     {
       TimingLogger::ScopedTiming split2("(Paused)SetFromSpace", cc->GetTimings());
-      cc->region_space_->SetFromSpace(cc->rb_table_, cc->force_evacuate_all_);
+      space::RegionSpace::EvacMode evac_mode =
+          space::RegionSpace::EvacMode::kEvacModeLivePercentNewlyAllocated;
+      if (cc->young_gen_) {
+        evac_mode = space::RegionSpace::EvacMode::kEvacModeNewlyAllocated;
+      } else if (cc->force_evacuate_all_) {
+        evac_mode = space::RegionSpace::EvacMode::kEvacModeForceAll;
+      }
+      cc->region_space_->SetFromSpace(cc->rb_table_, evac_mode);
     }
     cc->SwapStacks();
     if (ConcurrentCopying::kEnableFromSpaceAccountingCheck) {
       cc->RecordLiveStackFreezeSize(self);
-      cc->from_space_num_objects_at_first_pause_ = cc->region_space_->GetObjectsAllocated();
-      cc->from_space_num_bytes_at_first_pause_ = cc->region_space_->GetBytesAllocated();
+      if (cc->young_gen_) {
+        // The old regions stay in the to-space and are not accounted for by the collection.
+        cc->from_space_num_objects_at_first_pause_ =
+            cc->region_space_->GetObjectsAllocatedInFromSpace() +
+            cc->region_space_->GetObjectsAllocatedInUnevacFromSpace();
+        cc->from_space_num_bytes_at_first_pause_ =
+            cc->region_space_->GetBytesAllocatedInFromSpace() +
+            cc->region_space_->GetBytesAllocatedInUnevacFromSpace();
+      } else {
+        cc->from_space_num_objects_at_first_pause_ = cc->region_space_->GetObjectsAllocated();
+        cc->from_space_num_bytes_at_first_pause_ = cc->region_space_->GetBytesAllocated();
+      }
     }
     cc->is_marking_ = true;
     cc->mark_stack_mode_.store(ConcurrentCopying::kMarkStackModeThreadLocal,
                                std::memory_order_relaxed);
-    if (kIsDebugBuild) {
+    if (kIsDebugBuild && !cc->young_gen_) {
+      // The old regions left in the to-space by a young-generation collection keep their live
+      // bytes.
       cc->region_space_->AssertAllRegionLiveBytesZeroOrCleared();
     }
     if (UNLIKELY(Runtime::Current()->IsActiveTransaction())) {
@@ -447,6 +502,9 @@ class ConcurrentCopying::FlipCallback : public Closure {
         // Check that all non-gray immune objects only reference immune objects.
         cc->VerifyGrayImmuneObjects();
       }
+      if (cc->young_gen_) {
+        cc->GrayAllNewlyDirtyOldObjects();
+      }
     }
     // May be null during runtime creation, in this case leave java_lang_Object null.
     // This is safe since single threaded behavior should mean FillDummyObject does not
@@ -733,6 +791,62 @@ void ConcurrentCopying::GrayAllNewlyDirtyImmuneObjects() {
   updated_all_immune_objects_.store(true, std::memory_order_relaxed);
 }
 
+void ConcurrentCopying::GrayAllDirtyOldObjects() {
+  TimingLogger::ScopedTiming split("GrayAllDirtyOldObjects", GetTimings());
+  DCHECK(young_gen_);
+  accounting::CardTable* const card_table = heap_->GetCardTable();
+  Thread* const self = Thread::Current();
+  using VisitorType = GrayImmuneObjectVisitor</* kIsConcurrent */ true>;
+  VisitorType visitor(self);
+  WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
+  // The live old objects in the region space are marked in the region space bitmap. The
+  // non-moving space is handled in the pause since the objects allocated there since the last
+  // collection are only marked live once the allocation stack is frozen.
+  // Don't clear cards here since we need to rescan in the pause.
+  card_table->Scan</* kClearCard */ false>(region_space_bitmap_,
+                                           region_space_->Begin(),
+                                           region_space_->Limit(),
+                                           visitor,
+                                           gc::accounting::CardTable::kCardAged);
+}
+
+void ConcurrentCopying::GrayAllNewlyDirtyOldObjects() {
+  TimingLogger::ScopedTiming split("(Paused)GrayAllNewlyDirtyOldObjects", GetTimings());
+  DCHECK(young_gen_);
+  accounting::CardTable* const card_table = heap_->GetCardTable();
+  using VisitorType = GrayImmuneObjectVisitor</* kIsConcurrent */ false>;
+  Thread* const self = Thread::Current();
+  VisitorType visitor(self);
+  WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
+  // Don't need to scan aged cards of the region space since we did these before the pause.
+  card_table->Scan</* kClearCard */ false>(region_space_bitmap_,
+                                           region_space_->Begin(),
+                                           region_space_->Limit(),
+                                           visitor,
+                                           gc::accounting::CardTable::kCardDirty);
+  // The non-moving space is not collected by a young-generation collection. Mark the objects
+  // allocated there since the last collection as live and dirty their cards: their fields (such as
+  // the class) may have been set without a card mark.
+  accounting::ObjectStack* const live_stack = heap_->GetLiveStack();
+  space::ContinuousSpace* const non_moving_space = heap_->GetNonMovingSpace();
+  if (non_moving_space != nullptr) {
+    for (StackReference<mirror::Object>* it = live_stack->Begin(); it != live_stack->End(); ++it) {
+      mirror::Object* const obj = it->AsMirrorPtr();
+      if (obj != nullptr && non_moving_space->HasAddress(obj)) {
+        card_table->MarkCard(obj);
+      }
+    }
+  }
+  heap_->MarkAllocStackAsLive(live_stack);
+  if (non_moving_space != nullptr) {
+    card_table->Scan</* kClearCard */ false>(non_moving_space->GetLiveBitmap(),
+                                             non_moving_space->Begin(),
+                                             non_moving_space->Limit(),
+                                             visitor,
+                                             gc::accounting::CardTable::kCardAged);
+  }
+}
+
 void ConcurrentCopying::SwapStacks() {
   heap_->SwapStacks();
 }
@@ -779,6 +893,61 @@ class ConcurrentCopying::ImmuneSpaceScanObjVisitor {
   ConcurrentCopying* const collector_;
 };
 
+class ConcurrentCopying::DirtyOldObjectScanVisitor {
+ public:
+  explicit DirtyOldObjectScanVisitor(ConcurrentCopying* cc)
+      : collector_(cc) {}
+
+  ALWAYS_INLINE void operator()(mirror::Object* obj) const REQUIRES_SHARED(Locks::mutator_lock_) {
+    // Only need to scan gray objects: the others are not on a card that was dirty or aged at the
+    // flip, or were already scanned.
+    if (obj->GetReadBarrierState() != ReadBarrier::GrayState()) {
+      return;
+    }
+    collector_->Scan(obj);
+    mirror::Object* referent = nullptr;
+    if (UNLIKELY((obj->GetClass<kVerifyNone, kWithoutReadBarrier>()->IsTypeOfReferenceClass() &&
+                  (referent = obj->AsReference()->GetReferent<kWithoutReadBarrier>()) != nullptr &&
+                  !collector_->IsInToSpace(referent)))) {
+      // Leave this reference gray in the queue so that GetReferent() will trigger a read barrier,
+      // as in ProcessMarkStackRef.
+      DCHECK(obj->AsReference()->GetPendingNext() != nullptr)
+          << "Left unenqueued ref gray " << obj;
+      return;
+    }
+    // Done scanning the object, go back to black (non-gray).
+    bool success = obj->AtomicSetReadBarrierState(ReadBarrier::GrayState(),
+                                                  ReadBarrier::NonGrayState());
+    CHECK(success)
+        << Runtime::Current()->GetHeap()->GetVerification()->DumpObjectInfo(obj, "failed CAS");
+  }
+
+ private:
+  ConcurrentCopying* const collector_;
+};
+
+void ConcurrentCopying::ScanDirtyOldObjects() {
+  TimingLogger::ScopedTiming split("ScanDirtyOldObjects", GetTimings());
+  DCHECK(young_gen_);
+  accounting::CardTable* const card_table = heap_->GetCardTable();
+  DirtyOldObjectScanVisitor visitor(this);
+  WriterMutexLock mu(Thread::Current(), *Locks::heap_bitmap_lock_);
+  card_table->Scan</* kClearCard */ false>(region_space_bitmap_,
+                                           region_space_->Begin(),
+                                           region_space_->Limit(),
+                                           visitor,
+                                           gc::accounting::CardTable::kCardAged);
+  space::ContinuousSpace* const non_moving_space = heap_->GetNonMovingSpace();
+  if (non_moving_space == nullptr) {
+    return;
+  }
+  card_table->Scan</* kClearCard */ false>(non_moving_space->GetLiveBitmap(),
+                                           non_moving_space->Begin(),
+                                           non_moving_space->Limit(),
+                                           visitor,
+                                           gc::accounting::CardTable::kCardAged);
+}
+
 // Concurrently mark roots that are guarded by read barriers and process the mark stack.
 void ConcurrentCopying::MarkingPhase() {
   TimingLogger::ScopedTiming split("MarkingPhase", GetTimings());
@@ -840,6 +1009,10 @@ void ConcurrentCopying::MarkingPhase() {
     }
     immune_gray_stack_.clear();
   }
+  if (young_gen_) {
+    // Scan the old objects grayed by GrayAllDirtyOldObjects and GrayAllNewlyDirtyOldObjects.
+    ScanDirtyOldObjects();
+  }
 
   {
     TimingLogger::ScopedTiming split2("VisitConcurrentRoots", GetTimings());
@@ -1080,8 +1253,10 @@ void ConcurrentCopying::PushOntoMarkStack(mirror::Object* to_ref) {
   CHECK(thread_running_gc_ != nullptr);
   MarkStackMode mark_stack_mode = mark_stack_mode_.load(std::memory_order_relaxed);
   if (LIKELY(mark_stack_mode == kMarkStackModeThreadLocal)) {
-    if (LIKELY(self == thread_running_gc_)) {
-      // If GC-running thread, use the GC mark stack instead of a thread-local mark stack.
+    if (LIKELY(self == thread_running_gc_ && !parallel_marking_.load(std::memory_order_relaxed))) {
+      // If GC-running thread, use the GC mark stack instead of a thread-local mark stack. While
+      // the GC workers take chunks of the GC mark stack, the GC-running thread uses a thread-local
+      // mark stack too.
       CHECK(self->GetThreadLocalMarkStack() == nullptr);
       if (UNLIKELY(gc_mark_stack_->IsFull())) {
         ExpandGcMarkStack();
@@ -1253,10 +1428,14 @@ void ConcurrentCopying::VerifyNoFromSpaceReferences() {
   }
   // The to-space.
   region_space_->WalkToSpace(verify_no_from_space_refs_visitor);
-  // Non-moving spaces.
+  // Non-moving spaces. A young-generation collection does not mark them, use the live bitmap.
   {
     WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
-    heap_->GetMarkBitmap()->Visit(verify_no_from_space_refs_visitor);
+    if (young_gen_) {
+      heap_->GetLiveBitmap()->Visit(verify_no_from_space_refs_visitor);
+    } else {
+      heap_->GetMarkBitmap()->Visit(verify_no_from_space_refs_visitor);
+    }
   }
   // The alloc stack.
   {
@@ -1419,8 +1598,13 @@ bool ConcurrentCopying::ProcessMarkStackOnce() {
   MarkStackMode mark_stack_mode = mark_stack_mode_.load(std::memory_order_relaxed);
   if (mark_stack_mode == kMarkStackModeThreadLocal) {
     // Process the thread-local mark stacks and the GC mark stack.
-    count += ProcessThreadLocalMarkStacks(/* disable_weak_ref_access */ false,
-                                          /* checkpoint_callback */ nullptr);
+    const size_t thread_count = GetMarkThreadCount();
+    if (thread_count > 1) {
+      count += ProcessMarkStackParallel(thread_count);
+    } else {
+      count += ProcessThreadLocalMarkStacks(/* disable_weak_ref_access */ false,
+                                            /* checkpoint_callback */ nullptr);
+    }
     while (!gc_mark_stack_->IsEmpty()) {
       mirror::Object* to_ref = gc_mark_stack_->PopBack();
       ProcessMarkStackRef(to_ref);
@@ -1480,10 +1664,15 @@ size_t ConcurrentCopying::ProcessThreadLocalMarkStacks(bool disable_weak_ref_acc
                                                        Closure* checkpoint_callback) {
   // Run a checkpoint to collect all thread local mark stacks and iterate over them all.
   RevokeThreadLocalMarkStacks(disable_weak_ref_access, checkpoint_callback);
+  return ProcessRevokedMarkStacks();
+}
+
+size_t ConcurrentCopying::ProcessRevokedMarkStacks() {
+  Thread* self = Thread::Current();
   size_t count = 0;
   std::vector<accounting::AtomicStack<mirror::Object>*> mark_stacks;
   {
-    MutexLock mu(Thread::Current(), mark_stack_lock_);
+    MutexLock mu(self, mark_stack_lock_);
     // Make a copy of the mark stack vector.
     mark_stacks = revoked_mark_stacks_;
     revoked_mark_stacks_.clear();
@@ -1494,19 +1683,144 @@ size_t ConcurrentCopying::ProcessThreadLocalMarkStacks(bool disable_weak_ref_acc
       ProcessMarkStackRef(to_ref);
       ++count;
     }
+    RecycleMarkStack(self, mark_stack);
+  }
+  return count;
+}
+
+void ConcurrentCopying::RecycleMarkStack(Thread* self, accounting::ObjectStack* mark_stack) {
+  MutexLock mu(self, mark_stack_lock_);
+  if (pooled_mark_stacks_.size() >= kMarkStackPoolSize) {
+    // The pool has enough. Delete it.
+    delete mark_stack;
+  } else {
+    // Otherwise, put it into the pool for later reuse.
+    mark_stack->Reset();
+    pooled_mark_stacks_.push_back(mark_stack);
+  }
+}
+
+class ConcurrentCopying::ParallelMarkTask : public SelfDeletingTask {
+ public:
+  explicit ParallelMarkTask(ConcurrentCopying* concurrent_copying)
+      : concurrent_copying_(concurrent_copying) {}
+
+  // The GC-running thread holds the mutator lock on behalf of the workers, like for the parallel
+  // tasks of mark sweep.
+  void Run(Thread* self) OVERRIDE NO_THREAD_SAFETY_ANALYSIS {
+    concurrent_copying_->ProcessMarkStackParallelWork(self);
+  }
+
+ private:
+  ConcurrentCopying* const concurrent_copying_;
+};
+
+size_t ConcurrentCopying::GetMarkThreadCount() const {
+  if (!heap_->GetUseParallelCCMarking() || heap_->GetThreadPool() == nullptr) {
+    return 1;
+  }
+  // Like mark sweep, leave the CPUs to the foreground apps when in the background.
+  if (!Runtime::Current()->InJankPerceptibleProcessState()) {
+    return 1;
+  }
+  return heap_->GetConcGCThreadCount() + 1;
+}
+
+bool ConcurrentCopying::IsGcThread(Thread* self) const {
+  if (self == thread_running_gc_) {
+    return true;
+  }
+  if (parallel_marking_.load(std::memory_order_relaxed)) {
+    for (ThreadPoolWorker* worker : heap_->GetThreadPool()->GetWorkers()) {
+      if (worker->GetThread() == self) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+size_t ConcurrentCopying::ProcessMarkStackParallel(size_t thread_count) {
+  Thread* self = Thread::Current();
+  RevokeThreadLocalMarkStacks(/* disable_weak_ref_access */ false,
+                              /* checkpoint_callback */ nullptr);
+  size_t num_refs = gc_mark_stack_->Size();
+  {
+    MutexLock mu(self, mark_stack_lock_);
+    for (accounting::ObjectStack* mark_stack : revoked_mark_stacks_) {
+      num_refs += mark_stack->Size();
+    }
+  }
+  if (num_refs < kMinimumParallelMarkStackSize) {
+    // Not worth waking up the workers. The caller processes the GC mark stack.
+    return ProcessRevokedMarkStacks();
+  }
+  // The tasks take chunks of the GC mark stack, then the revoked mark stacks. Each of them pushes
+  // onto and drains its own thread-local mark stack, and full thread-local mark stacks are shared
+  // through revoked_mark_stacks_. No thread-local mark stack is revoked by a checkpoint meanwhile
+  // since only the GC-running thread runs such checkpoints.
+  parallel_mark_stack_index_.store(0, std::memory_order_relaxed);
+  parallel_mark_count_.store(0, std::memory_order_relaxed);
+  parallel_marking_.store(true, std::memory_order_relaxed);
+  ThreadPool* thread_pool = heap_->GetThreadPool();
+  for (size_t i = 0; i < thread_count; ++i) {
+    thread_pool->AddTask(self, new ParallelMarkTask(this));
+  }
+  thread_pool->SetMaxActiveWorkers(thread_count - 1);
+  thread_pool->StartWorkers(self);
+  thread_pool->Wait(self, /* do_work */ true, /* may_hold_locks */ true);
+  thread_pool->StopWorkers(self);
+  parallel_marking_.store(false, std::memory_order_relaxed);
+  gc_mark_stack_->Reset();
+  // Refs pushed by a task after it ran out of work are left for the next round.
+  return parallel_mark_count_.load(std::memory_order_relaxed);
+}
+
+void ConcurrentCopying::ProcessMarkStackParallelWork(Thread* self) {
+  size_t count = 0;
+  const size_t gc_mark_stack_size = gc_mark_stack_->Size();
+  while (true) {
+    // Drain our own thread-local mark stack first. It may be replaced when it gets full.
+    for (accounting::ObjectStack* tl_mark_stack = self->GetThreadLocalMarkStack();
+         tl_mark_stack != nullptr && !tl_mark_stack->IsEmpty();
+         tl_mark_stack = self->GetThreadLocalMarkStack()) {
+      ProcessMarkStackRef(tl_mark_stack->PopBack());
+      ++count;
+    }
+    // Then take a chunk of the GC mark stack.
+    const size_t begin = parallel_mark_stack_index_.fetch_add(kParallelMarkStackChunkSize,
+                                                              std::memory_order_relaxed);
+    if (begin < gc_mark_stack_size) {
+      const size_t end = std::min(begin + kParallelMarkStackChunkSize, gc_mark_stack_size);
+      StackReference<mirror::Object>* const refs = gc_mark_stack_->Begin();
+      for (size_t i = begin; i != end; ++i) {
+        ProcessMarkStackRef(refs[i].AsMirrorPtr());
+      }
+      count += end - begin;
+      continue;
+    }
+    // Then steal a full mark stack revoked by a mutator or another task.
+    accounting::ObjectStack* mark_stack = nullptr;
     {
-      MutexLock mu(Thread::Current(), mark_stack_lock_);
-      if (pooled_mark_stacks_.size() >= kMarkStackPoolSize) {
-        // The pool has enough. Delete it.
-        delete mark_stack;
-      } else {
-        // Otherwise, put it into the pool for later reuse.
-        mark_stack->Reset();
-        pooled_mark_stacks_.push_back(mark_stack);
+      MutexLock mu(self, mark_stack_lock_);
+      if (!revoked_mark_stacks_.empty()) {
+        mark_stack = revoked_mark_stacks_.back();
+        revoked_mark_stacks_.pop_back();
       }
     }
+    if (mark_stack == nullptr) {
+      break;
+    }
+    for (StackReference<mirror::Object>* p = mark_stack->Begin(); p != mark_stack->End(); ++p) {
+      ProcessMarkStackRef(p->AsMirrorPtr());
+      ++count;
+    }
+    RecycleMarkStack(self, mark_stack);
   }
-  return count;
+  // Hand the (empty) thread-local mark stack back so that the GC-running thread does not hold one
+  // outside of parallel marking.
+  RevokeThreadLocalMarkStack(self);
+  parallel_mark_count_.fetch_add(count, std::memory_order_relaxed);
 }
 
 inline void ConcurrentCopying::ProcessMarkStackRef(mirror::Object* to_ref) {
@@ -1517,16 +1831,42 @@ inline void ConcurrentCopying::ProcessMarkStackRef(mirror::Object* to_ref) {
         << " is_marked=" << IsMarked(to_ref);
   }
   bool add_to_live_bytes = false;
+  // The GC workers share the region space bitmap words and the live bytes with the GC-running
+  // thread during parallel marking.
+  const bool parallel = parallel_marking_.load(std::memory_order_relaxed);
   if (region_space_->IsInUnevacFromSpace(to_ref)) {
-    // Mark the bitmap only in the GC thread here so that we don't need a CAS.
-    if (!kUseBakerReadBarrier || !region_space_bitmap_->Set(to_ref)) {
-      // It may be already marked if we accidentally pushed the same object twice due to the racy
-      // bitmap read in MarkUnevacFromSpaceRegion.
+    // Mark the bitmap only in the GC threads here so that we don't need a CAS unless marking in
+    // parallel.
+    if (!kUseBakerReadBarrier ||
+        !(parallel ? region_space_bitmap_->AtomicTestAndSet(to_ref)
+                   : region_space_bitmap_->Set(to_ref))) {
       Scan(to_ref);
       // Only add to the live bytes if the object was not already marked.
       add_to_live_bytes = true;
+    } else {
+      // The object is already marked: another push of it is being or has been processed, and only
+      // the thread which scanned it may make it non-gray, after the scan. MarkUnevacFromSpaceRegion
+      // does not push an object it grays after it got marked through, so there is nothing left to
+      // do for this push.
+      return;
     }
   } else {
+    if (use_generational_cc_) {
+      // Record the survivors as live old objects for the next young-generation collection.
+      if (region_space_->IsInToSpace(to_ref)) {
+        if (parallel) {
+          region_space_bitmap_->AtomicTestAndSet(to_ref);
+        } else {
+          region_space_bitmap_->Set(to_ref);
+        }
+      } else if (young_gen_) {
+        // A fall-back copy. A young-generation collection does not swap the bitmaps.
+        space::ContinuousSpace* const non_moving_space = heap_->GetNonMovingSpace();
+        if (non_moving_space != nullptr && non_moving_space->HasAddress(to_ref)) {
+          non_moving_space->GetLiveBitmap()->AtomicTestAndSet(to_ref);
+        }
+      }
+    }
     Scan(to_ref);
   }
   if (kUseBakerReadBarrier) {
@@ -1561,11 +1901,15 @@ inline void ConcurrentCopying::ProcessMarkStackRef(mirror::Object* to_ref) {
 
   if (add_to_live_bytes) {
     // Add to the live bytes per unevacuated from-space. Note this code is always run by the
-    // GC-running thread (no synchronization required).
+    // GC-running thread (no synchronization required) unless marking in parallel.
     DCHECK(region_space_bitmap_->Test(to_ref));
     size_t obj_size = to_ref->SizeOf<kDefaultVerifyFlags>();
     size_t alloc_size = RoundUp(obj_size, space::RegionSpace::kAlignment);
-    region_space_->AddLiveBytes(to_ref, alloc_size);
+    if (parallel) {
+      region_space_->AtomicAddLiveBytes(to_ref, alloc_size);
+    } else {
+      region_space_->AddLiveBytes(to_ref, alloc_size);
+    }
   }
   if (ReadBarrier::kEnableToSpaceInvariantChecks) {
     CHECK(to_ref != nullptr);
@@ -1772,7 +2116,9 @@ void ConcurrentCopying::ReclaimPhase() {
     uint64_t cleared_objects;
     {
       TimingLogger::ScopedTiming split4("ClearFromSpace", GetTimings());
-      region_space_->ClearFromSpace(&cleared_bytes, &cleared_objects);
+      region_space_->ClearFromSpace(&cleared_bytes,
+                                    &cleared_objects,
+                                    /* clear_bitmap */ !use_generational_cc_);
       // `cleared_bytes` and `cleared_objects` may be greater than the from space equivalents since
       // RegionSpace::ClearFromSpace may clear empty unevac regions.
       CHECK_GE(cleared_bytes, from_bytes);
@@ -1802,11 +2148,18 @@ void ConcurrentCopying::ReclaimPhase() {
 
   {
     WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
-    Sweep(false);
-    SwapBitmaps();
-    heap_->UnBindBitmaps();
+    if (young_gen_) {
+      // The non-moving spaces are not collected. Their objects allocated since the last collection
+      // were marked live in GrayAllNewlyDirtyOldObjects.
+      heap_->GetLiveStack()->Reset();
+    } else {
+      Sweep(false);
+      SwapBitmaps();
+      heap_->UnBindBitmaps();
+    }
 
-    // The bitmap was cleared at the start of the GC, there is nothing we need to do here.
+    // The bitmap was cleared at the start of the GC (or holds the live old objects in
+    // generational mode), there is nothing we need to do here.
     DCHECK(region_space_bitmap_ != nullptr);
     region_space_bitmap_ = nullptr;
   }
@@ -2043,7 +2396,7 @@ void ConcurrentCopying::AssertToSpaceInvariantInNonMovingSpace(mirror::Object* o
   if (immune_spaces_.ContainsObject(ref)) {
     if (kUseBakerReadBarrier) {
       // Immune object may not be gray if called from the GC.
-      if (Thread::Current() == thread_running_gc_ && !gc_grays_immune_objects_) {
+      if (IsGcThread(Thread::Current()) && !gc_grays_immune_objects_) {
         return;
       }
       bool updated_all_immune_objects = updated_all_immune_objects_.load(std::memory_order_seq_cst);
@@ -2053,6 +2406,8 @@ void ConcurrentCopying::AssertToSpaceInvariantInNonMovingSpace(mirror::Object* o
           << " ref=" << ref << " ref rb_state=" << ref->GetReadBarrierState()
           << " updated_all_immune_objects=" << updated_all_immune_objects;
     }
+  } else if (young_gen_) {
+    // A young-generation collection does not mark the non-moving spaces.
   } else {
     accounting::ContinuousSpaceBitmap* mark_bitmap =
         heap_mark_bitmap_->GetContinuousSpaceBitmap(ref);
@@ -2118,7 +2473,7 @@ inline void ConcurrentCopying::Scan(mirror::Object* to_ref) {
     Thread::Current()->ModifyDebugDisallowReadBarrier(1);
   }
   DCHECK(!region_space_->IsInFromSpace(to_ref));
-  DCHECK_EQ(Thread::Current(), thread_running_gc_);
+  DCHECK(IsGcThread(Thread::Current()));
   RefFieldsVisitor visitor(this);
   // Disable the read barrier for a performance reason.
   to_ref->VisitReferences</*kVisitNativeRoots*/true, kDefaultVerifyFlags, kWithoutReadBarrier>(
@@ -2129,7 +2484,7 @@ inline void ConcurrentCopying::Scan(mirror::Object* to_ref) {
 }
 
 inline void ConcurrentCopying::Process(mirror::Object* obj, MemberOffset offset) {
-  DCHECK_EQ(Thread::Current(), thread_running_gc_);
+  DCHECK(IsGcThread(Thread::Current()));
   mirror::Object* ref = obj->GetFieldObject<
       mirror::Object, kVerifyNone, kWithoutReadBarrier, false>(offset);
   mirror::Object* to_ref = Mark</*kGrayImmuneObject*/false, /*kFromGCThread*/true>(
@@ -2537,6 +2892,9 @@ mirror::Object* ConcurrentCopying::IsMarked(mirror::Object* from_ref) {
     if (immune_spaces_.ContainsObject(from_ref)) {
       // An immune object is alive.
       to_ref = from_ref;
+    } else if (young_gen_) {
+      // A young-generation collection does not collect the non-moving spaces.
+      to_ref = from_ref;
     } else {
       // Non-immune non-moving space. Use the mark bitmap.
       accounting::ContinuousSpaceBitmap* mark_bitmap =
@@ -2586,6 +2944,12 @@ mirror::Object* ConcurrentCopying::MarkNonMoving(mirror::Object* ref,
   // ref is in a non-moving space (from_ref == to_ref).
   DCHECK(!region_space_->HasAddress(ref)) << ref;
   DCHECK(!immune_spaces_.ContainsObject(ref));
+  if (young_gen_) {
+    // A young-generation collection treats all the objects in the non-moving spaces as live. The
+    // ones referring to young objects are on dirty or aged cards and are scanned by
+    // ScanDirtyOldObjects.
+    return ref;
+  }
   // Use the mark bitmap.
   accounting::ContinuousSpaceBitmap* mark_bitmap =
       heap_mark_bitmap_->GetContinuousSpaceBitmap(ref);
@@ -2672,8 +3036,9 @@ void ConcurrentCopying::FinishPhase() {
     CHECK_EQ(pooled_mark_stacks_.size(), kMarkStackPoolSize);
   }
   // kVerifyNoMissingCardMarks relies on the region space cards not being cleared to avoid false
-  // positives.
-  if (!kVerifyNoMissingCardMarks) {
+  // positives. The generational mode relies on them to find the old objects referring to young
+  // ones.
+  if (!use_generational_cc_ && !kVerifyNoMissingCardMarks) {
     TimingLogger::ScopedTiming split("ClearRegionSpaceCards", GetTimings());
     // We do not currently use the region space cards at all, madvise them away to save ram.
     heap_->GetCardTable()->ClearCardRange(region_space_->Begin(), region_space_->Limit());
@@ -65,9 +65,13 @@ class ConcurrentCopying : public GarbageCollector {
   // pages.
   static constexpr bool kGrayDirtyImmuneObjects = true;
 
-  explicit ConcurrentCopying(Heap* heap,
-                             const std::string& name_prefix = "",
-                             bool measure_read_barrier_slow_path = false);
+  // If young_gen is true then the collector only collects the regions allocated since the last
+  // collection (see Heap::GetUseGenerationalCC). Old objects referring to young ones are found
+  // through the card table, which relies on graying them like the dirty immune objects.
+  ConcurrentCopying(Heap* heap,
+                    bool young_gen,
+                    const std::string& name_prefix = "",
+                    bool measure_read_barrier_slow_path = false);
   ~ConcurrentCopying();
 
   virtual void RunPhases() OVERRIDE
@@ -87,7 +91,7 @@ class ConcurrentCopying : public GarbageCollector {
   void BindBitmaps() REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(!Locks::heap_bitmap_lock_);
   virtual GcType GetGcType() const OVERRIDE {
-    return kGcTypePartial;
+    return young_gen_ ? kGcTypeSticky : kGcTypePartial;
   }
   virtual CollectorType GetCollectorType() const OVERRIDE {
     return kCollectorTypeCC;
@@ -175,6 +179,17 @@ class ConcurrentCopying : public GarbageCollector {
   virtual void ProcessMarkStack() OVERRIDE REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_);
   bool ProcessMarkStackOnce() REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!mark_stack_lock_);
+  // Process the GC mark stack and the revoked thread-local mark stacks with the heap thread pool.
+  // Returns the number of refs processed.
+  size_t ProcessMarkStackParallel(size_t thread_count)
+      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!mark_stack_lock_);
+  // Body of a parallel marking task, run by the GC workers and the GC-running thread.
+  void ProcessMarkStackParallelWork(Thread* self)
+      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!mark_stack_lock_);
+  // Number of threads, including the GC-running thread, to process the mark stack with.
+  size_t GetMarkThreadCount() const;
+  // True for the GC-running thread and, during parallel marking, the GC workers helping it.
+  bool IsGcThread(Thread* self) const;
   void ProcessMarkStackRef(mirror::Object* to_ref) REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_);
   void GrayAllDirtyImmuneObjects()
@@ -183,6 +198,18 @@ class ConcurrentCopying : public GarbageCollector {
   void GrayAllNewlyDirtyImmuneObjects()
       REQUIRES(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_);
+  // Gray the old objects on aged cards (young-generation collection only). Done concurrently
+  // before the flip so that the pause only needs to handle the cards dirtied in the meantime.
+  void GrayAllDirtyOldObjects()
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!mark_stack_lock_, !Locks::heap_bitmap_lock_);
+  void GrayAllNewlyDirtyOldObjects()
+      REQUIRES(Locks::mutator_lock_)
+      REQUIRES(!mark_stack_lock_);
+  // Scan the gray old objects to mark the young objects they refer to.
+  void ScanDirtyOldObjects()
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!mark_stack_lock_, !Locks::heap_bitmap_lock_);
   void VerifyGrayImmuneObjects()
       REQUIRES(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_);
@@ -191,6 +218,11 @@ class ConcurrentCopying : public GarbageCollector {
       REQUIRES(!mark_stack_lock_);
   size_t ProcessThreadLocalMarkStacks(bool disable_weak_ref_access, Closure* checkpoint_callback)
       REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!mark_stack_lock_);
+  size_t ProcessRevokedMarkStacks() REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!mark_stack_lock_);
+  // Return an emptied mark stack to the pool, or delete it if the pool is full.
+  void RecycleMarkStack(Thread* self, accounting::ObjectStack* mark_stack)
+      REQUIRES(!mark_stack_lock_);
   void RevokeThreadLocalMarkStacks(bool disable_weak_ref_access, Closure* checkpoint_callback)
       REQUIRES_SHARED(Locks::mutator_lock_);
   void SwitchToSharedMarkStackMode() REQUIRES_SHARED(Locks::mutator_lock_)
@@ -304,6 +336,14 @@ class ConcurrentCopying : public GarbageCollector {
   std::vector<accounting::ObjectStack*> pooled_mark_stacks_
       GUARDED_BY(mark_stack_lock_);
   Thread* thread_running_gc_;
+  // True while the GC workers help the GC-running thread process the mark stack. The GC-running
+  // thread then uses a thread-local mark stack like the workers, and the region space bitmap and
+  // live bytes are updated atomically.
+  Atomic<bool> parallel_marking_;
+  // Index of the next chunk of the GC mark stack to be taken by a parallel marking task.
+  Atomic<size_t> parallel_mark_stack_index_;
+  // Number of refs processed by the parallel marking tasks.
+  Atomic<size_t> parallel_mark_count_;
   bool is_marking_;                       // True while marking is ongoing.
   // True while we might dispatch on the read barrier entrypoints.
   bool is_using_read_barrier_entrypoints_;
@@ -359,6 +399,10 @@ class ConcurrentCopying : public GarbageCollector {
 
   accounting::ReadBarrierTable* rb_table_;
   bool force_evacuate_all_;  // True if all regions are evacuated.
+  // True if the heap collects the young generation separately. Cards are then aged instead of
+  // cleared and the region space bitmap keeps the live old objects, also in full collections.
+  const bool use_generational_cc_;
+  const bool young_gen_;  // True if only the young generation is collected.
   Atomic<bool> updated_all_immune_objects_;
   bool gc_grays_immune_objects_;
   Mutex immune_gray_stack_lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
@@ -377,11 +421,13 @@ class ConcurrentCopying : public GarbageCollector {
   class ComputeUnevacFromSpaceLiveRatioVisitor;
   class DisableMarkingCallback;
   class DisableMarkingCheckpoint;
+  class DirtyOldObjectScanVisitor;
   class DisableWeakRefAccessCallback;
   class FlipCallback;
   template <bool kConcurrent> class GrayImmuneObjectVisitor;
   class ImmuneSpaceScanObjVisitor;
   class LostCopyVisitor;
+  class ParallelMarkTask;
   class RefFieldsVisitor;
   class RevokeThreadLocalMarkStackCheckpoint;
   class ScopedGcGraysImmuneObjects;
@@ -391,6 +437,8 @@ class ConcurrentCopying : public GarbageCollector {
   class VerifyNoFromSpaceRefsVisitor;
   class VerifyNoMissingCardMarkVisitor;
 
+  ART_FRIEND_TEST(ParallelMarkingTest, MarkedObjectsSurvive);
+
   DISALLOW_IMPLICIT_CONSTRUCTORS(ConcurrentCopying);
 };
 
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gc/collector/concurrent_copying.h"
+
+#include <string>
+#include <vector>
+
+#include "class_linker-inl.h"
+#include "common_runtime_test.h"
+#include "gc/heap.h"
+#include "handle_scope-inl.h"
+#include "mirror/class-inl.h"
+#include "mirror/object-inl.h"
+#include "mirror/object_array-inl.h"
+#include "mirror/string-inl.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread_pool.h"
+
+namespace art {
+namespace gc {
+namespace collector {
+
+class ParallelMarkingTest : public CommonRuntimeTest {
+  void SetUpRuntimeOptions(RuntimeOptions* options) OVERRIDE {
+    CommonRuntimeTest::SetUpRuntimeOptions(options);
+    options->push_back(std::make_pair("-Xgc:parallel_cc_marking", nullptr));
+    options->push_back(std::make_pair("-XX:ConcGCThreads=2", nullptr));
+  }
+};
+
+TEST_F(ParallelMarkingTest, MarkedObjectsSurvive) {
+  Heap* heap = Runtime::Current()->GetHeap();
+  if (heap->CurrentCollectorType() != kCollectorTypeCC) {
+    return;
+  }
+  ASSERT_TRUE(heap->GetUseParallelCCMarking());
+  // The runtime is not started, create the GC workers.
+  heap->CreateThreadPool();
+  ASSERT_TRUE(heap->GetThreadPool() != nullptr);
+  ConcurrentCopying* cc = heap->ConcurrentCopyingCollector();
+  ASSERT_EQ(3u, cc->GetMarkThreadCount());
+  {
+    ScopedObjectAccess soa(Thread::Current());
+    // Enough roots for the mark stack to be split between the GC workers.
+    static constexpr size_t kNumArrays = 4096;
+    ObjPtr<mirror::Class> array_class =
+        class_linker_->FindSystemClass(soa.Self(), "[Ljava/lang/Object;");
+    ASSERT_TRUE(array_class != nullptr);
+    VariableSizedHandleScope hs(soa.Self());
+    std::vector<Handle<mirror::ObjectArray<mirror::Object>>> arrays;
+    for (size_t i = 0; i != kNumArrays; ++i) {
+      arrays.push_back(hs.NewHandle(
+          mirror::ObjectArray<mirror::Object>::Alloc(soa.Self(), array_class, /* length */ 1)));
+      ASSERT_TRUE(arrays.back() != nullptr);
+      arrays.back()->Set<false>(
+          0, mirror::String::AllocFromModifiedUtf8(soa.Self(), std::to_string(i).c_str()));
+    }
+    for (size_t round = 0; round != 2; ++round) {
+      heap->CollectGarbage(/* clear_soft_references */ false);
+      // The arrays and strings were marked by the parallel tasks.
+      EXPECT_LE(kNumArrays, cc->parallel_mark_count_.load(std::memory_order_relaxed));
+      for (size_t i = 0; i != kNumArrays; ++i) {
+        ASSERT_TRUE(arrays[i]->Get(0) != nullptr);
+        EXPECT_TRUE(arrays[i]->Get(0)->AsString()->Equals(std::to_string(i))) << i;
+      }
+    }
+  }
+  heap->DeleteThreadPool();
+}
+
+}  // namespace collector
+}  // namespace gc
+}  // namespace art
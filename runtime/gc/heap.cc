@@ -143,6 +143,11 @@ static constexpr bool kLogAllGCs = false;
 static constexpr size_t kPartialTlabSize = 16 * KB;
 static constexpr bool kUsePartialTlabs = true;
 
+// Whether the heap thread pool gives each worker its own task deque. Parallel marking tasks that
+// overflow their mark stack push the overflow as new tasks, which then stay local to the worker
+// unless stolen.
+static constexpr bool kUseWorkStealingThreadPool = true;
+
 #if defined(__LP64__) || !defined(ADDRESS_SANITIZER)
 // 300 MB (0x12c00000) - (default non-moving space capacity).
 uint8_t* const Heap::kPreferredAllocSpaceBegin =
@@ -190,6 +195,8 @@ Heap::Heap(size_t initial_size,
            bool verify_post_gc_rosalloc,
            bool gc_stress_mode,
            bool measure_gc_performance,
+           bool use_generational_cc,
+           bool use_parallel_cc_marking,
            bool use_homogeneous_space_compaction_for_oom,
            uint64_t min_interval_homogeneous_space_compaction_by_oom)
     : non_moving_space_(nullptr),
@@ -237,6 +244,10 @@ Heap::Heap(size_t initial_size,
       verify_pre_sweeping_rosalloc_(verify_pre_sweeping_rosalloc),
       verify_post_gc_rosalloc_(verify_post_gc_rosalloc),
       gc_stress_mode_(gc_stress_mode),
+      use_generational_cc_(use_generational_cc &&
+                           kUseBakerReadBarrier &&
+                           collector::ConcurrentCopying::kGrayDirtyImmuneObjects),
+      use_parallel_cc_marking_(use_parallel_cc_marking),
       /* For GC a lot mode, we limit the allocation stacks to be kGcAlotInterval allocations. This
        * causes a lot of GC since we do a GC for alloc whenever the stack is full. When heap
        * verification is enabled, we limit the size of allocation stacks to speed up their
@@ -260,6 +271,8 @@ Heap::Heap(size_t initial_size,
       semi_space_collector_(nullptr),
       mark_compact_collector_(nullptr),
       concurrent_copying_collector_(nullptr),
+      young_concurrent_copying_collector_(nullptr),
+      active_concurrent_copying_collector_(nullptr),
       is_running_on_memory_tool_(Runtime::Current()->IsRunningOnMemoryTool()),
       use_tlab_(use_tlab),
       main_space_backup_(nullptr),
@@ -280,6 +293,7 @@ Heap::Heap(size_t initial_size,
       blocking_gc_count_rate_histogram_("blocking gc count rate histogram", 1U,
                                         kGcCountRateMaxBucketCount),
       alloc_tracking_enabled_(false),
+      alloc_sampling_enabled_(false),
       backtrace_lock_(nullptr),
       seen_backtrace_count_(0u),
       unique_backtrace_count_(0u),
@@ -593,11 +607,25 @@ Heap::Heap(size_t initial_size,
     }
     if (MayUseCollector(kCollectorTypeCC)) {
       concurrent_copying_collector_ = new collector::ConcurrentCopying(this,
+                                                                       /* young_gen */ false,
                                                                        "",
                                                                        measure_gc_performance);
+      if (use_generational_cc_) {
+        young_concurrent_copying_collector_ = new collector::ConcurrentCopying(
+            this,
+            /* young_gen */ true,
+            "young",
+            measure_gc_performance);
+      }
+      active_concurrent_copying_collector_.store(concurrent_copying_collector_,
+                                                 std::memory_order_relaxed);
       DCHECK(region_space_ != nullptr);
       concurrent_copying_collector_->SetRegionSpace(region_space_);
       garbage_collectors_.push_back(concurrent_copying_collector_);
+      if (young_concurrent_copying_collector_ != nullptr) {
+        young_concurrent_copying_collector_->SetRegionSpace(region_space_);
+        garbage_collectors_.push_back(young_concurrent_copying_collector_);
+      }
     }
     if (MayUseCollector(kCollectorTypeMC)) {
       mark_compact_collector_ = new collector::MarkCompact(this);
@@ -895,7 +923,10 @@ void Heap::UpdateProcessState(ProcessState old_process_state, ProcessState new_p
 void Heap::CreateThreadPool() {
   const size_t num_threads = std::max(parallel_gc_threads_, conc_gc_threads_);
   if (num_threads != 0) {
-    thread_pool_.reset(new ThreadPool("Heap thread pool", num_threads));
+    thread_pool_.reset(new ThreadPool("Heap thread pool",
+                                      num_threads,
+                                      /* create_peers */ false,
+                                      kUseWorkStealingThreadPool));
   }
 }
 
@@ -1048,6 +1079,10 @@ void Heap::DumpGcPerformanceInfo(std::ostream& os) {
     rosalloc_space_->DumpStats(os);
   }
 
+  if (region_space_ != nullptr) {
+    region_space_->DumpEvacuationStats(os);
+  }
+
   os << "Registered native bytes allocated: "
      << (old_native_bytes_allocated_.load(std::memory_order_relaxed) +
          new_native_bytes_allocated_.load(std::memory_order_relaxed))
@@ -1126,6 +1161,7 @@ Heap::~Heap() {
   // If we don't reset then the mark stack complains in its destructor.
   allocation_stack_->Reset();
   allocation_records_.reset();
+  alloc_sample_table_.reset();
   live_stack_->Reset();
   STLDeleteValues(&mod_union_tables_);
   STLDeleteValues(&remembered_sets_);
@@ -2126,6 +2162,9 @@ void Heap::ChangeCollector(CollectorType collector_type) {
     gc_plan_.clear();
     switch (collector_type_) {
       case kCollectorTypeCC: {
+        if (use_generational_cc_) {
+          gc_plan_.push_back(collector::kGcTypeSticky);
+        }
         gc_plan_.push_back(collector::kGcTypeFull);
         if (use_tlab_) {
           ChangeAllocator(kAllocatorTypeRegionTLAB);
@@ -2576,9 +2615,17 @@ collector::GcType Heap::CollectGarbageInternal(collector::GcType gc_type,
         semi_space_collector_->SetSwapSemiSpaces(true);
         collector = semi_space_collector_;
         break;
-      case kCollectorTypeCC:
-        collector = concurrent_copying_collector_;
+      case kCollectorTypeCC: {
+        collector::ConcurrentCopying* const cc_collector =
+            (gc_type == collector::kGcTypeSticky && young_concurrent_copying_collector_ != nullptr)
+                ? young_concurrent_copying_collector_
+                : concurrent_copying_collector_;
+        // Mutators only look at the collector through the read barrier once the collection has
+        // started, which happens after this store through the thread flip.
+        active_concurrent_copying_collector_.store(cc_collector, std::memory_order_relaxed);
+        collector = cc_collector;
         break;
+      }
       case kCollectorTypeMC:
         mark_compact_collector_->SetSpace(bump_pointer_space_);
         collector = mark_compact_collector_;
@@ -2586,7 +2633,9 @@ collector::GcType Heap::CollectGarbageInternal(collector::GcType gc_type,
       default:
         LOG(FATAL) << "Invalid collector type " << static_cast<size_t>(collector_type_);
     }
-    if (collector != mark_compact_collector_ && collector != concurrent_copying_collector_) {
+    if (collector != mark_compact_collector_ &&
+        collector != concurrent_copying_collector_ &&
+        collector != young_concurrent_copying_collector_) {
       temp_space_->GetMemMap()->Protect(PROT_READ | PROT_WRITE);
       if (kIsDebugBuild) {
         // Try to read each page of the memory map in case mprotect didn't work properly b/19894268.
@@ -2594,7 +2643,9 @@ collector::GcType Heap::CollectGarbageInternal(collector::GcType gc_type,
       }
       CHECK(temp_space_->IsEmpty());
     }
-    gc_type = collector::kGcTypeFull;  // TODO: Not hard code this in.
+    if (collector != young_concurrent_copying_collector_) {
+      gc_type = collector::kGcTypeFull;  // TODO: Not hard code this in.
+    }
   } else if (current_allocator_ == kAllocatorTypeRosAlloc ||
       current_allocator_ == kAllocatorTypeDlMalloc) {
     collector = FindCollectorByGcType(gc_type);
@@ -3392,6 +3443,15 @@ void Heap::DumpForSigQuit(std::ostream& os) {
   os << "Heap: " << GetPercentFree() << "% free, " << PrettySize(GetBytesAllocated()) << "/"
      << PrettySize(GetTotalMemory()) << "; " << GetObjectsAllocated() << " objects\n";
   DumpGcPerformanceInfo(os);
+  DumpAllocSamples(os);
+}
+
+void Heap::DumpAllocSamples(std::ostream& os) {
+  ScopedObjectAccess soa(Thread::Current());
+  MutexLock mu(soa.Self(), *Locks::alloc_tracker_lock_);
+  if (alloc_sample_table_ != nullptr) {
+    alloc_sample_table_->Dump(os);
+  }
 }
 
 size_t Heap::GetPercentFree() {
@@ -3462,6 +3522,10 @@ void Heap::GrowForUtilization(collector::GarbageCollector* collector_ran,
     collector::GcType non_sticky_gc_type = NonStickyGcType();
     // Find what the next non sticky collector will be.
     collector::GarbageCollector* non_sticky_collector = FindCollectorByGcType(non_sticky_gc_type);
+    if (collector_type_ == kCollectorTypeCC) {
+      // The full-heap concurrent copying collector reports kGcTypePartial.
+      non_sticky_collector = concurrent_copying_collector_;
+    }
     // If the throughput of the current sticky GC >= throughput of the non sticky collector, then
     // do another sticky collection next.
     // We also check that the bytes allocated aren't over the footprint limit in order to prevent a
@@ -3866,6 +3930,10 @@ void Heap::SetAllocationRecords(AllocRecordObjectMap* records) {
   allocation_records_.reset(records);
 }
 
+void Heap::SetAllocSampleTable(AllocSampleTable* table) {
+  alloc_sample_table_.reset(table);
+}
+
 void Heap::VisitAllocationRecords(RootVisitor* visitor) const {
   if (IsAllocTrackingEnabled()) {
     MutexLock mu(Thread::Current(), *Locks::alloc_tracker_lock_);
@@ -3873,6 +3941,13 @@ void Heap::VisitAllocationRecords(RootVisitor* visitor) const {
       GetAllocationRecords()->VisitRoots(visitor);
     }
   }
+  {
+    // The samples are kept after sampling is disabled, until they are dumped.
+    MutexLock mu(Thread::Current(), *Locks::alloc_tracker_lock_);
+    if (GetAllocSampleTable() != nullptr) {
+      GetAllocSampleTable()->VisitRoots(visitor);
+    }
+  }
 }
 
 void Heap::SweepAllocationRecords(IsMarkedVisitor* visitor) const {
@@ -4095,6 +4170,9 @@ mirror::Object* Heap::AllocWithNewTLAB(Thread* self,
       return nullptr;
     }
   }
+  if (UNLIKELY(IsAllocSamplingEnabled())) {
+    alloc_sample_table_->RecordTlabAllocation(self, *bytes_tl_bulk_allocated);
+  }
   // Refilled TLAB, return.
   mirror::Object* ret = self->AllocTlab(alloc_size);
   DCHECK(ret != nullptr);
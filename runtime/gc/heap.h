@@ -66,6 +66,7 @@ namespace gc {
 
 class AllocationListener;
 class AllocRecordObjectMap;
+class AllocSampleTable;
 class GcPauseListener;
 class ReferenceProcessor;
 class TaskProcessor;
@@ -196,6 +197,8 @@ class Heap {
        bool verify_post_gc_rosalloc,
        bool gc_stress_mode,
        bool measure_gc_performance,
+       bool use_generational_cc,
+       bool use_parallel_cc_marking,
        bool use_homogeneous_space_compaction,
        uint64_t min_interval_homogeneous_space_compaction_by_oom);
 
@@ -710,8 +713,18 @@ class Heap {
     return zygote_space_ != nullptr;
   }
 
+  // Returns the concurrent copying collector that is running or ran last: the young-generation
+  // one for sticky collections in generational mode, the full-heap one otherwise.
   collector::ConcurrentCopying* ConcurrentCopyingCollector() {
-    return concurrent_copying_collector_;
+    return active_concurrent_copying_collector_.load(std::memory_order_relaxed);
+  }
+
+  bool GetUseGenerationalCC() const {
+    return use_generational_cc_;
+  }
+
+  bool GetUseParallelCCMarking() const {
+    return use_parallel_cc_marking_;
   }
 
   CollectorType CurrentCollectorType() {
@@ -792,6 +805,24 @@ class Heap {
   void BroadcastForNewAllocationRecords() const
       REQUIRES(!Locks::alloc_tracker_lock_);
 
+  // Sampled allocation profiling support, see AllocSampleTable.
+  bool IsAllocSamplingEnabled() const {
+    return alloc_sampling_enabled_.load(std::memory_order_acquire);
+  }
+
+  void SetAllocSamplingEnabled(bool enabled) REQUIRES(Locks::alloc_tracker_lock_) {
+    alloc_sampling_enabled_.store(enabled, std::memory_order_release);
+  }
+
+  AllocSampleTable* GetAllocSampleTable() const REQUIRES(Locks::alloc_tracker_lock_) {
+    return alloc_sample_table_.get();
+  }
+
+  void SetAllocSampleTable(AllocSampleTable* table) REQUIRES(Locks::alloc_tracker_lock_);
+
+  // Dump the allocation samples, if sampling was ever enabled. Part of the SIGQUIT dump.
+  void DumpAllocSamples(std::ostream& os) REQUIRES(!Locks::alloc_tracker_lock_);
+
   void DisableGCForShutdown() REQUIRES(!*gc_complete_lock_);
 
   // Create a new alloc space and compact default alloc space to it.
@@ -1247,6 +1278,11 @@ class Heap {
   bool verify_pre_sweeping_rosalloc_;
   bool verify_post_gc_rosalloc_;
   const bool gc_stress_mode_;
+  // True if sticky collections of the concurrent copying collector only collect the young
+  // generation. Only possible with the Baker read barrier and gray dirty immune objects.
+  const bool use_generational_cc_;
+  // True if the concurrent copying collector processes its mark stack with the GC workers.
+  const bool use_parallel_cc_marking_;
 
   // RAII that temporarily disables the rosalloc verification during
   // the zygote fork.
@@ -1334,6 +1370,10 @@ class Heap {
   collector::SemiSpace* semi_space_collector_;
   collector::MarkCompact* mark_compact_collector_;
   collector::ConcurrentCopying* concurrent_copying_collector_;
+  // Only created if use_generational_cc_ is true.
+  collector::ConcurrentCopying* young_concurrent_copying_collector_;
+  // Read by mutators (e.g. in the read barrier slow path) while a collection switches it.
+  Atomic<collector::ConcurrentCopying*> active_concurrent_copying_collector_;
 
   const bool is_running_on_memory_tool_;
   const bool use_tlab_;
@@ -1396,6 +1436,12 @@ class Heap {
   Atomic<bool> alloc_tracking_enabled_;
   std::unique_ptr<AllocRecordObjectMap> allocation_records_;
 
+  // Allocation sampling. The table is created when sampling is first enabled and is only deleted
+  // with the heap, so that allocating threads can use it without locking once they see
+  // alloc_sampling_enabled_.
+  Atomic<bool> alloc_sampling_enabled_;
+  std::unique_ptr<AllocSampleTable> alloc_sample_table_;
+
   // GC stress related data structures.
   Mutex* backtrace_lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
   // Debugging variables, seen backtraces vs unique backtraces.
@@ -1429,6 +1475,7 @@ class Heap {
   friend class VerifyReferenceCardVisitor;
   friend class VerifyReferenceVisitor;
   friend class VerifyObjectVisitor;
+  ART_FRIEND_TEST(GenerationalCCHeapTest, YoungGcAgesCards);
 
   DISALLOW_IMPLICIT_CONSTRUCTORS(Heap);
 };
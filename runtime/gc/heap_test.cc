@@ -16,12 +16,14 @@
 
 #include "class_linker-inl.h"
 #include "common_runtime_test.h"
+#include "gc/collector/concurrent_copying.h"
 #include "gc/accounting/card_table-inl.h"
 #include "gc/accounting/space_bitmap-inl.h"
 #include "handle_scope-inl.h"
 #include "mirror/class-inl.h"
 #include "mirror/object-inl.h"
 #include "mirror/object_array-inl.h"
+#include "mirror/string-inl.h"
 #include "scoped_thread_state_change-inl.h"
 
 namespace art {
@@ -108,5 +110,62 @@ TEST_F(ZygoteHeapTest, PreZygoteFork) {
   Runtime::Current()->GetHeap()->PreZygoteFork();
 }
 
+class GenerationalCCHeapTest : public CommonRuntimeTest {
+  void SetUpRuntimeOptions(RuntimeOptions* options) {
+    CommonRuntimeTest::SetUpRuntimeOptions(options);
+    options->push_back(std::make_pair("-Xgc:generational_cc", nullptr));
+  }
+};
+
+TEST_F(GenerationalCCHeapTest, AgeCardVisitor) {
+  AgeCardVisitor visitor;
+  EXPECT_EQ(accounting::CardTable::kCardDirty - 1, visitor(accounting::CardTable::kCardDirty));
+  EXPECT_EQ(0, visitor(accounting::CardTable::kCardDirty - 1));
+  EXPECT_EQ(0, visitor(0));
+}
+
+TEST_F(GenerationalCCHeapTest, YoungGcAgesCards) {
+  Heap* heap = Runtime::Current()->GetHeap();
+  if (!heap->GetUseGenerationalCC()) {
+    // Generational collection needs the concurrent copying collector with the Baker read barrier.
+    return;
+  }
+  accounting::CardTable* card_table = heap->GetCardTable();
+  ScopedObjectAccess soa(Thread::Current());
+  StackHandleScope<1> hs(soa.Self());
+  Handle<mirror::ObjectArray<mirror::Object>> array(hs.NewHandle(
+      mirror::ObjectArray<mirror::Object>::Alloc(
+          soa.Self(),
+          class_linker_->FindSystemClass(soa.Self(), "[Ljava/lang/Object;"),
+          /* length */ 2)));
+  ASSERT_TRUE(array != nullptr);
+  // A full collection makes the array an old object.
+  heap->CollectGarbageInternal(collector::kGcTypeFull, kGcCauseExplicit, false);
+  EXPECT_NE(accounting::CardTable::kCardDirty, card_table->GetCard(array.Get()));
+
+  // The only reference to the young string is from the old array, found through its card.
+  array->Set<false>(0, mirror::String::AllocFromModifiedUtf8(soa.Self(), "young"));
+  EXPECT_EQ(accounting::CardTable::kCardDirty, card_table->GetCard(array.Get()));
+  EXPECT_EQ(collector::kGcTypeSticky,
+            heap->CollectGarbageInternal(collector::kGcTypeSticky, kGcCauseExplicit, false));
+  EXPECT_EQ(collector::kGcTypeSticky, heap->ConcurrentCopyingCollector()->GetGcType());
+  // The card was aged at the start of the collection and is not cleared by it.
+  EXPECT_EQ(accounting::CardTable::kCardDirty - 1, card_table->GetCard(array.Get()));
+  ASSERT_TRUE(array->Get(0) != nullptr);
+  EXPECT_TRUE(array->Get(0)->AsString()->Equals("young"));
+
+  // Without another write, the next young collection cleans the card. The string survived the
+  // previous collection and is old: it is not collected although its card is clean.
+  heap->CollectGarbageInternal(collector::kGcTypeSticky, kGcCauseExplicit, false);
+  EXPECT_EQ(0, card_table->GetCard(array.Get()));
+  ASSERT_TRUE(array->Get(0) != nullptr);
+  EXPECT_TRUE(array->Get(0)->AsString()->Equals("young"));
+
+  // A full collection goes back to the full-heap collector.
+  heap->CollectGarbage(/* clear_soft_references */ false);
+  EXPECT_NE(collector::kGcTypeSticky, heap->ConcurrentCopyingCollector()->GetGcType());
+  EXPECT_TRUE(array->Get(0)->AsString()->Equals("young"));
+}
+
 }  // namespace gc
 }  // namespace art
@@ -38,6 +38,7 @@
 #include "base/systrace.h"
 #include "base/time_utils.h"
 #include "base/utils.h"
+#include "class_root.h"
 #include "dex/art_dex_file_loader.h"
 #include "dex/dex_file_loader.h"
 #include "exec_utils.h"
@@ -49,7 +50,9 @@
 #include "mirror/object-refvisitor-inl.h"
 #include "oat_file.h"
 #include "runtime.h"
+#include "scoped_thread_state_change-inl.h"
 #include "space-inl.h"
+#include "thread_pool.h"
 
 namespace art {
 namespace gc {
@@ -504,6 +507,15 @@ std::ostream& operator<<(std::ostream& os, const RelocationRange& reloc) {
             << reinterpret_cast<const void*>(reloc.Dest() + reloc.Length()) << ")";
 }
 
+// Compressed images with fewer blocks are decompressed on the loading thread.
+static constexpr size_t kMinBlocksForParallelDecompression = 8;
+// Images with a smaller objects section are relocated on the loading thread.
+static constexpr size_t kMinObjectsSizeForParallelRelocation = 1 * MB;
+// Granularity of the object ranges relocated in parallel.
+static constexpr size_t kRelocationChunkSize = 64 * KB;
+// Maximum number of threads, including the loading thread, working on a single image.
+static constexpr size_t kMaxImageLoaderThreads = 4;
+
 // Helper class encapsulating loading, so we can access private ImageSpace members (this is a
 // friend class), but not declare functions in the header.
 class ImageSpaceLoader {
@@ -801,7 +813,8 @@ class ImageSpaceLoader {
                                uint8_t* address,
                                int fd,
                                TimingLogger& logger,
-                               std::string* error_msg) {
+                               std::string* error_msg)
+      REQUIRES_SHARED(Locks::mutator_lock_) {
     TimingLogger::ScopedTiming timing("MapImageFile", &logger);
     const ImageHeader::StorageMode storage_mode = image_header.GetStorageMode();
     if (storage_mode == ImageHeader::kStorageModeUncompressed) {
@@ -836,7 +849,6 @@ class ImageSpaceLoader {
                                                      error_msg));
     if (map != nullptr) {
       const size_t stored_size = image_header.GetDataSize();
-      const size_t decompress_offset = sizeof(ImageHeader);  // Skip the header.
       std::unique_ptr<MemMap> temp_map(MemMap::MapFile(sizeof(ImageHeader) + stored_size,
                                                        PROT_READ,
                                                        MAP_PRIVATE,
@@ -853,28 +865,118 @@ class ImageSpaceLoader {
       const uint64_t start = NanoTime();
       // LZ4HC and LZ4 have same internal format, both use LZ4_decompress.
       TimingLogger::ScopedTiming timing2("LZ4 decompress image", &logger);
-      const size_t decompressed_size = LZ4_decompress_safe(
-          reinterpret_cast<char*>(temp_map->Begin()) + sizeof(ImageHeader),
-          reinterpret_cast<char*>(map->Begin()) + decompress_offset,
-          stored_size,
-          map->Size() - decompress_offset);
+      if (!DecompressImageBlocks(image_header,
+                                 temp_map->Begin() + sizeof(ImageHeader),
+                                 map->Begin() + sizeof(ImageHeader),
+                                 /* parallel */ true,
+                                 error_msg)) {
+        return nullptr;
+      }
       const uint64_t time = NanoTime() - start;
       // Add one 1 ns to prevent possible divide by 0.
       VLOG(image) << "Decompressing image took " << PrettyDuration(time) << " ("
                   << PrettySize(static_cast<uint64_t>(map->Size()) * MsToNs(1000) / (time + 1))
                   << "/s)";
-      if (decompressed_size + sizeof(ImageHeader) != image_header.GetImageSize()) {
+    }
+
+    return map.release();
+  }
+
+  // Calls `fn(i)` for each i in [0, count). If `parallel` and the calling thread is attached, the
+  // work is spread over a temporary thread pool, with the calling thread helping out. Otherwise
+  // (notably for boot images, which are loaded before the runtime can attach threads) runs
+  // serially on the calling thread. Only suitable for work on images not yet added to the heap,
+  // as the calling thread is suspended while it waits for the pool.
+  template <typename Fn>
+  static void RunInParallel(const char* pool_name, size_t count, bool parallel, const Fn& fn)
+      REQUIRES_SHARED(Locks::mutator_lock_) {
+    Thread* const self = Thread::Current();
+    const size_t thread_count = (parallel && self != nullptr)
+        ? std::min(kMaxImageLoaderThreads, count)
+        : 0u;
+    if (thread_count <= 1u) {
+      for (size_t i = 0; i != count; ++i) {
+        fn(i);
+      }
+      return;
+    }
+    ScopedThreadSuspension sts(self, kNative);
+    ThreadPool pool(pool_name, thread_count - 1u);
+    // A few tasks per thread to even out the load.
+    const size_t task_count = thread_count * 4u;
+    const size_t items_per_task = RoundUp(count, task_count) / task_count;
+    for (size_t begin = 0; begin < count; begin += items_per_task) {
+      const size_t end = std::min(count, begin + items_per_task);
+      pool.AddTask(self, new FunctionTask([&fn, begin, end](Thread*) {
+        for (size_t i = begin; i != end; ++i) {
+          fn(i);
+        }
+      }));
+    }
+    pool.StartWorkers(self);
+    pool.Wait(self, /* do_work */ true, /* may_hold_locks */ false);
+  }
+
+  // Decompresses the blocks of a compressed image from `data` (the stored data right after the
+  // header in the file) to `out` (the image data right after the header in memory).
+  static bool DecompressImageBlocks(const ImageHeader& image_header,
+                                    const uint8_t* data,
+                                    uint8_t* out,
+                                    bool parallel,
+                                    std::string* error_msg)
+      REQUIRES_SHARED(Locks::mutator_lock_) {
+    const size_t stored_size = image_header.GetDataSize();
+    const size_t image_data_size = image_header.GetImageSize() - sizeof(ImageHeader);
+    const size_t block_size = image_header.GetBlockSize();
+    const size_t block_count = image_header.GetBlockCount();
+    if (block_size == 0u ||
+        block_count != RoundUp(image_data_size, block_size) / block_size ||
+        block_count * sizeof(ImageHeader::Block) > stored_size) {
+      if (error_msg != nullptr) {
+        *error_msg = StringPrintf("Invalid block table in image header: %zu blocks of %zu bytes",
+                                  block_count,
+                                  block_size);
+      }
+      return false;
+    }
+    const ImageHeader::Block* blocks = image_header.GetBlocks(data);
+    for (size_t i = 0; i != block_count; ++i) {
+      if (blocks[i].data_offset_ > stored_size ||
+          blocks[i].data_size_ > stored_size - blocks[i].data_offset_) {
         if (error_msg != nullptr) {
-          *error_msg = StringPrintf(
-              "Decompressed size does not match expected image size %zu vs %zu",
-              decompressed_size + sizeof(ImageHeader),
-              image_header.GetImageSize());
+          *error_msg = StringPrintf("Compressed image block %zu out of bounds", i);
         }
-        return nullptr;
+        return false;
       }
     }
 
-    return map.release();
+    Atomic<size_t> failed_block(block_count);
+    auto decompress_block = [&](size_t i) {
+      const size_t block_begin = i * block_size;
+      const size_t expected_size = std::min(block_size, image_data_size - block_begin);
+      const int decompressed_size = LZ4_decompress_safe(
+          reinterpret_cast<const char*>(data) + blocks[i].data_offset_,
+          reinterpret_cast<char*>(out) + block_begin,
+          blocks[i].data_size_,
+          expected_size);
+      if (decompressed_size < 0 || static_cast<size_t>(decompressed_size) != expected_size) {
+        failed_block.store(i, std::memory_order_relaxed);
+      }
+    };
+
+    RunInParallel("Image decompression thread pool",
+                  block_count,
+                  parallel && block_count >= kMinBlocksForParallelDecompression,
+                  decompress_block);
+
+    const size_t failed = failed_block.load(std::memory_order_relaxed);
+    if (failed != block_count) {
+      if (error_msg != nullptr) {
+        *error_msg = StringPrintf("Failed to decompress image block %zu of %zu", failed, block_count);
+      }
+      return false;
+    }
+    return true;
   }
 
   class FixupVisitor : public ValueObject {
@@ -1029,11 +1131,11 @@ class ImageSpaceLoader {
 
     void operator()(mirror::Object* obj) const
         NO_THREAD_SAFETY_ANALYSIS {
-      if (visited_->Test(obj)) {
+      // Atomic since non-class objects are fixed up in parallel, see RelocateInPlace.
+      if (visited_->AtomicTestAndSet(obj)) {
         // Already visited.
         return;
       }
-      visited_->Set(obj);
 
       // Handle class specially first since we need it to be updated to properly visit the rest of
       // the instance fields.
@@ -1282,8 +1384,32 @@ class ImageSpaceLoader {
       // Fixup objects may read fields in the boot image, use the mutator lock here for sanity. Though
       // its probably not required.
       ScopedObjectAccess soa(Thread::Current());
+      // Fixing up an object requires its class to be fixed up already. The visitor takes care of
+      // that by recursing into classes, super classes and the vtable and iftable arrays, so fix up
+      // all classes serially first. Other objects then only write to themselves and the disjoint
+      // object ranges can be fixed up in parallel.
+      ObjPtr<mirror::Class> class_class = GetClassRoot<kWithoutReadBarrier>(ClassRoot::kJavaLangClass);
+      bitmap->VisitMarkedRange(
+          objects_begin,
+          objects_end,
+          [&](mirror::Object* obj) NO_THREAD_SAFETY_ANALYSIS {
+            mirror::Object* klass = obj->GetClass<kVerifyNone, kWithoutReadBarrier>();
+            if (fixup_adapter.ForwardObject(klass) == class_class.Ptr()) {
+              fixup_object_visitor(obj);
+            }
+          });
       timing.NewTiming("Fixup objects");
-      bitmap->VisitMarkedRange(objects_begin, objects_end, fixup_object_visitor);
+      const size_t objects_size = objects_end - objects_begin;
+      const size_t chunk_count = RoundUp(objects_size, kRelocationChunkSize) / kRelocationChunkSize;
+      RunInParallel("Image relocation thread pool",
+                    chunk_count,
+                    /* parallel */ objects_size >= kMinObjectsSizeForParallelRelocation,
+                    [&](size_t i) NO_THREAD_SAFETY_ANALYSIS {
+                      const uintptr_t chunk_begin = objects_begin + i * kRelocationChunkSize;
+                      const uintptr_t chunk_end =
+                          std::min(objects_end, chunk_begin + kRelocationChunkSize);
+                      bitmap->VisitMarkedRange(chunk_begin, chunk_end, fixup_object_visitor);
+                    });
       // Fixup image roots.
       CHECK(app_image.InSource(reinterpret_cast<uintptr_t>(
           image_header.GetImageRoots<kWithoutReadBarrier>())));
@@ -1457,6 +1583,8 @@ class ImageSpaceLoader {
 
     return oat_file;
   }
+
+  friend class ImageSpace;
 };
 
 static constexpr uint64_t kLowSpaceValue = 50 * MB;
@@ -1800,6 +1928,14 @@ ImageSpace::~ImageSpace() {
   runtime->ClearCalleeSaveMethods();
 }
 
+bool ImageSpace::DecompressImageData(const ImageHeader& image_header,
+                                     const uint8_t* data,
+                                     uint8_t* out,
+                                     bool parallel,
+                                     std::string* error_msg) {
+  return ImageSpaceLoader::DecompressImageBlocks(image_header, data, out, parallel, error_msg);
+}
+
 std::unique_ptr<ImageSpace> ImageSpace::CreateFromAppImage(const char* image,
                                                            const OatFile* oat_file,
                                                            std::string* error_msg) {
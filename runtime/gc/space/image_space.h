@@ -53,6 +53,17 @@ class ImageSpace : public MemMapSpace {
                                                         std::string* error_msg)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
+  // Decompress the blocks of a compressed image. `data` is the data stored after the header in the
+  // image file and `out` receives the image data following the header. Unless `parallel` is
+  // false, the blocks are decompressed on a temporary thread pool when called from an attached
+  // thread.
+  static bool DecompressImageData(const ImageHeader& image_header,
+                                  const uint8_t* data,
+                                  uint8_t* out,
+                                  bool parallel,
+                                  std::string* error_msg)
+      REQUIRES_SHARED(Locks::mutator_lock_);
+
   // Reads the image header from the specified image location for the
   // instruction set image_isa. Returns null on failure, with
   // reason in error_msg.
@@ -281,6 +281,7 @@ inline mirror::Object* RegionSpace::AllocLarge(size_t num_bytes,
       first_reg->UnfreeLarge(this, time_);
       if (kForEvac) {
         ++num_evac_regions_;
+        first_reg->IncrementAge();
       } else {
         ++num_non_free_regions_;
       }
@@ -294,6 +295,7 @@ inline mirror::Object* RegionSpace::AllocLarge(size_t num_bytes,
         regions_[p].UnfreeLargeTail(this, time_);
         if (kForEvac) {
           ++num_evac_regions_;
+          regions_[p].IncrementAge();
         } else {
           ++num_non_free_regions_;
         }
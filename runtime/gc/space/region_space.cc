@@ -29,6 +29,15 @@ namespace space {
 // value of the region size, evaculate the region.
 static constexpr uint kEvacuateLivePercentThreshold = 75U;
 
+// Old regions are evacuated by increasing live ratio, below kEvacuateLivePercentThreshold, as long
+// as their live bytes do not exceed this percent value of the non-free bytes of the region space
+// (and half of the free bytes, which the newly allocated regions are also evacuated to).
+static constexpr size_t kEvacuateCopyBudgetPercent = 10U;
+
+// The copy budget is at least this many regions, so that a nearly full or small heap still
+// defragments. Objects which do not fit in the free regions are copied to the non-moving space.
+static constexpr size_t kEvacuateMinCopyBudgetRegions = 4U;
+
 // If we protect the cleared regions.
 // Only protect for target builds to prevent flaky test failures (b/63131961).
 static constexpr bool kProtectClearedRegions = kIsTargetBuild;
@@ -90,6 +99,14 @@ RegionSpace::RegionSpace(const std::string& name, MemMap* mem_map)
       num_non_free_regions_(0U),
       num_evac_regions_(0U),
       max_peak_num_non_free_regions_(0U),
+      live_percent_histogram_(),
+      last_evac_live_percent_threshold_(kEvacuateLivePercentThreshold),
+      last_evac_copy_budget_(0U),
+      evac_policy_cycles_(0U),
+      evac_policy_bytes_to_copy_(0U),
+      evac_policy_bytes_to_reclaim_(0U),
+      evac_policy_regions_evacuated_(0U),
+      evac_policy_regions_over_budget_(0U),
       non_free_region_index_limit_(0U),
       current_region_(&full_region_),
       evac_region_(nullptr) {
@@ -156,31 +173,31 @@ size_t RegionSpace::ToSpaceSize() {
   return num_regions * kRegionSize;
 }
 
-inline bool RegionSpace::Region::ShouldBeEvacuated() {
+inline bool RegionSpace::Region::ShouldBeEvacuated(size_t live_percent_threshold) {
   DCHECK((IsAllocated() || IsLarge()) && IsInToSpace());
   // The region should be evacuated if:
   // - the region was allocated after the start of the previous GC (newly allocated region); or
-  // - the live ratio is below threshold (`kEvacuateLivePercentThreshold`).
+  // - the live ratio is below threshold (`live_percent_threshold`).
   bool result;
   if (is_newly_allocated_) {
     result = true;
   } else {
-    bool is_live_percent_valid = (live_bytes_ != static_cast<size_t>(-1));
+    bool is_live_percent_valid = (LiveBytes() != static_cast<size_t>(-1));
     if (is_live_percent_valid) {
       DCHECK(IsInToSpace());
       DCHECK(!IsLargeTail());
-      DCHECK_NE(live_bytes_, static_cast<size_t>(-1));
-      DCHECK_LE(live_bytes_, BytesAllocated());
+      DCHECK_NE(LiveBytes(), static_cast<size_t>(-1));
+      DCHECK_LE(LiveBytes(), BytesAllocated());
       const size_t bytes_allocated = RoundUp(BytesAllocated(), kRegionSize);
-      DCHECK_LE(live_bytes_, bytes_allocated);
+      DCHECK_LE(LiveBytes(), bytes_allocated);
       if (IsAllocated()) {
         // Side node: live_percent == 0 does not necessarily mean
         // there's no live objects due to rounding (there may be a
         // few).
-        result = (live_bytes_ * 100U < kEvacuateLivePercentThreshold * bytes_allocated);
+        result = (LiveBytes() * 100U < live_percent_threshold * bytes_allocated);
       } else {
         DCHECK(IsLarge());
-        result = (live_bytes_ == 0U);
+        result = (LiveBytes() == 0U);
       }
     } else {
       result = false;
@@ -189,9 +206,107 @@ inline bool RegionSpace::Region::ShouldBeEvacuated() {
   return result;
 }
 
+bool RegionSpace::Region::GetLivePercent(/* out */ size_t* live_percent) const {
+  // Large regions are only evacuated when they are dead; they are not worth a budget.
+  if (is_newly_allocated_ || !IsAllocated() || LiveBytes() == static_cast<size_t>(-1)) {
+    return false;
+  }
+  // Same rounding as in ShouldBeEvacuated, so that `*live_percent < threshold` if and only if
+  // the region is evacuated with this threshold.
+  const size_t bytes_allocated = RoundUp(BytesAllocated(), kRegionSize);
+  DCHECK_LE(LiveBytes(), bytes_allocated);
+  *live_percent = (bytes_allocated == 0U) ? 0U : LiveBytes() * 100U / bytes_allocated;
+  return true;
+}
+
+size_t RegionSpace::ComputeEvacLivePercentThreshold() {
+  // Live bytes and number of the regions which may be evacuated for their live ratio, indexed by
+  // live percent. The live bytes were computed by the marking of the previous collection.
+  std::vector<size_t> live_bytes_per_percent(kEvacuateLivePercentThreshold, 0U);
+  std::vector<size_t> regions_per_percent(kEvacuateLivePercentThreshold, 0U);
+  std::fill_n(live_percent_histogram_, kLivePercentHistogramBins, 0U);
+  for (size_t i = 0; i < std::min(num_regions_, non_free_region_index_limit_); ++i) {
+    Region* r = &regions_[i];
+    size_t live_percent;
+    if (r->IsFree() || !r->GetLivePercent(&live_percent)) {
+      continue;
+    }
+    ++live_percent_histogram_[std::min(live_percent * kLivePercentHistogramBins / 100U,
+                                       kLivePercentHistogramBins - 1U)];
+    if (live_percent < kEvacuateLivePercentThreshold) {
+      live_bytes_per_percent[live_percent] += r->LiveBytes();
+      ++regions_per_percent[live_percent];
+    }
+  }
+  const size_t copy_budget = ComputeEvacCopyBudget(num_non_free_regions_, num_regions_);
+  const size_t threshold = SelectEvacLivePercentThreshold(live_bytes_per_percent, copy_budget);
+  size_t bytes_to_copy = 0U;
+  size_t regions_evacuated = 0U;
+  for (size_t percent = 0; percent < threshold; ++percent) {
+    bytes_to_copy += live_bytes_per_percent[percent];
+    regions_evacuated += regions_per_percent[percent];
+  }
+  size_t regions_over_budget = 0U;
+  for (size_t percent = threshold; percent < kEvacuateLivePercentThreshold; ++percent) {
+    regions_over_budget += regions_per_percent[percent];
+  }
+  last_evac_live_percent_threshold_ = threshold;
+  last_evac_copy_budget_ = copy_budget;
+  ++evac_policy_cycles_;
+  evac_policy_bytes_to_copy_ += bytes_to_copy;
+  evac_policy_bytes_to_reclaim_ += regions_evacuated * kRegionSize - bytes_to_copy;
+  evac_policy_regions_evacuated_ += regions_evacuated;
+  evac_policy_regions_over_budget_ += regions_over_budget;
+  return threshold;
+}
+
+size_t RegionSpace::ComputeEvacCopyBudget(size_t num_non_free_regions, size_t num_regions) {
+  DCHECK_LE(num_non_free_regions, num_regions);
+  const size_t non_free_bytes = num_non_free_regions * kRegionSize;
+  const size_t free_bytes = (num_regions - num_non_free_regions) * kRegionSize;
+  const size_t copy_budget =
+      std::min(non_free_bytes / 100U * kEvacuateCopyBudgetPercent, free_bytes / 2U);
+  return std::max(copy_budget, kEvacuateMinCopyBudgetRegions * kRegionSize);
+}
+
+size_t RegionSpace::SelectEvacLivePercentThreshold(
+    const std::vector<size_t>& live_bytes_per_percent, size_t copy_budget) {
+  // Take the regions by increasing live ratio, i.e. decreasing reclaimed bytes per copied byte,
+  // until the copy budget is exhausted.
+  size_t threshold = 0U;
+  size_t bytes_to_copy = 0U;
+  while (threshold < live_bytes_per_percent.size() &&
+         bytes_to_copy + live_bytes_per_percent[threshold] <= copy_budget) {
+    bytes_to_copy += live_bytes_per_percent[threshold];
+    ++threshold;
+  }
+  return threshold;
+}
+
+void RegionSpace::DumpEvacuationStats(std::ostream& os) {
+  MutexLock mu(Thread::Current(), region_lock_);
+  if (evac_policy_cycles_ == 0U) {
+    return;
+  }
+  os << "Regions per live ratio at the last full collection:";
+  for (size_t i = 0; i < kLivePercentHistogramBins; ++i) {
+    os << " " << (i * 100U / kLivePercentHistogramBins) << "%:" << live_percent_histogram_[i];
+  }
+  os << "\n";
+  os << "Last evacuation live percent threshold: " << last_evac_live_percent_threshold_ << "%"
+     << " (copy budget " << PrettySize(last_evac_copy_budget_) << ")\n";
+  os << "Regions evacuated for their live ratio: " << evac_policy_regions_evacuated_
+     << " in " << evac_policy_cycles_ << " collections, "
+     << PrettySize(evac_policy_bytes_to_copy_) << " to copy, "
+     << PrettySize(evac_policy_bytes_to_reclaim_) << " to reclaim\n";
+  os << "Regions kept below the " << kEvacuateLivePercentThreshold
+     << "% live ratio threshold because of the copy budget: "
+     << evac_policy_regions_over_budget_ << "\n";
+}
+
 // Determine which regions to evacuate and mark them as
 // from-space. Mark the rest as unevacuated from-space.
-void RegionSpace::SetFromSpace(accounting::ReadBarrierTable* rb_table, bool force_evacuate_all) {
+void RegionSpace::SetFromSpace(accounting::ReadBarrierTable* rb_table, EvacMode evac_mode) {
   ++time_;
   if (kUseTableLookupReadBarrier) {
     DCHECK(rb_table->IsAllCleared());
@@ -203,7 +318,13 @@ void RegionSpace::SetFromSpace(accounting::ReadBarrierTable* rb_table, bool forc
   // Flag to store whether the previously seen large region has been evacuated.
   // This is used to apply the same evacuation policy to related large tail regions.
   bool prev_large_evacuated = false;
+  // Flag to store whether the previously seen large region is old and was left in the to-space
+  // by a young-generation collection. Also applied to related large tail regions.
+  bool prev_large_kept = false;
   VerifyNonFreeRegionLimit();
+  const size_t live_percent_threshold = (evac_mode == EvacMode::kEvacModeLivePercentNewlyAllocated)
+      ? ComputeEvacLivePercentThreshold()
+      : kEvacuateLivePercentThreshold;
   const size_t iter_limit = kUseTableLookupReadBarrier
       ? num_regions_
       : std::min(num_regions_, non_free_region_index_limit_);
@@ -217,24 +338,37 @@ void RegionSpace::SetFromSpace(accounting::ReadBarrierTable* rb_table, bool forc
         DCHECK((state == RegionState::kRegionStateAllocated ||
                 state == RegionState::kRegionStateLarge) &&
                type == RegionType::kRegionTypeToSpace);
-        bool should_evacuate = force_evacuate_all || r->ShouldBeEvacuated();
-        if (should_evacuate) {
-          r->SetAsFromSpace();
-          DCHECK(r->IsInFromSpace());
+        // In a young-generation collection, old regions are neither evacuated nor marked through:
+        // they stay in the to-space and references from them into young regions are found
+        // through the card table.
+        const bool keep = (evac_mode == EvacMode::kEvacModeNewlyAllocated) && !r->IsYoung();
+        bool should_evacuate = false;
+        if (keep) {
+          r->IncrementAge();
         } else {
-          r->SetAsUnevacFromSpace();
-          DCHECK(r->IsInUnevacFromSpace());
+          should_evacuate = (evac_mode == EvacMode::kEvacModeForceAll) ||
+              r->ShouldBeEvacuated(live_percent_threshold);
+          if (should_evacuate) {
+            r->SetAsFromSpace();
+            DCHECK(r->IsInFromSpace());
+          } else {
+            r->SetAsUnevacFromSpace();
+            DCHECK(r->IsInUnevacFromSpace());
+          }
         }
         if (UNLIKELY(state == RegionState::kRegionStateLarge &&
                      type == RegionType::kRegionTypeToSpace)) {
           prev_large_evacuated = should_evacuate;
+          prev_large_kept = keep;
           num_expected_large_tails = RoundUp(r->BytesAllocated(), kRegionSize) / kRegionSize - 1;
           DCHECK_GT(num_expected_large_tails, 0U);
         }
       } else {
         DCHECK(state == RegionState::kRegionStateLargeTail &&
                type == RegionType::kRegionTypeToSpace);
-        if (prev_large_evacuated) {
+        if (prev_large_kept) {
+          r->IncrementAge();
+        } else if (prev_large_evacuated) {
           r->SetAsFromSpace();
           DCHECK(r->IsInFromSpace());
         } else {
@@ -264,7 +398,8 @@ static void ZeroAndProtectRegion(uint8_t* begin, uint8_t* end) {
 }
 
 void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
-                                 /* out */ uint64_t* cleared_objects) {
+                                 /* out */ uint64_t* cleared_objects,
+                                 bool clear_bitmap) {
   DCHECK(cleared_bytes != nullptr);
   DCHECK(cleared_objects != nullptr);
   *cleared_bytes = 0;
@@ -337,7 +472,7 @@ void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
         continue;
       }
       r->SetUnevacFromSpaceAsToSpace();
-      if (r->AllAllocatedBytesAreLive()) {
+      if (clear_bitmap && r->AllAllocatedBytesAreLive()) {
         // Try to optimize the number of ClearRange calls by checking whether the next regions
         // can also be cleared.
         size_t regions_to_clear_bitmap = 1;
@@ -568,10 +703,11 @@ void RegionSpace::Region::Dump(std::ostream& os) const {
      << " type=" << type_
      << " objects_allocated=" << objects_allocated_
      << " alloc_time=" << alloc_time_
-     << " live_bytes=" << live_bytes_
+     << " live_bytes=" << LiveBytes()
      << " is_newly_allocated=" << std::boolalpha << is_newly_allocated_ << std::noboolalpha
      << " is_a_tlab=" << std::boolalpha << is_a_tlab_ << std::noboolalpha
-     << " thread=" << thread_ << '\n';
+     << " thread=" << thread_
+     << " age=" << static_cast<uint32_t>(age_) << '\n';
 }
 
 size_t RegionSpace::AllocationSizeNonvirtual(mirror::Object* obj, size_t* usable_size) {
@@ -594,13 +730,14 @@ void RegionSpace::Region::Clear(bool zero_and_release_pages) {
   type_ = RegionType::kRegionTypeNone;
   objects_allocated_.store(0, std::memory_order_relaxed);
   alloc_time_ = 0;
-  live_bytes_ = static_cast<size_t>(-1);
+  live_bytes_.store(static_cast<size_t>(-1), std::memory_order_relaxed);
   if (zero_and_release_pages) {
     ZeroAndProtectRegion(begin_, end_);
   }
   is_newly_allocated_ = false;
   is_a_tlab_ = false;
   thread_ = nullptr;
+  age_ = 0;
 }
 
 RegionSpace::Region* RegionSpace::AllocateRegion(bool for_evac) {
@@ -613,7 +750,8 @@ RegionSpace::Region* RegionSpace::AllocateRegion(bool for_evac) {
       r->Unfree(this, time_);
       if (for_evac) {
         ++num_evac_regions_;
-        // Evac doesn't count as newly allocated.
+        // Evac doesn't count as newly allocated. It holds survivors, which are old.
+        r->IncrementAge();
       } else {
         r->SetNewlyAllocated();
         ++num_non_free_regions_;
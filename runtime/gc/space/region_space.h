@@ -17,6 +17,9 @@
 #ifndef ART_RUNTIME_GC_SPACE_REGION_SPACE_H_
 #define ART_RUNTIME_GC_SPACE_REGION_SPACE_H_
 
+#include <limits>
+#include <vector>
+
 #include "base/macros.h"
 #include "base/mutex.h"
 #include "space.h"
@@ -137,6 +140,20 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
     kRegionStateLargeTail,       // Large tail (non-first regions of a large allocation).
   };
 
+  enum class EvacMode {
+    // Evacuate newly allocated regions and regions whose live ratio is below the threshold; keep
+    // the others as unevacuated from-space (full-heap collection).
+    kEvacModeLivePercentNewlyAllocated,
+    // Evacuate all non-free regions (full-heap collection).
+    kEvacModeForceAll,
+    // Only consider young regions (allocated by mutators since the last collection). Old regions
+    // stay in the to-space and are treated as live (young-generation collection).
+    kEvacModeNewlyAllocated,
+  };
+
+  // Dump the statistics of the copy budget evacuation policy.
+  void DumpEvacuationStats(std::ostream& os) REQUIRES(!region_lock_);
+
   template<RegionType kRegionType> uint64_t GetBytesAllocatedInternal() REQUIRES(!region_lock_);
   template<RegionType kRegionType> uint64_t GetObjectsAllocatedInternal() REQUIRES(!region_lock_);
   uint64_t GetBytesAllocated() REQUIRES(!region_lock_) {
@@ -249,14 +266,21 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
   }
 
   // Determine which regions to evacuate and tag them as
-  // from-space. Tag the rest as unevacuated from-space.
-  void SetFromSpace(accounting::ReadBarrierTable* rb_table, bool force_evacuate_all)
+  // from-space. Tag the rest as unevacuated from-space, except for
+  // old regions in kEvacModeNewlyAllocated, which are left untouched.
+  void SetFromSpace(accounting::ReadBarrierTable* rb_table, EvacMode evac_mode)
       REQUIRES(!region_lock_);
 
   size_t FromSpaceSize() REQUIRES(!region_lock_);
   size_t UnevacFromSpaceSize() REQUIRES(!region_lock_);
   size_t ToSpaceSize() REQUIRES(!region_lock_);
-  void ClearFromSpace(/* out */ uint64_t* cleared_bytes, /* out */ uint64_t* cleared_objects)
+  // Reclaim from-space regions and turn unevacuated from-space regions back into to-space.
+  // If `clear_bitmap` is true, the mark bits of regions whose bytes are all live are cleared since
+  // the objects can be walked without them. The generational mode of the concurrent copying
+  // collector keeps them to find old objects on dirty cards.
+  void ClearFromSpace(/* out */ uint64_t* cleared_bytes,
+                      /* out */ uint64_t* cleared_objects,
+                      bool clear_bitmap)
       REQUIRES(!region_lock_);
 
   void AddLiveBytes(mirror::Object* ref, size_t alloc_size) {
@@ -264,6 +288,12 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
     reg->AddLiveBytes(alloc_size);
   }
 
+  // Thread-safe version of AddLiveBytes, for parallel marking.
+  void AtomicAddLiveBytes(mirror::Object* ref, size_t alloc_size) {
+    Region* reg = RefToRegionUnlocked(ref);
+    reg->AtomicAddLiveBytes(alloc_size);
+  }
+
   void AssertAllRegionLiveBytesZeroOrCleared() REQUIRES(!region_lock_) {
     if (kIsDebugBuild) {
       MutexLock mu(Thread::Current(), region_lock_);
@@ -295,7 +325,7 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
           begin_(nullptr), top_(nullptr), end_(nullptr),
           state_(RegionState::kRegionStateAllocated), type_(RegionType::kRegionTypeToSpace),
           objects_allocated_(0), alloc_time_(0), live_bytes_(static_cast<size_t>(-1)),
-          is_newly_allocated_(false), is_a_tlab_(false), thread_(nullptr) {}
+          is_newly_allocated_(false), is_a_tlab_(false), thread_(nullptr), age_(0) {}
 
     void Init(size_t idx, uint8_t* begin, uint8_t* end) {
       idx_ = idx;
@@ -306,10 +336,11 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
       type_ = RegionType::kRegionTypeNone;
       objects_allocated_.store(0, std::memory_order_relaxed);
       alloc_time_ = 0;
-      live_bytes_ = static_cast<size_t>(-1);
+      live_bytes_.store(static_cast<size_t>(-1), std::memory_order_relaxed);
       is_newly_allocated_ = false;
       is_a_tlab_ = false;
       thread_ = nullptr;
+      age_ = 0;
       DCHECK_LT(begin, end);
       DCHECK_EQ(static_cast<size_t>(end - begin), kRegionSize);
     }
@@ -389,6 +420,23 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
       return is_newly_allocated_;
     }
 
+    // The number of collections the region has survived (saturated).
+    uint8_t Age() const {
+      return age_;
+    }
+
+    // Young regions were allocated by mutators since the last collection. Regions allocated for
+    // evacuation hold survivors and start out old.
+    bool IsYoung() const {
+      return age_ == 0;
+    }
+
+    void IncrementAge() {
+      if (age_ != std::numeric_limits<uint8_t>::max()) {
+        ++age_;
+      }
+    }
+
     bool IsInFromSpace() const {
       return type_ == RegionType::kRegionTypeFromSpace;
     }
@@ -411,7 +459,7 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
     void SetAsFromSpace() {
       DCHECK(!IsFree() && IsInToSpace());
       type_ = RegionType::kRegionTypeFromSpace;
-      live_bytes_ = static_cast<size_t>(-1);
+      live_bytes_.store(static_cast<size_t>(-1), std::memory_order_relaxed);
     }
 
     // Set this region as unevacuated from-space. At the end of the
@@ -421,7 +469,7 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
     void SetAsUnevacFromSpace() {
       DCHECK(!IsFree() && IsInToSpace());
       type_ = RegionType::kRegionTypeUnevacFromSpace;
-      live_bytes_ = 0U;
+      live_bytes_.store(0U, std::memory_order_relaxed);
     }
 
     // Set this region as to-space. Used by RegionSpace::ClearFromSpace.
@@ -429,19 +477,35 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
     void SetUnevacFromSpaceAsToSpace() {
       DCHECK(!IsFree() && IsInUnevacFromSpace());
       type_ = RegionType::kRegionTypeToSpace;
+      IncrementAge();
     }
 
     // Return whether this region should be evacuated. Used by RegionSpace::SetFromSpace.
-    ALWAYS_INLINE bool ShouldBeEvacuated();
+    // Allocated regions are evacuated if their live ratio is below `live_percent_threshold`.
+    ALWAYS_INLINE bool ShouldBeEvacuated(size_t live_percent_threshold);
+
+    // Return whether the live ratio of this region is known from the previous collection and
+    // can be used to decide whether to evacuate it. If so, store it in `live_percent`.
+    bool GetLivePercent(/* out */ size_t* live_percent) const;
 
     void AddLiveBytes(size_t live_bytes) {
       DCHECK(IsInUnevacFromSpace());
       DCHECK(!IsLargeTail());
-      DCHECK_NE(live_bytes_, static_cast<size_t>(-1));
+      DCHECK_NE(LiveBytes(), static_cast<size_t>(-1));
       // For large allocations, we always consider all bytes in the
       // regions live.
-      live_bytes_ += IsLarge() ? Top() - begin_ : live_bytes;
-      DCHECK_LE(live_bytes_, BytesAllocated());
+      // Only the GC-running thread adds live bytes outside of parallel marking, no need for an
+      // atomic read-modify-write.
+      live_bytes_.store(LiveBytes() + (IsLarge() ? Top() - begin_ : live_bytes),
+                        std::memory_order_relaxed);
+      DCHECK_LE(LiveBytes(), BytesAllocated());
+    }
+
+    void AtomicAddLiveBytes(size_t live_bytes) {
+      DCHECK(IsInUnevacFromSpace());
+      DCHECK(!IsLargeTail());
+      DCHECK_NE(LiveBytes(), static_cast<size_t>(-1));
+      live_bytes_.fetch_add(IsLarge() ? Top() - begin_ : live_bytes, std::memory_order_relaxed);
     }
 
     bool AllAllocatedBytesAreLive() const {
@@ -449,7 +513,7 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
     }
 
     size_t LiveBytes() const {
-      return live_bytes_;
+      return live_bytes_.load(std::memory_order_relaxed);
     }
 
     size_t BytesAllocated() const;
@@ -501,10 +565,11 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
     uint32_t alloc_time_;               // The allocation time of the region.
     // Note that newly allocated and evacuated regions use -1 as
     // special value for `live_bytes_`.
-    size_t live_bytes_;                 // The live bytes. Used to compute the live percent.
+    Atomic<size_t> live_bytes_;         // The live bytes. Used to compute the live percent.
     bool is_newly_allocated_;           // True if it's allocated after the last collection.
     bool is_a_tlab_;                    // True if it's a tlab.
     Thread* thread_;                    // The owning thread if it's a tlab.
+    uint8_t age_;                       // The number of collections survived (see Age()).
 
     friend class RegionSpace;
   };
@@ -571,6 +636,17 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
 
   Region* AllocateRegion(bool for_evac) REQUIRES(region_lock_);
 
+  // Compute the live percent threshold of the copy budget policy. Also updates the histogram and
+  // the statistics of the policy.
+  size_t ComputeEvacLivePercentThreshold() REQUIRES(region_lock_);
+  // The bytes which may be copied out of the regions evacuated for their live ratio, with
+  // `num_non_free_regions` out of `num_regions` in use.
+  static size_t ComputeEvacCopyBudget(size_t num_non_free_regions, size_t num_regions);
+  // The highest live percent threshold such that the regions below it, whose live bytes are
+  // indexed by live percent in `live_bytes_per_percent`, fit in `copy_budget`.
+  static size_t SelectEvacLivePercentThreshold(const std::vector<size_t>& live_bytes_per_percent,
+                                               size_t copy_budget);
+
   Mutex region_lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
 
   uint32_t time_;                  // The time as the number of collections since the startup.
@@ -586,6 +662,21 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
   // regions are in non-free.
   size_t max_peak_num_non_free_regions_;
 
+  // Statistics of the evacuation policy of full-heap collections.
+  static constexpr size_t kLivePercentHistogramBins = 10;
+  // Number of candidate regions per 10% of live ratio, at the last full-heap collection.
+  size_t live_percent_histogram_[kLivePercentHistogramBins] GUARDED_BY(region_lock_);
+  size_t last_evac_live_percent_threshold_ GUARDED_BY(region_lock_);
+  size_t last_evac_copy_budget_ GUARDED_BY(region_lock_);
+  uint64_t evac_policy_cycles_ GUARDED_BY(region_lock_);
+  // Live bytes of the regions evacuated for their live ratio, i.e. the bytes expected to be copied.
+  uint64_t evac_policy_bytes_to_copy_ GUARDED_BY(region_lock_);
+  // Bytes expected to be reclaimed from the regions evacuated for their live ratio.
+  uint64_t evac_policy_bytes_to_reclaim_ GUARDED_BY(region_lock_);
+  uint64_t evac_policy_regions_evacuated_ GUARDED_BY(region_lock_);
+  // Regions below the fixed threshold which were not evacuated because of the copy budget.
+  uint64_t evac_policy_regions_over_budget_ GUARDED_BY(region_lock_);
+
   // The pointer to the region array.
   std::unique_ptr<Region[]> regions_ GUARDED_BY(region_lock_);
 
@@ -603,6 +694,9 @@ class RegionSpace FINAL : public ContinuousMemMapAllocSpace {
   // Mark bitmap used by the GC.
   std::unique_ptr<accounting::ContinuousSpaceBitmap> mark_bitmap_;
 
+  ART_FRIEND_TEST(RegionSpaceTest, EvacCopyBudget);
+  ART_FRIEND_TEST(RegionSpaceTest, SelectEvacLivePercentThreshold);
+
   DISALLOW_COPY_AND_ASSIGN(RegionSpace);
 };
 
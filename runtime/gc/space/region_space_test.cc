@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "region_space.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace art {
+namespace gc {
+namespace space {
+
+static constexpr size_t kRegionSize = RegionSpace::kRegionSize;
+
+TEST(RegionSpaceTest, EvacCopyBudget) {
+  // 10% of the non-free bytes.
+  EXPECT_EQ(100 * kRegionSize / 10, RegionSpace::ComputeEvacCopyBudget(100, 1000));
+  // Capped at half of the free bytes.
+  EXPECT_EQ(40 * kRegionSize, RegionSpace::ComputeEvacCopyBudget(920, 1000));
+  // A nearly full or small heap still gets the minimum budget.
+  EXPECT_EQ(4 * kRegionSize, RegionSpace::ComputeEvacCopyBudget(999, 1000));
+  EXPECT_EQ(4 * kRegionSize, RegionSpace::ComputeEvacCopyBudget(1000, 1000));
+  EXPECT_EQ(4 * kRegionSize, RegionSpace::ComputeEvacCopyBudget(10, 1000));
+}
+
+TEST(RegionSpaceTest, SelectEvacLivePercentThreshold) {
+  std::vector<size_t> live_bytes_per_percent(75, 0U);
+  // Without candidates, every live ratio below the fixed threshold fits.
+  EXPECT_EQ(75u, RegionSpace::SelectEvacLivePercentThreshold(live_bytes_per_percent, 0U));
+
+  live_bytes_per_percent[0] = 100;
+  live_bytes_per_percent[10] = 2 * kRegionSize / 10;
+  live_bytes_per_percent[50] = 4 * kRegionSize / 2;
+  const size_t below_50 = live_bytes_per_percent[0] + live_bytes_per_percent[10];
+  EXPECT_EQ(0u, RegionSpace::SelectEvacLivePercentThreshold(live_bytes_per_percent, 99U));
+  EXPECT_EQ(10u, RegionSpace::SelectEvacLivePercentThreshold(live_bytes_per_percent, 100U));
+  EXPECT_EQ(50u, RegionSpace::SelectEvacLivePercentThreshold(live_bytes_per_percent, below_50));
+  EXPECT_EQ(75u,
+            RegionSpace::SelectEvacLivePercentThreshold(live_bytes_per_percent,
+                                                        below_50 + live_bytes_per_percent[50]));
+}
+
+}  // namespace space
+}  // namespace gc
+}  // namespace art
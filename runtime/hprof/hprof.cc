@@ -33,11 +33,13 @@
 #include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include <set>
 
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
 
 #include "art_field-inl.h"
 #include "art_method-inl.h"
@@ -75,6 +77,15 @@ namespace hprof {
 
 static constexpr bool kDirectStream = true;
 
+// Write file dumps in a single pass as a stream of records, instead of first walking the heap to
+// measure the size of the dump.
+static constexpr bool kStreamFileDump = true;
+// Size of the chunks of the stream that are compressed and written out together.
+static constexpr size_t kStreamChunkSize = 256 * KB;
+// File dumps whose name ends with this suffix are gzip compressed while they are written.
+static constexpr const char* kGzipSuffix = ".gz";
+static constexpr int kGzipCompressionLevel = Z_BEST_SPEED;
+
 static constexpr uint32_t kHprofTime = 0;
 static constexpr uint32_t kHprofNullThread = 0;
 
@@ -431,6 +442,120 @@ class VectorEndianOuputput FINAL : public EndianOutputBuffered {
   std::vector<uint8_t>& full_data_;
 };
 
+// Collects the records flushed by one or more EndianOutputs into a fixed size chunk, and writes
+// full chunks to a file, compressing them with gzip if requested. The memory used does not depend
+// on the size of the dump.
+class StreamingFileSink {
+ public:
+  StreamingFileSink(File* fp, bool compress)
+      : fp_(fp), compress_(compress), compressor_initialized_(false), errors_(false) {
+    DCHECK(fp != nullptr);
+    chunk_.reserve(kStreamChunkSize);
+    if (compress_) {
+      memset(&zstream_, 0, sizeof(zstream_));
+      // Adding 16 to the window bits asks for a gzip header and trailer instead of a zlib one.
+      int result = deflateInit2(&zstream_,
+                                kGzipCompressionLevel,
+                                Z_DEFLATED,
+                                /* windowBits */ MAX_WBITS + 16,
+                                /* memLevel */ 8,
+                                Z_DEFAULT_STRATEGY);
+      compressor_initialized_ = (result == Z_OK);
+      errors_ = !compressor_initialized_;
+      compressed_.resize(kStreamChunkSize);
+    }
+  }
+
+  ~StreamingFileSink() {
+    if (compressor_initialized_) {
+      deflateEnd(&zstream_);
+    }
+  }
+
+  void Write(const uint8_t* data, size_t length) {
+    while (length != 0u && !errors_) {
+      size_t to_copy = std::min(length, kStreamChunkSize - chunk_.size());
+      chunk_.insert(chunk_.end(), data, data + to_copy);
+      data += to_copy;
+      length -= to_copy;
+      if (chunk_.size() == kStreamChunkSize) {
+        WriteChunk(/* finish */ false);
+      }
+    }
+  }
+
+  // Write out the last partial chunk and the gzip trailer. Returns false on error.
+  bool Finish() {
+    if (!errors_) {
+      WriteChunk(/* finish */ true);
+    }
+    return !errors_;
+  }
+
+ private:
+  void WriteChunk(bool finish) {
+    if (!compress_) {
+      errors_ = !fp_->WriteFully(chunk_.data(), chunk_.size());
+      chunk_.clear();
+      return;
+    }
+    zstream_.next_in = chunk_.data();
+    zstream_.avail_in = chunk_.size();
+    int result;
+    do {
+      zstream_.next_out = compressed_.data();
+      zstream_.avail_out = compressed_.size();
+      result = deflate(&zstream_, finish ? Z_FINISH : Z_NO_FLUSH);
+      if (result == Z_STREAM_ERROR) {
+        errors_ = true;
+        break;
+      }
+      size_t produced = compressed_.size() - zstream_.avail_out;
+      if (produced != 0u && !fp_->WriteFully(compressed_.data(), produced)) {
+        errors_ = true;
+        break;
+      }
+    } while (zstream_.avail_out == 0u);
+    DCHECK(errors_ || zstream_.avail_in == 0u);
+    DCHECK(errors_ || !finish || result == Z_STREAM_END);
+    chunk_.clear();
+  }
+
+  File* fp_;
+  const bool compress_;
+  bool compressor_initialized_;
+  bool errors_;
+  z_stream zstream_;
+  std::vector<uint8_t> chunk_;
+  std::vector<uint8_t> compressed_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamingFileSink);
+};
+
+class StreamingEndianOutput FINAL : public EndianOutputBuffered {
+ public:
+  explicit StreamingEndianOutput(StreamingFileSink* sink)
+      : EndianOutputBuffered(kMaxBytesPerSegment), sink_(sink) {}
+  ~StreamingEndianOutput() {}
+
+ protected:
+  void HandleFlush(const uint8_t* buffer, size_t length) OVERRIDE {
+    sink_->Write(buffer, length);
+  }
+
+  void HandleEndRecord() OVERRIDE {
+    EndianOutputBuffered::HandleEndRecord();
+    // Do not hold on to the buffer of an unusually large record, e.g. one with a huge array.
+    if (buffer_.capacity() > kStreamChunkSize) {
+      std::vector<uint8_t>().swap(buffer_);
+      buffer_.reserve(kMaxBytesPerSegment);
+    }
+  }
+
+ private:
+  StreamingFileSink* const sink_;
+};
+
 #define __ output_->
 
 class Hprof : public SingleRootVisitor {
@@ -452,28 +577,32 @@ class Hprof : public SingleRootVisitor {
       }
     }
 
-    // First pass to measure the size of the dump.
     size_t overall_size;
-    size_t max_length;
-    {
-      EndianOutput count_output;
-      output_ = &count_output;
-      ProcessHeap(false);
-      overall_size = count_output.SumLength();
-      max_length = count_output.MaxLength();
-      output_ = nullptr;
-    }
-
     bool okay;
-    visited_objects_.clear();
-    if (direct_to_ddms_) {
-      if (kDirectStream) {
-        okay = DumpToDdmsDirect(overall_size, max_length, CHUNK_TYPE("HPDS"));
+    if (!direct_to_ddms_ && kStreamFileDump) {
+      okay = DumpToFileStreaming(&overall_size);
+    } else {
+      // First pass to measure the size of the dump.
+      size_t max_length;
+      {
+        EndianOutput count_output;
+        output_ = &count_output;
+        ProcessHeap(false);
+        overall_size = count_output.SumLength();
+        max_length = count_output.MaxLength();
+        output_ = nullptr;
+      }
+
+      visited_objects_.clear();
+      if (direct_to_ddms_) {
+        if (kDirectStream) {
+          okay = DumpToDdmsDirect(overall_size, max_length, CHUNK_TYPE("HPDS"));
+        } else {
+          okay = DumpToDdmsBuffered(overall_size, max_length);
+        }
       } else {
-        okay = DumpToDdmsBuffered(overall_size, max_length);
+        okay = DumpToFile(overall_size, max_length);
       }
-    } else {
-      okay = DumpToFile(overall_size, max_length);
     }
 
     if (okay) {
@@ -520,6 +649,33 @@ class Hprof : public SingleRootVisitor {
     }
   }
 
+  // Single pass version of ProcessHeap. The string and class records are not known before the
+  // body has been walked, so they are written out as they are discovered, always ahead of the
+  // first record that refers to them.
+  void ProcessHeapStreaming() REQUIRES(Locks::mutator_lock_) {
+    DCHECK(streaming_);
+    current_heap_ = HPROF_HEAP_DEFAULT;
+    objects_in_segment_ = 0;
+
+    WriteFixedHeader();
+    output_->EndRecord();
+    // The stack frames refer to classes and strings which have not been written yet.
+    for (const auto& it : traces_) {
+      const gc::AllocRecordStackTrace* trace = it.first;
+      for (size_t i = 0, depth = trace->GetDepth(); i < depth; ++i) {
+        ArtMethod* method = trace->GetStackElement(i).GetMethod();
+        LookupClassId(method->GetDeclaringClass());
+        LookupStringId(method->GetName());
+        LookupStringId(method->GetSignature().ToString());
+        const char* source_file = method->GetDeclaringClassSourceFile();
+        LookupStringId(source_file != nullptr ? source_file : "");
+      }
+    }
+    WritePendingRecords();
+    WriteStackTraces();
+    ProcessBody();
+  }
+
   void ProcessBody() REQUIRES(Locks::mutator_lock_) {
     Runtime* const runtime = Runtime::Current();
     // Walk the roots and the heap.
@@ -533,6 +689,7 @@ class Hprof : public SingleRootVisitor {
       DumpHeapObject(obj);
     };
     runtime->GetHeap()->VisitObjectsPaused(dump_object);
+    WritePendingRecords();
     output_->StartNewRecord(HPROF_TAG_HEAP_DUMP_END, kHprofTime);
     output_->EndRecord();
   }
@@ -558,39 +715,66 @@ class Hprof : public SingleRootVisitor {
 
   void WriteClassTable() REQUIRES_SHARED(Locks::mutator_lock_) {
     for (const auto& p : classes_) {
-      mirror::Class* c = p.first;
-      HprofClassSerialNumber sn = p.second;
-      CHECK(c != nullptr);
-      output_->StartNewRecord(HPROF_TAG_LOAD_CLASS, kHprofTime);
-      // LOAD CLASS format:
-      // U4: class serial number (always > 0)
-      // ID: class object ID. We use the address of the class object structure as its ID.
-      // U4: stack trace serial number
-      // ID: class name string ID
-      __ AddU4(sn);
-      __ AddObjectId(c);
-      __ AddStackTraceSerialNumber(LookupStackTraceSerialNumber(c));
-      __ AddStringId(LookupClassNameId(c));
+      WriteLoadClass(p.first, p.second);
     }
   }
 
+  void WriteLoadClass(mirror::Class* c, HprofClassSerialNumber sn)
+      REQUIRES_SHARED(Locks::mutator_lock_) {
+    CHECK(c != nullptr);
+    output_->StartNewRecord(HPROF_TAG_LOAD_CLASS, kHprofTime);
+    // LOAD CLASS format:
+    // U4: class serial number (always > 0)
+    // ID: class object ID. We use the address of the class object structure as its ID.
+    // U4: stack trace serial number
+    // ID: class name string ID
+    __ AddU4(sn);
+    __ AddObjectId(c);
+    __ AddStackTraceSerialNumber(LookupStackTraceSerialNumber(c));
+    __ AddStringId(LookupClassNameId(c));
+  }
+
   void WriteStringTable() {
     for (const auto& p : strings_) {
-      const std::string& string = p.first;
-      const HprofStringId id = p.second;
+      WriteString(p.first, p.second);
+    }
+  }
+
+  void WriteString(const std::string& string, HprofStringId id) {
+    output_->StartNewRecord(HPROF_TAG_STRING, kHprofTime);
 
-      output_->StartNewRecord(HPROF_TAG_STRING, kHprofTime);
+    // STRING format:
+    // ID:  ID for this string
+    // U1*: UTF8 characters for string (NOT null terminated)
+    //      (the record format encodes the length)
+    __ AddU4(id);
+    __ AddUtf8String(string.c_str());
+  }
 
-      // STRING format:
-      // ID:  ID for this string
-      // U1*: UTF8 characters for string (NOT null terminated)
-      //      (the record format encodes the length)
-      __ AddU4(id);
-      __ AddUtf8String(string.c_str());
+  // In streaming mode, write the strings and classes discovered since the last call. They go
+  // through pending_output_ so that they reach the file before the record being built in output_.
+  void WritePendingRecords() REQUIRES_SHARED(Locks::mutator_lock_) {
+    if (pending_strings_.empty() && pending_classes_.empty()) {
+      return;
     }
+    DCHECK(streaming_);
+    EndianOutput* const record_output = output_;
+    output_ = pending_output_;
+    // Strings first, the class records refer to the class names.
+    for (const auto& p : pending_strings_) {
+      WriteString(*p.first, p.second);
+    }
+    for (mirror::Class* c : pending_classes_) {
+      WriteLoadClass(c, classes_.Get(c));
+    }
+    output_->EndRecord();
+    output_ = record_output;
+    pending_strings_.clear();
+    pending_classes_.clear();
   }
 
-  void StartNewHeapDumpSegment() {
+  void StartNewHeapDumpSegment() REQUIRES_SHARED(Locks::mutator_lock_) {
+    WritePendingRecords();
     // This flushes the old segment and starts a new one.
     output_->StartNewRecord(HPROF_TAG_HEAP_DUMP_SEGMENT, kHprofTime);
     objects_in_segment_ = 0;
@@ -598,7 +782,7 @@ class Hprof : public SingleRootVisitor {
     current_heap_ = HPROF_HEAP_DEFAULT;
   }
 
-  void CheckHeapSegmentConstraints() {
+  void CheckHeapSegmentConstraints() REQUIRES_SHARED(Locks::mutator_lock_) {
     if (objects_in_segment_ >= kMaxObjectsPerSegment || output_->Length() >= kMaxBytesPerSegment) {
       StartNewHeapDumpSegment();
     }
@@ -607,7 +791,7 @@ class Hprof : public SingleRootVisitor {
   void VisitRoot(mirror::Object* obj, const RootInfo& root_info)
       OVERRIDE REQUIRES_SHARED(Locks::mutator_lock_);
   void MarkRootObject(const mirror::Object* obj, jobject jni_obj, HprofHeapTag heap_tag,
-                      uint32_t thread_serial);
+                      uint32_t thread_serial) REQUIRES_SHARED(Locks::mutator_lock_);
 
   HprofClassObjectId LookupClassId(mirror::Class* c) REQUIRES_SHARED(Locks::mutator_lock_) {
     if (c != nullptr) {
@@ -616,6 +800,9 @@ class Hprof : public SingleRootVisitor {
         // first time to see this class
         HprofClassSerialNumber sn = next_class_serial_number_++;
         classes_.Put(c, sn);
+        if (streaming_) {
+          pending_classes_.push_back(c);
+        }
         // Make sure that we've assigned a string ID for this class' name
         LookupClassNameId(c);
       }
@@ -650,7 +837,11 @@ class Hprof : public SingleRootVisitor {
       return it->second;
     }
     HprofStringId id = next_string_id_++;
-    strings_.Put(string, id);
+    auto new_it = strings_.Put(string, id);
+    if (streaming_) {
+      // SafeMap nodes are stable, refer to the key instead of copying it.
+      pending_strings_.emplace_back(&new_it->first, id);
+    }
     return id;
   }
 
@@ -757,26 +948,50 @@ class Hprof : public SingleRootVisitor {
     //        Dbg::DdmSendChunkV(CHUNK_TYPE("HPDS"), iov, 2);
   }
 
-  bool DumpToFile(size_t overall_size, size_t max_length)
-      REQUIRES(Locks::mutator_lock_) {
+  // Returns null and throws if the output file cannot be opened.
+  std::unique_ptr<File> OpenOutputFile() REQUIRES(Locks::mutator_lock_) {
     // Where exactly are we writing to?
     int out_fd;
     if (fd_ >= 0) {
       out_fd = dup(fd_);
       if (out_fd < 0) {
         ThrowRuntimeException("Couldn't dump heap; dup(%d) failed: %s", fd_, strerror(errno));
-        return false;
+        return nullptr;
       }
     } else {
       out_fd = open(filename_.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
       if (out_fd < 0) {
         ThrowRuntimeException("Couldn't dump heap; open(\"%s\") failed: %s", filename_.c_str(),
                               strerror(errno));
-        return false;
+        return nullptr;
       }
     }
+    return std::unique_ptr<File>(new File(out_fd, filename_, true));
+  }
+
+  // Closes the file if the dump was written successfully, erases it otherwise.
+  bool CloseOutputFile(File* file, bool okay) REQUIRES(Locks::mutator_lock_) {
+    if (okay) {
+      okay = file->FlushCloseOrErase() == 0;
+    } else {
+      file->Erase();
+    }
+    if (!okay) {
+      std::string msg(android::base::StringPrintf("Couldn't dump heap; writing \"%s\" failed: %s",
+                                                  filename_.c_str(),
+                                                  strerror(errno)));
+      ThrowRuntimeException("%s", msg.c_str());
+      LOG(ERROR) << msg;
+    }
+    return okay;
+  }
 
-    std::unique_ptr<File> file(new File(out_fd, filename_, true));
+  bool DumpToFile(size_t overall_size, size_t max_length)
+      REQUIRES(Locks::mutator_lock_) {
+    std::unique_ptr<File> file = OpenOutputFile();
+    if (file == nullptr) {
+      return false;
+    }
     bool okay;
     {
       FileEndianOutput file_output(file.get(), max_length);
@@ -792,20 +1007,34 @@ class Hprof : public SingleRootVisitor {
       output_ = nullptr;
     }
 
-    if (okay) {
-      okay = file->FlushCloseOrErase() == 0;
-    } else {
-      file->Erase();
+    return CloseOutputFile(file.get(), okay);
+  }
+
+  // Writes the dump in a single pass. Only a few records and one chunk of the stream are in memory
+  // at any time, and the dump is gzip compressed on the fly if the file name ends with ".gz".
+  bool DumpToFileStreaming(size_t* overall_size) REQUIRES(Locks::mutator_lock_) {
+    std::unique_ptr<File> file = OpenOutputFile();
+    if (file == nullptr) {
+      *overall_size = 0u;
+      return false;
     }
-    if (!okay) {
-      std::string msg(android::base::StringPrintf("Couldn't dump heap; writing \"%s\" failed: %s",
-                                                  filename_.c_str(),
-                                                  strerror(errno)));
-      ThrowRuntimeException("%s", msg.c_str());
-      LOG(ERROR) << msg;
+    bool okay;
+    {
+      StreamingFileSink sink(file.get(), android::base::EndsWith(filename_, kGzipSuffix));
+      StreamingEndianOutput record_output(&sink);
+      StreamingEndianOutput pending_output(&sink);
+      output_ = &record_output;
+      pending_output_ = &pending_output;
+      streaming_ = true;
+      ProcessHeapStreaming();
+      okay = sink.Finish();
+      *overall_size = record_output.SumLength() + pending_output.SumLength();
+      streaming_ = false;
+      pending_output_ = nullptr;
+      output_ = nullptr;
     }
 
-    return okay;
+    return CloseOutputFile(file.get(), okay);
   }
 
   bool DumpToDdmsDirect(size_t overall_size, size_t max_length, uint32_t chunk_type)
@@ -882,6 +1111,13 @@ class Hprof : public SingleRootVisitor {
 
   EndianOutput* output_ = nullptr;
 
+  // Set while writing a dump with DumpToFileStreaming. The strings and classes found since the
+  // last WritePendingRecords are kept in pending_strings_ and pending_classes_.
+  bool streaming_ = false;
+  EndianOutput* pending_output_ = nullptr;
+  std::vector<std::pair<const std::string*, HprofStringId>> pending_strings_;
+  std::vector<mirror::Class*> pending_classes_;
+
   HprofHeapId current_heap_ = HPROF_HEAP_DEFAULT;  // Which heap we're currently dumping.
   size_t objects_in_segment_ = 0;
 
@@ -21,6 +21,8 @@ namespace art {
 
 namespace hprof {
 
+// Dumps the heap in hprof format to DDMS, or to the given file or fd. File dumps are gzip
+// compressed if the file name ends with ".gz".
 void DumpHeap(const char* filename, int fd, bool direct_to_ddms);
 
 }  // namespace hprof
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hprof.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/os.h"
+#include "base/unix_file/fd_file.h"
+#include "common_runtime_test.h"
+#include "thread-current-inl.h"
+
+namespace art {
+
+// Record and heap dump sub-record tags, see hprof.cc.
+static constexpr uint8_t kTagString = 0x01u;
+static constexpr uint8_t kTagLoadClass = 0x02u;
+static constexpr uint8_t kTagStackFrame = 0x04u;
+static constexpr uint8_t kTagStackTrace = 0x05u;
+static constexpr uint8_t kTagHeapDumpSegment = 0x1cu;
+static constexpr uint8_t kTagHeapDumpEnd = 0x2cu;
+static constexpr uint8_t kClassDump = 0x20u;
+static constexpr uint8_t kInstanceDump = 0x21u;
+static constexpr uint8_t kObjectArrayDump = 0x22u;
+static constexpr uint8_t kPrimitiveArrayDump = 0x23u;
+static constexpr uint8_t kHeapDumpInfo = 0xfeu;
+static constexpr uint8_t kBasicObject = 2u;
+
+class HprofTest : public CommonRuntimeTest {
+ protected:
+  // Dumps the heap to `filename` and returns the uncompressed contents of the file.
+  void DumpHeap(const std::string& filename, bool gzip, std::vector<uint8_t>* data) {
+    Thread* self = Thread::Current();
+    ASSERT_EQ(kNative, self->GetState());
+    hprof::DumpHeap(filename.c_str(), /* fd */ -1, /* direct_to_ddms */ false);
+    ASSERT_FALSE(self->IsExceptionPending());
+
+    std::unique_ptr<File> file(OS::OpenFileForReading(filename.c_str()));
+    ASSERT_TRUE(file != nullptr);
+    std::vector<uint8_t> contents(file->GetLength());
+    ASSERT_TRUE(file->ReadFully(contents.data(), contents.size()));
+    if (!gzip) {
+      *data = std::move(contents);
+      return;
+    }
+
+    // A single gzip member. inflate() checks that its trailer, the CRC and the size, matches.
+    ASSERT_GE(contents.size(), 2u);
+    ASSERT_EQ(0x1fu, contents[0]);
+    ASSERT_EQ(0x8bu, contents[1]);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    ASSERT_EQ(Z_OK, inflateInit2(&stream, MAX_WBITS + 16));
+    stream.next_in = contents.data();
+    stream.avail_in = contents.size();
+    int result = Z_OK;
+    std::vector<uint8_t> chunk(64 * KB);
+    while (result == Z_OK) {
+      stream.next_out = chunk.data();
+      stream.avail_out = chunk.size();
+      result = inflate(&stream, Z_NO_FLUSH);
+      data->insert(data->end(), chunk.data(), stream.next_out);
+    }
+    inflateEnd(&stream);
+    ASSERT_EQ(Z_STREAM_END, result);
+    ASSERT_EQ(0u, stream.avail_in);
+  }
+
+  // Parses the records of a dump and checks that the strings and classes are written before the
+  // records and heap dump segments which refer to them.
+  void CheckDump(const std::vector<uint8_t>& data) {
+    const char magic[] = "JAVA PROFILE 1.0.3";
+    ASSERT_GE(data.size(), sizeof(magic) + 12u);
+    ASSERT_EQ(0, memcmp(data.data(), magic, sizeof(magic)));
+    size_t offset = sizeof(magic);
+    ASSERT_EQ(4u, Read4(data, offset));  // The size of the ids.
+    offset += 12u;
+
+    std::set<uint32_t> strings;
+    std::set<uint32_t> classes;
+    std::set<uint32_t> class_serials;
+    std::vector<std::string> string_values;
+    size_t num_segments = 0u;
+    size_t num_class_dumps = 0u;
+    size_t num_instance_dumps = 0u;
+    bool heap_dump_end = false;
+    while (offset != data.size()) {
+      ASSERT_FALSE(heap_dump_end) << "Records after the end of the heap dump";
+      ASSERT_LE(offset + 9u, data.size());
+      const uint8_t tag = data[offset];
+      const size_t length = Read4(data, offset + 5u);
+      const size_t start = offset + 9u;
+      const size_t end = start + length;
+      ASSERT_LE(end, data.size()) << static_cast<int>(tag);
+      switch (tag) {
+        case kTagString:
+          ASSERT_GE(length, 4u);
+          ASSERT_TRUE(strings.insert(Read4(data, start)).second);
+          string_values.emplace_back(data.begin() + start + 4u, data.begin() + end);
+          break;
+        case kTagLoadClass:
+          ASSERT_EQ(16u, length);
+          ASSERT_TRUE(class_serials.insert(Read4(data, start)).second);
+          ASSERT_TRUE(classes.insert(Read4(data, start + 4u)).second);
+          ASSERT_EQ(1u, strings.count(Read4(data, start + 12u)));
+          break;
+        case kTagStackFrame:
+          ASSERT_EQ(24u, length);
+          for (size_t i = 1u; i != 4u; ++i) {
+            ASSERT_EQ(1u, strings.count(Read4(data, start + 4u * i)));
+          }
+          ASSERT_EQ(1u, class_serials.count(Read4(data, start + 16u)));
+          break;
+        case kTagStackTrace:
+          ASSERT_GE(length, 12u);
+          ASSERT_EQ(12u + 4u * Read4(data, start + 8u), length);
+          break;
+        case kTagHeapDumpSegment:
+          ++num_segments;
+          ASSERT_NO_FATAL_FAILURE(CheckSegment(
+              data, start, end, strings, classes, &num_class_dumps, &num_instance_dumps));
+          break;
+        case kTagHeapDumpEnd:
+          ASSERT_EQ(0u, length);
+          heap_dump_end = true;
+          break;
+        default:
+          FAIL() << "Unexpected record " << static_cast<int>(tag);
+      }
+      offset = end;
+    }
+
+    // The dump is complete.
+    EXPECT_TRUE(heap_dump_end);
+    EXPECT_LT(1u, num_segments);
+    EXPECT_LT(0u, num_class_dumps);
+    EXPECT_LT(0u, num_instance_dumps);
+    EXPECT_NE(string_values.end(),
+              std::find(string_values.begin(), string_values.end(), "java.lang.String"));
+  }
+
+ private:
+  static uint32_t Read4(const std::vector<uint8_t>& data, size_t offset) {
+    return (data[offset] << 24) | (data[offset + 1] << 16) | (data[offset + 2] << 8) |
+        data[offset + 3];
+  }
+
+  static uint16_t Read2(const std::vector<uint8_t>& data, size_t offset) {
+    return (data[offset] << 8) | data[offset + 1];
+  }
+
+  static size_t BasicTypeSize(uint8_t type) {
+    switch (type) {
+      case 2u: return 4u;   // object
+      case 4u: return 1u;   // boolean
+      case 5u: return 2u;   // char
+      case 6u: return 4u;   // float
+      case 7u: return 8u;   // double
+      case 8u: return 1u;   // byte
+      case 9u: return 2u;   // short
+      case 10u: return 4u;  // int
+      case 11u: return 8u;  // long
+      default: return 0u;
+    }
+  }
+
+  void CheckSegment(const std::vector<uint8_t>& data,
+                    size_t offset,
+                    size_t end,
+                    const std::set<uint32_t>& strings,
+                    const std::set<uint32_t>& classes,
+                    size_t* num_class_dumps,
+                    size_t* num_instance_dumps) {
+    while (offset != end) {
+      ASSERT_LT(offset, end);
+      const uint8_t tag = data[offset];
+      ++offset;
+      switch (tag) {
+        case 0xffu:  // Unknown.
+        case 0x05u:  // Sticky class.
+        case 0x07u:  // Monitor used.
+        case 0x89u:  // Interned string.
+        case 0x8bu:  // Debugger.
+        case 0x8du:  // VM internal.
+          offset += 4u;
+          break;
+        case 0x01u:  // JNI global.
+        case 0x04u:  // Native stack.
+        case 0x06u:  // Thread block.
+          offset += 8u;
+          break;
+        case 0x02u:  // JNI local.
+        case 0x03u:  // Java frame.
+        case 0x08u:  // Thread object.
+        case 0x8eu:  // JNI monitor.
+          offset += 12u;
+          break;
+        case kHeapDumpInfo:
+          ASSERT_LE(offset + 8u, end);
+          ASSERT_EQ(1u, strings.count(Read4(data, offset + 4u)));
+          offset += 8u;
+          break;
+        case kClassDump: {
+          ++*num_class_dumps;
+          ASSERT_LE(offset + 34u, end);
+          ASSERT_EQ(1u, classes.count(Read4(data, offset)));
+          const uint32_t super_class = Read4(data, offset + 8u);
+          ASSERT_TRUE(super_class == 0u || classes.count(super_class) == 1u);
+          offset += 32u;
+          ASSERT_EQ(0u, Read2(data, offset));  // The constant pool.
+          offset += 2u;
+          ASSERT_LE(offset + 2u, end);
+          const size_t num_static_fields = Read2(data, offset);
+          offset += 2u;
+          for (size_t i = 0; i != num_static_fields; ++i) {
+            ASSERT_LE(offset + 5u, end);
+            ASSERT_EQ(1u, strings.count(Read4(data, offset)));
+            const size_t size = BasicTypeSize(data[offset + 4u]);
+            ASSERT_NE(0u, size);
+            offset += 5u + size;
+          }
+          ASSERT_LE(offset + 2u, end);
+          const size_t num_instance_fields = Read2(data, offset);
+          offset += 2u;
+          for (size_t i = 0; i != num_instance_fields; ++i) {
+            ASSERT_LE(offset + 5u, end);
+            ASSERT_EQ(1u, strings.count(Read4(data, offset)));
+            ASSERT_NE(0u, BasicTypeSize(data[offset + 4u]));
+            offset += 5u;
+          }
+          break;
+        }
+        case kInstanceDump:
+          ++*num_instance_dumps;
+          ASSERT_LE(offset + 16u, end);
+          ASSERT_EQ(1u, classes.count(Read4(data, offset + 8u)));
+          offset += 16u + Read4(data, offset + 12u);
+          break;
+        case kObjectArrayDump:
+          ASSERT_LE(offset + 16u, end);
+          ASSERT_EQ(1u, classes.count(Read4(data, offset + 12u)));
+          offset += 16u + 4u * Read4(data, offset + 8u);
+          break;
+        case kPrimitiveArrayDump: {
+          ASSERT_LE(offset + 13u, end);
+          const size_t size = BasicTypeSize(data[offset + 12u]);
+          ASSERT_NE(0u, size);
+          ASSERT_NE(kBasicObject, data[offset + 12u]);
+          offset += 13u + size * Read4(data, offset + 8u);
+          break;
+        }
+        default:
+          FAIL() << "Unexpected heap dump record " << static_cast<int>(tag);
+      }
+    }
+  }
+};
+
+TEST_F(HprofTest, StreamingDump) {
+  ScratchFile scratch;
+  ScratchFile dump(scratch, ".hprof");
+  std::vector<uint8_t> data;
+  ASSERT_NO_FATAL_FAILURE(DumpHeap(dump.GetFilename(), /* gzip */ false, &data));
+  ASSERT_NO_FATAL_FAILURE(CheckDump(data));
+}
+
+TEST_F(HprofTest, StreamingGzipDump) {
+  ScratchFile scratch;
+  ScratchFile dump(scratch, ".hprof.gz");
+  std::vector<uint8_t> data;
+  ASSERT_NO_FATAL_FAILURE(DumpHeap(dump.GetFilename(), /* gzip */ true, &data));
+  ASSERT_NO_FATAL_FAILURE(CheckDump(data));
+}
+
+}  // namespace art
@@ -93,6 +93,20 @@ class PACKED(4) ImageHeader {
   };
   static constexpr StorageMode kDefaultStorageMode = kStorageModeUncompressed;
 
+  // Compressed image data is split into independently compressed blocks of this many uncompressed
+  // bytes so that the blocks can be decompressed in parallel when loading the image.
+  static constexpr size_t kCompressionBlockSize = 256 * KB;
+
+  // Entry of the block table. For compressed images, the table is stored in the file right after
+  // the header and is followed by the compressed blocks. Block i decompresses to the image data at
+  // offset sizeof(ImageHeader) + i * GetBlockSize().
+  struct Block {
+    // Offset of the compressed block, relative to the end of the header in the file.
+    uint32_t data_offset_;
+    // Compressed size of the block.
+    uint32_t data_size_;
+  };
+
   ImageHeader()
       : image_begin_(0U),
         image_size_(0U),
@@ -111,7 +125,9 @@ class PACKED(4) ImageHeader {
         compile_pic_(0),
         is_pic_(0),
         storage_mode_(kDefaultStorageMode),
-        data_size_(0) {}
+        data_size_(0),
+        block_size_(0),
+        block_count_(0) {}
 
   ImageHeader(uint32_t image_begin,
               uint32_t image_size,
@@ -321,6 +337,21 @@ class PACKED(4) ImageHeader {
     return data_size_;
   }
 
+  // Number of uncompressed bytes per compressed block, zero if the image is not compressed.
+  uint32_t GetBlockSize() const {
+    return block_size_;
+  }
+
+  uint32_t GetBlockCount() const {
+    return block_count_;
+  }
+
+  // Returns the block table, given the start of the stored data (right after the header).
+  const Block* GetBlocks(const uint8_t* data) const {
+    DCHECK_NE(block_count_, 0u);
+    return reinterpret_cast<const Block*>(data);
+  }
+
   bool IsAppImage() const {
     // App images currently require a boot image, if the size is non zero then it is an app image
     // header.
@@ -447,9 +478,14 @@ class PACKED(4) ImageHeader {
   StorageMode storage_mode_;
 
   // Data size for the image data excluding the bitmap and the header. For compressed images, this
-  // is the compressed size in the file.
+  // is the size of the block table plus the compressed blocks in the file.
   uint32_t data_size_;
 
+  // Uncompressed size of each compressed block (except the last one, which may be smaller) and
+  // number of entries in the block table. Both zero for uncompressed images.
+  uint32_t block_size_;
+  uint32_t block_count_;
+
   friend class linker::ImageWriter;
 };
 
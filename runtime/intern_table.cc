@@ -88,12 +88,29 @@ void InternTable::VisitRoots(RootVisitor* visitor, VisitRootFlags flags) {
   // Note: we deliberately don't visit the weak_interns_ table and the immutable image roots.
 }
 
+bool InternTable::CanLookupWeakConcurrently(Thread* self) {
+  // With read barriers, the GC disables weak reference access with a checkpoint and only sweeps
+  // once every thread has run it. A lookup has no suspend point, so it cannot overlap the sweep.
+  // Without read barriers, the weak root state is guarded by the lock.
+  return kUseReadBarrier && self->GetWeakRefAccessEnabled();
+}
+
 ObjPtr<mirror::String> InternTable::LookupWeak(Thread* self, ObjPtr<mirror::String> s) {
+  if (CanLookupWeakConcurrently(self)) {
+    ObjPtr<mirror::String> weak = weak_interns_.FindConcurrent(s);
+    if (weak != nullptr) {
+      return weak;
+    }
+  }
   MutexLock mu(self, *Locks::intern_table_lock_);
   return LookupWeakLocked(s);
 }
 
 ObjPtr<mirror::String> InternTable::LookupStrong(Thread* self, ObjPtr<mirror::String> s) {
+  ObjPtr<mirror::String> strong = strong_interns_.FindConcurrent(s);
+  if (strong != nullptr) {
+    return strong;
+  }
   MutexLock mu(self, *Locks::intern_table_lock_);
   return LookupStrongLocked(s);
 }
@@ -105,6 +122,10 @@ ObjPtr<mirror::String> InternTable::LookupStrong(Thread* self,
   Utf8String string(utf16_length,
                     utf8_data,
                     ComputeUtf16HashFromModifiedUtf8(utf8_data, utf16_length));
+  ObjPtr<mirror::String> strong = strong_interns_.FindConcurrent(string);
+  if (strong != nullptr) {
+    return strong;
+  }
   MutexLock mu(self, *Locks::intern_table_lock_);
   return strong_interns_.Find(string);
 }
@@ -215,6 +236,17 @@ ObjPtr<mirror::String> InternTable::Insert(ObjPtr<mirror::String> s,
     return nullptr;
   }
   Thread* const self = Thread::Current();
+  // Most strings are already interned, try to find them without taking the lock.
+  ObjPtr<mirror::String> interned = strong_interns_.FindConcurrent(s);
+  if (interned != nullptr) {
+    return interned;
+  }
+  if (!is_strong && CanLookupWeakConcurrently(self)) {
+    interned = weak_interns_.FindConcurrent(s);
+    if (interned != nullptr) {
+      return interned;
+    }
+  }
   MutexLock mu(self, *Locks::intern_table_lock_);
   if (kDebugLocking && !holding_locks) {
     Locks::mutator_lock_->AssertSharedHeld(self);
@@ -301,6 +333,12 @@ bool InternTable::ContainsWeak(ObjPtr<mirror::String> s) {
 void InternTable::SweepInternTableWeaks(IsMarkedVisitor* visitor) {
   MutexLock mu(Thread::Current(), *Locks::intern_table_lock_);
   weak_interns_.SweepWeaks(visitor);
+  // Weak lookups cannot run concurrently with the sweeping, see CanLookupWeakConcurrently.
+  weak_interns_.FreeRetiredSets();
+  // Strong lookups can. But the GC suspends all threads at least once before sweeping, and a
+  // lookup has no suspend point, so the lookups which may have been reading a set retired
+  // before the previous sweep are done.
+  strong_interns_.FreeSetsRetiredBeforePreviousCall();
 }
 
 size_t InternTable::AddTableFromMemory(const uint8_t* ptr) {
@@ -331,7 +369,9 @@ bool InternTable::StringHashEquals::operator()(const GcRoot<mirror::String>& a,
   if (kIsDebugBuild) {
     Locks::mutator_lock_->AssertSharedHeld(Thread::Current());
   }
-  return a.Read<kWithoutReadBarrier>()->Equals(b.Read<kWithoutReadBarrier>());
+  ObjPtr<mirror::String> a_string = a.Read<kWithoutReadBarrier>();
+  // `a` may have been erased while a concurrent lookup was reading it.
+  return a_string != nullptr && a_string->Equals(b.Read<kWithoutReadBarrier>());
 }
 
 bool InternTable::StringHashEquals::operator()(const GcRoot<mirror::String>& a,
@@ -340,6 +380,10 @@ bool InternTable::StringHashEquals::operator()(const GcRoot<mirror::String>& a,
     Locks::mutator_lock_->AssertSharedHeld(Thread::Current());
   }
   ObjPtr<mirror::String> a_string = a.Read<kWithoutReadBarrier>();
+  if (a_string == nullptr) {
+    // `a` was erased while a concurrent lookup was reading it.
+    return false;
+  }
   uint32_t a_length = static_cast<uint32_t>(a_string->GetLength());
   if (a_length != b.GetUtf16Length()) {
     return false;
@@ -365,99 +409,117 @@ bool InternTable::StringHashEquals::operator()(const GcRoot<mirror::String>& a,
 
 size_t InternTable::Table::AddTableFromMemory(const uint8_t* ptr) {
   size_t read_count = 0;
-  UnorderedSet set(ptr, /*make copy*/false, &read_count);
-  if (set.empty()) {
+  std::unique_ptr<UnorderedSet> set(new UnorderedSet(ptr, /*make copy*/false, &read_count));
+  if (set->empty()) {
     // Avoid inserting empty sets.
     return read_count;
   }
   // TODO: Disable this for app images if app images have intern tables.
   static constexpr bool kCheckDuplicates = kIsDebugBuild;
   if (kCheckDuplicates) {
-    for (GcRoot<mirror::String>& string : set) {
+    for (GcRoot<mirror::String>& string : *set) {
       CHECK(Find(string.Read()) == nullptr) << "Already found " << string.Read()->ToModifiedUtf8();
     }
   }
   // Insert at the front since we add new interns into the back.
-  tables_.insert(tables_.begin(), std::move(set));
+  sets_.PrependFrozenSet(set.release());
   return read_count;
 }
 
 size_t InternTable::Table::WriteToMemory(uint8_t* ptr) {
-  if (tables_.empty()) {
-    return 0;
-  }
+  std::vector<UnorderedSet*> sets = GetSets();
   UnorderedSet* table_to_write;
   UnorderedSet combined;
-  if (tables_.size() > 1) {
+  if (sets.size() > 1) {
     table_to_write = &combined;
-    for (UnorderedSet& table : tables_) {
-      for (GcRoot<mirror::String>& string : table) {
+    for (UnorderedSet* set : sets) {
+      for (GcRoot<mirror::String>& string : *set) {
         combined.insert(string);
       }
     }
   } else {
-    table_to_write = &tables_.back();
+    table_to_write = sets.back();
   }
   return table_to_write->WriteToMemory(ptr);
 }
 
 void InternTable::Table::Remove(ObjPtr<mirror::String> s) {
-  for (UnorderedSet& table : tables_) {
-    auto it = table.find(GcRoot<mirror::String>(s));
-    if (it != table.end()) {
-      table.erase(it);
+  for (UnorderedSet* set : GetSets()) {
+    auto it = set->find(GcRoot<mirror::String>(s));
+    if (it != set->end()) {
+      set->erase(it);
       return;
     }
   }
   LOG(FATAL) << "Attempting to remove non-interned string " << s->ToModifiedUtf8();
 }
 
+template <typename K>
+ObjPtr<mirror::String> InternTable::Table::FindInSets(const K& key) {
+  GcRoot<mirror::String>* root = sets_.Find(key);
+  return (root != nullptr) ? root->Read() : nullptr;
+}
+
 ObjPtr<mirror::String> InternTable::Table::Find(ObjPtr<mirror::String> s) {
   Locks::intern_table_lock_->AssertHeld(Thread::Current());
-  for (UnorderedSet& table : tables_) {
-    auto it = table.find(GcRoot<mirror::String>(s));
-    if (it != table.end()) {
-      return it->Read();
-    }
-  }
-  return nullptr;
+  return FindInSets(GcRoot<mirror::String>(s));
 }
 
 ObjPtr<mirror::String> InternTable::Table::Find(const Utf8String& string) {
   Locks::intern_table_lock_->AssertHeld(Thread::Current());
-  for (UnorderedSet& table : tables_) {
-    auto it = table.find(string);
-    if (it != table.end()) {
-      return it->Read();
-    }
+  return FindInSets(string);
+}
+
+ObjPtr<mirror::String> InternTable::Table::FindConcurrent(ObjPtr<mirror::String> s) {
+  ObjPtr<mirror::String> result = FindInSets(GcRoot<mirror::String>(s));
+  // The slot we found may have been overwritten by an erase before we read it.
+  if (result != nullptr && !result->Equals(s)) {
+    return nullptr;
+  }
+  return result;
+}
+
+ObjPtr<mirror::String> InternTable::Table::FindConcurrent(const Utf8String& string) {
+  ObjPtr<mirror::String> result = FindInSets(string);
+  // The slot we found may have been overwritten by an erase before we read it.
+  if (result != nullptr && !StringHashEquals()(GcRoot<mirror::String>(result), string)) {
+    return nullptr;
   }
-  return nullptr;
+  return result;
 }
 
 void InternTable::Table::AddNewTable() {
-  tables_.push_back(UnorderedSet());
+  // Freeze the live set. A concurrent lookup which misses it in both places retries with the lock.
+  sets_.FreezeLiveSet(new UnorderedSet());
 }
 
 void InternTable::Table::Insert(ObjPtr<mirror::String> s) {
-  // Always insert the last table, the image tables are before and we avoid inserting into these
-  // to prevent dirty pages.
-  DCHECK(!tables_.empty());
-  tables_.back().insert(GcRoot<mirror::String>(s));
+  // Always insert into the live set, the image tables are frozen and we avoid inserting into
+  // these to prevent dirty pages.
+  sets_.GetLiveSetForInsert()->insert(GcRoot<mirror::String>(s));
+}
+
+void InternTable::Table::FreeRetiredSets() {
+  sets_.FreeRetiredSets();
+}
+
+void InternTable::Table::FreeSetsRetiredBeforePreviousCall() {
+  sets_.FreeSetsRetiredBeforePreviousCall();
 }
 
 void InternTable::Table::VisitRoots(RootVisitor* visitor) {
   BufferedRootVisitor<kDefaultBufferedRootCount> buffered_visitor(
       visitor, RootInfo(kRootInternedString));
-  for (UnorderedSet& table : tables_) {
-    for (auto& intern : table) {
+  for (UnorderedSet* set : GetSets()) {
+    for (auto& intern : *set) {
       buffered_visitor.VisitRoot(intern);
     }
   }
 }
 
 void InternTable::Table::SweepWeaks(IsMarkedVisitor* visitor) {
-  for (UnorderedSet& table : tables_) {
-    SweepWeaks(&table, visitor);
+  for (UnorderedSet* set : GetSets()) {
+    SweepWeaks(set, visitor);
   }
 }
 
@@ -476,11 +538,12 @@ void InternTable::Table::SweepWeaks(UnorderedSet* set, IsMarkedVisitor* visitor)
 }
 
 size_t InternTable::Table::Size() const {
-  return std::accumulate(tables_.begin(),
-                         tables_.end(),
+  std::vector<UnorderedSet*> sets = GetSets();
+  return std::accumulate(sets.begin(),
+                         sets.end(),
                          0U,
-                         [](size_t sum, const UnorderedSet& set) {
-                           return sum + set.size();
+                         [](size_t sum, const UnorderedSet* set) {
+                           return sum + set->size();
                          });
 }
 
@@ -497,12 +560,11 @@ void InternTable::ChangeWeakRootStateLocked(gc::WeakRootState new_state) {
   }
 }
 
-InternTable::Table::Table() {
+InternTable::Table::Table() : sets_(new UnorderedSet()) {
   Runtime* const runtime = Runtime::Current();
   // Initial table.
-  tables_.push_back(UnorderedSet());
-  tables_.back().SetLoadFactor(runtime->GetHashTableMinLoadFactor(),
-                               runtime->GetHashTableMaxLoadFactor());
+  sets_.GetLiveSet()->SetLoadFactor(runtime->GetHashTableMinLoadFactor(),
+                                    runtime->GetHashTableMaxLoadFactor());
 }
 
 }  // namespace art
@@ -18,9 +18,11 @@
 #define ART_RUNTIME_INTERN_TABLE_H_
 
 #include <unordered_set>
+#include <vector>
 
 #include "base/atomic.h"
 #include "base/allocator.h"
+#include "base/concurrent_set_list.h"
 #include "base/hash_set.h"
 #include "base/mutex.h"
 #include "gc/weak_root_state.h"
@@ -56,6 +58,12 @@ class Transaction;
  * String.intern. Some code (XML parsers being a prime example) relies on being able to intern
  * arbitrarily many strings for the duration of a parse without permanently increasing the memory
  * footprint.
+ *
+ * Lookups do not take Locks::intern_table_lock_ on the fast path: the tables can be searched
+ * concurrently with inserts, which are still serialized by the lock. A lock-free lookup that races
+ * with a writer may miss a string, so a miss is always confirmed under the lock. Weak interns are
+ * only searched without the lock when weak reference access is a thread-local flag (read
+ * barriers), since the GC then cannot sweep them while a lookup is in progress.
  */
 class InternTable {
  public:
@@ -187,7 +195,8 @@ class InternTable {
   };
 
   // Table which holds pre zygote and post zygote interned strings. There is one instance for
-  // weak interns and strong interns.
+  // weak interns and strong interns. The image tables and the sets frozen by AddNewTable are
+  // frozen sets of a ConcurrentSetList, so that FindConcurrent can search them without the lock.
   class Table {
    public:
     Table();
@@ -195,6 +204,12 @@ class InternTable {
         REQUIRES(Locks::intern_table_lock_);
     ObjPtr<mirror::String> Find(const Utf8String& string) REQUIRES_SHARED(Locks::mutator_lock_)
         REQUIRES(Locks::intern_table_lock_);
+    // Same as Find but does not require the lock. May return null for a string in the table if
+    // it races with a writer, the caller must then retry with Find.
+    ObjPtr<mirror::String> FindConcurrent(ObjPtr<mirror::String> s)
+        REQUIRES_SHARED(Locks::mutator_lock_);
+    ObjPtr<mirror::String> FindConcurrent(const Utf8String& string)
+        REQUIRES_SHARED(Locks::mutator_lock_);
     void Insert(ObjPtr<mirror::String> s) REQUIRES_SHARED(Locks::mutator_lock_)
         REQUIRES(Locks::intern_table_lock_);
     void Remove(ObjPtr<mirror::String> s)
@@ -215,20 +230,36 @@ class InternTable {
     // one. Returns how many bytes were written.
     size_t WriteToMemory(uint8_t* ptr)
         REQUIRES(Locks::intern_table_lock_) REQUIRES_SHARED(Locks::mutator_lock_);
+    // Free the sets replaced when growing the live set. Must only be called when no
+    // FindConcurrent can be in progress on this table.
+    void FreeRetiredSets() REQUIRES(Locks::intern_table_lock_);
+    // Free the sets replaced when growing the live set before the previous call. Must only be
+    // called once the FindConcurrent calls in progress at the previous call are done.
+    void FreeSetsRetiredBeforePreviousCall() REQUIRES(Locks::intern_table_lock_);
 
    private:
     typedef HashSet<GcRoot<mirror::String>, GcRootEmptyFn, StringHashEquals, StringHashEquals,
         TrackingAllocator<GcRoot<mirror::String>, kAllocatorTagInternTable>> UnorderedSet;
 
+    template <typename K>
+    ObjPtr<mirror::String> FindInSets(const K& key) REQUIRES_SHARED(Locks::mutator_lock_);
+
+    // Return the frozen sets followed by the live set.
+    std::vector<UnorderedSet*> GetSets() const {
+      return sets_.GetSets();
+    }
+
     void SweepWeaks(UnorderedSet* set, IsMarkedVisitor* visitor)
         REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(Locks::intern_table_lock_);
 
     // We call AddNewTable when we create the zygote to reduce private dirty pages caused by
-    // modifying the zygote intern table. The back of table is modified when strings are interned.
-    std::vector<UnorderedSet> tables_;
+    // modifying the zygote intern table. Modified with the lock held.
+    ConcurrentSetList<UnorderedSet> sets_;
 
     friend class linker::OatWriter;  // for boot image string table slot address lookup.
     ART_FRIEND_TEST(InternTableTest, CrossHash);
+    ART_FRIEND_TEST(InternTableTest, GrowAndAddNewTable);
+    DISALLOW_COPY_AND_ASSIGN(Table);
   };
 
   // Insert if non null, otherwise return null. Must be called holding the mutator lock.
@@ -271,25 +302,30 @@ class InternTable {
   void WaitUntilAccessible(Thread* self)
       REQUIRES(Locks::intern_table_lock_) REQUIRES_SHARED(Locks::mutator_lock_);
 
+  // Whether the weak interns can be searched without the lock, see the class comment.
+  static bool CanLookupWeakConcurrently(Thread* self);
+
   bool log_new_roots_ GUARDED_BY(Locks::intern_table_lock_);
   ConditionVariable weak_intern_condition_ GUARDED_BY(Locks::intern_table_lock_);
   // Since this contains (strong) roots, they need a read barrier to
   // enable concurrent intern table (strong) root scan. Do not
   // directly access the strings in it. Use functions that contain
-  // read barriers.
-  Table strong_interns_ GUARDED_BY(Locks::intern_table_lock_);
+  // read barriers. Not GUARDED_BY the lock as Table::FindConcurrent
+  // does not need it, the other Table methods are annotated instead.
+  Table strong_interns_;
   std::vector<GcRoot<mirror::String>> new_strong_intern_roots_
       GUARDED_BY(Locks::intern_table_lock_);
   // Since this contains (weak) roots, they need a read barrier. Do
   // not directly access the strings in it. Use functions that contain
   // read barriers.
-  Table weak_interns_ GUARDED_BY(Locks::intern_table_lock_);
+  Table weak_interns_;
   // Weak root state, used for concurrent system weak processing and more.
   gc::WeakRootState weak_root_state_ GUARDED_BY(Locks::intern_table_lock_);
 
   friend class linker::OatWriter;  // for boot image string table slot address lookup.
   friend class Transaction;
   ART_FRIEND_TEST(InternTableTest, CrossHash);
+  ART_FRIEND_TEST(InternTableTest, GrowAndAddNewTable);
   DISALLOW_COPY_AND_ASSIGN(InternTable);
 };
 
@@ -24,6 +24,7 @@
 #include "mirror/object.h"
 #include "mirror/string.h"
 #include "scoped_thread_state_change-inl.h"
+#include "thread_pool.h"
 
 namespace art {
 
@@ -78,9 +79,9 @@ TEST_F(InternTableTest, CrossHash) {
   GcRoot<mirror::String> str(mirror::String::AllocFromModifiedUtf8(soa.Self(), "00000000"));
 
   MutexLock mu(Thread::Current(), *Locks::intern_table_lock_);
-  for (InternTable::Table::UnorderedSet& table : t.strong_interns_.tables_) {
+  for (InternTable::Table::UnorderedSet* table : t.strong_interns_.GetSets()) {
     // The negative hash value shall be 32-bit wide on every host.
-    ASSERT_TRUE(IsUint<32>(table.hashfn_(str)));
+    ASSERT_TRUE(IsUint<32>(table->hashfn_(str)));
   }
 }
 
@@ -234,4 +235,69 @@ TEST_F(InternTableTest, LookupStrong) {
   EXPECT_TRUE(lookup_foobbS == nullptr);
 }
 
+TEST_F(InternTableTest, GrowAndAddNewTable) {
+  ScopedObjectAccess soa(Thread::Current());
+  InternTable t;
+  static constexpr size_t kNumStrings = 1000u;
+  auto intern_range = [&t](size_t begin, size_t end) REQUIRES_SHARED(Locks::mutator_lock_) {
+    for (size_t i = begin; i != end; ++i) {
+      std::string str = "s" + std::to_string(i);
+      ASSERT_TRUE(t.InternStrong(str.c_str()) != nullptr);
+    }
+  };
+  // Grow the live set several times, freeze it and keep inserting into a new one.
+  intern_range(0u, kNumStrings);
+  t.AddNewTable();
+  intern_range(kNumStrings, 2u * kNumStrings);
+  EXPECT_EQ(2u * kNumStrings, t.StrongSize());
+  for (size_t i = 0; i != 2u * kNumStrings; ++i) {
+    std::string str = "s" + std::to_string(i);
+    ObjPtr<mirror::String> lookup = t.LookupStrong(soa.Self(), str.length(), str.c_str());
+    ASSERT_TRUE(lookup != nullptr) << str;
+    EXPECT_TRUE(lookup->Equals(str.c_str()));
+  }
+  // Interning again finds the existing strings.
+  intern_range(0u, 2u * kNumStrings);
+  EXPECT_EQ(2u * kNumStrings, t.StrongSize());
+
+  // The strong sets replaced when growing are freed by the second sweep after they were retired.
+  auto num_retired_sets = [&t, &soa]() {
+    MutexLock mu(soa.Self(), *Locks::intern_table_lock_);
+    return t.strong_interns_.sets_.GetNumRetiredSets();
+  };
+  const size_t num_retired_sets_before_sweep = num_retired_sets();
+  EXPECT_NE(0u, num_retired_sets_before_sweep);
+  TestPredicate p;
+  t.SweepInternTableWeaks(&p);
+  EXPECT_EQ(num_retired_sets_before_sweep, num_retired_sets());
+  t.SweepInternTableWeaks(&p);
+  EXPECT_EQ(0u, num_retired_sets());
+  EXPECT_EQ(2u * kNumStrings, t.StrongSize());
+}
+
+TEST_F(InternTableTest, ConcurrentIntern) {
+  Thread* self = Thread::Current();
+  InternTable t;
+  static constexpr size_t kNumThreads = 4u;
+  static constexpr size_t kNumStrings = 2000u;
+  ThreadPool pool("Intern table test thread pool", kNumThreads);
+  for (size_t i = 0; i != kNumThreads; ++i) {
+    pool.AddTask(self, new FunctionTask([&t, i](Thread* worker) {
+      ScopedObjectAccess soa(worker);
+      // Start at different offsets so that the threads race on both hits and inserts.
+      for (size_t j = 0; j != kNumStrings; ++j) {
+        std::string str = "c" + std::to_string((j + i * kNumStrings / kNumThreads) % kNumStrings);
+        ObjPtr<mirror::String> interned = t.InternStrong(str.length(), str.c_str());
+        ASSERT_TRUE(interned != nullptr);
+        ASSERT_OBJ_PTR_EQ(interned, t.LookupStrong(worker, str.length(), str.c_str()));
+      }
+    }));
+  }
+  pool.StartWorkers(self);
+  pool.Wait(self, /* do_work */ true, /* may_hold_locks */ false);
+  pool.StopWorkers(self);
+  // Each string was inserted exactly once.
+  EXPECT_EQ(kNumStrings, t.StrongSize());
+}
+
 }  // namespace art
@@ -29,6 +29,7 @@
 #include "entrypoints/runtime_asm_entrypoints.h"
 #include "interpreter/interpreter.h"
 #include "jit_code_cache.h"
+#include "jit_compile_queue.h"
 #include "jni/java_vm_ext.h"
 #include "mirror/method_handle_impl.h"
 #include "mirror/var_handle.h"
@@ -81,6 +82,8 @@ JitOptions* JitOptions::CreateFromRuntimeArguments(const RuntimeArgumentMap& opt
       options.GetOrDefault(RuntimeArgumentMap::ProfileSaverOpts);
   jit_options->thread_pool_pthread_priority_ =
       options.GetOrDefault(RuntimeArgumentMap::JITPoolThreadPthreadPriority);
+  jit_options->thread_pool_thread_count_ =
+      std::max(options.GetOrDefault(RuntimeArgumentMap::JITPoolThreadCount), 1u);
 
   if (options.Exists(RuntimeArgumentMap::JITCompileThreshold)) {
     jit_options->compile_threshold_ = *options.Get(RuntimeArgumentMap::JITCompileThreshold);
@@ -154,6 +157,7 @@ bool Jit::ShouldUsePriorityThreadWeight(Thread* self) {
 
 void Jit::DumpInfo(std::ostream& os) {
   code_cache_->Dump(os);
+  compile_queue_->Dump(os);
   cumulative_timings_.Dump(os);
   MutexLock mu(Thread::Current(), lock_);
   memory_use_.PrintMemoryUse(os);
@@ -169,6 +173,7 @@ void Jit::AddTimingLogger(const TimingLogger& logger) {
 }
 
 Jit::Jit(JitOptions* options) : options_(options),
+                                compile_queue_(new JitCompileQueue()),
                                 cumulative_timings_("JIT timings"),
                                 memory_use_("Memory used for compilation", 16),
                                 lock_("JIT memory use lock") {}
@@ -314,7 +319,9 @@ void Jit::CreateThreadPool() {
 
   // We need peers as we may report the JIT thread, e.g., in the debugger.
   constexpr bool kJitPoolNeedsPeers = true;
-  thread_pool_.reset(new ThreadPool("Jit thread pool", 1, kJitPoolNeedsPeers));
+  thread_pool_.reset(new ThreadPool("Jit thread pool",
+                                    options_->GetThreadPoolThreadCount(),
+                                    kJitPoolNeedsPeers));
 
   thread_pool_->SetPthreadPriority(options_->GetThreadPoolPthreadPriority());
   Start();
@@ -341,6 +348,9 @@ void Jit::DeleteThreadPool() {
     // will finish in a short period, so it's not worth adding a suspend logic
     // here. Besides, this is only done for shutdown.
     pool->Wait(self, false, false);
+    // The tasks which would have run the pending compilation requests are gone, release the
+    // requests and the classes they keep alive.
+    compile_queue_->Clear(self);
   }
 }
 
@@ -581,7 +591,7 @@ void Jit::AddMemoryUsage(ArtMethod* method, size_t bytes) {
   memory_use_.AddValue(bytes);
 }
 
-class JitCompileTask FINAL : public Task {
+class JitCompileTask FINAL : public JitCompileRequest {
  public:
   enum TaskKind {
     kAllocateProfile,
@@ -597,8 +607,9 @@ class JitCompileTask FINAL : public Task {
   }
 
   ~JitCompileTask() {
-    ScopedObjectAccess soa(Thread::Current());
-    soa.Vm()->DeleteGlobalRef(soa.Self(), klass_);
+    // Deleting a global reference does not need the mutator lock. Pending tasks are deleted at
+    // shutdown, possibly after the current thread was detached.
+    Runtime::Current()->GetJavaVM()->DeleteGlobalRef(Thread::Current(), klass_);
   }
 
   void Run(Thread* self) OVERRIDE {
@@ -620,6 +631,37 @@ class JitCompileTask FINAL : public Task {
     delete this;
   }
 
+  ArtMethod* GetMethod() const OVERRIDE {
+    return method_;
+  }
+
+  bool IsStale() const OVERRIDE REQUIRES_SHARED(Locks::mutator_lock_) {
+    JitCodeCache* code_cache = Runtime::Current()->GetJit()->GetCodeCache();
+    switch (kind_) {
+      case kCompile:
+        return code_cache->ContainsPc(method_->GetEntryPointFromQuickCompiledCode());
+      case kCompileOsr:
+        return code_cache->IsOsrCompiled(method_);
+      case kAllocateProfile:
+        return method_->GetProfilingInfo(kRuntimePointerSize) != nullptr;
+    }
+    LOG(FATAL) << "Unreachable";
+    UNREACHABLE();
+  }
+
+  uint32_t GetRank() const OVERRIDE {
+    switch (kind_) {
+      case kCompileOsr:
+        return 2u;
+      case kCompile:
+        return 1u;
+      case kAllocateProfile:
+        return 0u;
+    }
+    LOG(FATAL) << "Unreachable";
+    UNREACHABLE();
+  }
+
  private:
   ArtMethod* const method_;
   const TaskKind kind_;
@@ -693,7 +735,8 @@ void Jit::AddSamples(Thread* self, ArtMethod* method, uint16_t count, bool with_
       if (!success) {
         // We failed allocating. Instead of doing the collection on the Java thread, we push
         // an allocation to a compiler thread, that will do the collection.
-        thread_pool_->AddTask(self, new JitCompileTask(method, JitCompileTask::kAllocateProfile));
+        compile_queue_->Add(
+            self, thread_pool_.get(), new JitCompileTask(method, JitCompileTask::kAllocateProfile));
       }
     }
     // Avoid jumping more than one state at a time.
@@ -703,7 +746,8 @@ void Jit::AddSamples(Thread* self, ArtMethod* method, uint16_t count, bool with_
       if ((new_count >= HotMethodThreshold()) &&
           !code_cache_->ContainsPc(method->GetEntryPointFromQuickCompiledCode())) {
         DCHECK(thread_pool_ != nullptr);
-        thread_pool_->AddTask(self, new JitCompileTask(method, JitCompileTask::kCompile));
+        compile_queue_->Add(
+            self, thread_pool_.get(), new JitCompileTask(method, JitCompileTask::kCompile));
       }
       // Avoid jumping more than one state at a time.
       new_count = std::min(new_count, static_cast<uint32_t>(OSRMethodThreshold() - 1));
@@ -715,7 +759,8 @@ void Jit::AddSamples(Thread* self, ArtMethod* method, uint16_t count, bool with_
       DCHECK(!method->IsNative());  // No back edges reported for native methods.
       if ((new_count >= OSRMethodThreshold()) &&  !code_cache_->IsOsrCompiled(method)) {
         DCHECK(thread_pool_ != nullptr);
-        thread_pool_->AddTask(self, new JitCompileTask(method, JitCompileTask::kCompileOsr));
+        compile_queue_->Add(
+            self, thread_pool_.get(), new JitCompileTask(method, JitCompileTask::kCompileOsr));
       }
     }
   }
@@ -40,6 +40,7 @@ class Class;
 namespace jit {
 
 class JitCodeCache;
+class JitCompileQueue;
 class JitOptions;
 
 static constexpr int16_t kJitCheckForOSR = -1;
@@ -47,6 +48,8 @@ static constexpr int16_t kJitHotnessDisabled = -2;
 // At what priority to schedule jit threads. 9 is the lowest foreground priority on device.
 // See android/os/Process.java.
 static constexpr int kJitPoolThreadPthreadDefaultPriority = 9;
+// How many jit threads to compile with. Compilations are picked by priority, see JitCompileQueue.
+static constexpr unsigned int kJitPoolDefaultThreadCount = 1;
 
 class JitOptions {
  public:
@@ -96,6 +99,10 @@ class JitOptions {
     return thread_pool_pthread_priority_;
   }
 
+  size_t GetThreadPoolThreadCount() const {
+    return thread_pool_thread_count_;
+  }
+
   bool UseJitCompilation() const {
     return use_jit_compilation_;
   }
@@ -132,6 +139,7 @@ class JitOptions {
   uint16_t invoke_transition_weight_;
   bool dump_info_on_shutdown_;
   int thread_pool_pthread_priority_;
+  size_t thread_pool_thread_count_;
   ProfileSaverOptions profile_saver_options_;
 
   JitOptions()
@@ -144,7 +152,8 @@ class JitOptions {
         priority_thread_weight_(0),
         invoke_transition_weight_(0),
         dump_info_on_shutdown_(false),
-        thread_pool_pthread_priority_(kJitPoolThreadPthreadDefaultPriority) {}
+        thread_pool_pthread_priority_(kJitPoolThreadPthreadDefaultPriority),
+        thread_pool_thread_count_(kJitPoolDefaultThreadCount) {}
 
   DISALLOW_COPY_AND_ASSIGN(JitOptions);
 };
@@ -300,6 +309,8 @@ class Jit {
 
   std::unique_ptr<jit::JitCodeCache> code_cache_;
   std::unique_ptr<ThreadPool> thread_pool_;
+  // Compilation requests waiting for the thread pool.
+  std::unique_ptr<JitCompileQueue> compile_queue_;
 
   // Performance monitoring.
   CumulativeLogger cumulative_timings_;
@@ -36,6 +36,7 @@
 #include "handle.h"
 #include "intern_table.h"
 #include "jit/jit.h"
+#include "jit/jit_code_index.h"
 #include "jit/profiling_info.h"
 #include "linear_alloc.h"
 #include "oat_file-inl.h"
@@ -262,6 +263,7 @@ JitCodeCache::JitCodeCache(MemMap* code_map,
       collection_in_progress_(false),
       code_map_(code_map),
       data_map_(data_map),
+      code_index_(new JitCodeIndex(code_map->Begin(), code_map->Size())),
       max_capacity_(max_capacity),
       current_capacity_(initial_code_capacity + initial_data_capacity),
       code_end_(initial_code_capacity),
@@ -314,22 +316,17 @@ bool JitCodeCache::ContainsPc(const void* ptr) const {
 }
 
 bool JitCodeCache::ContainsMethod(ArtMethod* method) {
-  MutexLock mu(Thread::Current(), lock_);
   if (UNLIKELY(method->IsNative())) {
+    MutexLock mu(Thread::Current(), lock_);
     auto it = jni_stubs_map_.find(JniStubKey(method));
     if (it != jni_stubs_map_.end() &&
         it->second.IsCompiled() &&
         ContainsElement(it->second.GetMethods(), method)) {
       return true;
     }
-  } else {
-    for (const auto& it : method_code_map_) {
-      if (it.second == method) {
-        return true;
-      }
-    }
+    return false;
   }
-  return false;
+  return code_index_->ContainsMethod(method);
 }
 
 const void* JitCodeCache::GetJniStubCode(ArtMethod* method) {
@@ -627,6 +624,7 @@ void JitCodeCache::RemoveMethodsIn(Thread* self, const LinearAlloc& alloc) {
       for (auto it = method_code_map_.begin(); it != method_code_map_.end();) {
         if (alloc.ContainsUnsafe(it->second)) {
           method_headers.insert(OatQuickMethodHeader::FromCodePointer(it->first));
+          code_index_->Remove(it->first);
           it = method_code_map_.erase(it);
         } else {
           ++it;
@@ -845,6 +843,7 @@ uint8_t* JitCodeCache::CommitCodeInternal(Thread* self,
                        reinterpret_cast<char*>(roots_data + data_size));
       }
       method_code_map_.Put(code_ptr, method);
+      code_index_->Put(code_ptr, method);
       if (osr) {
         number_of_osr_compilations_++;
         osr_code_map_.Put(method, code_ptr);
@@ -935,6 +934,9 @@ bool JitCodeCache::RemoveMethodLocked(ArtMethod* method, bool release_memory) {
     for (auto it = method_code_map_.begin(); it != method_code_map_.end();) {
       if (it->second == method) {
         in_cache = true;
+        // Remove the code from the index before freeing it, so that a lock-free lookup never
+        // finds freed code.
+        code_index_->Remove(it->first);
         if (release_memory) {
           FreeCode(it->first);
         }
@@ -992,6 +994,7 @@ void JitCodeCache::MoveObsoleteMethod(ArtMethod* old_method, ArtMethod* new_meth
   for (auto& it : method_code_map_) {
     if (it.second == old_method) {
       it.second = new_method;
+      code_index_->Put(it.first, new_method);
     }
   }
   // Update osr_code_map_ to point to the new method.
@@ -1330,6 +1333,7 @@ void JitCodeCache::RemoveUnmarkedCode(Thread* self) {
         ++it;
       } else {
         method_headers.insert(OatQuickMethodHeader::FromCodePointer(code_ptr));
+        code_index_->Remove(code_ptr);
         it = method_code_map_.erase(it);
       }
     }
@@ -1463,10 +1467,10 @@ OatQuickMethodHeader* JitCodeCache::LookupMethodHeader(uintptr_t pc, ArtMethod*
     CHECK(method != nullptr);
   }
 
-  MutexLock mu(Thread::Current(), lock_);
   OatQuickMethodHeader* method_header = nullptr;
   ArtMethod* found_method = nullptr;  // Only for DCHECK(), not for JNI stubs.
   if (method != nullptr && UNLIKELY(method->IsNative())) {
+    MutexLock mu(Thread::Current(), lock_);
     auto it = jni_stubs_map_.find(JniStubKey(method));
     if (it == jni_stubs_map_.end() || !ContainsElement(it->second.GetMethods(), method)) {
       return nullptr;
@@ -1477,18 +1481,18 @@ OatQuickMethodHeader* JitCodeCache::LookupMethodHeader(uintptr_t pc, ArtMethod*
       return nullptr;
     }
   } else {
-    auto it = method_code_map_.lower_bound(reinterpret_cast<const void*>(pc));
-    if (it != method_code_map_.begin()) {
-      --it;
-      const void* code_ptr = it->first;
-      if (OatQuickMethodHeader::FromCodePointer(code_ptr)->Contains(pc)) {
-        method_header = OatQuickMethodHeader::FromCodePointer(code_ptr);
-        found_method = it->second;
-      }
+    // Use the lock-free index, stack walks should not wait for the JIT committing code.
+    const void* code_ptr = nullptr;
+    ArtMethod* index_method = nullptr;
+    if (code_index_->Lookup(pc, &code_ptr, &index_method) &&
+        OatQuickMethodHeader::FromCodePointer(code_ptr)->Contains(pc)) {
+      method_header = OatQuickMethodHeader::FromCodePointer(code_ptr);
+      found_method = index_method;
     }
     if (method_header == nullptr && method == nullptr) {
       // Scan all compiled JNI stubs as well. This slow search is used only
       // for checks in debug build, for release builds the `method` is not null.
+      MutexLock mu(Thread::Current(), lock_);
       for (auto&& entry : jni_stubs_map_) {
         const JniStubData& data = entry.second;
         if (data.IsCompiled() &&
@@ -67,6 +67,7 @@ template<class T> class ObjectArray;
 
 namespace jit {
 
+class JitCodeIndex;
 class JitInstrumentationCache;
 class ScopedCodeCacheWrite;
 
@@ -390,6 +391,8 @@ class JitCodeCache {
   SafeMap<JniStubKey, JniStubData> jni_stubs_map_ GUARDED_BY(lock_);
   // Holds compiled code associated to the ArtMethod.
   SafeMap<const void*, ArtMethod*> method_code_map_ GUARDED_BY(lock_);
+  // Copy of method_code_map_ that can be searched without holding lock_. Updated with lock_ held.
+  std::unique_ptr<JitCodeIndex> code_index_;
   // Holds osr compiled code associated to the ArtMethod.
   SafeMap<ArtMethod*, const void*> osr_code_map_ GUARDED_BY(lock_);
   // ProfilingInfo objects we have allocated.
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_JIT_JIT_CODE_INDEX_H_
+#define ART_RUNTIME_JIT_JIT_CODE_INDEX_H_
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <android-base/logging.h>
+
+#include "base/atomic.h"
+#include "base/bit_utils.h"
+#include "base/macros.h"
+
+namespace art {
+
+class ArtMethod;
+
+namespace jit {
+
+// A read-mostly index from code pointers to methods. JitCodeCache keeps it in sync with its
+// `method_code_map_` so that `LookupMethodHeader()` and `ContainsMethod()` can find compiled code
+// without taking the code cache `lock_`. Put() and Remove() must be serialized by the caller.
+//
+// The code space is split into `kNumShards` address ranges. Each shard keeps its entries sorted by
+// code pointer in an array guarded by a sequence counter: writers make the
+// counter odd while they shift entries around and even again when done, and readers retry their
+// search if they saw an odd counter or if it changed under them. Arrays replaced when a shard grows
+// are kept until the index is destroyed, so a reader never follows a dangling array pointer; they
+// at most add up to the size of the live arrays.
+class JitCodeIndex {
+ public:
+  JitCodeIndex(const uint8_t* begin, size_t size)
+      : begin_(reinterpret_cast<uintptr_t>(begin)),
+        shard_size_(RoundUp(size, kNumShards) / kNumShards) {
+    DCHECK_NE(shard_size_, 0u);
+  }
+
+  // Adds or updates the entry for `code_ptr`. Writers must be serialized.
+  void Put(const void* code_ptr, ArtMethod* method) {
+    const uintptr_t code = reinterpret_cast<uintptr_t>(code_ptr);
+    Shard& shard = GetShard(code);
+    EntryArray* array = shard.array.load(std::memory_order_relaxed);
+    size_t size = shard.size.load(std::memory_order_relaxed);
+    size_t pos = LowerBound(array, size, code);
+    if (pos != size && array->entries[pos].code.load(std::memory_order_relaxed) == code) {
+      BeginWrite(shard);
+      array->entries[pos].method.store(method, std::memory_order_relaxed);
+      EndWrite(shard);
+      return;
+    }
+    if (array == nullptr || size == array->capacity) {
+      array = Grow(shard, size);
+    }
+    BeginWrite(shard);
+    for (size_t i = size; i != pos; --i) {
+      array->entries[i].Assign(array->entries[i - 1]);
+    }
+    array->entries[pos].code.store(code, std::memory_order_relaxed);
+    array->entries[pos].method.store(method, std::memory_order_relaxed);
+    shard.size.store(size + 1, std::memory_order_relaxed);
+    EndWrite(shard);
+  }
+
+  // Removes the entry for `code_ptr`, if any. Writers must be serialized.
+  void Remove(const void* code_ptr) {
+    const uintptr_t code = reinterpret_cast<uintptr_t>(code_ptr);
+    Shard& shard = GetShard(code);
+    EntryArray* array = shard.array.load(std::memory_order_relaxed);
+    size_t size = shard.size.load(std::memory_order_relaxed);
+    size_t pos = LowerBound(array, size, code);
+    if (pos == size || array->entries[pos].code.load(std::memory_order_relaxed) != code) {
+      return;
+    }
+    BeginWrite(shard);
+    for (size_t i = pos + 1; i != size; ++i) {
+      array->entries[i - 1].Assign(array->entries[i]);
+    }
+    shard.size.store(size - 1, std::memory_order_relaxed);
+    EndWrite(shard);
+  }
+
+  // Finds the entry with the greatest code pointer not above `pc`. May run concurrently with a
+  // writer.
+  bool Lookup(uintptr_t pc, const void** code_ptr, ArtMethod** method) const {
+    if (pc < begin_) {
+      return false;
+    }
+    // The code containing `pc` may start in a previous shard.
+    for (size_t index = std::min((pc - begin_) / shard_size_, kNumShards - 1) + 1; index != 0;) {
+      --index;
+      uintptr_t code = 0u;
+      if (FindFloor(shards_[index], pc, &code, method)) {
+        *code_ptr = reinterpret_cast<const void*>(code);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Returns whether some entry maps to `method`. May run concurrently with a writer.
+  bool ContainsMethod(ArtMethod* method) const {
+    for (const Shard& shard : shards_) {
+      bool found;
+      uint32_t sequence;
+      do {
+        sequence = BeginRead(shard);
+        found = false;
+        EntryArray* array = shard.array.load(std::memory_order_acquire);
+        size_t size = ClampedSize(shard, array);
+        for (size_t i = 0; i != size && !found; ++i) {
+          found = (array->entries[i].method.load(std::memory_order_relaxed) == method);
+        }
+      } while (!EndRead(shard, sequence));
+      if (found) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  static constexpr size_t kNumShards = 64;
+  static constexpr size_t kInitialShardCapacity = 16;
+
+  struct Entry {
+    Atomic<uintptr_t> code;
+    Atomic<ArtMethod*> method;
+
+    void Assign(const Entry& other) {
+      code.store(other.code.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      method.store(other.method.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+  };
+
+  struct EntryArray {
+    explicit EntryArray(size_t c) : capacity(c), entries(new Entry[c]) {}
+
+    const size_t capacity;
+    const std::unique_ptr<Entry[]> entries;
+  };
+
+  struct Shard {
+    Shard() : sequence(0u), size(0u), array(nullptr) {}
+
+    Atomic<uint32_t> sequence;
+    Atomic<size_t> size;
+    Atomic<EntryArray*> array;
+    // All the arrays allocated for this shard. Only accessed by writers.
+    std::vector<std::unique_ptr<EntryArray>> arrays;
+  };
+
+  Shard& GetShard(uintptr_t code) {
+    DCHECK_GE(code, begin_);
+    size_t index = (code - begin_) / shard_size_;
+    DCHECK_LT(index, kNumShards);
+    return shards_[index];
+  }
+
+  // Index of the first entry not below `code`. Writers must be serialized.
+  static size_t LowerBound(const EntryArray* array, size_t size, uintptr_t code) {
+    size_t lo = 0u;
+    size_t hi = size;
+    while (lo != hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (array->entries[mid].code.load(std::memory_order_relaxed) < code) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  EntryArray* Grow(Shard& shard, size_t size) {
+    size_t capacity = (size == 0u) ? kInitialShardCapacity : 2 * size;
+    shard.arrays.emplace_back(new EntryArray(capacity));
+    EntryArray* new_array = shard.arrays.back().get();
+    EntryArray* old_array = shard.array.load(std::memory_order_relaxed);
+    for (size_t i = 0; i != size; ++i) {
+      new_array->entries[i].Assign(old_array->entries[i]);
+    }
+    // Publish the copy. Readers may see either array with either size, see ClampedSize().
+    shard.array.store(new_array, std::memory_order_release);
+    return new_array;
+  }
+
+  static void BeginWrite(Shard& shard) {
+    shard.sequence.store(shard.sequence.load(std::memory_order_relaxed) + 1u,
+                         std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  static void EndWrite(Shard& shard) {
+    shard.sequence.store(shard.sequence.load(std::memory_order_relaxed) + 1u,
+                         std::memory_order_release);
+  }
+
+  static uint32_t BeginRead(const Shard& shard) {
+    uint32_t sequence;
+    while (((sequence = shard.sequence.load(std::memory_order_acquire)) & 1u) != 0u) {
+      // A writer is updating the shard; it only holds it for a few stores.
+    }
+    return sequence;
+  }
+
+  static bool EndRead(const Shard& shard, uint32_t sequence) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return shard.sequence.load(std::memory_order_relaxed) == sequence;
+  }
+
+  static size_t ClampedSize(const Shard& shard, const EntryArray* array) {
+    // The size may belong to a newer array than the one we loaded; the search is retried then.
+    return (array == nullptr) ? 0u
+                              : std::min(shard.size.load(std::memory_order_relaxed),
+                                         array->capacity);
+  }
+
+  static bool FindFloor(const Shard& shard, uintptr_t pc, uintptr_t* code, ArtMethod** method) {
+    bool found;
+    uint32_t sequence;
+    do {
+      sequence = BeginRead(shard);
+      found = false;
+      EntryArray* array = shard.array.load(std::memory_order_acquire);
+      size_t size = ClampedSize(shard, array);
+      // Index of the first entry above `pc`.
+      size_t lo = 0u;
+      size_t hi = size;
+      while (lo != hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (array->entries[mid].code.load(std::memory_order_relaxed) <= pc) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      if (lo != 0u) {
+        found = true;
+        *code = array->entries[lo - 1].code.load(std::memory_order_relaxed);
+        *method = array->entries[lo - 1].method.load(std::memory_order_relaxed);
+      }
+    } while (!EndRead(shard, sequence));
+    return found;
+  }
+
+  const uintptr_t begin_;
+  const size_t shard_size_;
+  Shard shards_[kNumShards];
+
+  DISALLOW_COPY_AND_ASSIGN(JitCodeIndex);
+};
+
+}  // namespace jit
+}  // namespace art
+
+#endif  // ART_RUNTIME_JIT_JIT_CODE_INDEX_H_
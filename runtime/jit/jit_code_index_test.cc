@@ -0,0 +1,178 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jit/jit_code_index.h"
+
+#include <pthread.h>
+
+#include "base/globals.h"
+#include "gtest/gtest.h"
+
+namespace art {
+namespace jit {
+
+static const uint8_t* const kBegin = reinterpret_cast<const uint8_t*>(64 * KB);
+static constexpr size_t kSize = 1 * MB;
+
+static const void* Code(size_t offset) {
+  return kBegin + offset;
+}
+
+static ArtMethod* Method(size_t id) {
+  return reinterpret_cast<ArtMethod*>(id * kObjectAlignment);
+}
+
+static uintptr_t Pc(size_t offset) {
+  return reinterpret_cast<uintptr_t>(kBegin) + offset;
+}
+
+TEST(JitCodeIndexTest, Lookup) {
+  JitCodeIndex index(kBegin, kSize);
+  const void* code_ptr = nullptr;
+  ArtMethod* method = nullptr;
+  EXPECT_FALSE(index.Lookup(Pc(0), &code_ptr, &method));
+
+  index.Put(Code(0x100), Method(1));
+  index.Put(Code(0x40), Method(2));
+  index.Put(Code(kSize / 2), Method(3));
+
+  EXPECT_FALSE(index.Lookup(Pc(0) - 1u, &code_ptr, &method));
+  EXPECT_FALSE(index.Lookup(Pc(0x3f), &code_ptr, &method));
+  ASSERT_TRUE(index.Lookup(Pc(0x40), &code_ptr, &method));
+  EXPECT_EQ(Code(0x40), code_ptr);
+  EXPECT_EQ(Method(2), method);
+  ASSERT_TRUE(index.Lookup(Pc(0x120), &code_ptr, &method));
+  EXPECT_EQ(Code(0x100), code_ptr);
+  EXPECT_EQ(Method(1), method);
+  // The code containing a pc may start in a previous shard.
+  ASSERT_TRUE(index.Lookup(Pc(kSize / 2 - 1), &code_ptr, &method));
+  EXPECT_EQ(Code(0x100), code_ptr);
+  ASSERT_TRUE(index.Lookup(Pc(kSize - 1), &code_ptr, &method));
+  EXPECT_EQ(Code(kSize / 2), code_ptr);
+  EXPECT_EQ(Method(3), method);
+}
+
+TEST(JitCodeIndexTest, PutRemove) {
+  JitCodeIndex index(kBegin, kSize);
+  const void* code_ptr = nullptr;
+  ArtMethod* method = nullptr;
+  index.Put(Code(0x40), Method(1));
+  index.Put(Code(0x80), Method(2));
+  EXPECT_TRUE(index.ContainsMethod(Method(1)));
+  EXPECT_TRUE(index.ContainsMethod(Method(2)));
+  EXPECT_FALSE(index.ContainsMethod(Method(3)));
+
+  // Putting an existing code pointer updates its method.
+  index.Put(Code(0x80), Method(3));
+  EXPECT_FALSE(index.ContainsMethod(Method(2)));
+  EXPECT_TRUE(index.ContainsMethod(Method(3)));
+
+  index.Remove(Code(0x80));
+  EXPECT_FALSE(index.ContainsMethod(Method(3)));
+  ASSERT_TRUE(index.Lookup(Pc(0x90), &code_ptr, &method));
+  EXPECT_EQ(Code(0x40), code_ptr);
+  // Removing a missing entry does nothing.
+  index.Remove(Code(0x80));
+  index.Remove(Code(0x40));
+  EXPECT_FALSE(index.Lookup(Pc(0x90), &code_ptr, &method));
+  EXPECT_FALSE(index.ContainsMethod(Method(1)));
+}
+
+TEST(JitCodeIndexTest, Grow) {
+  JitCodeIndex index(kBegin, kSize);
+  // Enough entries in the first shard to grow its array several times, added out of order.
+  static constexpr size_t kEntries = 100;
+  for (size_t i = 0; i != kEntries; ++i) {
+    size_t id = (i * 37) % kEntries;
+    index.Put(Code(id * 16), Method(id + 1));
+  }
+  for (size_t id = 0; id != kEntries; ++id) {
+    const void* code_ptr = nullptr;
+    ArtMethod* method = nullptr;
+    ASSERT_TRUE(index.Lookup(Pc(id * 16 + 8), &code_ptr, &method));
+    EXPECT_EQ(Code(id * 16), code_ptr);
+    EXPECT_EQ(Method(id + 1), method);
+  }
+  for (size_t id = 0; id != kEntries; id += 2) {
+    index.Remove(Code(id * 16));
+  }
+  for (size_t id = 0; id != kEntries; ++id) {
+    const void* code_ptr = nullptr;
+    ArtMethod* method = nullptr;
+    bool found = index.Lookup(Pc(id * 16 + 8), &code_ptr, &method);
+    if (id == 0) {
+      EXPECT_FALSE(found);
+    } else {
+      ASSERT_TRUE(found);
+      size_t expected_id = (id % 2 == 0) ? id - 1 : id;
+      EXPECT_EQ(Code(expected_id * 16), code_ptr);
+      EXPECT_EQ(Method(expected_id + 1), method);
+    }
+  }
+}
+
+struct ConcurrentLookupArgs {
+  const JitCodeIndex* index;
+  Atomic<bool> stop;
+  size_t lookups;
+  size_t failures;
+};
+
+static void* ConcurrentLookup(void* arg) {
+  ConcurrentLookupArgs* args = reinterpret_cast<ConcurrentLookupArgs*>(arg);
+  while (!args->stop.load(std::memory_order_relaxed)) {
+    const void* code_ptr = nullptr;
+    ArtMethod* method = nullptr;
+    // The entry at 0x800 is never removed and nothing is put between it and the pc.
+    if (!args->index->Lookup(Pc(0x808), &code_ptr, &method) ||
+        code_ptr != Code(0x800) ||
+        method != Method(1)) {
+      ++args->failures;
+    }
+    ++args->lookups;
+  }
+  return nullptr;
+}
+
+TEST(JitCodeIndexTest, ConcurrentLookup) {
+  JitCodeIndex index(kBegin, kSize);
+  index.Put(Code(0x800), Method(1));
+  ConcurrentLookupArgs args;
+  args.index = &index;
+  args.stop.store(false, std::memory_order_relaxed);
+  args.lookups = 0u;
+  args.failures = 0u;
+  pthread_t reader;
+  ASSERT_EQ(0, pthread_create(&reader, nullptr, ConcurrentLookup, &args));
+  // Shift the stable entry around and grow the shard's array while the reader searches it.
+  for (size_t round = 0; round != 100; ++round) {
+    for (size_t i = 0; i != 64; ++i) {
+      index.Put(Code(i * 16), Method(i + 2));
+      index.Put(Code(0x900 + i * 16), Method(i + 2));
+    }
+    for (size_t i = 0; i != 64; ++i) {
+      index.Remove(Code(i * 16));
+      index.Remove(Code(0x900 + i * 16));
+    }
+  }
+  args.stop.store(true, std::memory_order_relaxed);
+  ASSERT_EQ(0, pthread_join(reader, nullptr));
+  EXPECT_NE(0u, args.lookups);
+  EXPECT_EQ(0u, args.failures);
+}
+
+}  // namespace jit
+}  // namespace art
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jit_compile_queue.h"
+
+#include <algorithm>
+
+#include "art_method-inl.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread-current-inl.h"
+
+namespace art {
+namespace jit {
+
+class JitCompileQueue::PollTask FINAL : public Task {
+ public:
+  explicit PollTask(JitCompileQueue* queue) : queue_(queue) {}
+
+  void Run(Thread* self) OVERRIDE {
+    queue_->RunNext(self);
+  }
+
+  void Finalize() OVERRIDE {
+    delete this;
+  }
+
+ private:
+  JitCompileQueue* const queue_;
+
+  DISALLOW_COPY_AND_ASSIGN(PollTask);
+};
+
+JitCompileQueue::JitCompileQueue()
+    : lock_("JIT compile queue lock"),
+      next_sequence_number_(0u),
+      peak_size_(0u),
+      num_added_(0u),
+      num_deduplicated_(0u),
+      num_cancelled_(0u),
+      num_run_(0u) {}
+
+JitCompileQueue::~JitCompileQueue() {
+  if (!requests_.empty()) {
+    Clear(Thread::Current());
+  }
+}
+
+void JitCompileQueue::Add(Thread* self, ThreadPool* pool, JitCompileRequest* request) {
+  bool duplicate = false;
+  {
+    MutexLock mu(self, lock_);
+    for (const Request& pending : requests_) {
+      if (pending.request->GetMethod() == request->GetMethod() &&
+          pending.request->GetRank() == request->GetRank()) {
+        duplicate = true;
+        break;
+      }
+    }
+    if (duplicate) {
+      ++num_deduplicated_;
+    } else {
+      requests_.push_back(Request { request, next_sequence_number_++ });
+      peak_size_ = std::max(peak_size_, requests_.size());
+      ++num_added_;
+    }
+  }
+  if (duplicate) {
+    // Finalize without holding lock_, see Clear.
+    request->Finalize();
+    return;
+  }
+  pool->AddTask(self, new PollTask(this));
+}
+
+JitCompileRequest* JitCompileQueue::Poll(Thread* self) {
+  MutexLock mu(self, lock_);
+  if (requests_.empty()) {
+    return nullptr;
+  }
+  // The queue is short and the hotness counters keep changing while requests wait, so we pick the
+  // best request with a linear scan rather than keeping the requests sorted.
+  auto is_more_urgent = [](const Request& lhs, const Request& rhs)
+      REQUIRES_SHARED(Locks::mutator_lock_) {
+    if (lhs.request->GetRank() != rhs.request->GetRank()) {
+      return lhs.request->GetRank() > rhs.request->GetRank();
+    }
+    uint16_t lhs_counter = lhs.request->GetMethod()->GetCounter();
+    uint16_t rhs_counter = rhs.request->GetMethod()->GetCounter();
+    if (lhs_counter != rhs_counter) {
+      return lhs_counter > rhs_counter;
+    }
+    return lhs.sequence_number < rhs.sequence_number;
+  };
+  auto best = requests_.begin();
+  for (auto it = best + 1; it != requests_.end(); ++it) {
+    if (is_more_urgent(*it, *best)) {
+      best = it;
+    }
+  }
+  JitCompileRequest* request = best->request;
+  requests_.erase(best);
+  return request;
+}
+
+void JitCompileQueue::RunNext(Thread* self) {
+  JitCompileRequest* request = nullptr;
+  bool stale = false;
+  {
+    ScopedObjectAccess soa(self);
+    request = Poll(self);
+    if (request == nullptr) {
+      return;
+    }
+    stale = request->IsStale();
+  }
+  if (stale) {
+    MutexLock mu(self, lock_);
+    ++num_cancelled_;
+  } else {
+    request->Run(self);
+    MutexLock mu(self, lock_);
+    ++num_run_;
+  }
+  request->Finalize();
+}
+
+void JitCompileQueue::Clear(Thread* self) {
+  std::vector<Request> requests;
+  {
+    MutexLock mu(self, lock_);
+    requests.swap(requests_);
+    num_cancelled_ += requests.size();
+  }
+  // Finalize without holding lock_, requests may take other locks to release their resources.
+  for (const Request& pending : requests) {
+    pending.request->Finalize();
+  }
+}
+
+void JitCompileQueue::Dump(std::ostream& os) {
+  MutexLock mu(Thread::Current(), lock_);
+  os << "Current number of pending JIT compilation requests: " << requests_.size() << "\n"
+     << "Peak number of pending JIT compilation requests: " << peak_size_ << "\n"
+     << "Total number of JIT compilation requests: " << num_added_ << "\n"
+     << "Total number of JIT compilation requests deduplicated: " << num_deduplicated_ << "\n"
+     << "Total number of JIT compilation requests cancelled: " << num_cancelled_ << "\n"
+     << "Total number of JIT compilation requests run: " << num_run_ << std::endl;
+}
+
+}  // namespace jit
+}  // namespace art
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_JIT_JIT_COMPILE_QUEUE_H_
+#define ART_RUNTIME_JIT_JIT_COMPILE_QUEUE_H_
+
+#include <ostream>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "thread_pool.h"
+
+namespace art {
+
+class ArtMethod;
+class Thread;
+
+namespace jit {
+
+// A request which can wait in a JitCompileQueue. Finalize() is called once the request has been
+// run, cancelled or dropped.
+class JitCompileRequest : public Task {
+ public:
+  virtual ArtMethod* GetMethod() const = 0;
+
+  // Requests with a greater rank run first. Requests for the same method with the same rank are
+  // identical.
+  virtual uint32_t GetRank() const = 0;
+
+  // Whether the request has nothing left to do, e.g. because the method got compiled by another
+  // request.
+  virtual bool IsStale() const REQUIRES_SHARED(Locks::mutator_lock_) = 0;
+};
+
+// Compilation requests waiting for a jit thread. The thread pool gets one task per request, and
+// that task runs whichever request is the most urgent when it gets a thread rather than the one it
+// was added for: the highest rank first, and the hottest method first within a rank. Requests
+// identical to a pending one are dropped, and requests that became useless while waiting (the
+// method got compiled meanwhile) are cancelled.
+class JitCompileQueue {
+ public:
+  JitCompileQueue();
+
+  // Finalizes the requests still pending. The thread pool tasks added for them must have been
+  // removed or run.
+  ~JitCompileQueue();
+
+  // Queue `request` and add a task to `pool` to run it. Takes ownership of `request`.
+  void Add(Thread* self, ThreadPool* pool, JitCompileRequest* request)
+      REQUIRES(!lock_) REQUIRES_SHARED(Locks::mutator_lock_);
+
+  // Run the most urgent pending request, if it is still needed.
+  void RunNext(Thread* self) REQUIRES(!lock_, !Locks::mutator_lock_);
+
+  // Finalize the pending requests without running them, e.g. once the thread pool tasks which
+  // would have run them have been removed.
+  void Clear(Thread* self) REQUIRES(!lock_, !Locks::mutator_lock_);
+
+  void Dump(std::ostream& os) REQUIRES(!lock_);
+
+ private:
+  class PollTask;
+
+  struct Request {
+    JitCompileRequest* request;
+    uint64_t sequence_number;
+  };
+
+  // Remove the most urgent request from the queue.
+  JitCompileRequest* Poll(Thread* self) REQUIRES(!lock_) REQUIRES_SHARED(Locks::mutator_lock_);
+
+  Mutex lock_;
+  std::vector<Request> requests_ GUARDED_BY(lock_);
+  uint64_t next_sequence_number_ GUARDED_BY(lock_);
+  size_t peak_size_ GUARDED_BY(lock_);
+  uint64_t num_added_ GUARDED_BY(lock_);
+  uint64_t num_deduplicated_ GUARDED_BY(lock_);
+  uint64_t num_cancelled_ GUARDED_BY(lock_);
+  uint64_t num_run_ GUARDED_BY(lock_);
+
+  DISALLOW_COPY_AND_ASSIGN(JitCompileQueue);
+};
+
+}  // namespace jit
+}  // namespace art
+
+#endif  // ART_RUNTIME_JIT_JIT_COMPILE_QUEUE_H_
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jit/jit_compile_queue.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "art_method-inl.h"
+#include "base/enums.h"
+#include "class_linker.h"
+#include "common_runtime_test.h"
+#include "mirror/class-inl.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread-current-inl.h"
+
+namespace art {
+namespace jit {
+
+// Records what happened to the requests, in order.
+struct RequestLog {
+  Mutex lock{"request log lock"};
+  std::vector<int> run GUARDED_BY(lock);
+  std::vector<int> finalized GUARDED_BY(lock);
+};
+
+class TestRequest FINAL : public JitCompileRequest {
+ public:
+  TestRequest(int id, ArtMethod* method, uint32_t rank, bool stale, RequestLog* log)
+      : id_(id), method_(method), rank_(rank), stale_(stale), log_(log) {}
+
+  void Run(Thread* self) OVERRIDE {
+    MutexLock mu(self, log_->lock);
+    log_->run.push_back(id_);
+  }
+
+  void Finalize() OVERRIDE {
+    {
+      MutexLock mu(Thread::Current(), log_->lock);
+      log_->finalized.push_back(id_);
+    }
+    delete this;
+  }
+
+  ArtMethod* GetMethod() const OVERRIDE {
+    return method_;
+  }
+
+  uint32_t GetRank() const OVERRIDE {
+    return rank_;
+  }
+
+  bool IsStale() const OVERRIDE {
+    return stale_;
+  }
+
+ private:
+  const int id_;
+  ArtMethod* const method_;
+  const uint32_t rank_;
+  const bool stale_;
+  RequestLog* const log_;
+};
+
+class JitCompileQueueTest : public CommonRuntimeTest {
+ protected:
+  void SetUp() OVERRIDE {
+    CommonRuntimeTest::SetUp();
+    ScopedObjectAccess soa(Thread::Current());
+    ObjPtr<mirror::Class> object_class =
+        class_linker_->FindSystemClass(soa.Self(), "Ljava/lang/Object;");
+    ASSERT_TRUE(object_class != nullptr);
+    for (ArtMethod& method : object_class->GetVirtualMethods(kRuntimePointerSize)) {
+      methods_.push_back(&method);
+      counters_.push_back(method.GetCounter());
+      if (methods_.size() == 3u) {
+        break;
+      }
+    }
+    ASSERT_EQ(3u, methods_.size());
+  }
+
+  void TearDown() OVERRIDE {
+    for (size_t i = 0; i != methods_.size(); ++i) {
+      methods_[i]->SetCounter(counters_[i]);
+    }
+    CommonRuntimeTest::TearDown();
+  }
+
+  std::string Dump(JitCompileQueue* queue) {
+    std::ostringstream oss;
+    queue->Dump(oss);
+    return oss.str();
+  }
+
+  std::vector<ArtMethod*> methods_;
+  std::vector<uint16_t> counters_;
+};
+
+TEST_F(JitCompileQueueTest, PriorityDedupAndCancel) {
+  Thread* self = Thread::Current();
+  RequestLog log;
+  JitCompileQueue queue;
+  // The workers do not run anything before StartWorkers, so the whole queue is in place when the
+  // first request is picked.
+  ThreadPool pool("JitCompileQueueTest pool", 1u);
+  {
+    ScopedObjectAccess soa(self);
+    methods_[0]->SetCounter(10u);
+    methods_[1]->SetCounter(20u);
+    methods_[2]->SetCounter(30u);
+    queue.Add(self, &pool, new TestRequest(1, methods_[0], 0u, false, &log));
+    queue.Add(self, &pool, new TestRequest(2, methods_[0], 1u, false, &log));
+    queue.Add(self, &pool, new TestRequest(3, methods_[1], 1u, false, &log));
+    queue.Add(self, &pool, new TestRequest(4, methods_[2], 1u, true, &log));
+    queue.Add(self, &pool, new TestRequest(5, methods_[2], 2u, false, &log));
+    // Identical to request 3, dropped right away.
+    queue.Add(self, &pool, new TestRequest(6, methods_[1], 1u, false, &log));
+  }
+  {
+    MutexLock mu(self, log.lock);
+    EXPECT_TRUE(log.run.empty());
+    EXPECT_EQ(std::vector<int>({ 6 }), log.finalized);
+  }
+  pool.StartWorkers(self);
+  pool.Wait(self, /* do_work */ false, /* may_hold_locks */ false);
+
+  {
+    MutexLock mu(self, log.lock);
+    // Highest rank first, then the hottest method. Request 4 is stale and cancelled.
+    EXPECT_EQ(std::vector<int>({ 5, 3, 2, 1 }), log.run);
+    EXPECT_EQ(std::vector<int>({ 6, 5, 4, 3, 2, 1 }), log.finalized);
+  }
+  std::string dump = Dump(&queue);
+  EXPECT_NE(std::string::npos, dump.find("requests: 5\n")) << dump;
+  EXPECT_NE(std::string::npos, dump.find("requests deduplicated: 1\n")) << dump;
+  EXPECT_NE(std::string::npos, dump.find("requests cancelled: 1\n")) << dump;
+  EXPECT_NE(std::string::npos, dump.find("requests run: 4\n")) << dump;
+}
+
+TEST_F(JitCompileQueueTest, PendingRequestsAreFinalized) {
+  Thread* self = Thread::Current();
+  RequestLog log;
+  {
+    std::unique_ptr<JitCompileQueue> queue(new JitCompileQueue());
+    ThreadPool pool("JitCompileQueueTest pool", 1u);
+    {
+      ScopedObjectAccess soa(self);
+      queue->Add(self, &pool, new TestRequest(1, methods_[0], 1u, false, &log));
+      queue->Add(self, &pool, new TestRequest(2, methods_[1], 1u, false, &log));
+    }
+    // As at shutdown: the tasks which would have run the requests are dropped.
+    pool.RemoveAllTasks(self);
+    queue->Clear(self);
+    {
+      MutexLock mu(self, log.lock);
+      EXPECT_EQ(2u, log.finalized.size());
+    }
+    std::string dump = Dump(queue.get());
+    EXPECT_NE(std::string::npos, dump.find("Current number of pending JIT compilation requests: 0"))
+        << dump;
+
+    // Requests still pending when the queue is destroyed are finalized too.
+    {
+      ScopedObjectAccess soa(self);
+      queue->Add(self, &pool, new TestRequest(3, methods_[2], 1u, false, &log));
+    }
+    pool.RemoveAllTasks(self);
+    queue.reset();
+  }
+  MutexLock mu(self, log.lock);
+  EXPECT_TRUE(log.run.empty());
+  EXPECT_EQ(std::vector<int>({ 1, 2, 3 }), log.finalized);
+}
+
+}  // namespace jit
+}  // namespace art
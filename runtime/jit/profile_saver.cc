@@ -54,6 +54,12 @@ static_assert(ProfileCompilationInfo::kIndividualInlineCacheSize ==
 // At what priority to schedule the saver threads. 9 is the lowest foreground priority on device.
 static constexpr int kProfileSaverPthreadPriority = 9;
 
+// Append the new data to profiles instead of rewriting them in full.
+static constexpr bool kAppendToProfiles = true;
+
+// Number of appends after which a profile is rewritten in full, merging its sections.
+static constexpr uint32_t kMaxNumberOfProfileAppends = 16;
+
 static void SetProfileSaverThreadPriority(pthread_t thread, int priority) {
 #if defined(ART_TARGET_ANDROID)
   int result = setpriority(PRIO_PROCESS, pthread_gettid_np(thread), priority);
@@ -90,6 +96,7 @@ ProfileSaver::ProfileSaver(const ProfileSaverOptions& options,
       period_condition_("ProfileSaver period condition", wait_lock_),
       total_bytes_written_(0),
       total_number_of_writes_(0),
+      total_number_of_appends_(0),
       total_number_of_code_cache_queries_(0),
       total_number_of_skipped_writes_(0),
       total_number_of_failed_writes_(0),
@@ -519,6 +526,21 @@ bool ProfileSaver::ProcessProfilingInfo(bool force_save, /*out*/uint16_t* number
       jit_code_cache_->GetProfiledMethods(locations, profile_methods);
       total_number_of_code_cache_queries_++;
     }
+    auto saved_profile_it = saved_profiles_.find(filename);
+    if (saved_profile_it != saved_profiles_.end()) {
+      if (kAppendToProfiles &&
+          saved_profile_it->second.number_of_appends < kMaxNumberOfProfileAppends &&
+          AppendNewProfileData(filename,
+                               profile_methods,
+                               force_save,
+                               &saved_profile_it->second,
+                               number_of_new_methods,
+                               &profile_file_saved)) {
+        continue;
+      }
+      // Reload and rewrite the whole file below.
+      saved_profiles_.erase(saved_profile_it);
+    }
     {
       ProfileCompilationInfo info(Runtime::Current()->GetArenaPool());
       if (!info.Load(filename, /*clear_if_invalid*/ true)) {
@@ -568,7 +590,7 @@ bool ProfileSaver::ProcessProfilingInfo(bool force_save, /*out*/uint16_t* number
             std::max(static_cast<uint16_t>(delta_number_of_methods),
                      *number_of_new_methods);
       }
-      uint64_t bytes_written;
+      uint64_t bytes_written = 0;
       // Force the save. In case the profile data is corrupted or the the profile
       // has the wrong version this will "fix" the file to the correct format.
       if (info.Save(filename, &bytes_written)) {
@@ -582,6 +604,15 @@ bool ProfileSaver::ProcessProfilingInfo(bool force_save, /*out*/uint16_t* number
           total_number_of_writes_++;
           total_bytes_written_ += bytes_written;
           profile_file_saved = true;
+          if (kAppendToProfiles) {
+            // Remember what the file contains, so that the next saves only append to it.
+            std::unique_ptr<ProfileCompilationInfo::SavedDataDigest> digest(
+                new ProfileCompilationInfo::SavedDataDigest());
+            if (info.RecordDataIn(digest.get())) {
+              saved_profiles_.Put(filename,
+                                  SavedProfile { std::move(digest), bytes_written, 0u });
+            }
+          }
         } else {
           // At this point we could still have avoided the write.
           // We load and merge the data from the file lazily at its first ever
@@ -603,6 +634,63 @@ bool ProfileSaver::ProcessProfilingInfo(bool force_save, /*out*/uint16_t* number
   return profile_file_saved;
 }
 
+bool ProfileSaver::AppendNewProfileData(const std::string& filename,
+                                        const std::vector<ProfileMethodInfo>& profile_methods,
+                                        bool force_save,
+                                        SavedProfile* saved_profile,
+                                        /*out*/ uint16_t* number_of_new_methods,
+                                        /*out*/ bool* profile_file_saved) {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  ProfileCompilationInfo new_data(Runtime::Current()->GetArenaPool());
+  if (!new_data.AddMethods(profile_methods,
+                           ProfileCompilationInfo::MethodHotness::kFlagPostStartup)) {
+    return false;
+  }
+  auto profile_cache_it = profile_cache_.find(filename);
+  if (profile_cache_it != profile_cache_.end() && !new_data.MergeWith(*profile_cache_it->second)) {
+    return false;
+  }
+  new_data.RemoveDataPresentIn(*saved_profile->digest);
+
+  // Methods which are not new but have new inline cache data are counted as well.
+  uint32_t delta_number_of_methods = new_data.GetNumberOfMethods();
+  uint32_t delta_number_of_classes = new_data.GetNumberOfResolvedClasses();
+  if (!force_save &&
+      delta_number_of_methods < options_.GetMinMethodsToSave() &&
+      delta_number_of_classes < options_.GetMinClassesToSave()) {
+    VLOG(profiler) << "Not enough information to append to: " << filename
+                   << " Number of methods: " << delta_number_of_methods
+                   << " Number of classes: " << delta_number_of_classes;
+    total_number_of_skipped_writes_++;
+    return true;
+  }
+  if (number_of_new_methods != nullptr) {
+    *number_of_new_methods =
+        std::max(static_cast<uint16_t>(delta_number_of_methods), *number_of_new_methods);
+  }
+
+  // Record first, this fails (without appending anything) if the new data does not match the
+  // dex files of the saved profile. If appending fails, the caller drops the saved profile.
+  if (!new_data.RecordDataIn(saved_profile->digest.get())) {
+    return false;
+  }
+  uint64_t file_size;
+  if (!new_data.Append(filename, saved_profile->file_size, &file_size)) {
+    return false;
+  }
+  if (profile_cache_it != profile_cache_.end()) {
+    ProfileCompilationInfo* cached_info = profile_cache_it->second;
+    profile_cache_.erase(profile_cache_it);
+    delete cached_info;
+  }
+  total_number_of_appends_++;
+  total_bytes_written_ += file_size - saved_profile->file_size;
+  saved_profile->file_size = file_size;
+  saved_profile->number_of_appends++;
+  *profile_file_saved = true;
+  return true;
+}
+
 void* ProfileSaver::RunProfileSaverThread(void* arg) {
   Runtime* runtime = Runtime::Current();
 
@@ -815,6 +903,7 @@ void ProfileSaver::DumpInstanceInfo(std::ostream& os) {
 void ProfileSaver::DumpInfo(std::ostream& os) {
   os << "ProfileSaver total_bytes_written=" << total_bytes_written_ << '\n'
      << "ProfileSaver total_number_of_writes=" << total_number_of_writes_ << '\n'
+     << "ProfileSaver total_number_of_appends=" << total_number_of_appends_ << '\n'
      << "ProfileSaver total_number_of_code_cache_queries="
      << total_number_of_code_cache_queries_ << '\n'
      << "ProfileSaver total_number_of_skipped_writes=" << total_number_of_skipped_writes_ << '\n'
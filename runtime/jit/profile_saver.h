@@ -84,6 +84,24 @@ class ProfileSaver {
     REQUIRES(!Locks::profiler_lock_)
     REQUIRES(!Locks::mutator_lock_);
 
+  // A digest of the content of a profile file as of the last time the saver wrote it in full or
+  // appended to it, so that the next save only needs to append what is new.
+  struct SavedProfile {
+    std::unique_ptr<ProfileCompilationInfo::SavedDataDigest> digest;
+    uint64_t file_size;
+    uint32_t number_of_appends;
+  };
+
+  // Appends the data which is not yet in the saved profile to the file. Returns false if the
+  // file needs to be saved in full instead, for instance because it was changed by somebody
+  // else. Sets `profile_file_saved` if something was written.
+  bool AppendNewProfileData(const std::string& filename,
+                            const std::vector<ProfileMethodInfo>& profile_methods,
+                            bool force_save,
+                            SavedProfile* saved_profile,
+                            /*out*/ uint16_t* number_of_new_methods,
+                            /*out*/ bool* profile_file_saved);
+
   void NotifyJitActivityInternal() REQUIRES(!wait_lock_);
   void WakeUpSaver() REQUIRES(wait_lock_);
 
@@ -133,12 +151,16 @@ class ProfileSaver {
   // to just a few hundreds entries in the ProfileCompilationInfo objects.
   SafeMap<std::string, ProfileCompilationInfo*> profile_cache_;
 
+  // A digest of the last saved content of each tracked file, see AppendNewProfileData().
+  SafeMap<std::string, SavedProfile> saved_profiles_;
+
   // Save period condition support.
   Mutex wait_lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
   ConditionVariable period_condition_ GUARDED_BY(wait_lock_);
 
   uint64_t total_bytes_written_;
   uint64_t total_number_of_writes_;
+  uint64_t total_number_of_appends_;
   uint64_t total_number_of_code_cache_queries_;
   uint64_t total_number_of_skipped_writes_;
   uint64_t total_number_of_failed_writes_;
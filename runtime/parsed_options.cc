@@ -198,6 +198,18 @@ std::unique_ptr<RuntimeParser> ParsedOptions::MakeParser(bool ignore_unrecognize
       .Define("-Xjitpthreadpriority:_")
           .WithType<int>()
           .IntoKey(M::JITPoolThreadPthreadPriority)
+      .Define("-Xjitthreads:_")
+          .WithType<unsigned int>()
+          .IntoKey(M::JITPoolThreadCount)
+      .Define("-Xbackgroundverifythreads:_")
+          .WithType<unsigned int>()
+          .IntoKey(M::BackgroundVerificationThreadCount)
+      .Define("-Xpreloadclassesprofile:_")
+          .WithType<std::string>()
+          .IntoKey(M::PreloadClassesProfile)
+      .Define("-Xpreloadclassesthreads:_")
+          .WithType<unsigned int>()
+          .IntoKey(M::PreloadClassesThreadCount)
       .Define("-Xjitsaveprofilinginfo")
           .WithType<ProfileSaverOptions>()
           .AppendValues()
@@ -272,6 +284,17 @@ std::unique_ptr<RuntimeParser> ParsedOptions::MakeParser(bool ignore_unrecognize
           .IntoKey(M::MethodTraceFileSize)
       .Define("-Xmethod-trace-stream")
           .IntoKey(M::MethodTraceStreaming)
+      .Define("-Xsamplingprofiler")
+          .IntoKey(M::SamplingProfiler)
+      .Define("-Xsamplingprofiler-file:_")
+          .WithType<std::string>()
+          .IntoKey(M::SamplingProfilerFile)
+      .Define("-Xsamplingprofiler-interval:_")
+          .WithType<unsigned int>()
+          .IntoKey(M::SamplingProfilerInterval)
+      .Define("-Xallocsampling-interval:_")
+          .WithType<unsigned int>()
+          .IntoKey(M::AllocSamplingInterval)
       .Define("-Xprofile:_")
           .WithType<TraceClockSource>()
           .WithValueMap({{"threadcpuclock", TraceClockSource::kThreadCpu},
@@ -722,6 +745,8 @@ void ParsedOptions::Usage(const char* fmt, ...) {
   UsageMessage(stream, "  -Xgc:[no]postsweepingverify_rosalloc\n");
   UsageMessage(stream, "  -Xgc:[no]postverify_rosalloc\n");
   UsageMessage(stream, "  -Xgc:[no]presweepingverify\n");
+  UsageMessage(stream, "  -Xgc:[no]generational_cc\n");
+  UsageMessage(stream, "  -Xgc:[no]parallel_cc_marking\n");
   UsageMessage(stream, "  -Ximage:filename\n");
   UsageMessage(stream, "  -Xbootclasspath-locations:bootclasspath\n"
                        "     (override the dex locations of the -Xbootclasspath files)\n");
@@ -745,6 +770,10 @@ void ParsedOptions::Usage(const char* fmt, ...) {
   UsageMessage(stream, "  -Xmethod-trace\n");
   UsageMessage(stream, "  -Xmethod-trace-file:filename");
   UsageMessage(stream, "  -Xmethod-trace-file-size:integervalue\n");
+  UsageMessage(stream, "  -Xsamplingprofiler\n");
+  UsageMessage(stream, "  -Xsamplingprofiler-file:filename (the pid is added to the name)\n");
+  UsageMessage(stream, "  -Xsamplingprofiler-interval:integervalue (microseconds)\n");
+  UsageMessage(stream, "  -Xallocsampling-interval:integervalue (bytes)\n");
   UsageMessage(stream, "  -Xps-min-save-period-ms:integervalue\n");
   UsageMessage(stream, "  -Xps-save-resolved-classes-delay-ms:integervalue\n");
   UsageMessage(stream, "  -Xps-hot-startup-method-samples:integervalue\n");
@@ -763,6 +792,13 @@ void ParsedOptions::Usage(const char* fmt, ...) {
   UsageMessage(stream, "  -Xjitwarmupthreshold:integervalue\n");
   UsageMessage(stream, "  -Xjitosrthreshold:integervalue\n");
   UsageMessage(stream, "  -Xjitprithreadweight:integervalue\n");
+  UsageMessage(stream, "  -Xjitthreads:integervalue\n");
+  UsageMessage(stream, "  -Xbackgroundverifythreads:integervalue\n");
+  UsageMessage(stream, "  -Xpreloadclassesprofile:filename\n"
+                       "     (load the classes of the profile on background threads, which cannot\n"
+                       "     call into Java: only the classes of the boot class loader and of a\n"
+                       "     PathClassLoader are preloaded, the others are left to load on use)\n");
+  UsageMessage(stream, "  -Xpreloadclassesthreads:integervalue\n");
   UsageMessage(stream, "  -X[no]relocate\n");
   UsageMessage(stream, "  -X[no]dex2oat (Whether to invoke dex2oat on the application)\n");
   UsageMessage(stream, "  -X[no]image-dex2oat (Whether to create and use a boot image)\n");
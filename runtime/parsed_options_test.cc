@@ -127,6 +127,26 @@ TEST_F(ParsedOptionsTest, ParsedOptionsGc) {
   EXPECT_EQ(gc::kCollectorTypeMC, xgc.collector_type_);
 }
 
+TEST_F(ParsedOptionsTest, ParsedOptionsPreloadClasses) {
+  using Opt = RuntimeArgumentMap;
+
+  {
+    // Nothing is preloaded by default.
+    RuntimeOptions options;
+    RuntimeArgumentMap map;
+    ASSERT_TRUE(ParsedOptions::Parse(options, false, &map));
+    EXPECT_FALSE(map.Exists(Opt::PreloadClassesProfile));
+  }
+
+  RuntimeOptions options;
+  options.push_back(std::make_pair("-Xpreloadclassesprofile:/data/app.prof", nullptr));
+  options.push_back(std::make_pair("-Xpreloadclassesthreads:2", nullptr));
+  RuntimeArgumentMap map;
+  ASSERT_TRUE(ParsedOptions::Parse(options, false, &map));
+  EXPECT_EQ("/data/app.prof", map.GetOrDefault(Opt::PreloadClassesProfile));
+  EXPECT_EQ(2u, map.GetOrDefault(Opt::PreloadClassesThreadCount));
+}
+
 TEST_F(ParsedOptionsTest, ParsedOptionsInstructionSet) {
   using Opt = RuntimeArgumentMap;
 
@@ -56,6 +56,7 @@
 #include "base/dumpable.h"
 #include "base/enums.h"
 #include "base/file_utils.h"
+#include "base/hash_set.h"
 #include "base/malloc_arena_pool.h"
 #include "base/mem_map_arena_pool.h"
 #include "base/memory_tool.h"
@@ -67,6 +68,7 @@
 #include "base/unix_file/fd_file.h"
 #include "base/utils.h"
 #include "class_linker-inl.h"
+#include "class_loader_utils.h"
 #include "compiler_callbacks.h"
 #include "debugger.h"
 #include "dex/art_dex_file_loader.h"
@@ -76,6 +78,7 @@
 #include "experimental_flags.h"
 #include "fault_handler.h"
 #include "gc/accounting/card_table-inl.h"
+#include "gc/allocation_record.h"
 #include "gc/heap.h"
 #include "gc/scoped_gc_critical_section.h"
 #include "gc/space/image_space.h"
@@ -143,11 +146,13 @@
 #include "oat_file_manager.h"
 #include "object_callbacks.h"
 #include "parsed_options.h"
+#include "profile/profile_compilation_info.h"
 #include "quick/quick_method_frame_info.h"
 #include "reflection.h"
 #include "runtime_callbacks.h"
 #include "runtime_intrinsics.h"
 #include "runtime_options.h"
+#include "sampling_profiler.h"
 #include "scoped_thread_state_change-inl.h"
 #include "sigchain.h"
 #include "signal_catcher.h"
@@ -246,6 +251,9 @@ Runtime::Runtime()
       system_thread_group_(nullptr),
       system_class_loader_(nullptr),
       dump_gc_performance_on_shutdown_(false),
+      background_verification_thread_count_(0u),
+      preload_classes_thread_count_(0u),
+      sampling_profiler_interval_us_(0u),
       preinitialization_transactions_(),
       verify_(verifier::VerifyMode::kNone),
       allow_dex_file_fallback_(true),
@@ -351,6 +359,15 @@ Runtime::~Runtime() {
 
   Trace::Shutdown();
 
+  if (sampling_profiler_ != nullptr) {
+    sampling_profiler_->Stop();
+    std::string filename;
+    std::string error_msg;
+    if (!WriteSamplingProfile(&filename, &error_msg)) {
+      LOG(WARNING) << error_msg;
+    }
+  }
+
   // Report death. Clients me require a working thread, still, so do it before GC completes and
   // all non-daemon threads are done.
   {
@@ -373,6 +390,12 @@ Runtime::~Runtime() {
     // JIT compiler threads.
     jit_->DeleteThreadPool();
   }
+  if (class_linker_ != nullptr) {
+    // Like the JIT thread pool, delete the background verification and class preloading threads
+    // before the thread list.
+    class_linker_->ShutdownBackgroundVerification(Thread::Current());
+    class_linker_->ShutdownClassPreloading(Thread::Current());
+  }
 
   // Make sure our internal threads are dead before we start tearing down things they're using.
   GetRuntimeCallbacks()->StopDebugger();
@@ -911,6 +934,23 @@ void Runtime::InitNonZygoteOrPostFork(
     CreateJit();
   }
 
+  if (background_verification_thread_count_ != 0u &&
+      IsVerificationEnabled() &&
+      !IsAotCompiler() &&
+      class_linker_->GetBackgroundVerifier() == nullptr) {
+    class_linker_->StartBackgroundVerification(background_verification_thread_count_);
+  }
+
+  if (!preload_classes_profile_.empty() && !IsAotCompiler()) {
+    PreloadProfileClasses(Thread::Current());
+  }
+
+  // Like the JIT, the profiler is started after the fork so that its thread is not in the zygote.
+  if (sampling_profiler_interval_us_ != 0u && !IsAotCompiler() && sampling_profiler_ == nullptr) {
+    sampling_profiler_.reset(new SamplingProfiler(sampling_profiler_interval_us_));
+    sampling_profiler_->Start();
+  }
+
   StartSignalCatcher();
 
   // Start the JDWP thread. If the command-line debugger flags specified "suspend=y",
@@ -920,6 +960,48 @@ void Runtime::InitNonZygoteOrPostFork(
   GetRuntimeCallbacks()->StartDebugger();
 }
 
+void Runtime::PreloadProfileClasses(Thread* self) {
+  ScopedTrace trace(__FUNCTION__);
+  ProfileCompilationInfo info;
+  if (!info.Load(preload_classes_profile_, /* clear_if_invalid */ false)) {
+    LOG(WARNING) << "Could not load the profile of the classes to preload "
+                 << preload_classes_profile_;
+    return;
+  }
+  // The system class loader delegates to the boot class loader, so the classes of both are
+  // preloaded through it. In a zygote child the application class loader does not exist yet and
+  // only the boot classes of the profile are preloaded.
+  std::vector<const DexFile*> dex_files(class_linker_->GetBootClassPath());
+  if (system_class_loader_ != nullptr) {
+    ScopedObjectAccess soa(self);
+    StackHandleScope<1> hs(self);
+    Handle<mirror::ClassLoader> class_loader(
+        hs.NewHandle(soa.Decode<mirror::ClassLoader>(system_class_loader_)));
+    if (class_loader->GetClass() == WellKnownClasses::ToClass(
+            WellKnownClasses::dalvik_system_PathClassLoader)) {
+      VisitClassLoaderDexFiles(soa, class_loader, [&](const DexFile* dex_file) {
+        dex_files.push_back(dex_file);
+        return true;
+      });
+    }
+  }
+  std::vector<std::string> descriptors;
+  for (const std::string& descriptor : info.GetClassDescriptors(dex_files)) {
+    descriptors.push_back(descriptor);
+  }
+  // The application starts while the classes are loaded, the first to use a class waits for it.
+  class_linker_->StartPreloadingClasses(self,
+                                        system_class_loader_,
+                                        std::move(descriptors),
+                                        preload_classes_thread_count_);
+}
+
+bool Runtime::WriteSamplingProfile(std::string* filename, std::string* error_msg) {
+  // The processes forked from the zygote share the option, each writes its own file.
+  *filename = SamplingProfiler::GetProcessFileName(sampling_profiler_file_, getpid());
+  return sampling_profiler_->DumpToFile(*filename, error_msg);
+}
+
 void Runtime::StartSignalCatcher() {
   if (!is_zygote_) {
     signal_catcher_ = new SignalCatcher(stack_trace_file_, use_tombstoned_traces_);
@@ -1278,6 +1360,8 @@ bool Runtime::Init(RuntimeArgumentMap&& runtime_options_in) {
                        xgc_option.verify_post_gc_rosalloc_,
                        xgc_option.gcstress_,
                        xgc_option.measure_,
+                       xgc_option.generational_cc_,
+                       xgc_option.parallel_cc_marking_,
                        runtime_options.GetOrDefault(Opt::EnableHSpaceCompactForOOM),
                        runtime_options.GetOrDefault(Opt::HSpaceCompactForOOMMinIntervalsMs));
 
@@ -1287,6 +1371,14 @@ bool Runtime::Init(RuntimeArgumentMap&& runtime_options_in) {
   }
 
   dump_gc_performance_on_shutdown_ = runtime_options.Exists(Opt::DumpGCPerformanceOnShutdown);
+  background_verification_thread_count_ =
+      runtime_options.GetOrDefault(Opt::BackgroundVerificationThreadCount);
+  preload_classes_profile_ = runtime_options.ReleaseOrDefault(Opt::PreloadClassesProfile);
+  preload_classes_thread_count_ = runtime_options.GetOrDefault(Opt::PreloadClassesThreadCount);
+  if (runtime_options.Exists(Opt::SamplingProfiler)) {
+    sampling_profiler_interval_us_ = runtime_options.GetOrDefault(Opt::SamplingProfilerInterval);
+    sampling_profiler_file_ = runtime_options.ReleaseOrDefault(Opt::SamplingProfilerFile);
+  }
 
   jdwp_options_ = runtime_options.GetOrDefault(Opt::JdwpOptions);
   jdwp_provider_ = runtime_options.GetOrDefault(Opt::JdwpProvider);
@@ -1432,6 +1524,12 @@ bool Runtime::Init(RuntimeArgumentMap&& runtime_options_in) {
   // Now we're attached, we can take the heap locks and validate the heap.
   GetHeap()->EnableObjectValidation();
 
+  const unsigned int alloc_sampling_interval =
+      runtime_options.GetOrDefault(Opt::AllocSamplingInterval);
+  if (alloc_sampling_interval != 0u && !IsAotCompiler()) {
+    gc::AllocSampleTable::SetAllocSamplingEnabled(true, alloc_sampling_interval);
+  }
+
   CHECK_GE(GetHeap()->GetContinuousSpaces().size(), 1U);
   if (UNLIKELY(IsAotCompiler())) {
     class_linker_ = new AotClassLinker(intern_table_);
@@ -1817,6 +1915,17 @@ void Runtime::DumpForSigQuit(std::ostream& os) {
   } else {
     os << "Running non JIT\n";
   }
+  if (sampling_profiler_ != nullptr) {
+    // The runtime of an application is usually not shut down, write the profile out now as well.
+    sampling_profiler_->DumpForSigQuit(os);
+    std::string filename;
+    std::string error_msg;
+    if (WriteSamplingProfile(&filename, &error_msg)) {
+      os << "CPU profile written to " << filename << "\n";
+    } else {
+      os << error_msg << "\n";
+    }
+  }
   DumpDeoptimizations(os);
   TrackedAllocators::Dump(os);
   os << "\n";
@@ -94,6 +94,7 @@ class OatFileManager;
 class Plugin;
 struct RuntimeArgumentMap;
 class RuntimeCallbacks;
+class SamplingProfiler;
 class SignalCatcher;
 class StackOverflowHandler;
 class SuspensionHandler;
@@ -437,6 +438,11 @@ class Runtime {
     return jit_.get();
   }
 
+  // The CPU sampling profiler, if enabled with -Xsamplingprofiler.
+  SamplingProfiler* GetSamplingProfiler() const {
+    return sampling_profiler_.get();
+  }
+
   // Returns true if JIT compilations are enabled. GetJit() will be not null in this case.
   bool UseJitCompilation() const;
 
@@ -787,6 +793,11 @@ class Runtime {
   void StartDaemonThreads();
   void StartSignalCatcher();
 
+  void PreloadProfileClasses(Thread* self) REQUIRES(!Locks::mutator_lock_);
+
+  // Write the samples of the CPU sampling profiler to the file of this process.
+  bool WriteSamplingProfile(std::string* filename, std::string* error_msg);
+
   void MaybeSaveJitProfilingInfo();
 
   // Visit all of the thread roots.
@@ -937,6 +948,20 @@ class Runtime {
   // If true, then we dump the GC cumulative timings on shutdown.
   bool dump_gc_performance_on_shutdown_;
 
+  // Number of threads verifying classes in the background, or 0 to verify them on demand only.
+  size_t background_verification_thread_count_;
+
+  // Profile whose classes are loaded ahead of their first use when the application starts, or
+  // empty, and the number of threads loading them.
+  std::string preload_classes_profile_;
+  size_t preload_classes_thread_count_;
+
+  // Interval between two samples of the CPU sampling profiler, or 0 if it is disabled, and the file
+  // the profile is written to on shutdown and on SIGQUIT, with the pid inserted in its name.
+  uint32_t sampling_profiler_interval_us_;
+  std::string sampling_profiler_file_;
+  std::unique_ptr<SamplingProfiler> sampling_profiler_;
+
   // Transactions used for pre-initializing classes at compilation time.
   // Support nested transactions, maintain a list containing all transactions. Transactions are
   // handled under a stack discipline. Because GC needs to go over all transactions, we choose list
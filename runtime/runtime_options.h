@@ -32,6 +32,7 @@
 #include "jit/jit.h"
 #include "jit/jit_code_cache.h"
 #include "jit/profile_saver_options.h"
+#include "sampling_profiler.h"
 #include "verifier/verifier_enums.h"
 
 namespace art {
@@ -0,0 +1,485 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sampling_profiler.h"
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <ostream>
+
+#include "android-base/stringprintf.h"
+
+#include "art_method-inl.h"
+#include "barrier.h"
+#include "base/casts.h"
+#include "base/enums.h"
+#include "base/os.h"
+#include "base/systrace.h"
+#include "base/time_utils.h"
+#include "base/unix_file/fd_file.h"
+#include "runtime.h"
+#include "scoped_thread_state_change-inl.h"
+#include "stack.h"
+#include "thread-current-inl.h"
+#include "thread_list.h"
+
+namespace art {
+
+using android::base::StringPrintf;
+
+// Records the innermost frames of the stack of a thread, without allocating.
+class SampleStackVisitor FINAL : public StackVisitor {
+ public:
+  SampleStackVisitor(Thread* thread, ArtMethod** frames, size_t max_frame_count)
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      : StackVisitor(thread, nullptr, StackVisitor::StackWalkKind::kIncludeInlinedFrames),
+        frames_(frames),
+        max_frame_count_(max_frame_count),
+        frame_count_(0u) {}
+
+  bool VisitFrame() OVERRIDE REQUIRES_SHARED(Locks::mutator_lock_) {
+    ArtMethod* m = GetMethod();
+    // Ignore runtime frames (in particular callee save).
+    if (m->IsRuntimeMethod()) {
+      return true;
+    }
+    frames_[frame_count_++] = m;
+    return frame_count_ != max_frame_count_;
+  }
+
+  size_t GetFrameCount() const {
+    return frame_count_;
+  }
+
+ private:
+  ArtMethod** const frames_;
+  const size_t max_frame_count_;
+  size_t frame_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(SampleStackVisitor);
+};
+
+class SamplingCheckpoint FINAL : public Closure {
+ public:
+  SamplingCheckpoint(SamplingProfiler* profiler, Thread* sampling_thread, Barrier* barrier)
+      : profiler_(profiler), sampling_thread_(sampling_thread), barrier_(barrier) {}
+
+  void Run(Thread* thread) OVERRIDE NO_THREAD_SAFETY_ANALYSIS {
+    // The checkpoint of a thread which was not runnable when it was requested is run by the
+    // sampling thread. Such a thread is not running Java code, skip it like the sampling thread.
+    Thread* self = Thread::Current();
+    if (thread == self && thread != sampling_thread_) {
+      // The thread runs its own checkpoint at a suspend point, holding the mutator lock.
+      Locks::mutator_lock_->AssertSharedHeld(self);
+      profiler_->RecordSample(thread);
+    }
+    // See the code in ThreadList::RunCheckpoint.
+    barrier_->Pass(self);
+  }
+
+ private:
+  SamplingProfiler* const profiler_;
+  Thread* const sampling_thread_;
+  Barrier* const barrier_;
+};
+
+SamplingProfiler::SamplingProfiler(uint32_t interval_us)
+    : interval_us_(interval_us),
+      running_(false),
+      sampling_pthread_(0U),
+      start_time_ns_(0u),
+      start_monotonic_time_ns_(0u),
+      sampled_duration_ns_(0u),
+      recording_time_ns_(0u),
+      lock_("sampling profiler lock", kSamplingProfilerLock),
+      sample_count_(0u) {
+  CHECK_GT(interval_us, 0u);
+  // The root of the call tree.
+  nodes_.push_back(CallTreeNode { 0u, 0u, 0u, 0u, 0u });
+}
+
+SamplingProfiler::~SamplingProfiler() {
+  Stop();
+}
+
+void SamplingProfiler::Start() {
+  CHECK(!IsRunning());
+  if (start_time_ns_ == 0u) {
+    timeval now;
+    gettimeofday(&now, nullptr);
+    start_time_ns_ =
+        static_cast<uint64_t>(now.tv_sec) * UINT64_C(1000000000) + now.tv_usec * UINT64_C(1000);
+  }
+  start_monotonic_time_ns_ = NanoTime();
+  running_.store(true, std::memory_order_relaxed);
+  CHECK_PTHREAD_CALL(pthread_create,
+                     (&sampling_pthread_, nullptr, &RunSamplingThread, this),
+                     "Sampling profiler thread");
+}
+
+void SamplingProfiler::Stop() {
+  if (!IsRunning()) {
+    return;
+  }
+  running_.store(false, std::memory_order_relaxed);
+  CHECK_PTHREAD_CALL(pthread_join,
+                     (sampling_pthread_, nullptr),
+                     "sampling profiler thread shutdown");
+  sampling_pthread_ = 0U;
+  sampled_duration_ns_ += NanoTime() - start_monotonic_time_ns_;
+}
+
+void* SamplingProfiler::RunSamplingThread(void* arg) {
+  SamplingProfiler* profiler = reinterpret_cast<SamplingProfiler*>(arg);
+  Runtime* runtime = Runtime::Current();
+  CHECK(runtime->AttachCurrentThread("Sampling CPU Profiler",
+                                     /* as_daemon */ true,
+                                     runtime->GetSystemThreadGroup(),
+                                     !runtime->IsAotCompiler()));
+  Thread* self = Thread::Current();
+  while (true) {
+    usleep(profiler->interval_us_);
+    if (!profiler->IsRunning()) {
+      break;
+    }
+    profiler->SampleThreads(self);
+  }
+  runtime->DetachCurrentThread();
+  return nullptr;
+}
+
+void SamplingProfiler::SampleThreads(Thread* self) {
+  ScopedTrace trace("CPU profile sampling");
+  Barrier barrier(0);
+  SamplingCheckpoint checkpoint(this, self, &barrier);
+  ScopedThreadStateChange tsc(self, kWaitingForCheckPointsToRun);
+  size_t barrier_count = Runtime::Current()->GetThreadList()->RunCheckpoint(&checkpoint);
+  if (barrier_count != 0) {
+    barrier.Increment(self, barrier_count);
+  }
+}
+
+void SamplingProfiler::RecordSample(Thread* thread) {
+  DCHECK_EQ(thread, Thread::Current());
+  const uint64_t start_ns = NanoTime();
+  ArtMethod* frames[kMaxFrames];
+  SampleStackVisitor visitor(thread, frames, kMaxFrames);
+  visitor.WalkStack();
+  // Threads running in the runtime only, like the GC threads, have no Java frames.
+  if (visitor.GetFrameCount() != 0u) {
+    AddSample(thread, frames, visitor.GetFrameCount());
+  }
+  recording_time_ns_.fetch_add(NanoTime() - start_ns, std::memory_order_relaxed);
+}
+
+void SamplingProfiler::AddSample(Thread* self, ArtMethod* const* frames, size_t frame_count) {
+  MutexLock mu(self, lock_);
+  uint32_t node = 0u;
+  for (size_t i = frame_count; i != 0u; --i) {
+    node = FindOrAddChild(node, FindOrAddFunction(frames[i - 1u]));
+  }
+  ++nodes_[node].sample_count;
+  ++sample_count_;
+}
+
+uint32_t SamplingProfiler::FindOrAddFunction(ArtMethod* method) {
+  auto it = function_indexes_.find(method);
+  if (it != function_indexes_.end() &&
+      functions_[it->second].dex_method_index == method->GetDexMethodIndex()) {
+    return it->second;
+  }
+  // The method was not seen yet, or the method seen at the same address was unloaded since.
+  uint32_t index = dchecked_integral_cast<uint32_t>(functions_.size());
+  const char* file_name =
+      method->GetInterfaceMethodIfProxy(kRuntimePointerSize)->GetDeclaringClassSourceFile();
+  functions_.push_back(Function {
+      method,
+      method->GetDexMethodIndex(),
+      method->PrettyMethod(),
+      file_name != nullptr ? file_name : "" });
+  function_indexes_[method] = index;
+  return index;
+}
+
+uint32_t SamplingProfiler::FindOrAddChild(uint32_t parent, uint32_t function) {
+  // The root is nobody's child, so 0 ends the list of siblings.
+  uint32_t child = nodes_[parent].first_child;
+  for (; child != 0u; child = nodes_[child].next_sibling) {
+    if (nodes_[child].function == function) {
+      return child;
+    }
+  }
+  uint32_t index = dchecked_integral_cast<uint32_t>(nodes_.size());
+  uint32_t next_sibling = nodes_[parent].first_child;
+  nodes_.push_back(CallTreeNode { function, parent, 0u, next_sibling, 0u });
+  nodes_[parent].first_child = index;
+  return index;
+}
+
+uint64_t SamplingProfiler::GetSampleCount() {
+  MutexLock mu(Thread::Current(), lock_);
+  return sample_count_;
+}
+
+// Field numbers and wire types of the pprof profile.proto messages, see
+// https://github.com/google/pprof/blob/master/proto/profile.proto.
+enum ProfileField : uint32_t {
+  kProfileSampleType = 1,
+  kProfileSample = 2,
+  kProfileLocation = 4,
+  kProfileFunction = 5,
+  kProfileStringTable = 6,
+  kProfileTimeNanos = 9,
+  kProfileDurationNanos = 10,
+  kProfilePeriodType = 11,
+  kProfilePeriod = 12,
+};
+
+enum ValueTypeField : uint32_t {
+  kValueTypeType = 1,
+  kValueTypeUnit = 2,
+};
+
+enum SampleField : uint32_t {
+  kSampleLocationId = 1,
+  kSampleValue = 2,
+};
+
+enum LocationField : uint32_t {
+  kLocationId = 1,
+  kLocationLine = 4,
+};
+
+enum LineField : uint32_t {
+  kLineFunctionId = 1,
+};
+
+enum FunctionField : uint32_t {
+  kFunctionId = 1,
+  kFunctionName = 2,
+  kFunctionSystemName = 3,
+  kFunctionFilename = 4,
+};
+
+static constexpr uint32_t kWireTypeVarint = 0;
+static constexpr uint32_t kWireTypeLengthDelimited = 2;
+
+static void EncodeVarint(std::vector<uint8_t>* out, uint64_t value) {
+  while (value >= 0x80u) {
+    out->push_back(static_cast<uint8_t>(value | 0x80u));
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+static void EncodeVarintField(std::vector<uint8_t>* out, uint32_t field, uint64_t value) {
+  EncodeVarint(out, (field << 3) | kWireTypeVarint);
+  EncodeVarint(out, value);
+}
+
+static void EncodeBytesField(std::vector<uint8_t>* out,
+                             uint32_t field,
+                             const uint8_t* data,
+                             size_t size) {
+  EncodeVarint(out, (field << 3) | kWireTypeLengthDelimited);
+  EncodeVarint(out, size);
+  out->insert(out->end(), data, data + size);
+}
+
+static void EncodeMessageField(std::vector<uint8_t>* out,
+                               uint32_t field,
+                               const std::vector<uint8_t>& message) {
+  EncodeBytesField(out, field, message.data(), message.size());
+}
+
+static void EncodePackedField(std::vector<uint8_t>* out,
+                              uint32_t field,
+                              const std::vector<uint64_t>& values) {
+  std::vector<uint8_t> packed;
+  for (uint64_t value : values) {
+    EncodeVarint(&packed, value);
+  }
+  EncodeMessageField(out, field, packed);
+}
+
+// The strings of a profile are referenced by their index in its string table, which starts with
+// the empty string.
+class ProfileStringTable {
+ public:
+  ProfileStringTable() {
+    Intern("");
+  }
+
+  uint64_t Intern(const std::string& str) {
+    auto it = indexes_.find(str);
+    if (it != indexes_.end()) {
+      return it->second;
+    }
+    uint64_t index = strings_.size();
+    strings_.push_back(str);
+    indexes_.emplace(str, index);
+    return index;
+  }
+
+  void Encode(std::vector<uint8_t>* out) const {
+    for (const std::string& str : strings_) {
+      EncodeBytesField(out,
+                       kProfileStringTable,
+                       reinterpret_cast<const uint8_t*>(str.data()),
+                       str.size());
+    }
+  }
+
+ private:
+  std::vector<std::string> strings_;
+  std::unordered_map<std::string, uint64_t> indexes_;
+};
+
+static void EncodeValueType(std::vector<uint8_t>* out,
+                            uint32_t field,
+                            ProfileStringTable* strings,
+                            const char* type,
+                            const char* unit) {
+  std::vector<uint8_t> value_type;
+  EncodeVarintField(&value_type, kValueTypeType, strings->Intern(type));
+  EncodeVarintField(&value_type, kValueTypeUnit, strings->Intern(unit));
+  EncodeMessageField(out, field, value_type);
+}
+
+void SamplingProfiler::Dump(std::vector<uint8_t>* profile) {
+  // Copy the call tree so that the sampled threads do not wait for the encoding.
+  std::vector<Function> functions;
+  std::vector<CallTreeNode> nodes;
+  {
+    MutexLock mu(Thread::Current(), lock_);
+    functions = functions_;
+    nodes = nodes_;
+  }
+  const uint64_t interval_ns = UsToNs(interval_us_);
+  const uint64_t duration_ns = GetSampledDurationNs();
+
+  ProfileStringTable strings;
+  profile->clear();
+  // Each sample has a count and the CPU time it stands for.
+  EncodeValueType(profile, kProfileSampleType, &strings, "samples", "count");
+  EncodeValueType(profile, kProfileSampleType, &strings, "cpu", "nanoseconds");
+
+  // One sample for each call path seen as a whole stack, with its locations from the leaf.
+  std::vector<uint64_t> location_ids;
+  std::vector<uint8_t> message;
+  for (size_t i = 1u; i != nodes.size(); ++i) {
+    if (nodes[i].sample_count == 0u) {
+      continue;
+    }
+    location_ids.clear();
+    for (uint32_t node = dchecked_integral_cast<uint32_t>(i);
+         node != 0u;
+         node = nodes[node].parent) {
+      location_ids.push_back(nodes[node].function + 1u);
+    }
+    message.clear();
+    EncodePackedField(&message, kSampleLocationId, location_ids);
+    EncodePackedField(&message, kSampleValue, { nodes[i].sample_count,
+                                                nodes[i].sample_count * interval_ns });
+    EncodeMessageField(profile, kProfileSample, message);
+  }
+
+  // There is no address to report, so each function has a single location, with the same id.
+  for (size_t i = 0u; i != functions.size(); ++i) {
+    const uint64_t id = i + 1u;
+    std::vector<uint8_t> line;
+    EncodeVarintField(&line, kLineFunctionId, id);
+    message.clear();
+    EncodeVarintField(&message, kLocationId, id);
+    EncodeMessageField(&message, kLocationLine, line);
+    EncodeMessageField(profile, kProfileLocation, message);
+
+    const uint64_t name = strings.Intern(functions[i].name);
+    message.clear();
+    EncodeVarintField(&message, kFunctionId, id);
+    EncodeVarintField(&message, kFunctionName, name);
+    EncodeVarintField(&message, kFunctionSystemName, name);
+    EncodeVarintField(&message, kFunctionFilename, strings.Intern(functions[i].file_name));
+    EncodeMessageField(profile, kProfileFunction, message);
+  }
+
+  EncodeVarintField(profile, kProfileTimeNanos, start_time_ns_);
+  EncodeVarintField(profile, kProfileDurationNanos, duration_ns);
+  EncodeValueType(profile, kProfilePeriodType, &strings, "cpu", "nanoseconds");
+  EncodeVarintField(profile, kProfilePeriod, interval_ns);
+  // Last, once all the strings are interned.
+  strings.Encode(profile);
+}
+
+uint64_t SamplingProfiler::GetSampledDurationNs() const {
+  uint64_t duration_ns = sampled_duration_ns_;
+  if (IsRunning()) {
+    duration_ns += NanoTime() - start_monotonic_time_ns_;
+  }
+  return duration_ns;
+}
+
+std::string SamplingProfiler::GetProcessFileName(const std::string& filename, pid_t pid) {
+  size_t extension = filename.rfind('.');
+  size_t last_slash = filename.rfind('/');
+  if (extension == std::string::npos ||
+      (last_slash != std::string::npos && extension < last_slash)) {
+    extension = filename.size();
+  }
+  return StringPrintf("%s.%d%s",
+                      filename.substr(0u, extension).c_str(),
+                      pid,
+                      filename.substr(extension).c_str());
+}
+
+void SamplingProfiler::DumpForSigQuit(std::ostream& os) {
+  const uint64_t duration_ns = GetSampledDurationNs();
+  const uint64_t recording_time_ns = GetRecordingTimeNs();
+  const double overhead =
+      (duration_ns != 0u) ? 100.0 * recording_time_ns / duration_ns : 0.0;
+  os << "CPU profile: " << GetSampleCount() << " samples in " << PrettyDuration(duration_ns)
+     << ", recorded in " << PrettyDuration(recording_time_ns)
+     << StringPrintf(" (%.3f%% of one CPU)\n", overhead);
+}
+
+bool SamplingProfiler::DumpToFile(const std::string& filename, std::string* error_msg) {
+  std::vector<uint8_t> profile;
+  Dump(&profile);
+  std::unique_ptr<File> file(OS::CreateEmptyFileWriteOnly(filename.c_str()));
+  if (file == nullptr) {
+    *error_msg = StringPrintf("Unable to open CPU profile '%s': %s",
+                              filename.c_str(),
+                              strerror(errno));
+    return false;
+  }
+  if (!file->WriteFully(profile.data(), profile.size())) {
+    *error_msg = StringPrintf("Failed to write CPU profile '%s': %s",
+                              filename.c_str(),
+                              strerror(errno));
+    file->Erase();
+    return false;
+  }
+  if (file->FlushCloseOrErase() != 0) {
+    *error_msg = StringPrintf("Failed to close CPU profile '%s': %s",
+                              filename.c_str(),
+                              strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+}  // namespace art
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_SAMPLING_PROFILER_H_
+#define ART_RUNTIME_SAMPLING_PROFILER_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/atomic.h"
+#include "base/macros.h"
+#include "base/mutex.h"
+
+namespace art {
+
+class ArtMethod;
+class Thread;
+
+// Default interval between two samples, 10ms.
+static constexpr uint32_t kSamplingProfilerDefaultIntervalUs = 10000;
+
+// A CPU profiler for Java code meant to be left running. Every interval, the threads running Java
+// code record their own stack in a checkpoint at their next suspend point, so unlike the sampling
+// mode of Trace no thread waits for all the others to be suspended. Threads which are suspended,
+// waiting or running native code are not on the CPU in Java code and are not sampled.
+//
+// The stacks are aggregated in a call tree, which only grows with the number of distinct call
+// paths, and dumped in the pprof profile.proto format.
+class SamplingProfiler {
+ public:
+  explicit SamplingProfiler(uint32_t interval_us);
+  ~SamplingProfiler();
+
+  // Start the sampling thread. The runtime must be started.
+  void Start() REQUIRES(!Locks::mutator_lock_);
+
+  // Stop and join the sampling thread. The samples recorded so far are kept.
+  void Stop() REQUIRES(!Locks::mutator_lock_);
+
+  bool IsRunning() const {
+    return running_.load(std::memory_order_relaxed);
+  }
+
+  // Write the samples recorded so far to `filename`, as an uncompressed pprof profile.
+  bool DumpToFile(const std::string& filename, std::string* error_msg) REQUIRES(!lock_);
+
+  // Return `filename` with `pid` inserted before its extension, so that the processes forked from
+  // the zygote with the same option write different files.
+  static std::string GetProcessFileName(const std::string& filename, pid_t pid);
+
+  // Print the number of samples and the time the sampled threads spent recording them.
+  void DumpForSigQuit(std::ostream& os) REQUIRES(!lock_);
+
+  // Encode the samples recorded so far as an uncompressed pprof profile.
+  void Dump(std::vector<uint8_t>* profile) REQUIRES(!lock_);
+
+  uint64_t GetSampleCount() REQUIRES(!lock_);
+
+  // Time the sampled threads spent recording their stack, which is the overhead of the profiler
+  // on the application besides the sampling thread waking up.
+  uint64_t GetRecordingTimeNs() const {
+    return recording_time_ns_.load(std::memory_order_relaxed);
+  }
+
+  // Time spent sampling, including the current run.
+  uint64_t GetSampledDurationNs() const;
+
+ private:
+  // Stack frames beyond this depth are not recorded, the outermost ones are dropped.
+  static constexpr size_t kMaxFrames = 128;
+
+  // A method seen in a sample. The names are taken when the method is first seen, as it may be
+  // unloaded before the profile is dumped.
+  struct Function {
+    ArtMethod* method;
+    uint32_t dex_method_index;
+    std::string name;
+    std::string file_name;
+  };
+
+  // A call path, identified by its last function and its parent node. The children of a node are
+  // linked from its first child. Index 0 is the root, which has no function.
+  struct CallTreeNode {
+    uint32_t function;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    // Number of samples with this call path as their whole stack.
+    uint64_t sample_count;
+  };
+
+  static void* RunSamplingThread(void* arg);
+
+  // Run a checkpoint on all threads and wait for the runnable ones to have recorded a sample.
+  void SampleThreads(Thread* self) REQUIRES(!Locks::mutator_lock_, !lock_);
+
+  // Record the stack of `thread`, which must be the current thread.
+  void RecordSample(Thread* thread) REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!lock_);
+
+  // Add a sample whose innermost frame is frames[0].
+  void AddSample(Thread* self, ArtMethod* const* frames, size_t frame_count)
+      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!lock_);
+
+  uint32_t FindOrAddFunction(ArtMethod* method) REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(lock_);
+  uint32_t FindOrAddChild(uint32_t parent, uint32_t function) REQUIRES(lock_);
+
+  const uint32_t interval_us_;
+  Atomic<bool> running_;
+  pthread_t sampling_pthread_;
+  // Wall clock time at which sampling first started.
+  uint64_t start_time_ns_;
+  // Monotonic time at which sampling last started, and time spent sampling before.
+  uint64_t start_monotonic_time_ns_;
+  uint64_t sampled_duration_ns_;
+  Atomic<uint64_t> recording_time_ns_;
+
+  Mutex lock_;
+  std::vector<Function> functions_ GUARDED_BY(lock_);
+  std::unordered_map<ArtMethod*, uint32_t> function_indexes_ GUARDED_BY(lock_);
+  std::vector<CallTreeNode> nodes_ GUARDED_BY(lock_);
+  uint64_t sample_count_ GUARDED_BY(lock_);
+
+  friend class SamplingCheckpoint;
+  ART_FRIEND_TEST(SamplingProfilerTest, CallTree);
+
+  DISALLOW_COPY_AND_ASSIGN(SamplingProfiler);
+};
+
+}  // namespace art
+
+#endif  // ART_RUNTIME_SAMPLING_PROFILER_H_
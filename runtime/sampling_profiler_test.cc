@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sampling_profiler.h"
+
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "art_method-inl.h"
+#include "base/enums.h"
+#include "base/time_utils.h"
+#include "class_linker.h"
+#include "common_runtime_test.h"
+#include "interpreter/shadow_frame.h"
+#include "mirror/class-inl.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread-inl.h"
+
+namespace art {
+
+class SamplingProfilerTest : public CommonRuntimeTest {};
+
+TEST_F(SamplingProfilerTest, CallTree) {
+  ScopedObjectAccess soa(Thread::Current());
+  ObjPtr<mirror::Class> object_class =
+      class_linker_->FindSystemClass(soa.Self(), "Ljava/lang/Object;");
+  ObjPtr<mirror::Class> string_class =
+      class_linker_->FindSystemClass(soa.Self(), "Ljava/lang/String;");
+  ASSERT_TRUE(object_class != nullptr);
+  ASSERT_TRUE(string_class != nullptr);
+  ArtMethod* to_string =
+      object_class->FindClassMethod("toString", "()Ljava/lang/String;", kRuntimePointerSize);
+  ArtMethod* hash_code = object_class->FindClassMethod("hashCode", "()I", kRuntimePointerSize);
+  ArtMethod* length = string_class->FindClassMethod("length", "()I", kRuntimePointerSize);
+  ASSERT_TRUE(to_string != nullptr);
+  ASSERT_TRUE(hash_code != nullptr);
+  ASSERT_TRUE(length != nullptr);
+
+  SamplingProfiler profiler(kSamplingProfilerDefaultIntervalUs);
+  // The innermost frame comes first.
+  ArtMethod* const hash_code_stack[] = { hash_code, to_string };
+  ArtMethod* const length_stack[] = { length, to_string };
+  profiler.AddSample(soa.Self(), hash_code_stack, arraysize(hash_code_stack));
+  profiler.AddSample(soa.Self(), hash_code_stack, arraysize(hash_code_stack));
+  profiler.AddSample(soa.Self(), length_stack, arraysize(length_stack));
+  profiler.AddSample(soa.Self(), length_stack, 1u);
+  EXPECT_EQ(4u, profiler.GetSampleCount());
+  {
+    MutexLock mu(soa.Self(), profiler.lock_);
+    // The root, toString, hashCode and length called by toString, and length alone.
+    ASSERT_EQ(5u, profiler.nodes_.size());
+    EXPECT_EQ(3u, profiler.functions_.size());
+    uint64_t sample_count = 0u;
+    for (const SamplingProfiler::CallTreeNode& node : profiler.nodes_) {
+      sample_count += node.sample_count;
+    }
+    EXPECT_EQ(4u, sample_count);
+  }
+
+  std::vector<uint8_t> profile;
+  profiler.Dump(&profile);
+  ASSERT_FALSE(profile.empty());
+  // The profile starts with a sample type, field 1 length delimited.
+  EXPECT_EQ(0x0au, profile[0]);
+  std::string contents(profile.begin(), profile.end());
+  EXPECT_NE(std::string::npos, contents.find(to_string->PrettyMethod()));
+  EXPECT_NE(std::string::npos, contents.find(hash_code->PrettyMethod()));
+  EXPECT_NE(std::string::npos, contents.find(length->PrettyMethod()));
+  EXPECT_NE(std::string::npos, contents.find("nanoseconds"));
+}
+
+TEST_F(SamplingProfilerTest, SamplesRunnableThreads) {
+  Thread* self = Thread::Current();
+  SamplingProfiler profiler(kSamplingProfilerDefaultIntervalUs);
+  profiler.Start();
+  ASSERT_TRUE(profiler.IsRunning());
+  // Enough samples for the overhead to be measured.
+  static constexpr uint64_t kMinSampleCount = 20u;
+  static constexpr uint64_t kTimeoutNs = MsToNs(30000);
+  ArtMethod* to_string;
+  {
+    ScopedObjectAccess soa(self);
+    ObjPtr<mirror::Class> object_class =
+        class_linker_->FindSystemClass(soa.Self(), "Ljava/lang/Object;");
+    ASSERT_TRUE(object_class != nullptr);
+    to_string =
+        object_class->FindClassMethod("toString", "()Ljava/lang/String;", kRuntimePointerSize);
+    ASSERT_TRUE(to_string != nullptr);
+    // Appear to run toString, and run the sampling checkpoints at suspend points.
+    ShadowFrameAllocaUniquePtr shadow_frame =
+        CREATE_SHADOW_FRAME(/* num_vregs */ 0u, /* link */ nullptr, to_string, /* dex_pc */ 0u);
+    self->PushShadowFrame(shadow_frame.get());
+    const uint64_t start_ns = NanoTime();
+    while (profiler.GetSampleCount() < kMinSampleCount && NanoTime() - start_ns < kTimeoutNs) {
+      self->AllowThreadSuspension();
+    }
+    self->PopShadowFrame();
+  }
+  const uint64_t sample_count = profiler.GetSampleCount();
+  ASSERT_GE(sample_count, kMinSampleCount);
+
+  // A thread which is not runnable is not sampled.
+  usleep(10 * kSamplingProfilerDefaultIntervalUs);
+  profiler.Stop();
+  EXPECT_FALSE(profiler.IsRunning());
+  EXPECT_EQ(sample_count, profiler.GetSampleCount());
+
+  // Recording the samples takes much less than 1% of the time of the sampled thread.
+  EXPECT_LT(100u * profiler.GetRecordingTimeNs(), profiler.GetSampledDurationNs())
+      << PrettyDuration(profiler.GetRecordingTimeNs()) << " recording " << sample_count
+      << " samples in " << PrettyDuration(profiler.GetSampledDurationNs());
+  std::ostringstream oss;
+  profiler.DumpForSigQuit(oss);
+  EXPECT_NE(std::string::npos, oss.str().find("CPU profile: " + std::to_string(sample_count)))
+      << oss.str();
+
+  std::vector<uint8_t> profile;
+  profiler.Dump(&profile);
+  std::string contents(profile.begin(), profile.end());
+  EXPECT_NE(std::string::npos, contents.find(to_string->PrettyMethod()));
+}
+
+TEST_F(SamplingProfilerTest, ProcessFileName) {
+  EXPECT_EQ("/data/misc/trace/cpu-profile.42.pb",
+            SamplingProfiler::GetProcessFileName("/data/misc/trace/cpu-profile.pb", 42));
+  EXPECT_EQ("/data/cpu.profile/out.42",
+            SamplingProfiler::GetProcessFileName("/data/cpu.profile/out", 42));
+  EXPECT_EQ("profile.42", SamplingProfiler::GetProcessFileName("profile", 42));
+}
+
+}  // namespace art
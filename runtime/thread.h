@@ -95,6 +95,8 @@ class SingleStepControl;
 class StackedShadowFrameRecord;
 class Thread;
 class ThreadList;
+class ThreadPoolWorker;
+class TraceThreadBuffer;
 enum VisitRootFlags : uint8_t;
 
 // Thread priorities. These must match the Thread.MIN_PRIORITY,
@@ -981,6 +983,24 @@ class Thread {
     can_call_into_java_ = can_call_into_java;
   }
 
+  // Returns true if the thread is one of the threads of verifier::BackgroundVerifier.
+  bool IsBackgroundVerificationThread() const {
+    return is_background_verification_thread_;
+  }
+
+  void SetIsBackgroundVerificationThread() {
+    is_background_verification_thread_ = true;
+  }
+
+  // Bytes left to allocate before the next allocation sample, see gc::AllocSampleTable.
+  int64_t GetAllocSampleBytesRemaining() const {
+    return alloc_sample_bytes_remaining_;
+  }
+
+  void SetAllocSampleBytesRemaining(int64_t bytes) {
+    alloc_sample_bytes_remaining_ = bytes;
+  }
+
   // Activates single step control for debugging. The thread takes the
   // ownership of the given SingleStepControl*. It is deleted by a call
   // to DeactivateSingleStepControl or upon thread destruction.
@@ -1086,6 +1106,22 @@ class Thread {
     tls64_.trace_clock_base = clock_base;
   }
 
+  TraceThreadBuffer* GetMethodTraceBuffer() const {
+    return tlsPtr_.method_trace_buffer;
+  }
+
+  void SetMethodTraceBuffer(TraceThreadBuffer* buffer) {
+    tlsPtr_.method_trace_buffer = buffer;
+  }
+
+  ThreadPoolWorker* GetThreadPoolWorker() const {
+    return tlsPtr_.thread_pool_worker;
+  }
+
+  void SetThreadPoolWorker(ThreadPoolWorker* worker) {
+    tlsPtr_.thread_pool_worker = worker;
+  }
+
   BaseMutex* GetHeldMutex(LockLevel level) const {
     return tlsPtr_.held_mutexes[level];
   }
@@ -1569,7 +1605,8 @@ class Thread {
       mterp_alt_ibase(nullptr), thread_local_alloc_stack_top(nullptr),
       thread_local_alloc_stack_end(nullptr),
       flip_function(nullptr), method_verifier(nullptr), thread_local_mark_stack(nullptr),
-      async_exception(nullptr) {
+      async_exception(nullptr), method_trace_buffer(nullptr),
+      thread_pool_worker(nullptr) {
       std::fill(held_mutexes, held_mutexes + kLockLevelCount, nullptr);
     }
 
@@ -1729,6 +1766,13 @@ class Thread {
 
     // The pending async-exception or null.
     mirror::Throwable* async_exception;
+
+    // Per-thread state of method tracing, owned by the Trace, or null if this thread did not
+    // record any trace event.
+    TraceThreadBuffer* method_trace_buffer;
+
+    // The thread pool worker running on this thread, or null.
+    ThreadPoolWorker* thread_pool_worker;
   } tlsPtr_;
 
   // Guards the 'wait_monitor_' members.
@@ -1756,6 +1800,14 @@ class Thread {
   // By default this is true.
   bool can_call_into_java_;
 
+  // True if the thread belongs to the pool of verifier::BackgroundVerifier, which sets it from the
+  // first task it runs on the thread. Only read by the thread itself, so no lock is needed.
+  bool is_background_verification_thread_ = false;
+
+  // Bytes left to allocate before the next allocation sample, or 0 if not drawn yet. Only used
+  // while allocation sampling is enabled, see gc::AllocSampleTable.
+  int64_t alloc_sample_bytes_remaining_ = 0;
+
   friend class Dbg;  // For SetStateUnsafe.
   friend class gc::collector::SemiSpace;  // For getting stack traces.
   friend class Runtime;  // For CreatePeer.
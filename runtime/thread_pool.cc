@@ -90,6 +90,78 @@ void ThreadPoolWorker::Run() {
   }
 }
 
+bool WorkStealingDeque::Push(Task* task) {
+  const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+  const int64_t top = top_.load(std::memory_order_acquire);
+  if (bottom - top >= static_cast<int64_t>(kCapacity)) {
+    return false;
+  }
+  Slot(bottom).store(task, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom_.store(bottom + 1, std::memory_order_relaxed);
+  return true;
+}
+
+Task* WorkStealingDeque::Pop() {
+  const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(bottom, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t top = top_.load(std::memory_order_relaxed);
+  if (top > bottom) {
+    // Empty.
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  Task* task = Slot(bottom).load(std::memory_order_relaxed);
+  if (top == bottom) {
+    // Last task, race with the thieves for it.
+    if (!top_.CompareAndSetStrongSequentiallyConsistent(top, top + 1)) {
+      task = nullptr;
+    }
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+  }
+  return task;
+}
+
+Task* WorkStealingDeque::Steal() {
+  int64_t top = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const int64_t bottom = bottom_.load(std::memory_order_acquire);
+  if (top >= bottom) {
+    return nullptr;
+  }
+  Task* task = Slot(top).load(std::memory_order_relaxed);
+  if (!top_.CompareAndSetStrongSequentiallyConsistent(top, top + 1)) {
+    return nullptr;
+  }
+  return task;
+}
+
+void WorkStealingWorker::Run() {
+  Thread* self = Thread::Current();
+  thread_pool_->creation_barier_.Wait(self);
+  while (true) {
+    Task* task = nullptr;
+    // Workers beyond the maximum number of active workers only take tasks through GetTask, which
+    // blocks them while enough workers are active.
+    if (thread_pool_->IsStartedRelaxed() && id_ < thread_pool_->GetMaxActiveWorkersRelaxed()) {
+      task = deque_.Pop();
+      if (task == nullptr) {
+        task = thread_pool_->StealTask(this);
+      }
+    }
+    if (task == nullptr) {
+      // Nothing to steal, block on the shared queue. This also re-checks the deques.
+      task = thread_pool_->GetTask(self);
+      if (task == nullptr) {
+        break;
+      }
+    }
+    task->Run(self);
+    task->Finalize();
+  }
+}
+
 void* ThreadPoolWorker::Callback(void* arg) {
   ThreadPoolWorker* worker = reinterpret_cast<ThreadPoolWorker*>(arg);
   Runtime* runtime = Runtime::Current();
@@ -98,15 +170,32 @@ void* ThreadPoolWorker::Callback(void* arg) {
                                      nullptr,
                                      worker->thread_pool_->create_peers_));
   worker->thread_ = Thread::Current();
+  worker->thread_->SetThreadPoolWorker(worker);
   // Thread pool workers cannot call into java.
   worker->thread_->SetCanCallIntoJava(false);
   // Do work until its time to shut down.
   worker->Run();
+  worker->thread_->SetThreadPoolWorker(nullptr);
   runtime->DetachCurrentThread();
   return nullptr;
 }
 
 void ThreadPool::AddTask(Thread* self, Task* task) {
+  if (work_stealing_) {
+    WorkStealingWorker* worker = GetWorkStealingWorker(self);
+    if (worker != nullptr && worker->GetDeque()->Push(task)) {
+      // Pairs with the fence in GetTask: either an idle worker sees the new task when it re-checks
+      // the deques, or we see it in idle_workers_ and wake it up.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (idle_workers_.load(std::memory_order_relaxed) != 0) {
+        MutexLock mu(self, task_queue_lock_);
+        if (started_ && waiting_count_ != 0) {
+          task_queue_condition_.Signal(self);
+        }
+      }
+      return;
+    }
+  }
   MutexLock mu(self, task_queue_lock_);
   tasks_.push_back(task);
   // If we have any waiters, signal one.
@@ -118,9 +207,68 @@ void ThreadPool::AddTask(Thread* self, Task* task) {
 void ThreadPool::RemoveAllTasks(Thread* self) {
   MutexLock mu(self, task_queue_lock_);
   tasks_.clear();
+  if (work_stealing_) {
+    for (ThreadPoolWorker* worker : threads_) {
+      WorkStealingDeque* deque = down_cast<WorkStealingWorker*>(worker)->GetDeque();
+      while (!deque->IsEmpty()) {
+        deque->Steal();
+      }
+    }
+  }
+}
+
+WorkStealingWorker* ThreadPool::GetWorkStealingWorker(Thread* self) const {
+  DCHECK(work_stealing_);
+  ThreadPoolWorker* worker = (self != nullptr) ? self->GetThreadPoolWorker() : nullptr;
+  if (worker == nullptr || worker->thread_pool_ != this) {
+    return nullptr;
+  }
+  return down_cast<WorkStealingWorker*>(worker);
+}
+
+bool ThreadPool::HasStealableTasks() const {
+  if (!work_stealing_) {
+    return false;
+  }
+  for (ThreadPoolWorker* worker : threads_) {
+    if (!down_cast<WorkStealingWorker*>(worker)->GetDeque()->IsEmpty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Task* ThreadPool::StealTask(WorkStealingWorker* thief) {
+  DCHECK(work_stealing_);
+  const size_t thread_count = GetThreadCount();
+  if (thread_count == 0) {
+    return nullptr;
+  }
+  const size_t start = (thief != nullptr) ? thief->NextRandom() % thread_count : 0u;
+  for (size_t i = 0; i != thread_count; ++i) {
+    WorkStealingWorker* victim =
+        down_cast<WorkStealingWorker*>(threads_[(start + i) % thread_count]);
+    if (victim == thief) {
+      continue;
+    }
+    WorkStealingDeque* deque = victim->GetDeque();
+    // Steal only fails spuriously when racing with other thieves or the owner, retry while the
+    // victim still has tasks.
+    while (!deque->IsEmpty()) {
+      Task* task = deque->Steal();
+      if (task != nullptr) {
+        steal_count_.fetch_add(1u, std::memory_order_relaxed);
+        return task;
+      }
+    }
+  }
+  return nullptr;
 }
 
-ThreadPool::ThreadPool(const char* name, size_t num_threads, bool create_peers)
+ThreadPool::ThreadPool(const char* name,
+                       size_t num_threads,
+                       bool create_peers,
+                       bool work_stealing)
   : name_(name),
     task_queue_lock_("task queue lock"),
     task_queue_condition_("task queue condition", task_queue_lock_),
@@ -133,13 +281,21 @@ ThreadPool::ThreadPool(const char* name, size_t num_threads, bool create_peers)
     // Add one since the caller of constructor waits on the barrier too.
     creation_barier_(num_threads + 1),
     max_active_workers_(num_threads),
-    create_peers_(create_peers) {
+    create_peers_(create_peers),
+    work_stealing_(work_stealing),
+    idle_workers_(0u),
+    steal_count_(0u) {
   Thread* self = Thread::Current();
   while (GetThreadCount() < num_threads) {
     const std::string worker_name = StringPrintf("%s worker thread %zu", name_.c_str(),
                                                  GetThreadCount());
-    threads_.push_back(
-        new ThreadPoolWorker(this, worker_name, ThreadPoolWorker::kDefaultStackSize));
+    if (work_stealing) {
+      threads_.push_back(new WorkStealingWorker(
+          this, worker_name, ThreadPoolWorker::kDefaultStackSize, GetThreadCount()));
+    } else {
+      threads_.push_back(
+          new ThreadPoolWorker(this, worker_name, ThreadPoolWorker::kDefaultStackSize));
+    }
   }
   // Wait for all of the threads to attach.
   creation_barier_.Wait(self);
@@ -148,7 +304,7 @@ ThreadPool::ThreadPool(const char* name, size_t num_threads, bool create_peers)
 void ThreadPool::SetMaxActiveWorkers(size_t threads) {
   MutexLock mu(Thread::Current(), task_queue_lock_);
   CHECK_LE(threads, GetThreadCount());
-  max_active_workers_ = threads;
+  max_active_workers_.store(threads, std::memory_order_relaxed);
 }
 
 ThreadPool::~ThreadPool() {
@@ -167,7 +323,7 @@ ThreadPool::~ThreadPool() {
 
 void ThreadPool::StartWorkers(Thread* self) {
   MutexLock mu(self, task_queue_lock_);
-  started_ = true;
+  started_.store(true, std::memory_order_relaxed);
   task_queue_condition_.Broadcast(self);
   start_time_ = NanoTime();
   total_wait_time_ = 0;
@@ -175,7 +331,7 @@ void ThreadPool::StartWorkers(Thread* self) {
 
 void ThreadPool::StopWorkers(Thread* self) {
   MutexLock mu(self, task_queue_lock_);
-  started_ = false;
+  started_.store(false, std::memory_order_relaxed);
 }
 
 Task* ThreadPool::GetTask(Thread* self) {
@@ -190,9 +346,28 @@ Task* ThreadPool::GetTask(Thread* self) {
       if (task != nullptr) {
         return task;
       }
+      if (work_stealing_ && started_ && HasStealableTasks()) {
+        task = StealTaskWithoutLock(self);
+        if (task != nullptr) {
+          return task;
+        }
+        // The state of the pool may have changed while the lock was released, check it again.
+        continue;
+      }
     }
 
     ++waiting_count_;
+    if (work_stealing_) {
+      // Publish that we are about to sleep before the last look at the deques, see AddTask.
+      idle_workers_.fetch_add(1u, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (active_threads <= max_active_workers_ && started_ && HasStealableTasks()) {
+        // Steal it in the next iteration, without holding the lock.
+        idle_workers_.fetch_sub(1u, std::memory_order_relaxed);
+        --waiting_count_;
+        continue;
+      }
+    }
     if (waiting_count_ == GetThreadCount() && !HasOutstandingTasks()) {
       // We may be done, lets broadcast to the completion condition.
       completion_condition_.Broadcast(self);
@@ -203,6 +378,9 @@ Task* ThreadPool::GetTask(Thread* self) {
       const uint64_t wait_end = NanoTime();
       total_wait_time_ += wait_end - std::max(wait_start, start_time_);
     }
+    if (work_stealing_) {
+      idle_workers_.fetch_sub(1u, std::memory_order_relaxed);
+    }
     --waiting_count_;
   }
 
@@ -211,12 +389,19 @@ Task* ThreadPool::GetTask(Thread* self) {
 }
 
 Task* ThreadPool::TryGetTask(Thread* self) {
-  MutexLock mu(self, task_queue_lock_);
-  return TryGetTaskLocked();
+  {
+    MutexLock mu(self, task_queue_lock_);
+    Task* task = TryGetTaskLocked();
+    if (task != nullptr || !work_stealing_ || !started_) {
+      return task;
+    }
+  }
+  // The deques are lock free, do not hold the lock while looking at all of them.
+  return StealTask(GetWorkStealingWorker(self));
 }
 
 Task* ThreadPool::TryGetTaskLocked() {
-  if (HasOutstandingTasks()) {
+  if (started_ && !tasks_.empty()) {
     Task* task = tasks_.front();
     tasks_.pop_front();
     return task;
@@ -224,6 +409,13 @@ Task* ThreadPool::TryGetTaskLocked() {
   return nullptr;
 }
 
+Task* ThreadPool::StealTaskWithoutLock(Thread* self) {
+  task_queue_lock_.ExclusiveUnlock(self);
+  Task* task = StealTask(GetWorkStealingWorker(self));
+  task_queue_lock_.ExclusiveLock(self);
+  return task;
+}
+
 void ThreadPool::Wait(Thread* self, bool do_work, bool may_hold_locks) {
   if (do_work) {
     CHECK(!create_peers_);
@@ -246,7 +438,13 @@ void ThreadPool::Wait(Thread* self, bool do_work, bool may_hold_locks) {
 
 size_t ThreadPool::GetTaskCount(Thread* self) {
   MutexLock mu(self, task_queue_lock_);
-  return tasks_.size();
+  size_t count = tasks_.size();
+  if (work_stealing_) {
+    for (ThreadPoolWorker* worker : threads_) {
+      count += down_cast<WorkStealingWorker*>(worker)->GetDeque()->Size();
+    }
+  }
+  return count;
 }
 
 void ThreadPool::SetPthreadPriority(int priority) {
@@ -18,9 +18,12 @@
 #define ART_RUNTIME_THREAD_POOL_H_
 
 #include <deque>
+#include <functional>
 #include <vector>
 
 #include "barrier.h"
+#include "base/atomic.h"
+#include "base/bit_utils.h"
 #include "base/mem_map.h"
 #include "base/mutex.h"
 
@@ -48,6 +51,19 @@ class SelfDeletingTask : public Task {
   }
 };
 
+// Task running a function, deleted once run.
+class FunctionTask : public SelfDeletingTask {
+ public:
+  explicit FunctionTask(std::function<void(Thread*)>&& func) : func_(std::move(func)) {}
+
+  void Run(Thread* self) OVERRIDE {
+    func_(self);
+  }
+
+ private:
+  std::function<void(Thread*)> func_;
+};
+
 class ThreadPoolWorker {
  public:
   static const size_t kDefaultStackSize = 1 * MB;
@@ -80,6 +96,99 @@ class ThreadPoolWorker {
   DISALLOW_COPY_AND_ASSIGN(ThreadPoolWorker);
 };
 
+// Bounded single-owner, multi-thief deque of tasks (Chase-Lev). Only the owning worker may call
+// Push and Pop, which operate on the bottom end; any thread may call Steal, which takes from the
+// top end. The buffer is fixed size so that no memory ever needs to be reclaimed while thieves
+// may still be reading it; Push fails when the deque is full and the caller falls back to the
+// shared queue of the pool.
+class WorkStealingDeque {
+ public:
+  static constexpr size_t kCapacity = 1024;
+
+  WorkStealingDeque() : top_(0), bottom_(0) {
+    for (Atomic<Task*>& slot : tasks_) {
+      slot.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns false if the deque is full. Owner only.
+  bool Push(Task* task);
+
+  // Returns the most recently pushed task, or null if the deque is empty. Owner only.
+  Task* Pop();
+
+  // Returns the oldest task, or null if the deque is empty or if we lost a race with another
+  // thief or with the owner.
+  Task* Steal();
+
+  // Racy estimate of the number of tasks, only exact when the deque is quiescent.
+  size_t Size() const {
+    const int64_t bottom = bottom_.load(std::memory_order_acquire);
+    const int64_t top = top_.load(std::memory_order_acquire);
+    return bottom > top ? static_cast<size_t>(bottom - top) : 0u;
+  }
+
+  bool IsEmpty() const {
+    return Size() == 0u;
+  }
+
+ private:
+  static_assert(IsPowerOfTwo(kCapacity), "Capacity must be a power of two");
+
+  Atomic<Task*>& Slot(int64_t index) {
+    return tasks_[static_cast<size_t>(index) & (kCapacity - 1)];
+  }
+
+  // Keep the end mostly written by thieves and the end written by the owner on separate cache
+  // lines.
+  static constexpr size_t kFalseSharingPadding = 64;
+
+  Atomic<int64_t> top_;
+  uint8_t padding_[kFalseSharingPadding - sizeof(Atomic<int64_t>)] ATTRIBUTE_UNUSED;
+  Atomic<int64_t> bottom_;
+  Atomic<Task*> tasks_[kCapacity];
+
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingDeque);
+};
+
+// Worker of a work-stealing thread pool. Tasks added by the worker itself go to its own deque and
+// are run in LIFO order; when the deque is empty, the worker steals from randomly chosen victims
+// before falling back to the shared queue of the pool.
+class WorkStealingWorker : public ThreadPoolWorker {
+ public:
+  virtual ~WorkStealingWorker() {}
+
+  WorkStealingDeque* GetDeque() {
+    return &deque_;
+  }
+
+ protected:
+  WorkStealingWorker(ThreadPool* thread_pool, const std::string& name, size_t stack_size, size_t id)
+      : ThreadPoolWorker(thread_pool, name, stack_size),
+        id_(id),
+        rng_state_(static_cast<uint32_t>(id) * 0x9E3779B9u + 1u) {}
+
+  void Run() OVERRIDE;
+
+  // Xorshift, only used to pick steal victims.
+  uint32_t NextRandom() {
+    rng_state_ ^= rng_state_ << 13;
+    rng_state_ ^= rng_state_ >> 17;
+    rng_state_ ^= rng_state_ << 5;
+    return rng_state_;
+  }
+
+ private:
+  WorkStealingDeque deque_;
+  // Index of the worker in the pool. Only the first max_active_workers_ workers take tasks without
+  // going through ThreadPool::GetTask.
+  const size_t id_;
+  uint32_t rng_state_;
+
+  friend class ThreadPool;
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingWorker);
+};
+
 // Note that thread pool workers will set Thread#setCanCallIntoJava to false.
 class ThreadPool {
  public:
@@ -99,7 +208,8 @@ class ThreadPool {
   void StopWorkers(Thread* self) REQUIRES(!task_queue_lock_);
 
   // Add a new task, the first available started worker will process it. Does not delete the task
-  // after running it, it is the caller's responsibility.
+  // after running it, it is the caller's responsibility. In work-stealing mode, tasks added by a
+  // worker of this pool go to that worker's deque without taking the task queue lock.
   void AddTask(Thread* self, Task* task) REQUIRES(!task_queue_lock_);
 
   // Remove all tasks in the queue.
@@ -110,7 +220,13 @@ class ThreadPool {
   // If create_peers is true, all worker threads will have a Java peer object. Note that if the
   // pool is asked to do work on the current thread (see Wait), a peer may not be available. Wait
   // will conservatively abort if create_peers and do_work are true.
-  ThreadPool(const char* name, size_t num_threads, bool create_peers = false);
+  //
+  // If work_stealing is true, each worker owns a lock-free deque for the tasks it adds itself and
+  // idle workers steal from the other workers before blocking on the shared queue.
+  ThreadPool(const char* name,
+             size_t num_threads,
+             bool create_peers = false,
+             bool work_stealing = false);
   virtual ~ThreadPool();
 
   // Wait for all tasks currently on queue to get completed. If the pool has been stopped, only
@@ -132,12 +248,22 @@ class ThreadPool {
   // Set the "nice" priorty for threads in the pool.
   void SetPthreadPriority(int priority);
 
+  bool IsWorkStealing() const {
+    return work_stealing_;
+  }
+
+  // Number of tasks that were taken from another worker's deque.
+  uint64_t GetStealCount() const {
+    return steal_count_.load(std::memory_order_relaxed);
+  }
+
  protected:
   // get a task to run, blocks if there are no tasks left
   virtual Task* GetTask(Thread* self) REQUIRES(!task_queue_lock_);
 
   // Try to get a task, returning null if there is none available.
   Task* TryGetTask(Thread* self) REQUIRES(!task_queue_lock_);
+  // Try to get a task from the shared queue only.
   Task* TryGetTaskLocked() REQUIRES(task_queue_lock_);
 
   // Are we shutting down?
@@ -146,14 +272,39 @@ class ThreadPool {
   }
 
   bool HasOutstandingTasks() const REQUIRES(task_queue_lock_) {
-    return started_ && !tasks_.empty();
+    return started_ && (!tasks_.empty() || HasStealableTasks());
+  }
+
+  // Returns the worker of this pool running on the given thread, or null.
+  WorkStealingWorker* GetWorkStealingWorker(Thread* self) const;
+
+  // Racy check whether any worker deque has tasks.
+  bool HasStealableTasks() const;
+
+  // Try to steal a task from the deques of the other workers, starting with a random victim.
+  // The thief may be null when the caller is not a worker of this pool. Must not be called with
+  // task_queue_lock_ held, as it retries while the victims race with it.
+  Task* StealTask(WorkStealingWorker* thief) REQUIRES(!task_queue_lock_);
+
+  // Release task_queue_lock_ while stealing a task.
+  Task* StealTaskWithoutLock(Thread* self) REQUIRES(task_queue_lock_);
+
+  // Called by a worker before running a task from its own deque or from a victim. Lock-free
+  // counterparts of the started_ and max_active_workers_ checks done under task_queue_lock_.
+  bool IsStartedRelaxed() const NO_THREAD_SAFETY_ANALYSIS {
+    return started_.load(std::memory_order_relaxed);
+  }
+
+  size_t GetMaxActiveWorkersRelaxed() const NO_THREAD_SAFETY_ANALYSIS {
+    return max_active_workers_.load(std::memory_order_relaxed);
   }
 
   const std::string name_;
   Mutex task_queue_lock_;
   ConditionVariable task_queue_condition_ GUARDED_BY(task_queue_lock_);
   ConditionVariable completion_condition_ GUARDED_BY(task_queue_lock_);
-  volatile bool started_ GUARDED_BY(task_queue_lock_);
+  // Atomic so that work-stealing workers can check it without task_queue_lock_.
+  Atomic<bool> started_ GUARDED_BY(task_queue_lock_);
   volatile bool shutting_down_ GUARDED_BY(task_queue_lock_);
   // How many worker threads are waiting on the condition.
   volatile size_t waiting_count_ GUARDED_BY(task_queue_lock_);
@@ -164,8 +315,13 @@ class ThreadPool {
   uint64_t start_time_ GUARDED_BY(task_queue_lock_);
   uint64_t total_wait_time_;
   Barrier creation_barier_;
-  size_t max_active_workers_ GUARDED_BY(task_queue_lock_);
+  Atomic<size_t> max_active_workers_ GUARDED_BY(task_queue_lock_);
   const bool create_peers_;
+  const bool work_stealing_;
+  // Mirror of waiting_count_ readable without task_queue_lock_, so that a worker pushing to its
+  // own deque only needs to take the lock when somebody has to be woken up.
+  Atomic<size_t> idle_workers_;
+  Atomic<uint64_t> steal_count_;
 
  private:
   friend class ThreadPoolWorker;
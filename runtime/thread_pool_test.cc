@@ -160,6 +160,97 @@ TEST_F(ThreadPoolTest, RecursiveTest) {
   EXPECT_EQ((1 << depth) - 1, count.load(std::memory_order_seq_cst));
 }
 
+// Check that a work-stealing pool runs tasks added both from outside and from its workers.
+TEST_F(ThreadPoolTest, WorkStealingCheckRun) {
+  Thread* self = Thread::Current();
+  ThreadPool thread_pool("Thread pool test thread pool",
+                         num_threads,
+                         /* create_peers */ false,
+                         /* work_stealing */ true);
+  AtomicInteger count(0);
+  static const int32_t num_tasks = num_threads * 4;
+  for (int32_t i = 0; i < num_tasks; ++i) {
+    thread_pool.AddTask(self, new CountTask(&count));
+  }
+  thread_pool.StartWorkers(self);
+  thread_pool.Wait(self, true, false);
+  EXPECT_EQ(num_tasks, count.load(std::memory_order_seq_cst));
+  EXPECT_EQ(0u, thread_pool.GetTaskCount(self));
+}
+
+// Tasks spawned by workers go to their own deques and must be stolen to be spread out.
+TEST_F(ThreadPoolTest, WorkStealingRecursiveTest) {
+  Thread* self = Thread::Current();
+  ThreadPool thread_pool("Thread pool test thread pool",
+                         num_threads,
+                         /* create_peers */ false,
+                         /* work_stealing */ true);
+  AtomicInteger count(0);
+  static const int depth = 12;
+  thread_pool.AddTask(self, new TreeTask(&thread_pool, &count, depth));
+  thread_pool.StartWorkers(self);
+  thread_pool.Wait(self, false, false);
+  EXPECT_EQ((1 << depth) - 1, count.load(std::memory_order_seq_cst));
+  EXPECT_EQ(0u, thread_pool.GetTaskCount(self));
+}
+
+// Records the largest number of tasks running at the same time.
+class ConcurrencyTask : public Task {
+ public:
+  ConcurrencyTask(ThreadPool* const thread_pool,
+                  AtomicInteger* running,
+                  AtomicInteger* max_running,
+                  int depth)
+      : thread_pool_(thread_pool),
+        running_(running),
+        max_running_(max_running),
+        depth_(depth) {}
+
+  void Run(Thread* self) {
+    if (depth_ > 1) {
+      thread_pool_->AddTask(
+          self, new ConcurrencyTask(thread_pool_, running_, max_running_, depth_ - 1));
+      thread_pool_->AddTask(
+          self, new ConcurrencyTask(thread_pool_, running_, max_running_, depth_ - 1));
+    }
+    int32_t running = running_->fetch_add(1, std::memory_order_seq_cst) + 1;
+    int32_t max_running = max_running_->load(std::memory_order_seq_cst);
+    while (running > max_running &&
+           !max_running_->CompareAndSetWeakSequentiallyConsistent(max_running, running)) {
+      max_running = max_running_->load(std::memory_order_seq_cst);
+    }
+    usleep(100);
+    running_->fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  void Finalize() {
+    delete this;
+  }
+
+ private:
+  ThreadPool* const thread_pool_;
+  AtomicInteger* const running_;
+  AtomicInteger* const max_running_;
+  const int depth_;
+};
+
+// Workers taking tasks from the deques must honour the maximum number of active workers.
+TEST_F(ThreadPoolTest, WorkStealingMaxActiveWorkers) {
+  Thread* self = Thread::Current();
+  ThreadPool thread_pool("Thread pool test thread pool",
+                         num_threads,
+                         /* create_peers */ false,
+                         /* work_stealing */ true);
+  thread_pool.SetMaxActiveWorkers(1);
+  AtomicInteger running(0);
+  AtomicInteger max_running(0);
+  thread_pool.AddTask(self, new ConcurrencyTask(&thread_pool, &running, &max_running, 8));
+  thread_pool.StartWorkers(self);
+  thread_pool.Wait(self, /* do_work */ false, false);
+  EXPECT_EQ(1, max_running.load(std::memory_order_seq_cst));
+  EXPECT_EQ(0u, thread_pool.GetTaskCount(self));
+}
+
 class PeerTask : public Task {
  public:
   PeerTask() {}
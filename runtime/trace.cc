@@ -58,6 +58,15 @@ static constexpr uint8_t kOpNewMethod = 1U;
 static constexpr uint8_t kOpNewThread = 2U;
 static constexpr uint8_t kOpTraceSummary = 3U;
 
+// Size of the chunks of records handed to the writer thread in streaming mode.
+static constexpr size_t kTraceChunkSize = 16 * KB;
+// Maximum number of written chunks kept for reuse.
+static constexpr size_t kMaxFreeTraceChunks = 16U;
+// Maximum number of chunks queued for the writer thread, 1MB, and the time a thread waits for the
+// writer thread to catch up before checking the queue again.
+static constexpr size_t kMaxQueuedTraceChunks = 64U;
+static constexpr useconds_t kTraceWriterBackoffUs = 100U;
+
 class BuildStackTraceVisitor : public StackVisitor {
  public:
   explicit BuildStackTraceVisitor(Thread* thread)
@@ -126,12 +135,6 @@ uint32_t Trace::EncodeTraceMethod(ArtMethod* method) {
   return idx;
 }
 
-uint32_t Trace::EncodeTraceMethodAndAction(ArtMethod* method, TraceAction action) {
-  uint32_t tmid = (EncodeTraceMethod(method) << TraceActionBits) | action;
-  DCHECK_EQ(method, DecodeTraceMethod(tmid));
-  return tmid;
-}
-
 std::vector<ArtMethod*>* Trace::AllocStackTrace() {
   return (temp_stack_trace_.get() != nullptr)  ? temp_stack_trace_.release() :
       new std::vector<ArtMethod*>();
@@ -290,6 +293,8 @@ void* Trace::RunSamplingThread(void* arg) {
   CHECK(runtime->AttachCurrentThread("Sampling Profiler", true, runtime->GetSystemThreadGroup(),
                                      !runtime->IsAotCompiler()));
 
+  // The trace of the last sample. It is kept alive until this thread is joined.
+  Trace* last_trace = nullptr;
   while (true) {
     usleep(interval_us);
     ScopedTrace trace("Profile sampling");
@@ -302,6 +307,7 @@ void* Trace::RunSamplingThread(void* arg) {
         break;
       }
     }
+    last_trace = the_trace;
     {
       // Avoid a deadlock between a thread doing garbage collection
       // and the profile sampling thread, by blocking GC when sampling
@@ -315,6 +321,48 @@ void* Trace::RunSamplingThread(void* arg) {
     }
   }
 
+  // The records of all sampled threads are buffered by this thread, hand them over before exiting.
+  if (last_trace != nullptr) {
+    last_trace->ReleaseThreadBuffer(Thread::Current());
+  }
+  runtime->DetachCurrentThread();
+  return nullptr;
+}
+
+void* Trace::RunWriterThread(void* arg) {
+  Runtime* runtime = Runtime::Current();
+  Trace* the_trace = reinterpret_cast<Trace*>(arg);
+  CHECK(runtime->AttachCurrentThread("Trace writer", true, runtime->GetSystemThreadGroup(),
+                                     !runtime->IsAotCompiler()));
+  Thread* self = Thread::Current();
+  std::deque<std::vector<uint8_t>> chunks;
+  while (true) {
+    {
+      MutexLock mu(self, *the_trace->writer_lock_);
+      for (std::vector<uint8_t>& chunk : chunks) {
+        if (chunk.capacity() >= kTraceChunkSize &&
+            the_trace->free_chunks_.size() < kMaxFreeTraceChunks) {
+          chunk.clear();
+          the_trace->free_chunks_.push_back(std::move(chunk));
+        }
+      }
+      chunks.clear();
+      while (the_trace->writer_queue_.empty() && !the_trace->writer_exiting_) {
+        the_trace->writer_cond_->Wait(self);
+      }
+      if (the_trace->writer_queue_.empty()) {
+        break;
+      }
+      chunks.swap(the_trace->writer_queue_);
+    }
+    ScopedTrace trace("Trace writing");
+    for (const std::vector<uint8_t>& chunk : chunks) {
+      if (!the_trace->trace_file_->WriteFully(chunk.data(), chunk.size())) {
+        PLOG(WARNING) << "Failed streaming a tracing event.";
+      }
+    }
+  }
+
   runtime->DetachCurrentThread();
   return nullptr;
 }
@@ -487,10 +535,17 @@ void Trace::StopTracing(bool finish_tracing, bool flush_file) {
             instrumentation::Instrumentation::kMethodExited |
             instrumentation::Instrumentation::kMethodUnwind);
       }
+      // No thread records events anymore, collect the records they buffered. Exiting threads
+      // release their own buffer if they see the trace, which was cleared above.
+      MutexLock mu(self, *Locks::thread_list_lock_);
+      runtime->GetThreadList()->ForEach(ReleaseThreadBufferCallback, the_trace);
     }
     // At this point, code may read buf_ as it's writers are shutdown
     // and the ScopedSuspendAll above has ensured all stores to buf_
     // are now visible.
+    if (the_trace->trace_output_mode_ == TraceOutputMode::kStreaming) {
+      the_trace->StopWriterThread();
+    }
     if (finish_tracing) {
       the_trace->FinishTracing();
     }
@@ -655,28 +710,39 @@ Trace::Trace(File* trace_file,
              TraceOutputMode output_mode,
              TraceMode trace_mode)
     : trace_file_(trace_file),
-      buf_(new uint8_t[std::max(kMinBufSize, buffer_size)]()),
+      buf_(output_mode == TraceOutputMode::kStreaming
+               ? nullptr
+               : new uint8_t[std::max(kMinBufSize, buffer_size)]()),
       flags_(flags), trace_output_mode_(output_mode), trace_mode_(trace_mode),
       clock_source_(default_clock_source_),
       buffer_size_(std::max(kMinBufSize, buffer_size)),
       start_time_(MicroTime()), clock_overhead_ns_(GetClockOverheadNanoSeconds()),
       overflow_(false), interval_us_(0), streaming_lock_(nullptr),
-      unique_methods_lock_(new Mutex("unique methods lock", kTracingUniqueMethodsLock)) {
+      unique_methods_lock_(new Mutex("unique methods lock", kTracingUniqueMethodsLock)),
+      writer_lock_(nullptr), writer_exiting_(false), writer_pthread_(0U) {
   CHECK(trace_file != nullptr || output_mode == TraceOutputMode::kDDMS);
 
   uint16_t trace_version = GetTraceVersion(clock_source_);
   if (output_mode == TraceOutputMode::kStreaming) {
     trace_version |= 0xF0U;
   }
-  // Set up the beginning of the trace.
-  memset(buf_.get(), 0, kTraceHeaderLength);
-  Append4LE(buf_.get(), kTraceMagicValue);
-  Append2LE(buf_.get() + 4, trace_version);
-  Append2LE(buf_.get() + 6, kTraceHeaderLength);
-  Append8LE(buf_.get() + 8, start_time_);
+  // Set up the beginning of the trace. When streaming, it is the first chunk to write out.
+  std::vector<uint8_t> header;
+  uint8_t* header_ptr;
+  if (output_mode == TraceOutputMode::kStreaming) {
+    header.resize(kTraceHeaderLength);
+    header_ptr = header.data();
+  } else {
+    header_ptr = buf_.get();
+  }
+  memset(header_ptr, 0, kTraceHeaderLength);
+  Append4LE(header_ptr, kTraceMagicValue);
+  Append2LE(header_ptr + 4, trace_version);
+  Append2LE(header_ptr + 6, kTraceHeaderLength);
+  Append8LE(header_ptr + 8, start_time_);
   if (trace_version >= kTraceVersionDualClock) {
     uint16_t record_size = GetRecordSize(clock_source_);
-    Append2LE(buf_.get() + 16, record_size);
+    Append2LE(header_ptr + 16, record_size);
   }
   static_assert(18 <= kMinBufSize, "Minimum buffer size not large enough for trace header");
 
@@ -685,10 +751,18 @@ Trace::Trace(File* trace_file,
   if (output_mode == TraceOutputMode::kStreaming) {
     streaming_lock_ = new Mutex("tracing lock", LockLevel::kTracingStreamingLock);
     seen_threads_.reset(new ThreadIDBitSet());
+    writer_lock_ = new Mutex("trace writer lock", LockLevel::kTracingWriterLock);
+    writer_cond_.reset(new ConditionVariable("trace writer condition variable", *writer_lock_));
+    writer_queue_.push_back(std::move(header));
+    CHECK_PTHREAD_CALL(pthread_create, (&writer_pthread_, nullptr, &RunWriterThread, this),
+                       "Trace writer thread");
   }
 }
 
 Trace::~Trace() {
+  DCHECK_EQ(writer_pthread_, 0U);
+  writer_cond_.reset();
+  delete writer_lock_;
   delete streaming_lock_;
   delete unique_methods_lock_;
 }
@@ -764,20 +838,19 @@ void Trace::FinishTracing() {
   std::string header(os.str());
 
   if (trace_output_mode_ == TraceOutputMode::kStreaming) {
-    // Protect access to buf_ and satisfy sanitizer for calls to WriteBuf / FlushBuf.
-    MutexLock mu(Thread::Current(), *streaming_lock_);
+    // The writer thread has written out all the records, see StopTracing().
     // Write a special token to mark the end of trace records and the start of
     // trace summary.
     uint8_t buf[7];
     Append2LE(buf, 0);
     buf[2] = kOpTraceSummary;
     Append4LE(buf + 3, static_cast<uint32_t>(header.length()));
-    WriteToBuf(buf, sizeof(buf));
     // Write the trace summary. The summary is identical to the file header when
     // the output mode is not streaming (except for methods).
-    WriteToBuf(reinterpret_cast<const uint8_t*>(header.c_str()), header.length());
-    // Flush the buffer, which may include some trace records before the summary.
-    FlushBuf();
+    if (!trace_file_->WriteFully(buf, sizeof(buf)) ||
+        !trace_file_->WriteFully(header.c_str(), header.length())) {
+      PLOG(WARNING) << "Failed flush the remaining data in streaming.";
+    }
   } else {
     if (trace_file_.get() == nullptr) {
       std::vector<uint8_t> data;
@@ -949,40 +1022,76 @@ std::string Trace::GetMethodLine(ArtMethod* method) {
       method->GetSignature().ToString().c_str(), method->GetDeclaringClassSourceFile());
 }
 
-void Trace::WriteToBuf(const uint8_t* src, size_t src_size) {
-  // Updates to cur_offset_ are done under the streaming_lock_ here as in streaming mode.
-  int32_t old_offset = cur_offset_.load(std::memory_order_relaxed);
-  int32_t new_offset = old_offset + static_cast<int32_t>(src_size);
-  if (dchecked_integral_cast<size_t>(new_offset) > buffer_size_) {
-    // Flush buffer.
-    if (!trace_file_->WriteFully(buf_.get(), old_offset)) {
-      PLOG(WARNING) << "Failed streaming a tracing event.";
+TraceThreadBuffer* Trace::GetThreadBuffer(Thread* self) {
+  TraceThreadBuffer* thread_buffer = self->GetMethodTraceBuffer();
+  if (UNLIKELY(thread_buffer == nullptr)) {
+    thread_buffer = new TraceThreadBuffer();
+    if (trace_output_mode_ == TraceOutputMode::kStreaming) {
+      thread_buffer->GetRecords()->reserve(kTraceChunkSize);
     }
+    self->SetMethodTraceBuffer(thread_buffer);
+  }
+  return thread_buffer;
+}
 
-    // Check whether the data is too large for the buffer, then write immediately.
-    if (src_size >= buffer_size_) {
-      if (!trace_file_->WriteFully(src, src_size)) {
-        PLOG(WARNING) << "Failed streaming a tracing event.";
+void Trace::ReleaseThreadBuffer(Thread* thread) {
+  TraceThreadBuffer* thread_buffer = thread->GetMethodTraceBuffer();
+  if (thread_buffer == nullptr) {
+    return;
+  }
+  if (trace_output_mode_ == TraceOutputMode::kStreaming) {
+    EnqueueChunk(Thread::Current(), std::move(*thread_buffer->GetRecords()));
+  }
+  thread->SetMethodTraceBuffer(nullptr);
+  delete thread_buffer;
+}
+
+void Trace::ReleaseThreadBufferCallback(Thread* thread, void* arg) {
+  reinterpret_cast<Trace*>(arg)->ReleaseThreadBuffer(thread);
+}
+
+void Trace::EnqueueChunk(Thread* self, std::vector<uint8_t>&& chunk) {
+  if (chunk.empty()) {
+    return;
+  }
+  MutexLock mu(self, *writer_lock_);
+  writer_queue_.push_back(std::move(chunk));
+  writer_cond_->Signal(self);
+}
+
+void Trace::FlushChunk(Thread* self, std::vector<uint8_t>* chunk) {
+  // When the writer thread cannot keep up, the threads recording events wait for it rather than
+  // queue their records without bound. They cannot wait on a condition variable as they may hold
+  // the mutator lock, but the writer thread does not need it to make progress.
+  while (true) {
+    {
+      MutexLock mu(self, *writer_lock_);
+      if (writer_queue_.size() < kMaxQueuedTraceChunks) {
+        writer_queue_.push_back(std::move(*chunk));
+        writer_cond_->Signal(self);
+        if (!free_chunks_.empty()) {
+          chunk->swap(free_chunks_.back());
+          free_chunks_.pop_back();
+          return;
+        }
+        break;
       }
-      cur_offset_.store(0, std::memory_order_relaxed);  // Buffer is empty now.
-      return;
     }
-
-    old_offset = 0;
-    new_offset = static_cast<int32_t>(src_size);
+    usleep(kTraceWriterBackoffUs);
   }
-  cur_offset_.store(new_offset, std::memory_order_relaxed);
-  // Fill in data.
-  memcpy(buf_.get() + old_offset, src, src_size);
+  *chunk = std::vector<uint8_t>();
+  chunk->reserve(kTraceChunkSize);
 }
 
-void Trace::FlushBuf() {
-  // Updates to cur_offset_ are done under the streaming_lock_ here as in streaming mode.
-  int32_t offset = cur_offset_.load(std::memory_order_relaxed);
-  if (!trace_file_->WriteFully(buf_.get(), offset)) {
-    PLOG(WARNING) << "Failed flush the remaining data in streaming.";
+void Trace::StopWriterThread() {
+  Thread* self = Thread::Current();
+  {
+    MutexLock mu(self, *writer_lock_);
+    writer_exiting_ = true;
+    writer_cond_->Signal(self);
   }
-  cur_offset_.store(0, std::memory_order_relaxed);
+  CHECK_PTHREAD_CALL(pthread_join, (writer_pthread_, nullptr), "trace writer thread shutdown");
+  writer_pthread_ = 0U;
 }
 
 void Trace::LogMethodTraceEvent(Thread* thread, ArtMethod* method,
@@ -997,6 +1106,11 @@ void Trace::LogMethodTraceEvent(Thread* thread, ArtMethod* method,
   // same pointer value.
   method = method->GetNonObsoleteMethod();
 
+  // The per-thread state of the thread recording the event, that is `thread` in method tracing
+  // mode and the sampling thread in sampling mode.
+  Thread* self = Thread::Current();
+  TraceThreadBuffer* thread_buffer = GetThreadBuffer(self);
+
   // Advance cur_offset_ atomically.
   int32_t new_offset;
   int32_t old_offset = 0;
@@ -1034,21 +1148,62 @@ void Trace::LogMethodTraceEvent(Thread* thread, ArtMethod* method,
       UNIMPLEMENTED(FATAL) << "Unexpected event: " << event;
   }
 
-  uint32_t method_value = EncodeTraceMethodAndAction(method, action);
+  uint32_t method_id;
+  if (UNLIKELY(!thread_buffer->LookupMethodId(method, &method_id))) {
+    method_id = EncodeTraceMethod(method);
+    if (trace_output_mode_ == TraceOutputMode::kStreaming) {
+      MutexLock mu(self, *streaming_lock_);
+      if (RegisterMethod(method)) {
+        // Queue a special block with the name. It is queued before any chunk with a record of the
+        // method, as the other threads only see the method after it is registered.
+        std::string method_line(GetMethodLine(method));
+        std::vector<uint8_t> block(5u + method_line.length());
+        Append2LE(block.data(), 0);
+        block[2] = kOpNewMethod;
+        Append2LE(block.data() + 3, static_cast<uint16_t>(method_line.length()));
+        memcpy(block.data() + 5, method_line.c_str(), method_line.length());
+        EnqueueChunk(self, std::move(block));
+      }
+    }
+    thread_buffer->CacheMethodId(method, method_id);
+  }
+  uint32_t method_value = (method_id << TraceActionBits) | action;
+  DCHECK_EQ(method, DecodeTraceMethod(method_value));
 
-  // Write data into the tracing buffer (if not streaming) or into a
-  // small buffer on the stack (if streaming) which we'll put into the
-  // tracing buffer below.
+  // Write data into the tracing buffer (if not streaming) or into the
+  // records of the thread (if streaming), which are written out in
+  // chunks by the writer thread.
   //
   // These writes to the tracing buffer are synchronised with the
   // future reads that (only) occur under FinishTracing(). The callers
   // of FinishTracing() acquire locks and (implicitly) synchronise
   // the buffer memory.
   uint8_t* ptr;
-  static constexpr size_t kPacketSize = 14U;  // The maximum size of data in a packet.
-  uint8_t stack_buf[kPacketSize];             // Space to store a packet when in streaming mode.
   if (trace_output_mode_ == TraceOutputMode::kStreaming) {
-    ptr = stack_buf;
+    if (UNLIKELY(thread_buffer->GetRegisteredTid() != thread->GetTid())) {
+      MutexLock mu(self, *streaming_lock_);
+      if (RegisterThread(thread)) {
+        // It might be better to postpone this. Threads might not have received names...
+        std::string thread_name;
+        thread->GetThreadName(thread_name);
+        std::vector<uint8_t> block(7u + thread_name.length());
+        Append2LE(block.data(), 0);
+        block[2] = kOpNewThread;
+        Append2LE(block.data() + 3, static_cast<uint16_t>(thread->GetTid()));
+        Append2LE(block.data() + 5, static_cast<uint16_t>(thread_name.length()));
+        memcpy(block.data() + 7, thread_name.c_str(), thread_name.length());
+        EnqueueChunk(self, std::move(block));
+      }
+      thread_buffer->SetRegisteredTid(thread->GetTid());
+    }
+    std::vector<uint8_t>* records = thread_buffer->GetRecords();
+    size_t record_size = GetRecordSize(clock_source_);
+    if (UNLIKELY(records->size() + record_size > kTraceChunkSize)) {
+      FlushChunk(self, records);
+    }
+    size_t offset = records->size();
+    records->resize(offset + record_size);
+    ptr = records->data() + offset;
   } else {
     ptr = buf_.get() + old_offset;
   }
@@ -1064,34 +1219,6 @@ void Trace::LogMethodTraceEvent(Thread* thread, ArtMethod* method,
   if (UseWallClock()) {
     Append4LE(ptr, wall_clock_diff);
   }
-  static_assert(kPacketSize == 2 + 4 + 4 + 4, "Packet size incorrect.");
-
-  if (trace_output_mode_ == TraceOutputMode::kStreaming) {
-    MutexLock mu(Thread::Current(), *streaming_lock_);  // To serialize writing.
-    if (RegisterMethod(method)) {
-      // Write a special block with the name.
-      std::string method_line(GetMethodLine(method));
-      uint8_t buf2[5];
-      Append2LE(buf2, 0);
-      buf2[2] = kOpNewMethod;
-      Append2LE(buf2 + 3, static_cast<uint16_t>(method_line.length()));
-      WriteToBuf(buf2, sizeof(buf2));
-      WriteToBuf(reinterpret_cast<const uint8_t*>(method_line.c_str()), method_line.length());
-    }
-    if (RegisterThread(thread)) {
-      // It might be better to postpone this. Threads might not have received names...
-      std::string thread_name;
-      thread->GetThreadName(thread_name);
-      uint8_t buf2[7];
-      Append2LE(buf2, 0);
-      buf2[2] = kOpNewThread;
-      Append2LE(buf2 + 3, static_cast<uint16_t>(thread->GetTid()));
-      Append2LE(buf2 + 5, static_cast<uint16_t>(thread_name.length()));
-      WriteToBuf(buf2, sizeof(buf2));
-      WriteToBuf(reinterpret_cast<const uint8_t*>(thread_name.c_str()), thread_name.length());
-    }
-    WriteToBuf(stack_buf, sizeof(stack_buf));
-  }
 }
 
 void Trace::GetVisitedMethods(size_t buf_size,
@@ -1138,6 +1265,7 @@ void Trace::StoreExitingThreadInfo(Thread* thread) {
     // The same thread/tid may be used multiple times. As SafeMap::Put does not allow to override
     // a previous mapping, use SafeMap::Overwrite.
     the_trace_->exited_threads_.Overwrite(thread->GetTid(), name);
+    the_trace_->ReleaseThreadBuffer(thread);
   }
 }
 
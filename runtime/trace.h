@@ -17,7 +17,9 @@
 #ifndef ART_RUNTIME_TRACE_H_
 #define ART_RUNTIME_TRACE_H_
 
+#include <algorithm>
 #include <bitset>
+#include <deque>
 #include <map>
 #include <memory>
 #include <ostream>
@@ -27,6 +29,7 @@
 #include <vector>
 
 #include "base/atomic.h"
+#include "base/bit_utils.h"
 #include "base/globals.h"
 #include "base/macros.h"
 #include "base/os.h"
@@ -99,6 +102,59 @@ enum TraceAction {
     kTraceMethodActionMask = 0x03,  // two bits
 };
 
+// Per-thread state of method tracing, owned by the thread recording the events: the traced thread
+// itself in method tracing mode, the sampling thread in sampling mode. It caches the ids of the
+// methods the thread has seen, so that encoding a method does not take the unique methods lock,
+// and in streaming mode it collects the records of the thread, handed to the writer thread in
+// chunks rather than taking the streaming lock for every record.
+class TraceThreadBuffer {
+ public:
+  TraceThreadBuffer() : registered_tid_(0) {
+    std::fill_n(method_ids_, kMethodIdCacheSize, std::pair<ArtMethod*, uint32_t>(nullptr, 0u));
+  }
+
+  bool LookupMethodId(ArtMethod* method, uint32_t* method_id) const {
+    const std::pair<ArtMethod*, uint32_t>& entry = method_ids_[MethodIdCacheIndex(method)];
+    if (entry.first != method) {
+      return false;
+    }
+    *method_id = entry.second;
+    return true;
+  }
+
+  void CacheMethodId(ArtMethod* method, uint32_t method_id) {
+    method_ids_[MethodIdCacheIndex(method)] = std::make_pair(method, method_id);
+  }
+
+  // The tid of the thread of the last streamed record, known to be registered.
+  pid_t GetRegisteredTid() const {
+    return registered_tid_;
+  }
+
+  void SetRegisteredTid(pid_t tid) {
+    registered_tid_ = tid;
+  }
+
+  std::vector<uint8_t>* GetRecords() {
+    return &records_;
+  }
+
+ private:
+  static constexpr size_t kMethodIdCacheSize = 256U;
+
+  static size_t MethodIdCacheIndex(ArtMethod* method) {
+    static_assert(IsPowerOfTwo(kMethodIdCacheSize), "Cache size must be a power of two");
+    return (reinterpret_cast<uintptr_t>(method) / sizeof(void*)) & (kMethodIdCacheSize - 1u);
+  }
+
+  // Direct-mapped cache of method ids.
+  std::pair<ArtMethod*, uint32_t> method_ids_[kMethodIdCacheSize];
+  pid_t registered_tid_;
+  std::vector<uint8_t> records_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceThreadBuffer);
+};
+
 // Class for recording event traces. Trace data is either collected
 // synchronously during execution (TracingMode::kMethodTracingActive),
 // or by a separate sampling thread (TracingMode::kSampleProfilingActive).
@@ -173,27 +229,31 @@ class Trace FINAL : public instrumentation::InstrumentationListener {
   uint32_t GetClockOverheadNanoSeconds();
 
   void CompareAndUpdateStackTrace(Thread* thread, std::vector<ArtMethod*>* stack_trace)
-      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!*unique_methods_lock_, !*streaming_lock_);
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!*unique_methods_lock_, !*streaming_lock_, !*writer_lock_);
 
   // InstrumentationListener implementation.
   void MethodEntered(Thread* thread,
                      Handle<mirror::Object> this_object,
                      ArtMethod* method,
                      uint32_t dex_pc)
-      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!*unique_methods_lock_, !*streaming_lock_)
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!*unique_methods_lock_, !*streaming_lock_, !*writer_lock_)
       OVERRIDE;
   void MethodExited(Thread* thread,
                     Handle<mirror::Object> this_object,
                     ArtMethod* method,
                     uint32_t dex_pc,
                     const JValue& return_value)
-      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!*unique_methods_lock_, !*streaming_lock_)
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!*unique_methods_lock_, !*streaming_lock_, !*writer_lock_)
       OVERRIDE;
   void MethodUnwind(Thread* thread,
                     Handle<mirror::Object> this_object,
                     ArtMethod* method,
                     uint32_t dex_pc)
-      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!*unique_methods_lock_, !*streaming_lock_)
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!*unique_methods_lock_, !*streaming_lock_, !*writer_lock_)
       OVERRIDE;
   void DexPcMoved(Thread* thread,
                   Handle<mirror::Object> this_object,
@@ -236,7 +296,7 @@ class Trace FINAL : public instrumentation::InstrumentationListener {
   static std::vector<ArtMethod*>* AllocStackTrace();
   // Clear and store an old stack trace for later use.
   static void FreeStackTrace(std::vector<ArtMethod*>* stack_trace);
-  // Save id and name of a thread before it exits.
+  // Save id and name of a thread before it exits, and hand its trace records to the writer.
   static void StoreExitingThreadInfo(Thread* thread);
 
   static TraceOutputMode GetOutputMode() REQUIRES(!Locks::trace_lock_);
@@ -271,7 +331,25 @@ class Trace FINAL : public instrumentation::InstrumentationListener {
   void LogMethodTraceEvent(Thread* thread, ArtMethod* method,
                            instrumentation::Instrumentation::InstrumentationEvent event,
                            uint32_t thread_clock_diff, uint32_t wall_clock_diff)
-      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!*unique_methods_lock_, !*streaming_lock_);
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!*unique_methods_lock_, !*streaming_lock_, !*writer_lock_);
+
+  // Returns the per-thread state of `self`, created on the first event the thread records.
+  TraceThreadBuffer* GetThreadBuffer(Thread* self);
+  // Hand the records buffered by `thread` to the writer thread and delete its per-thread state.
+  // Must be called by `thread`, or while `thread` cannot record events.
+  void ReleaseThreadBuffer(Thread* thread) REQUIRES(!*writer_lock_);
+  static void ReleaseThreadBufferCallback(Thread* thread, void* arg) NO_THREAD_SAFETY_ANALYSIS;
+
+  // Methods of the streaming mode writer thread. The records are handed to the writer in chunks,
+  // which it writes out in the order they were queued.
+  static void* RunWriterThread(void* arg) REQUIRES(!Locks::trace_lock_);
+  void EnqueueChunk(Thread* self, std::vector<uint8_t>&& chunk) REQUIRES(!*writer_lock_);
+  // Queue `chunk`, waiting for the writer thread if too many chunks are queued already, and
+  // replace it with an empty chunk.
+  void FlushChunk(Thread* self, std::vector<uint8_t>* chunk) REQUIRES(!*writer_lock_);
+  // Write out the queued chunks and join the writer thread.
+  void StopWriterThread() REQUIRES(!*writer_lock_);
 
   // Methods to output traced methods and threads.
   void GetVisitedMethods(size_t end_offset, std::set<ArtMethod*>* visited_methods)
@@ -287,17 +365,7 @@ class Trace FINAL : public instrumentation::InstrumentationListener {
   bool RegisterThread(Thread* thread)
       REQUIRES(streaming_lock_);
 
-  // Copy a temporary buffer to the main buffer. Used for streaming. Exposed here for lock
-  // annotation.
-  void WriteToBuf(const uint8_t* src, size_t src_size)
-      REQUIRES(streaming_lock_);
-  // Flush the main buffer to file. Used for streaming. Exposed here for lock annotation.
-  void FlushBuf()
-      REQUIRES(streaming_lock_);
-
   uint32_t EncodeTraceMethod(ArtMethod* method) REQUIRES(!*unique_methods_lock_);
-  uint32_t EncodeTraceMethodAndAction(ArtMethod* method, TraceAction action)
-      REQUIRES(!*unique_methods_lock_);
   ArtMethod* DecodeTraceMethod(uint32_t tmid) REQUIRES(!*unique_methods_lock_);
   std::string GetMethodLine(ArtMethod* method) REQUIRES(!*unique_methods_lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
@@ -320,10 +388,10 @@ class Trace FINAL : public instrumentation::InstrumentationListener {
   // File to write trace data out to, null if direct to ddms.
   std::unique_ptr<File> trace_file_;
 
-  // Buffer to store trace data. In streaming mode, this is protected
-  // by the streaming_lock_. In non-streaming mode, reserved regions
+  // Buffer to store trace data when not streaming. Reserved regions
   // are atomically allocated (using cur_offset_) for log entries to
-  // be written.
+  // be written. In streaming mode, the records are buffered per thread
+  // and written out by the writer thread instead.
   std::unique_ptr<uint8_t[]> buf_;
 
   // Flags enabling extra tracing of things such as alloc counts.
@@ -349,16 +417,11 @@ class Trace FINAL : public instrumentation::InstrumentationListener {
   // Offset into buf_. The field is atomic to allow multiple writers
   // to concurrently reserve space in the buffer. The newly written
   // buffer contents are not read without some other form of thread
-  // synchronization, such as suspending all potential writers or
-  // acquiring *streaming_lock_. Reading cur_offset_ is thus never
-  // used to ensure visibility of any other objects, and all accesses
-  // are memory_order_relaxed.
+  // synchronization, such as suspending all potential writers.
+  // Reading cur_offset_ is thus never used to ensure visibility of
+  // any other objects, and all accesses are memory_order_relaxed.
   //
-  // All accesses to buf_ in streaming mode occur whilst holding the
-  // streaming lock. In streaming mode, the buffer may be written out
-  // so cur_offset_ can move forwards and backwards.
-  //
-  // When not in streaming mode, the buf_ writes can come from
+  // The buf_ writes can come from
   // multiple threads when the trace mode is kMethodTracing. When
   // trace mode is kSampling, writes only come from the sampling
   // thread.
@@ -378,11 +441,22 @@ class Trace FINAL : public instrumentation::InstrumentationListener {
   // Sampling profiler sampling interval.
   int interval_us_;
 
-  // Streaming mode data.
+  // Streaming mode data. The streaming lock is only taken the first time a thread sees a method
+  // or records an event of a thread, the records are buffered per thread.
   Mutex* streaming_lock_;
   std::map<const DexFile*, DexIndexBitSet*> seen_methods_ GUARDED_BY(streaming_lock_);
   std::unique_ptr<ThreadIDBitSet> seen_threads_ GUARDED_BY(streaming_lock_);
 
+  // Streaming mode writer thread, and the chunks of records queued for it. The queue is bounded by
+  // FlushChunk, the other chunks are small or only queued once per thread.
+  Mutex* writer_lock_ ACQUIRED_AFTER(streaming_lock_);
+  std::unique_ptr<ConditionVariable> writer_cond_;
+  std::deque<std::vector<uint8_t>> writer_queue_ GUARDED_BY(writer_lock_);
+  // Written chunks kept for reuse by the threads.
+  std::vector<std::vector<uint8_t>> free_chunks_ GUARDED_BY(writer_lock_);
+  bool writer_exiting_ GUARDED_BY(writer_lock_);
+  pthread_t writer_pthread_;
+
   // Bijective map from ArtMethod* to index.
   // Map from ArtMethod* to index in unique_methods_;
   Mutex* unique_methods_lock_ ACQUIRED_AFTER(streaming_lock_);
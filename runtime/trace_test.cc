@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "art_method-inl.h"
+#include "base/enums.h"
+#include "base/os.h"
+#include "base/unix_file/fd_file.h"
+#include "class_linker.h"
+#include "common_runtime_test.h"
+#include "instrumentation.h"
+#include "mirror/class-inl.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread-current-inl.h"
+#include "thread_pool.h"
+
+namespace art {
+
+class TraceTest : public CommonRuntimeTest {
+ protected:
+  static uint16_t Read2LE(const std::vector<uint8_t>& data, size_t offset) {
+    return data[offset] | (data[offset + 1] << 8);
+  }
+
+  static uint32_t Read4LE(const std::vector<uint8_t>& data, size_t offset) {
+    return Read2LE(data, offset) | (Read2LE(data, offset + 2) << 16);
+  }
+};
+
+TEST_F(TraceTest, StreamingTraceCanBeDecoded) {
+  Thread* self = Thread::Current();
+  ArtMethod* to_string;
+  ArtMethod* hash_code;
+  ArtMethod* length;
+  {
+    ScopedObjectAccess soa(self);
+    ObjPtr<mirror::Class> object_class = class_linker_->FindSystemClass(self, "Ljava/lang/Object;");
+    ObjPtr<mirror::Class> string_class = class_linker_->FindSystemClass(self, "Ljava/lang/String;");
+    ASSERT_TRUE(object_class != nullptr);
+    ASSERT_TRUE(string_class != nullptr);
+    to_string =
+        object_class->FindClassMethod("toString", "()Ljava/lang/String;", kRuntimePointerSize);
+    hash_code = object_class->FindClassMethod("hashCode", "()I", kRuntimePointerSize);
+    length = string_class->FindClassMethod("length", "()I", kRuntimePointerSize);
+    ASSERT_TRUE(to_string != nullptr);
+    ASSERT_TRUE(hash_code != nullptr);
+    ASSERT_TRUE(length != nullptr);
+  }
+
+  ScratchFile trace_file;
+  Trace::Start(trace_file.GetFilename().c_str(),
+               /* buffer_size */ 0u,
+               /* flags */ 0,
+               Trace::TraceOutputMode::kStreaming,
+               Trace::TraceMode::kMethodTracing,
+               /* interval_us */ 0);
+  ASSERT_EQ(TracingMode::kMethodTracingActive, Trace::GetMethodTracingMode());
+
+  // Enough calls for each thread to fill several chunks of records, which are interleaved with
+  // the chunks of the other threads in the file.
+  static constexpr size_t kNumThreads = 4u;
+  static constexpr size_t kNumCalls = 2000u;
+  static constexpr size_t kNumEventsPerCall = 6u;
+  std::set<uint16_t> worker_tids;
+  {
+    ThreadPool thread_pool("Trace test thread pool", kNumThreads);
+    for (ThreadPoolWorker* worker : thread_pool.GetWorkers()) {
+      worker_tids.insert(static_cast<uint16_t>(worker->GetThread()->GetTid()));
+    }
+    for (size_t i = 0; i != kNumThreads; ++i) {
+      thread_pool.AddTask(self, new FunctionTask([&](Thread* thread) {
+        ScopedObjectAccess soa(thread);
+        const instrumentation::Instrumentation* instr = Runtime::Current()->GetInstrumentation();
+        JValue value;
+        for (size_t call = 0; call != kNumCalls; ++call) {
+          instr->MethodEnterEvent(thread, nullptr, to_string, /* dex_pc */ 0u);
+          instr->MethodEnterEvent(thread, nullptr, hash_code, /* dex_pc */ 0u);
+          instr->MethodExitEvent(thread, nullptr, hash_code, /* dex_pc */ 0u, value);
+          instr->MethodEnterEvent(thread, nullptr, length, /* dex_pc */ 0u);
+          instr->MethodExitEvent(thread, nullptr, length, /* dex_pc */ 0u, value);
+          instr->MethodExitEvent(thread, nullptr, to_string, /* dex_pc */ 0u, value);
+        }
+      }));
+    }
+    thread_pool.StartWorkers(self);
+    thread_pool.Wait(self, /* do_work */ false, /* may_hold_locks */ false);
+    // Deleting the pool hands over the records of the exiting threads.
+  }
+  Trace::Stop();
+  ASSERT_EQ(worker_tids.size(), kNumThreads);
+
+  std::unique_ptr<File> file(OS::OpenFileForReading(trace_file.GetFilename().c_str()));
+  ASSERT_TRUE(file != nullptr);
+  std::vector<uint8_t> data(file->GetLength());
+  ASSERT_TRUE(file->ReadFully(data.data(), data.size()));
+
+  // The header.
+  ASSERT_GE(data.size(), 32u);
+  EXPECT_EQ(0x574f4c53u, Read4LE(data, 0));  // "SLOW".
+  const uint16_t version = Read2LE(data, 4);
+  EXPECT_EQ(0xf0u, version & 0xf0u);
+  const size_t header_length = Read2LE(data, 6);
+  ASSERT_EQ(32u, header_length);
+  const size_t record_size = Read2LE(data, 16);
+  ASSERT_GE(record_size, 10u);
+
+  // The records, and the methods and threads defined before their first record.
+  std::set<uint32_t> methods;
+  std::set<uint16_t> threads;
+  std::map<uint16_t, std::vector<uint32_t>> call_stacks;
+  std::map<uint16_t, size_t> record_counts;
+  std::string summary;
+  size_t offset = header_length;
+  while (summary.empty()) {
+    ASSERT_LE(offset + 2u, data.size());
+    const uint16_t tid = Read2LE(data, offset);
+    if (tid == 0u) {
+      ASSERT_LE(offset + 3u, data.size());
+      const uint8_t op = data[offset + 2];
+      if (op == 1u) {
+        // A new method, its line starts with its id.
+        ASSERT_LE(offset + 5u, data.size());
+        const size_t line_length = Read2LE(data, offset + 3);
+        ASSERT_LE(offset + 5u + line_length, data.size());
+        std::string line(data.begin() + offset + 5, data.begin() + offset + 5 + line_length);
+        EXPECT_TRUE(methods.insert(std::stoul(line, nullptr, 16)).second) << line;
+        offset += 5u + line_length;
+      } else if (op == 2u) {
+        // A new thread.
+        ASSERT_LE(offset + 7u, data.size());
+        const size_t name_length = Read2LE(data, offset + 5);
+        EXPECT_TRUE(threads.insert(Read2LE(data, offset + 3)).second);
+        offset += 7u + name_length;
+      } else {
+        // The summary ends the file.
+        ASSERT_EQ(3u, op);
+        ASSERT_LE(offset + 7u, data.size());
+        const size_t summary_length = Read4LE(data, offset + 3);
+        ASSERT_EQ(data.size(), offset + 7u + summary_length);
+        summary.assign(data.begin() + offset + 7, data.end());
+        ASSERT_FALSE(summary.empty());
+      }
+      continue;
+    }
+    ASSERT_LE(offset + record_size, data.size());
+    ASSERT_EQ(1u, threads.count(tid)) << tid;
+    const uint32_t method_value = Read4LE(data, offset + 2);
+    const uint32_t method_id = method_value & ~static_cast<uint32_t>(kTraceMethodActionMask);
+    ASSERT_EQ(1u, methods.count(method_id)) << method_id;
+    // The records of each thread are written in order, whichever chunk they are in.
+    std::vector<uint32_t>& call_stack = call_stacks[tid];
+    if ((method_value & kTraceMethodActionMask) == kTraceMethodEnter) {
+      call_stack.push_back(method_id);
+    } else {
+      ASSERT_EQ(kTraceMethodExit, method_value & kTraceMethodActionMask);
+      ASSERT_FALSE(call_stack.empty());
+      ASSERT_EQ(call_stack.back(), method_id);
+      call_stack.pop_back();
+    }
+    ++record_counts[tid];
+    offset += record_size;
+  }
+
+  EXPECT_EQ(3u, methods.size());
+  for (uint16_t tid : worker_tids) {
+    EXPECT_EQ(kNumCalls * kNumEventsPerCall, record_counts[tid]) << tid;
+    EXPECT_TRUE(call_stacks[tid].empty()) << tid;
+  }
+  EXPECT_NE(std::string::npos, summary.find("vm=art\n")) << summary;
+  EXPECT_NE(std::string::npos, summary.find("*end\n")) << summary;
+}
+
+}  // namespace art
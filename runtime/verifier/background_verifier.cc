@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "background_verifier.h"
+
+#include "base/casts.h"
+#include "base/systrace.h"
+#include "class_linker.h"
+#include "class_status.h"
+#include "dex/dex_file-inl.h"
+#include "handle_scope-inl.h"
+#include "jni/java_vm_ext.h"
+#include "mirror/class-inl.h"
+#include "mirror/class_loader.h"
+#include "oat_file.h"
+#include "runtime.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread-current-inl.h"
+#include "thread_pool.h"
+
+namespace art {
+namespace verifier {
+
+BackgroundVerifier::BackgroundVerifier(size_t thread_count)
+    : lock_("background verifier lock", kBackgroundVerifierLock),
+      shutting_down_(false) {
+  CHECK_GT(thread_count, 0u);
+  Thread* self = Thread::Current();
+  thread_pool_.reset(new ThreadPool("Background verification thread pool", thread_count));
+  thread_pool_->SetPthreadPriority(kBackgroundVerifierPthreadPriority);
+  thread_pool_->StartWorkers(self);
+}
+
+BackgroundVerifier::~BackgroundVerifier() {
+  Shutdown(Thread::Current());
+}
+
+void BackgroundVerifier::AddDexFile(Thread* self,
+                                    const DexFile& dex_file,
+                                    ObjPtr<mirror::ClassLoader> class_loader) {
+  if (shutting_down_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  // Collect the classes that ClassLinker::VerifyClassUsingOatFile does not consider verified.
+  // Classes which failed hard when compiling would only fail again, leave them to be rejected on
+  // first use.
+  const OatFile::OatDexFile* oat_dex_file = dex_file.GetOatDexFile();
+  const bool has_oat_file = oat_dex_file != nullptr && oat_dex_file->GetOatFile() != nullptr;
+  std::vector<uint16_t> class_def_indexes;
+  for (uint32_t i = 0; i != dex_file.NumClassDefs(); ++i) {
+    if (has_oat_file) {
+      ClassStatus status = oat_dex_file->GetOatClass(i).GetStatus();
+      if (status >= ClassStatus::kVerified || mirror::Class::IsErroneous(status)) {
+        continue;
+      }
+    }
+    class_def_indexes.push_back(dchecked_integral_cast<uint16_t>(i));
+  }
+  if (class_def_indexes.empty()) {
+    return;
+  }
+  VLOG(verifier) << "Verifying " << class_def_indexes.size() << " classes of "
+                 << dex_file.GetLocation() << " in the background";
+  JavaVMExt* vm = Runtime::Current()->GetJavaVM();
+  jweak weak_class_loader = vm->AddWeakGlobalRef(self, class_loader);
+  MutexLock mu(self, lock_);
+  if (thread_pool_ == nullptr) {
+    vm->DeleteWeakGlobalRef(self, weak_class_loader);
+    return;
+  }
+  thread_pool_->AddTask(
+      self,
+      new FunctionTask([this, &dex_file, weak_class_loader, class_def_indexes](Thread* thread) {
+        VerifyClasses(thread, dex_file, weak_class_loader, class_def_indexes);
+      }));
+}
+
+void BackgroundVerifier::Wait(Thread* self) {
+  ThreadPool* thread_pool;
+  {
+    MutexLock mu(self, lock_);
+    thread_pool = thread_pool_.get();
+  }
+  if (thread_pool != nullptr) {
+    thread_pool->Wait(self, /* do_work */ false, /* may_hold_locks */ false);
+  }
+}
+
+void BackgroundVerifier::Shutdown(Thread* self) {
+  std::unique_ptr<ThreadPool> thread_pool;
+  {
+    MutexLock mu(self, lock_);
+    shutting_down_.store(true, std::memory_order_relaxed);
+    thread_pool = std::move(thread_pool_);
+  }
+  if (thread_pool != nullptr) {
+    // The tasks skip their remaining classes, let them release their class loader.
+    thread_pool->Wait(self, /* do_work */ false, /* may_hold_locks */ false);
+  }
+}
+
+bool BackgroundVerifier::IsWorkerThread(Thread* self) {
+  return self->IsBackgroundVerificationThread();
+}
+
+void BackgroundVerifier::VerifyClasses(Thread* self,
+                                       const DexFile& dex_file,
+                                       jweak class_loader,
+                                       const std::vector<uint16_t>& class_def_indexes) {
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  // The threads of the pool only run these tasks, and keep the flag until they exit.
+  self->SetIsBackgroundVerificationThread();
+  ClassLinker* const class_linker = Runtime::Current()->GetClassLinker();
+  size_t verified_count = 0u;
+  for (uint16_t class_def_index : class_def_indexes) {
+    if (shutting_down_.load(std::memory_order_relaxed)) {
+      break;
+    }
+    // Only hold the class loader while verifying a class, so that it can still be unloaded. It
+    // also keeps the dex file alive.
+    ScopedObjectAccess soa(self);
+    StackHandleScope<2> hs(self);
+    Handle<mirror::ClassLoader> loader(
+        hs.NewHandle(ObjPtr<mirror::ClassLoader>::DownCast(self->DecodeJObject(class_loader))));
+    if (loader == nullptr) {
+      break;
+    }
+    const char* descriptor = dex_file.GetClassDescriptor(dex_file.GetClassDef(class_def_index));
+    Handle<mirror::Class> klass(hs.NewHandle(class_linker->FindClass(self, descriptor, loader)));
+    if (klass == nullptr) {
+      // The application gets the error if it ever uses the class.
+      self->ClearException();
+      continue;
+    }
+    // The class may be defined by another dex file of the class loader, or verified already.
+    if (&klass->GetDexFile() != &dex_file || klass->IsVerified() || klass->IsErroneous()) {
+      continue;
+    }
+    class_linker->VerifyClass(self, klass);
+    // As for FindClass, the class is erroneous and the application gets the error on first use.
+    self->ClearException();
+    ++verified_count;
+  }
+  VLOG(verifier) << "Verified " << verified_count << " of " << class_def_indexes.size()
+                 << " classes in the background";
+  Runtime::Current()->GetJavaVM()->DeleteWeakGlobalRef(self, class_loader);
+}
+
+}  // namespace verifier
+}  // namespace art
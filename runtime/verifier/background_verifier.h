@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_VERIFIER_BACKGROUND_VERIFIER_H_
+#define ART_RUNTIME_VERIFIER_BACKGROUND_VERIFIER_H_
+
+#include <memory>
+#include <vector>
+
+#include "base/atomic.h"
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "jni.h"
+#include "obj_ptr.h"
+
+namespace art {
+
+class DexFile;
+class Thread;
+class ThreadPool;
+
+namespace mirror {
+class ClassLoader;
+}  // namespace mirror
+
+namespace verifier {
+
+// Default nice value of the background verification threads, below the JIT threads.
+static constexpr int kBackgroundVerifierPthreadPriority = 10;
+
+// Verifies ahead of their first use, on a pool of low priority threads, the classes that the
+// runtime would otherwise verify on the thread that first uses them: the classes that failed
+// verification softly when compiling the oat file, or all the classes of a dex file without oat
+// file. The results are published through the status of the classes like any other verification,
+// so a thread using a class verified in the background finds it verified, and a thread using a
+// class being verified waits for it instead of verifying it again.
+//
+// Classes are loaded on the pool threads, which cannot call into Java, so the classes of class
+// loaders that are not understood natively are left to be verified on demand. The classes are
+// not initialized.
+class BackgroundVerifier {
+ public:
+  explicit BackgroundVerifier(size_t thread_count);
+  ~BackgroundVerifier();
+
+  // Queue the classes of `dex_file` which still need to be verified, to be loaded with
+  // `class_loader`. The class loader is held weakly and the classes are skipped if it is unloaded.
+  void AddDexFile(Thread* self, const DexFile& dex_file, ObjPtr<mirror::ClassLoader> class_loader)
+      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!lock_);
+
+  // Wait for the classes queued so far to be verified. Must not be called concurrently with
+  // Shutdown.
+  void Wait(Thread* self) REQUIRES(!Locks::mutator_lock_, !lock_);
+
+  // Abandon the classes that are not verified yet and delete the threads. Classes added afterwards
+  // are ignored.
+  void Shutdown(Thread* self) REQUIRES(!Locks::mutator_lock_, !lock_);
+
+  // Whether `self` is one of the background verification threads. Does not take any lock, as
+  // it is called for every class verified.
+  static bool IsWorkerThread(Thread* self);
+
+ private:
+  void VerifyClasses(Thread* self,
+                     const DexFile& dex_file,
+                     jweak class_loader,
+                     const std::vector<uint16_t>& class_def_indexes)
+      REQUIRES(!Locks::mutator_lock_);
+
+  // Guards thread_pool_ against Shutdown.
+  Mutex lock_;
+  std::unique_ptr<ThreadPool> thread_pool_ GUARDED_BY(lock_);
+  Atomic<bool> shutting_down_;
+
+  DISALLOW_COPY_AND_ASSIGN(BackgroundVerifier);
+};
+
+}  // namespace verifier
+}  // namespace art
+
+#endif  // ART_RUNTIME_VERIFIER_BACKGROUND_VERIFIER_H_
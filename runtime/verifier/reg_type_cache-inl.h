@@ -179,11 +179,7 @@ template <class RegTypeType>
 inline RegTypeType& RegTypeCache::AddEntry(RegTypeType* new_entry) {
   DCHECK(new_entry != nullptr);
   entries_.push_back(new_entry);
-  if (new_entry->HasClass()) {
-    mirror::Class* klass = new_entry->GetClass();
-    DCHECK(!klass->IsPrimitive());
-    klass_entries_.push_back(std::make_pair(GcRoot<mirror::Class>(klass), new_entry));
-  }
+  AddToIndexes(new_entry);
   return *new_entry;
 }
 
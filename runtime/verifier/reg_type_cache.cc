@@ -39,6 +39,113 @@ uint16_t RegTypeCache::primitive_count_ = 0;
 const PreciseConstType* RegTypeCache::small_precise_constants_[kMaxSmallConstant -
                                                                kMinSmallConstant + 1];
 
+// Hashes of the entry indexes.
+static size_t HashDescriptor(const StringPiece& descriptor) {
+  size_t hash = 0u;
+  for (size_t i = 0; i != descriptor.length(); ++i) {
+    hash = hash * 31u + static_cast<uint8_t>(descriptor[i]);
+  }
+  return hash;
+}
+
+static size_t HashClass(mirror::Class* klass) {
+  return reinterpret_cast<uintptr_t>(klass) / kObjectAlignment;
+}
+
+static size_t HashConstant(int32_t value) {
+  return static_cast<uint32_t>(value);
+}
+
+static size_t HashUnresolvedMerge(const RegType& resolved_part, const BitVector& unresolved_types) {
+  size_t hash = resolved_part.GetId();
+  for (uint32_t idx : unresolved_types.Indexes()) {
+    hash = hash * 31u + idx;
+  }
+  return hash;
+}
+
+static size_t HashUnresolvedSuperClass(uint16_t child_id) {
+  return child_id;
+}
+
+RegTypeCache::EntryIndex::EntryIndex(ScopedArenaAllocator& allocator)
+    : chains_(allocator.Adapter(kArenaAllocVerifier)),
+      next_(allocator.Adapter(kArenaAllocVerifier)) {}
+
+void RegTypeCache::EntryIndex::Add(size_t hash, uint16_t id) {
+  DCHECK_NE(id, kNoEntry);
+  if (next_.size() <= id) {
+    next_.resize(id + 1u, kNoEntry);
+  }
+  auto it = chains_.find(hash);
+  if (it == chains_.end()) {
+    chains_.emplace(hash, std::make_pair(id, id));
+  } else {
+    DCHECK_LT(it->second.second, id);
+    next_[it->second.second] = id;
+    it->second.second = id;
+  }
+}
+
+void RegTypeCache::EntryIndex::Clear() {
+  chains_.clear();
+  next_.clear();
+}
+
+template <typename Matches>
+const RegType* RegTypeCache::FindEntry(const EntryIndex& index,
+                                       size_t hash,
+                                       const Matches& matches) const {
+  for (uint16_t id = index.First(hash); id != EntryIndex::kNoEntry; id = index.Next(id)) {
+    const RegType* entry = entries_[id];
+    if (matches(entry)) {
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+const RegTypeCache::EntryIndex& RegTypeCache::GetClassIndex() const {
+  if (UNLIKELY(class_index_stale_)) {
+    // Classes were moved since the index was built, rehash them.
+    class_index_.Clear();
+    for (size_t i = primitive_count_; i < entries_.size(); ++i) {
+      if (entries_[i]->HasClass()) {
+        class_index_.Add(HashClass(entries_[i]->GetClass()), i);
+      }
+    }
+    class_index_stale_ = false;
+  }
+  return class_index_;
+}
+
+void RegTypeCache::AddToIndexes(const RegType* entry) {
+  const uint16_t id = entry->GetId();
+  DCHECK_EQ(entries_[id], entry);
+  descriptor_index_.Add(HashDescriptor(entry->descriptor_), id);
+  if (entry->HasClass()) {
+    mirror::Class* klass = entry->GetClass();
+    DCHECK(!klass->IsPrimitive());
+    if (UNLIKELY(class_index_stale_)) {
+      // Rebuilding the index also adds the new entry.
+      GetClassIndex();
+    } else {
+      class_index_.Add(HashClass(klass), id);
+    }
+  }
+  if (entry->IsConstantTypes()) {
+    const ConstantType* constant = down_cast<const ConstantType*>(entry);
+    constant_index_.Add(HashConstant(constant->ConstantValue()), id);
+  } else if (entry->IsUnresolvedMergedReference()) {
+    const UnresolvedMergedType* merged = down_cast<const UnresolvedMergedType*>(entry);
+    unresolved_index_.Add(
+        HashUnresolvedMerge(merged->GetResolvedPart(), merged->GetUnresolvedTypes()), id);
+  } else if (entry->IsUnresolvedSuperClass()) {
+    const UnresolvedSuperClass* super = down_cast<const UnresolvedSuperClass*>(entry);
+    unresolved_index_.Add(HashUnresolvedSuperClass(super->GetUnresolvedSuperClassChildId()), id);
+  }
+}
+
 ALWAYS_INLINE static inline bool MatchingPrecisionForClass(const RegType* entry, bool precise)
     REQUIRES_SHARED(Locks::mutator_lock_) {
   if (entry->IsPreciseReference() == precise) {
@@ -135,8 +242,9 @@ const RegType& RegTypeCache::RegTypeFromPrimitiveType(Primitive::Type prim_type)
   }
 }
 
-bool RegTypeCache::MatchDescriptor(size_t idx, const StringPiece& descriptor, bool precise) {
-  const RegType* entry = entries_[idx];
+bool RegTypeCache::MatchDescriptor(const RegType* entry,
+                                   const StringPiece& descriptor,
+                                   bool precise) {
   if (descriptor != entry->descriptor_) {
     return false;
   }
@@ -181,10 +289,14 @@ const RegType& RegTypeCache::From(mirror::ClassLoader* loader,
   StringPiece sp_descriptor(descriptor);
   // Try looking up the class in the cache first. We use a StringPiece to avoid continual strlen
   // operations on the descriptor.
-  for (size_t i = primitive_count_; i < entries_.size(); i++) {
-    if (MatchDescriptor(i, sp_descriptor, precise)) {
-      return *(entries_[i]);
-    }
+  const RegType* cached = FindEntry(
+      descriptor_index_,
+      HashDescriptor(sp_descriptor),
+      [&](const RegType* entry) REQUIRES_SHARED(Locks::mutator_lock_) {
+        return MatchDescriptor(entry, sp_descriptor, precise);
+      });
+  if (cached != nullptr) {
+    return *cached;
   }
   // Class not found in the cache, will create a new type for that.
   // Try resolving class.
@@ -241,16 +353,12 @@ const RegType* RegTypeCache::FindClass(mirror::Class* klass, bool precise) const
     // primitive classes are final.
     return &RegTypeFromPrimitiveType(klass->GetPrimitiveType());
   }
-  for (auto& pair : klass_entries_) {
-    mirror::Class* const reg_klass = pair.first.Read();
-    if (reg_klass == klass) {
-      const RegType* reg_type = pair.second;
-      if (MatchingPrecisionForClass(reg_type, precise)) {
-        return reg_type;
-      }
-    }
-  }
-  return nullptr;
+  return FindEntry(GetClassIndex(),
+                   HashClass(klass),
+                   [&](const RegType* entry) REQUIRES_SHARED(Locks::mutator_lock_) {
+                     return entry->GetClass() == klass &&
+                            MatchingPrecisionForClass(entry, precise);
+                   });
 }
 
 const RegType* RegTypeCache::InsertClass(const StringPiece& descriptor,
@@ -276,16 +384,18 @@ const RegType& RegTypeCache::FromClass(const char* descriptor, mirror::Class* kl
 
 RegTypeCache::RegTypeCache(bool can_load_classes, ScopedArenaAllocator& allocator, bool can_suspend)
     : entries_(allocator.Adapter(kArenaAllocVerifier)),
-      klass_entries_(allocator.Adapter(kArenaAllocVerifier)),
+      descriptor_index_(allocator),
+      class_index_(allocator),
+      class_index_stale_(false),
+      constant_index_(allocator),
+      unresolved_index_(allocator),
       can_load_classes_(can_load_classes),
       allocator_(allocator) {
   DCHECK(can_suspend || !can_load_classes) << "Cannot load classes if suspension is disabled!";
   if (kIsDebugBuild && can_suspend) {
     Thread::Current()->AssertThreadSuspensionIsAllowable(gAborting == 0);
   }
-  // The klass_entries_ array does not have primitives or small constants.
   static constexpr size_t kNumReserveEntries = 32;
-  klass_entries_.reserve(kNumReserveEntries);
   // We want to have room for additional entries after inserting primitives and small
   // constants.
   entries_.reserve(kNumReserveEntries + kNumPrimitivesAndSmallConstants);
@@ -447,18 +557,22 @@ const RegType& RegTypeCache::FromUnresolvedMerge(const RegType& left,
   }
 
   // Check if entry already exists.
-  for (size_t i = primitive_count_; i < entries_.size(); i++) {
-    const RegType* cur_entry = entries_[i];
-    if (cur_entry->IsUnresolvedMergedReference()) {
-      const UnresolvedMergedType* cmp_type = down_cast<const UnresolvedMergedType*>(cur_entry);
-      const RegType& resolved_part = cmp_type->GetResolvedPart();
-      const BitVector& unresolved_part = cmp_type->GetUnresolvedTypes();
-      // Use SameBitsSet. "types" is expandable to allow merging in the components, but the
-      // BitVector in the final RegType will be made non-expandable.
-      if (&resolved_part == &resolved_parts_merged && types.SameBitsSet(&unresolved_part)) {
-        return *cur_entry;
-      }
-    }
+  const RegType* cached = FindEntry(
+      unresolved_index_,
+      HashUnresolvedMerge(resolved_parts_merged, types),
+      [&](const RegType* cur_entry) {
+        if (!cur_entry->IsUnresolvedMergedReference()) {
+          return false;
+        }
+        const UnresolvedMergedType* cmp_type = down_cast<const UnresolvedMergedType*>(cur_entry);
+        const RegType& resolved_part = cmp_type->GetResolvedPart();
+        const BitVector& unresolved_part = cmp_type->GetUnresolvedTypes();
+        // Use SameBitsSet. "types" is expandable to allow merging in the components, but the
+        // BitVector in the final RegType will be made non-expandable.
+        return &resolved_part == &resolved_parts_merged && types.SameBitsSet(&unresolved_part);
+      });
+  if (cached != nullptr) {
+    return *cached;
   }
   return AddEntry(new (&allocator_) UnresolvedMergedType(resolved_parts_merged,
                                                          types,
@@ -468,17 +582,19 @@ const RegType& RegTypeCache::FromUnresolvedMerge(const RegType& left,
 
 const RegType& RegTypeCache::FromUnresolvedSuperClass(const RegType& child) {
   // Check if entry already exists.
-  for (size_t i = primitive_count_; i < entries_.size(); i++) {
-    const RegType* cur_entry = entries_[i];
-    if (cur_entry->IsUnresolvedSuperClass()) {
-      const UnresolvedSuperClass* tmp_entry =
-          down_cast<const UnresolvedSuperClass*>(cur_entry);
-      uint16_t unresolved_super_child_id =
-          tmp_entry->GetUnresolvedSuperClassChildId();
-      if (unresolved_super_child_id == child.GetId()) {
-        return *cur_entry;
-      }
-    }
+  const RegType* cached = FindEntry(
+      unresolved_index_,
+      HashUnresolvedSuperClass(child.GetId()),
+      [&](const RegType* cur_entry) {
+        if (!cur_entry->IsUnresolvedSuperClass()) {
+          return false;
+        }
+        const UnresolvedSuperClass* tmp_entry =
+            down_cast<const UnresolvedSuperClass*>(cur_entry);
+        return tmp_entry->GetUnresolvedSuperClassChildId() == child.GetId();
+      });
+  if (cached != nullptr) {
+    return *cached;
   }
   return AddEntry(new (&allocator_) UnresolvedSuperClass(child.GetId(), this, entries_.size()));
 }
@@ -487,28 +603,34 @@ const UninitializedType& RegTypeCache::Uninitialized(const RegType& type, uint32
   UninitializedType* entry = nullptr;
   const StringPiece& descriptor(type.GetDescriptor());
   if (type.IsUnresolvedTypes()) {
-    for (size_t i = primitive_count_; i < entries_.size(); i++) {
-      const RegType* cur_entry = entries_[i];
-      if (cur_entry->IsUnresolvedAndUninitializedReference() &&
-          down_cast<const UnresolvedUninitializedRefType*>(cur_entry)->GetAllocationPc()
-              == allocation_pc &&
-          (cur_entry->GetDescriptor() == descriptor)) {
-        return *down_cast<const UnresolvedUninitializedRefType*>(cur_entry);
-      }
+    const RegType* cached = FindEntry(
+        descriptor_index_,
+        HashDescriptor(descriptor),
+        [&](const RegType* cur_entry) {
+          return cur_entry->IsUnresolvedAndUninitializedReference() &&
+                 down_cast<const UnresolvedUninitializedRefType*>(cur_entry)->GetAllocationPc()
+                     == allocation_pc &&
+                 (cur_entry->GetDescriptor() == descriptor);
+        });
+    if (cached != nullptr) {
+      return *down_cast<const UnresolvedUninitializedRefType*>(cached);
     }
     entry = new (&allocator_) UnresolvedUninitializedRefType(descriptor,
                                                              allocation_pc,
                                                              entries_.size());
   } else {
     mirror::Class* klass = type.GetClass();
-    for (size_t i = primitive_count_; i < entries_.size(); i++) {
-      const RegType* cur_entry = entries_[i];
-      if (cur_entry->IsUninitializedReference() &&
-          down_cast<const UninitializedReferenceType*>(cur_entry)
-              ->GetAllocationPc() == allocation_pc &&
-          cur_entry->GetClass() == klass) {
-        return *down_cast<const UninitializedReferenceType*>(cur_entry);
-      }
+    const RegType* cached = FindEntry(
+        GetClassIndex(),
+        HashClass(klass),
+        [&](const RegType* cur_entry) REQUIRES_SHARED(Locks::mutator_lock_) {
+          return cur_entry->IsUninitializedReference() &&
+                 down_cast<const UninitializedReferenceType*>(cur_entry)
+                     ->GetAllocationPc() == allocation_pc &&
+                 cur_entry->GetClass() == klass;
+        });
+    if (cached != nullptr) {
+      return *down_cast<const UninitializedReferenceType*>(cached);
     }
     entry = new (&allocator_) UninitializedReferenceType(klass,
                                                          descriptor,
@@ -523,23 +645,28 @@ const RegType& RegTypeCache::FromUninitialized(const RegType& uninit_type) {
 
   if (uninit_type.IsUnresolvedTypes()) {
     const StringPiece& descriptor(uninit_type.GetDescriptor());
-    for (size_t i = primitive_count_; i < entries_.size(); i++) {
-      const RegType* cur_entry = entries_[i];
-      if (cur_entry->IsUnresolvedReference() &&
-          cur_entry->GetDescriptor() == descriptor) {
-        return *cur_entry;
-      }
+    const RegType* cached = FindEntry(
+        descriptor_index_,
+        HashDescriptor(descriptor),
+        [&](const RegType* cur_entry) {
+          return cur_entry->IsUnresolvedReference() && cur_entry->GetDescriptor() == descriptor;
+        });
+    if (cached != nullptr) {
+      return *cached;
     }
     entry = new (&allocator_) UnresolvedReferenceType(descriptor, entries_.size());
   } else {
     mirror::Class* klass = uninit_type.GetClass();
     if (uninit_type.IsUninitializedThisReference() && !klass->IsFinal()) {
       // For uninitialized "this reference" look for reference types that are not precise.
-      for (size_t i = primitive_count_; i < entries_.size(); i++) {
-        const RegType* cur_entry = entries_[i];
-        if (cur_entry->IsReference() && cur_entry->GetClass() == klass) {
-          return *cur_entry;
-        }
+      const RegType* cached = FindEntry(
+          GetClassIndex(),
+          HashClass(klass),
+          [&](const RegType* cur_entry) REQUIRES_SHARED(Locks::mutator_lock_) {
+            return cur_entry->IsReference() && cur_entry->GetClass() == klass;
+          });
+      if (cached != nullptr) {
+        return *cached;
       }
       entry = new (&allocator_) ReferenceType(klass, "", entries_.size());
     } else if (!klass->IsPrimitive()) {
@@ -554,11 +681,14 @@ const RegType& RegTypeCache::FromUninitialized(const RegType& uninit_type) {
       //       2) Checking whether the klass is instantiable and using conflict may produce a hard
       //          error when the value is used, which leads to a VerifyError, which is not the
       //          correct semantics.
-      for (size_t i = primitive_count_; i < entries_.size(); i++) {
-        const RegType* cur_entry = entries_[i];
-        if (cur_entry->IsPreciseReference() && cur_entry->GetClass() == klass) {
-          return *cur_entry;
-        }
+      const RegType* cached = FindEntry(
+          GetClassIndex(),
+          HashClass(klass),
+          [&](const RegType* cur_entry) REQUIRES_SHARED(Locks::mutator_lock_) {
+            return cur_entry->IsPreciseReference() && cur_entry->GetClass() == klass;
+          });
+      if (cached != nullptr) {
+        return *cached;
       }
       entry = new (&allocator_) PreciseReferenceType(klass,
                                                      uninit_type.GetDescriptor(),
@@ -574,21 +704,27 @@ const UninitializedType& RegTypeCache::UninitializedThisArgument(const RegType&
   UninitializedType* entry;
   const StringPiece& descriptor(type.GetDescriptor());
   if (type.IsUnresolvedTypes()) {
-    for (size_t i = primitive_count_; i < entries_.size(); i++) {
-      const RegType* cur_entry = entries_[i];
-      if (cur_entry->IsUnresolvedAndUninitializedThisReference() &&
-          cur_entry->GetDescriptor() == descriptor) {
-        return *down_cast<const UninitializedType*>(cur_entry);
-      }
+    const RegType* cached = FindEntry(
+        descriptor_index_,
+        HashDescriptor(descriptor),
+        [&](const RegType* cur_entry) {
+          return cur_entry->IsUnresolvedAndUninitializedThisReference() &&
+                 cur_entry->GetDescriptor() == descriptor;
+        });
+    if (cached != nullptr) {
+      return *down_cast<const UninitializedType*>(cached);
     }
     entry = new (&allocator_) UnresolvedUninitializedThisRefType(descriptor, entries_.size());
   } else {
     mirror::Class* klass = type.GetClass();
-    for (size_t i = primitive_count_; i < entries_.size(); i++) {
-      const RegType* cur_entry = entries_[i];
-      if (cur_entry->IsUninitializedThisReference() && cur_entry->GetClass() == klass) {
-        return *down_cast<const UninitializedType*>(cur_entry);
-      }
+    const RegType* cached = FindEntry(
+        GetClassIndex(),
+        HashClass(klass),
+        [&](const RegType* cur_entry) REQUIRES_SHARED(Locks::mutator_lock_) {
+          return cur_entry->IsUninitializedThisReference() && cur_entry->GetClass() == klass;
+        });
+    if (cached != nullptr) {
+      return *down_cast<const UninitializedType*>(cached);
     }
     entry = new (&allocator_) UninitializedThisReferenceType(klass, descriptor, entries_.size());
   }
@@ -596,13 +732,16 @@ const UninitializedType& RegTypeCache::UninitializedThisArgument(const RegType&
 }
 
 const ConstantType& RegTypeCache::FromCat1NonSmallConstant(int32_t value, bool precise) {
-  for (size_t i = primitive_count_; i < entries_.size(); i++) {
-    const RegType* cur_entry = entries_[i];
-    if (cur_entry->klass_.IsNull() && cur_entry->IsConstant() &&
-        cur_entry->IsPreciseConstant() == precise &&
-        (down_cast<const ConstantType*>(cur_entry))->ConstantValue() == value) {
-      return *down_cast<const ConstantType*>(cur_entry);
-    }
+  const RegType* cached = FindEntry(
+      constant_index_,
+      HashConstant(value),
+      [&](const RegType* cur_entry) {
+        return cur_entry->klass_.IsNull() && cur_entry->IsConstant() &&
+               cur_entry->IsPreciseConstant() == precise &&
+               (down_cast<const ConstantType*>(cur_entry))->ConstantValue() == value;
+      });
+  if (cached != nullptr) {
+    return *down_cast<const ConstantType*>(cached);
   }
   ConstantType* entry;
   if (precise) {
@@ -614,12 +753,15 @@ const ConstantType& RegTypeCache::FromCat1NonSmallConstant(int32_t value, bool p
 }
 
 const ConstantType& RegTypeCache::FromCat2ConstLo(int32_t value, bool precise) {
-  for (size_t i = primitive_count_; i < entries_.size(); i++) {
-    const RegType* cur_entry = entries_[i];
-    if (cur_entry->IsConstantLo() && (cur_entry->IsPrecise() == precise) &&
-        (down_cast<const ConstantType*>(cur_entry))->ConstantValueLo() == value) {
-      return *down_cast<const ConstantType*>(cur_entry);
-    }
+  const RegType* cached = FindEntry(
+      constant_index_,
+      HashConstant(value),
+      [&](const RegType* cur_entry) {
+        return cur_entry->IsConstantLo() && (cur_entry->IsPrecise() == precise) &&
+               (down_cast<const ConstantType*>(cur_entry))->ConstantValueLo() == value;
+      });
+  if (cached != nullptr) {
+    return *down_cast<const ConstantType*>(cached);
   }
   ConstantType* entry;
   if (precise) {
@@ -631,12 +773,15 @@ const ConstantType& RegTypeCache::FromCat2ConstLo(int32_t value, bool precise) {
 }
 
 const ConstantType& RegTypeCache::FromCat2ConstHi(int32_t value, bool precise) {
-  for (size_t i = primitive_count_; i < entries_.size(); i++) {
-    const RegType* cur_entry = entries_[i];
-    if (cur_entry->IsConstantHi() && (cur_entry->IsPrecise() == precise) &&
-        (down_cast<const ConstantType*>(cur_entry))->ConstantValueHi() == value) {
-      return *down_cast<const ConstantType*>(cur_entry);
-    }
+  const RegType* cached = FindEntry(
+      constant_index_,
+      HashConstant(value),
+      [&](const RegType* cur_entry) {
+        return cur_entry->IsConstantHi() && (cur_entry->IsPrecise() == precise) &&
+               (down_cast<const ConstantType*>(cur_entry))->ConstantValueHi() == value;
+      });
+  if (cached != nullptr) {
+    return *down_cast<const ConstantType*>(cached);
   }
   ConstantType* entry;
   if (precise) {
@@ -704,11 +849,13 @@ void RegTypeCache::VisitStaticRoots(RootVisitor* visitor) {
 void RegTypeCache::VisitRoots(RootVisitor* visitor, const RootInfo& root_info) {
   // Exclude the static roots that are visited by VisitStaticRoots().
   for (size_t i = primitive_count_; i < entries_.size(); ++i) {
-    entries_[i]->VisitRoots(visitor, root_info);
-  }
-  for (auto& pair : klass_entries_) {
-    GcRoot<mirror::Class>& root = pair.first;
-    root.VisitRoot(visitor, root_info);
+    const RegType* entry = entries_[i];
+    mirror::Class* klass = entry->klass_.Read<kWithoutReadBarrier>();
+    entry->VisitRoots(visitor, root_info);
+    if (entry->klass_.Read<kWithoutReadBarrier>() != klass) {
+      // The class was moved, rehash the classes before the next lookup.
+      class_index_stale_ = true;
+    }
   }
 }
 
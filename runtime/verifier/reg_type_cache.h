@@ -18,6 +18,8 @@
 #define ART_RUNTIME_VERIFIER_REG_TYPE_CACHE_H_
 
 #include <stdint.h>
+#include <limits>
+#include <utility>
 #include <vector>
 
 #include "base/casts.h"
@@ -60,6 +62,10 @@ class UninitializedType;
 // Use 8 bytes since that is the default arena allocator alignment.
 static constexpr size_t kDefaultArenaBitVectorBytes = 8;
 
+// Cache of the RegTypes used when verifying a method. Lookups go through hash indexes of the
+// entries (by descriptor, by class, by constant value and by the components of unresolved merged
+// and unresolved super class types) rather than scans of all the entries, which would make the
+// verification of methods using many types quadratic.
 class RegTypeCache {
  public:
   RegTypeCache(bool can_load_classes, ScopedArenaAllocator& allocator, bool can_suspend = true);
@@ -157,10 +163,55 @@ class RegTypeCache {
       REQUIRES_SHARED(Locks::mutator_lock_);
 
  private:
+  // Index of entry ids by a hash of some of their properties. Different properties may have the
+  // same hash, so the candidates must be compared in full. The ids with the same hash are chained
+  // in the order they were added, so that walking a chain visits the candidates in the same order
+  // as a scan of entries_ and finds the same first match.
+  class EntryIndex {
+   public:
+    static constexpr uint16_t kNoEntry = std::numeric_limits<uint16_t>::max();
+
+    explicit EntryIndex(ScopedArenaAllocator& allocator);
+
+    void Add(size_t hash, uint16_t id);
+    void Clear();
+
+    // Return the first id added with the given hash, or kNoEntry.
+    uint16_t First(size_t hash) const {
+      auto it = chains_.find(hash);
+      return (it != chains_.end()) ? it->second.first : kNoEntry;
+    }
+
+    // Return the id added after `id` with the same hash, or kNoEntry.
+    uint16_t Next(uint16_t id) const {
+      return next_[id];
+    }
+
+   private:
+    // First and last id of the chain of each hash.
+    ScopedArenaUnorderedMap<size_t, std::pair<uint16_t, uint16_t>> chains_;
+    // Next id of the chain, indexed by id.
+    ScopedArenaVector<uint16_t> next_;
+
+    DISALLOW_COPY_AND_ASSIGN(EntryIndex);
+  };
+
+  // Return the first entry of `index` with the given hash for which `matches` returns true, or
+  // null.
+  template <typename Matches>
+  const RegType* FindEntry(const EntryIndex& index, size_t hash, const Matches& matches) const
+      REQUIRES_SHARED(Locks::mutator_lock_);
+
+  // Return the index of the entries by class, rebuilding it first if classes were moved.
+  const EntryIndex& GetClassIndex() const REQUIRES_SHARED(Locks::mutator_lock_);
+
+  // Add a new entry to the indexes.
+  void AddToIndexes(const RegType* entry) REQUIRES_SHARED(Locks::mutator_lock_);
+
   void FillPrimitiveAndSmallConstantTypes() REQUIRES_SHARED(Locks::mutator_lock_);
   mirror::Class* ResolveClass(const char* descriptor, mirror::ClassLoader* loader)
       REQUIRES_SHARED(Locks::mutator_lock_);
-  bool MatchDescriptor(size_t idx, const StringPiece& descriptor, bool precise)
+  bool MatchDescriptor(const RegType* entry, const StringPiece& descriptor, bool precise)
       REQUIRES_SHARED(Locks::mutator_lock_);
   const ConstantType& FromCat1NonSmallConstant(int32_t value, bool precise)
       REQUIRES_SHARED(Locks::mutator_lock_);
@@ -193,8 +244,13 @@ class RegTypeCache {
   // The actual storage for the RegTypes.
   ScopedArenaVector<const RegType*> entries_;
 
-  // Fast lookup for quickly finding entries that have a matching class.
-  ScopedArenaVector<std::pair<GcRoot<mirror::Class>, const RegType*>> klass_entries_;
+  // Indexes of entries_, excluding the primitives and small constants.
+  EntryIndex descriptor_index_;
+  // Keyed by class address, so it is rebuilt by GetClassIndex when the GC moves a class.
+  mutable EntryIndex class_index_;
+  mutable bool class_index_stale_;
+  EntryIndex constant_index_;
+  EntryIndex unresolved_index_;
 
   // Whether or not we're allowed to load classes.
   const bool can_load_classes_;
@@ -16,11 +16,14 @@
 
 #include "reg_type.h"
 
+#include <iostream>
 #include <set>
 
 #include "base/bit_vector.h"
 #include "base/casts.h"
+#include "base/histogram-inl.h"
 #include "base/scoped_arena_allocator.h"
+#include "base/time_utils.h"
 #include "common_runtime_test.h"
 #include "compiler_callbacks.h"
 #include "reg_type-inl.h"
@@ -1040,6 +1043,74 @@ TEST_F(RegTypeTest, ConstPrecision) {
   EXPECT_FALSE(imprecise_const.Equals(precise_const));
 }
 
+TEST_F(RegTypeReferenceTest, ManyTypes) {
+  // Tests that the cache finds the existing types when it holds many of them.
+  ArenaStack stack(Runtime::Current()->GetArenaPool());
+  ScopedArenaAllocator allocator(&stack);
+  ScopedObjectAccess soa(Thread::Current());
+  RegTypeCache cache(false, allocator);
+  static constexpr size_t kNumTypes = 1000;
+  std::vector<std::string> descriptors;
+  std::vector<const RegType*> unresolved_types;
+  std::vector<const RegType*> constants;
+  for (size_t i = 0; i != kNumTypes; ++i) {
+    descriptors.push_back("LDoesNotExist" + std::to_string(i) + ";");
+    unresolved_types.push_back(&cache.FromDescriptor(nullptr, descriptors[i].c_str(), true));
+    EXPECT_TRUE(unresolved_types[i]->IsUnresolvedReference());
+    constants.push_back(&cache.FromCat1Const(1000 + i, true));
+  }
+  for (size_t i = 0; i != kNumTypes; ++i) {
+    EXPECT_EQ(unresolved_types[i], &cache.FromDescriptor(nullptr, descriptors[i].c_str(), true));
+    EXPECT_EQ(constants[i], &cache.FromCat1Const(1000 + i, true));
+    const RegType& imprecise = cache.FromCat1Const(1000 + i, false);
+    EXPECT_TRUE(imprecise.IsImpreciseConstant());
+    EXPECT_EQ(&imprecise, &cache.FromCat1Const(1000 + i, false));
+  }
+  for (size_t i = 0; i + 1 < kNumTypes; ++i) {
+    const RegType& lhs = *unresolved_types[i];
+    const RegType& rhs = *unresolved_types[i + 1];
+    const RegType& merged = lhs.Merge(rhs, &cache, /* verifier */ nullptr);
+    EXPECT_TRUE(merged.IsUnresolvedMergedReference());
+    EXPECT_EQ(&merged, &lhs.Merge(rhs, &cache, /* verifier */ nullptr));
+    const RegType& super_class = cache.FromUnresolvedSuperClass(*unresolved_types[i]);
+    EXPECT_TRUE(super_class.IsUnresolvedSuperClass());
+    EXPECT_EQ(&super_class, &cache.FromUnresolvedSuperClass(*unresolved_types[i]));
+  }
+  EXPECT_EQ(&cache.JavaLangObject(true), &cache.From(nullptr, "Ljava/lang/Object;", true));
+}
+
+// A benchmark, which prints the times to stdout. Run with --gtest_also_run_disabled_tests.
+TEST_F(RegTypeReferenceTest, DISABLED_RegTypeCacheSpeed) {
+  // Simulates the verification of large generated methods, which use many different types and
+  // constants.
+  ArenaStack stack(Runtime::Current()->GetArenaPool());
+  ScopedObjectAccess soa(Thread::Current());
+  for (size_t num_types : {100u, 1000u, 10000u}) {
+    std::vector<std::string> descriptors;
+    for (size_t i = 0; i != num_types; ++i) {
+      descriptors.push_back("LDoesNotExist" + std::to_string(i) + ";");
+    }
+    std::unique_ptr<Histogram<uint64_t>> hist(new Histogram<uint64_t>(
+        ("RegTypeCacheSpeedTest" + std::to_string(num_types)).c_str(), 5));
+    for (size_t iteration = 0; iteration != 4u; ++iteration) {
+      ScopedArenaAllocator allocator(&stack);
+      RegTypeCache cache(false, allocator);
+      uint64_t start_time = NanoTime();
+      // Each type is used several times, as if by multiple instructions.
+      for (size_t use = 0; use != 3u; ++use) {
+        for (size_t i = 0; i != num_types; ++i) {
+          cache.FromDescriptor(nullptr, descriptors[i].c_str(), true);
+          cache.FromCat1Const(1000 + i, true);
+        }
+      }
+      hist->AddValue(NanoTime() - start_time);
+    }
+    Histogram<uint64_t>::CumulativeData data;
+    hist->CreateHistogram(&data);
+    hist->PrintConfidenceIntervals(std::cout, 0.99, data);
+  }
+}
+
 class RegTypeOOMTest : public RegTypeTest {
  protected:
   void SetUpRuntimeOptions(RuntimeOptions *options) OVERRIDE {
@@ -20,15 +20,21 @@
 
 #include "art_field-inl.h"
 #include "art_method-inl.h"
+#include "base/atomic.h"
 #include "base/indenter.h"
 #include "base/leb128.h"
 #include "base/stl_util.h"
+#include "base/systrace.h"
 #include "compiler_callbacks.h"
 #include "dex/dex_file-inl.h"
+#include "handle_scope-inl.h"
+#include "jni/java_vm_ext.h"
 #include "mirror/class-inl.h"
 #include "mirror/class_loader.h"
 #include "obj_ptr-inl.h"
 #include "runtime.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread_pool.h"
 
 namespace art {
 namespace verifier {
@@ -54,15 +60,30 @@ void VerifierDeps::MergeWith(const VerifierDeps& other,
     // We currently collect extra strings only on the main `VerifierDeps`,
     // which should be the one passed as `this` in this method.
     DCHECK(other_deps.strings_.empty());
-    MergeSets(my_deps->assignable_types_, other_deps.assignable_types_);
-    MergeSets(my_deps->unassignable_types_, other_deps.unassignable_types_);
-    MergeSets(my_deps->classes_, other_deps.classes_);
-    MergeSets(my_deps->fields_, other_deps.fields_);
-    MergeSets(my_deps->methods_, other_deps.methods_);
-    MergeSets(my_deps->unverified_classes_, other_deps.unverified_classes_);
+    my_deps->assignable_types_.Merge(other_deps.assignable_types_);
+    my_deps->unassignable_types_.Merge(other_deps.unassignable_types_);
+    my_deps->classes_.Merge(other_deps.classes_);
+    my_deps->fields_.Merge(other_deps.fields_);
+    my_deps->methods_.Merge(other_deps.methods_);
+    my_deps->unverified_classes_.Merge(other_deps.unverified_classes_);
   }
 }
 
+void VerifierDeps::SortDependencies() {
+  for (auto& entry : dex_deps_) {
+    entry.second->Sort();
+  }
+}
+
+void VerifierDeps::DexFileDeps::Sort() {
+  assignable_types_.Sort();
+  unassignable_types_.Sort();
+  classes_.Sort();
+  fields_.Sort();
+  methods_.Sort();
+  unverified_classes_.Sort();
+}
+
 VerifierDeps::DexFileDeps* VerifierDeps::GetDexFileDeps(const DexFile& dex_file) {
   auto it = dex_deps_.find(&dex_file);
   return (it == dex_deps_.end()) ? nullptr : it->second.get();
@@ -623,7 +644,8 @@ static inline void DecodeTuple(const uint8_t** in, const uint8_t* end, std::tupl
 }
 
 template<typename T>
-static inline void EncodeSet(std::vector<uint8_t>* out, const std::set<T>& set) {
+static inline void EncodeSet(std::vector<uint8_t>* out, const SortedVector<T>& set) {
+  DCHECK(set.IsSorted());
   EncodeUnsignedLeb128(out, set.size());
   for (const T& entry : set) {
     EncodeTuple(out, entry);
@@ -640,9 +662,11 @@ static inline void EncodeUint16Vector(std::vector<uint8_t>* out,
 }
 
 template<typename T>
-static inline void DecodeSet(const uint8_t** in, const uint8_t* end, std::set<T>* set) {
+static inline void DecodeSet(const uint8_t** in, const uint8_t* end, SortedVector<T>* set) {
   DCHECK(set->empty());
   size_t num_entries = DecodeUint32WithOverflowCheck(in, end);
+  // The entries were encoded in increasing order, so the set stays sorted.
+  set->reserve(num_entries);
   for (size_t i = 0; i < num_entries; ++i) {
     T tuple;
     DecodeTuple(in, end, &tuple);
@@ -724,6 +748,8 @@ VerifierDeps::VerifierDeps(const std::vector<const DexFile*>& dex_files,
     DecodeSet(&data_start, data_end, &deps->fields_);
     DecodeSet(&data_start, data_end, &deps->methods_);
     DecodeSet(&data_start, data_end, &deps->unverified_classes_);
+    // Only does something for data which was not encoded by Encode.
+    deps->Sort();
   }
   CHECK_LE(data_start, data_end);
 }
@@ -856,6 +882,48 @@ bool VerifierDeps::ValidateDependencies(Handle<mirror::ClassLoader> class_loader
   return true;
 }
 
+bool VerifierDeps::ValidateDependencies(Handle<mirror::ClassLoader> class_loader,
+                                        Thread* self,
+                                        ThreadPool* thread_pool) const {
+  if (thread_pool == nullptr || thread_pool->GetThreadCount() == 0u || dex_deps_.size() < 2u) {
+    return ValidateDependencies(class_loader, self);
+  }
+  ScopedTrace trace(__PRETTY_FUNCTION__);
+  // The handle belongs to the calling thread, the tasks decode the class loader from a global
+  // reference instead.
+  JavaVMExt* vm = Runtime::Current()->GetJavaVM();
+  jobject global_class_loader = vm->AddGlobalRef(self, class_loader.Get());
+  Atomic<bool> valid(true);
+  for (const auto& entry : dex_deps_) {
+    const DexFile* dex_file = entry.first;
+    const DexFileDeps* deps = entry.second.get();
+    thread_pool->AddTask(
+        self,
+        new FunctionTask([this, global_class_loader, dex_file, deps, &valid](Thread* thread) {
+          // No need to check the remaining dex files once one of them is invalid.
+          if (!valid.load(std::memory_order_relaxed)) {
+            return;
+          }
+          ScopedObjectAccess soa(thread);
+          StackHandleScope<1> hs(thread);
+          Handle<mirror::ClassLoader> loader(
+              hs.NewHandle(soa.Decode<mirror::ClassLoader>(global_class_loader)));
+          if (!VerifyDexFile(loader, *dex_file, *deps, thread)) {
+            valid.store(false, std::memory_order_relaxed);
+          }
+        }));
+  }
+  {
+    // The calling thread takes tasks too. Do not block suspension while waiting for the workers.
+    ScopedThreadSuspension sts(self, kSuspended);
+    thread_pool->StartWorkers(self);
+    thread_pool->Wait(self, /* do_work */ true, /* may_hold_locks */ false);
+    thread_pool->StopWorkers(self);
+  }
+  vm->DeleteGlobalRef(self, global_class_loader);
+  return valid.load(std::memory_order_relaxed);
+}
+
 // TODO: share that helper with other parts of the compiler that have
 // the same lookup pattern.
 static mirror::Class* FindClassAndClearException(ClassLinker* class_linker,
@@ -873,7 +941,7 @@ static mirror::Class* FindClassAndClearException(ClassLinker* class_linker,
 
 bool VerifierDeps::VerifyAssignability(Handle<mirror::ClassLoader> class_loader,
                                        const DexFile& dex_file,
-                                       const std::set<TypeAssignability>& assignables,
+                                       const SortedVector<TypeAssignability>& assignables,
                                        bool expected_assignability,
                                        Thread* self) const {
   StackHandleScope<2> hs(self);
@@ -914,7 +982,7 @@ bool VerifierDeps::VerifyAssignability(Handle<mirror::ClassLoader> class_loader,
 
 bool VerifierDeps::VerifyClasses(Handle<mirror::ClassLoader> class_loader,
                                  const DexFile& dex_file,
-                                 const std::set<ClassResolution>& classes,
+                                 const SortedVector<ClassResolution>& classes,
                                  Thread* self) const {
   StackHandleScope<1> hs(self);
   ClassLinker* class_linker = Runtime::Current()->GetClassLinker();
@@ -957,7 +1025,7 @@ static std::string GetFieldDescription(const DexFile& dex_file, uint32_t index)
 
 bool VerifierDeps::VerifyFields(Handle<mirror::ClassLoader> class_loader,
                                 const DexFile& dex_file,
-                                const std::set<FieldResolution>& fields,
+                                const SortedVector<FieldResolution>& fields,
                                 Thread* self) const {
   // Check recorded fields are resolved the same way, have the same recorded class,
   // and have the same recorded flags.
@@ -1018,7 +1086,7 @@ static std::string GetMethodDescription(const DexFile& dex_file, uint32_t index)
 
 bool VerifierDeps::VerifyMethods(Handle<mirror::ClassLoader> class_loader,
                                  const DexFile& dex_file,
-                                 const std::set<MethodResolution>& methods,
+                                 const SortedVector<MethodResolution>& methods,
                                  Thread* self) const {
   ClassLinker* class_linker = Runtime::Current()->GetClassLinker();
   PointerSize pointer_size = class_linker->GetImagePointerSize();